@@ -0,0 +1,428 @@
+#include "AeroKernel.h"
+#include "FlowRandom.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define AERO_KERNEL_AVX2 1          // Compiled always, used when the CPU reports AVX2
+#define AERO_KERNEL_AVX2_RUNTIME 1
+#define AERO_KERNEL_SSE2 1
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define AERO_KERNEL_AVX2 1
+#define AERO_KERNEL_SSE2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AERO_KERNEL_SSE2 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define AERO_KERNEL_NEON 1
+#endif
+
+void computeAeroDisplacementScalar(const AeroKernelParams& params, AeroLanes& lanes, int count) {
+    float carSpeedFactor = params.carSpeedFactor;
+    float turbulence = 0.01f * (0.5f + carSpeedFactor * 0.5f);
+
+    for (int i = 0; i < count; i++) {
+        // Base displacement
+        float dx = lanes.directionX[i] * lanes.distance[i];
+        float dy = lanes.directionY[i] * lanes.distance[i];
+        float dz = lanes.directionZ[i] * lanes.distance[i];
+
+        // Position relative to the car
+        float rx = lanes.headX[i];
+        float ry = lanes.headY[i];
+        float rz = lanes.headZ[i] - params.carPosition;
+
+        dx *= carSpeedFactor;
+        dy *= carSpeedFactor;
+        dz *= carSpeedFactor;
+
+        // 1. Wake effect behind the car
+        if (rz > params.carLength * 0.3f) {
+            float wakeStrength = 0.05f * std::exp(-(rz - params.carLength * 0.3f) / 2.0f);
+            float speedMultiplier = 0.8f + (carSpeedFactor * 0.4f);
+            if (rx > 0) {
+                dx -= wakeStrength * speedMultiplier;
+            }
+            else {
+                dx += wakeStrength * speedMultiplier;
+            }
+
+            if (params.simulateDRS && std::abs(rx) < params.carWidth * 0.3f &&
+                rz < params.carLength * 0.6f) {
+                dy += wakeStrength * 0.3f * speedMultiplier;
+            }
+            else {
+                dy += wakeStrength * 0.5f * speedMultiplier;
+            }
+        }
+
+        // 2. Ground effect under the car
+        if (ry < params.carHeight * 0.2f &&
+            std::abs(rx) < params.carWidth * 0.4f &&
+            std::abs(rz) < params.carLength * 0.4f) {
+            float speedEffect = 1.0f + (carSpeedFactor * 0.5f);
+            dz *= 1.2f * speedEffect;
+            dy *= 0.8f;
+
+            if (lanes.floorZone[i] > 0.5f) {
+                lanes.pressure[i] = std::min(std::max(lanes.pressure[i] * 0.5f, 0.05f), 0.2f);
+            }
+        }
+
+        // 3. Turbulence, from the first three draws of the line's stream
+        float range = turbulence - (-turbulence);
+        uint32_t key = lanes.randomKey[i];
+        dx += -turbulence + range * FlowRandom::toUnit(FlowRandom::bits(key, 0));
+        dy += -turbulence + range * FlowRandom::toUnit(FlowRandom::bits(key, 1));
+        dz += -turbulence + range * FlowRandom::toUnit(FlowRandom::bits(key, 2));
+
+        lanes.displacementX[i] = dx;
+        lanes.displacementY[i] = dy;
+        lanes.displacementZ[i] = dz;
+    }
+}
+
+// Each instruction set provides the same small set of lane operations, and
+// the kernel below is written once against them.
+
+#if defined(AERO_KERNEL_AVX2)
+struct Avx2Ops {
+    static const int kWidth = 8;
+    typedef __m256 F;
+    typedef __m256i I;
+
+    static F set(float v) { return _mm256_set1_ps(v); }
+    static F load(const float* p) { return _mm256_load_ps(p); }
+    static void store(float* p, F v) { _mm256_store_ps(p, v); }
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F min(F a, F b) { return _mm256_min_ps(a, b); }
+    static F max(F a, F b) { return _mm256_max_ps(a, b); }
+    static F abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+    static F greater(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static F less(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static F both(F a, F b) { return _mm256_and_ps(a, b); }
+    static F select(F mask, F a, F b) { return _mm256_blendv_ps(b, a, mask); }
+    static F allLanes(bool on) { return _mm256_castsi256_ps(_mm256_set1_epi32(on ? -1 : 0)); }
+
+    static I loadBits(const uint32_t* p) { return _mm256_load_si256(reinterpret_cast<const __m256i*>(p)); }
+    static I addBits(I a, uint32_t b) { return _mm256_add_epi32(a, _mm256_set1_epi32(static_cast<int>(b))); }
+    static I mulBits(I a, uint32_t b) { return _mm256_mullo_epi32(a, _mm256_set1_epi32(static_cast<int>(b))); }
+    static I xorShift(I a, int shift) { return _mm256_xor_si256(a, _mm256_srli_epi32(a, shift)); }
+    static F unitFromBits(I a) { return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(a, 8)), _mm256_set1_ps(1.0f / 16777216.0f)); }
+    static I roundToInt(F a) { return _mm256_cvtps_epi32(a); }
+    static F toFloat(I a) { return _mm256_cvtepi32_ps(a); }
+    static F exponentScale(I n) { return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23)); }
+};
+#endif
+
+#if defined(AERO_KERNEL_SSE2)
+struct Sse2Ops {
+    static const int kWidth = 4;
+    typedef __m128 F;
+    typedef __m128i I;
+
+    static F set(float v) { return _mm_set1_ps(v); }
+    static F load(const float* p) { return _mm_load_ps(p); }
+    static void store(float* p, F v) { _mm_store_ps(p, v); }
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F min(F a, F b) { return _mm_min_ps(a, b); }
+    static F max(F a, F b) { return _mm_max_ps(a, b); }
+    static F abs(F a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    static F greater(F a, F b) { return _mm_cmpgt_ps(a, b); }
+    static F less(F a, F b) { return _mm_cmplt_ps(a, b); }
+    static F both(F a, F b) { return _mm_and_ps(a, b); }
+    static F select(F mask, F a, F b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    static F allLanes(bool on) { return _mm_castsi128_ps(_mm_set1_epi32(on ? -1 : 0)); }
+
+    static I loadBits(const uint32_t* p) { return _mm_load_si128(reinterpret_cast<const __m128i*>(p)); }
+    static I addBits(I a, uint32_t b) { return _mm_add_epi32(a, _mm_set1_epi32(static_cast<int>(b))); }
+    static I mulBits(I a, uint32_t b) {
+        // SSE2 has no 32-bit low multiply; combine the even and odd 32x32->64 products
+        __m128i factor = _mm_set1_epi32(static_cast<int>(b));
+        __m128i even = _mm_mul_epu32(a, factor);
+        __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), factor);
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+            _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    }
+    static I xorShift(I a, int shift) { return _mm_xor_si128(a, _mm_srli_epi32(a, shift)); }
+    static F unitFromBits(I a) { return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(a, 8)), _mm_set1_ps(1.0f / 16777216.0f)); }
+    static I roundToInt(F a) { return _mm_cvtps_epi32(a); }
+    static F toFloat(I a) { return _mm_cvtepi32_ps(a); }
+    static F exponentScale(I n) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23)); }
+};
+#endif
+
+#if defined(AERO_KERNEL_NEON)
+struct NeonOps {
+    static const int kWidth = 4;
+    typedef float32x4_t F;
+    typedef uint32x4_t I;
+
+    static F set(float v) { return vdupq_n_f32(v); }
+    static F load(const float* p) { return vld1q_f32(p); }
+    static void store(float* p, F v) { vst1q_f32(p, v); }
+    static F add(F a, F b) { return vaddq_f32(a, b); }
+    static F sub(F a, F b) { return vsubq_f32(a, b); }
+    static F mul(F a, F b) { return vmulq_f32(a, b); }
+    static F min(F a, F b) { return vminq_f32(a, b); }
+    static F max(F a, F b) { return vmaxq_f32(a, b); }
+    static F abs(F a) { return vabsq_f32(a); }
+    static F greater(F a, F b) { return vreinterpretq_f32_u32(vcgtq_f32(a, b)); }
+    static F less(F a, F b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+    static F both(F a, F b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+    static F select(F mask, F a, F b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+    static F allLanes(bool on) { return vreinterpretq_f32_u32(vdupq_n_u32(on ? 0xffffffffu : 0u)); }
+
+    static I loadBits(const uint32_t* p) { return vld1q_u32(p); }
+    static I addBits(I a, uint32_t b) { return vaddq_u32(a, vdupq_n_u32(b)); }
+    static I mulBits(I a, uint32_t b) { return vmulq_u32(a, vdupq_n_u32(b)); }
+    static I xorShift(I a, int shift) {
+        // Shift counts must be immediates
+        switch (shift) {
+        case 15: return veorq_u32(a, vshrq_n_u32(a, 15));
+        default: return veorq_u32(a, vshrq_n_u32(a, 16));
+        }
+    }
+    static F unitFromBits(I a) { return vmulq_f32(vcvtq_f32_u32(vshrq_n_u32(a, 8)), vdupq_n_f32(1.0f / 16777216.0f)); }
+    static I roundToInt(F a) {
+        // Arguments are never positive here, so truncating value - 0.5 rounds to nearest
+        return vreinterpretq_u32_s32(vcvtq_s32_f32(vsubq_f32(a, vdupq_n_f32(0.5f))));
+    }
+    static F toFloat(I a) { return vcvtq_f32_s32(vreinterpretq_s32_u32(a)); }
+    static F exponentScale(I n) { return vreinterpretq_f32_u32(vshlq_n_u32(vaddq_u32(n, vdupq_n_u32(127)), 23)); }
+};
+#endif
+
+// FlowRandom::hash() on every lane
+template <class Ops>
+static typename Ops::I hashLanes(typename Ops::I x) {
+    x = Ops::xorShift(x, 16);
+    x = Ops::mulBits(x, 0x7feb352du);
+    x = Ops::xorShift(x, 15);
+    x = Ops::mulBits(x, 0x846ca68bu);
+    x = Ops::xorShift(x, 16);
+    return x;
+}
+
+// exp(x) for x in [-87, 0]: range reduction by ln 2 and a degree 5 polynomial
+template <class Ops>
+static typename Ops::F expLanes(typename Ops::F x) {
+    typedef typename Ops::F F;
+    x = Ops::max(Ops::min(x, Ops::set(0.0f)), Ops::set(-87.0f));
+
+    typename Ops::I n = Ops::roundToInt(Ops::mul(x, Ops::set(1.44269504f)));
+    F fn = Ops::toFloat(n);
+    F r = Ops::sub(Ops::sub(x, Ops::mul(fn, Ops::set(0.693359375f))), Ops::mul(fn, Ops::set(-2.12194440e-4f)));
+
+    F p = Ops::set(1.9875691500e-4f);
+    p = Ops::add(Ops::mul(p, r), Ops::set(1.3981999507e-3f));
+    p = Ops::add(Ops::mul(p, r), Ops::set(8.3334519073e-3f));
+    p = Ops::add(Ops::mul(p, r), Ops::set(4.1665795894e-2f));
+    p = Ops::add(Ops::mul(p, r), Ops::set(1.6666665459e-1f));
+    p = Ops::add(Ops::mul(p, r), Ops::set(5.0000001201e-1f));
+    F y = Ops::add(Ops::add(Ops::mul(Ops::mul(p, r), r), r), Ops::set(1.0f));
+
+    return Ops::mul(y, Ops::exponentScale(n));
+}
+
+// Mirrors computeAeroDisplacementScalar() step for step, with masks for branches
+template <class Ops>
+static void aeroKernel(const AeroKernelParams& params, AeroLanes& lanes) {
+    typedef typename Ops::F F;
+    typedef typename Ops::I I;
+
+    const float carSpeedFactor = params.carSpeedFactor;
+    const float turbulence = 0.01f * (0.5f + carSpeedFactor * 0.5f);
+    const F speedFactor = Ops::set(carSpeedFactor);
+    const F zero = Ops::set(0.0f);
+    const F wakeStart = Ops::set(params.carLength * 0.3f);
+    const F speedMultiplier = Ops::set(0.8f + (carSpeedFactor * 0.4f));
+    const F groundScaleZ = Ops::set(1.2f * (1.0f + (carSpeedFactor * 0.5f)));
+    const F drs = Ops::allLanes(params.simulateDRS);
+    const F turbulenceMin = Ops::set(-turbulence);
+    const F turbulenceRange = Ops::set(turbulence - (-turbulence));
+
+    for (int i = 0; i < kAeroLanes; i += Ops::kWidth) {
+        F distance = Ops::load(lanes.distance + i);
+        F dx = Ops::mul(Ops::load(lanes.directionX + i), distance);
+        F dy = Ops::mul(Ops::load(lanes.directionY + i), distance);
+        F dz = Ops::mul(Ops::load(lanes.directionZ + i), distance);
+
+        F rx = Ops::load(lanes.headX + i);
+        F ry = Ops::load(lanes.headY + i);
+        F rz = Ops::sub(Ops::load(lanes.headZ + i), Ops::set(params.carPosition));
+        F absX = Ops::abs(rx);
+
+        dx = Ops::mul(dx, speedFactor);
+        dy = Ops::mul(dy, speedFactor);
+        dz = Ops::mul(dz, speedFactor);
+
+        // 1. Wake effect
+        F inWake = Ops::greater(rz, wakeStart);
+        F wakeStrength = Ops::mul(Ops::set(0.05f),
+            expLanes<Ops>(Ops::mul(Ops::sub(zero, Ops::sub(rz, wakeStart)), Ops::set(0.5f))));
+        F curve = Ops::mul(wakeStrength, speedMultiplier);
+        F curveX = Ops::select(Ops::greater(rx, zero), Ops::sub(zero, curve), curve);
+        dx = Ops::add(dx, Ops::select(inWake, curveX, zero));
+
+        F overRearWing = Ops::both(drs, Ops::both(Ops::less(absX, Ops::set(params.carWidth * 0.3f)),
+            Ops::less(rz, Ops::set(params.carLength * 0.6f))));
+        F upwash = Ops::select(overRearWing,
+            Ops::mul(Ops::mul(wakeStrength, Ops::set(0.3f)), speedMultiplier),
+            Ops::mul(Ops::mul(wakeStrength, Ops::set(0.5f)), speedMultiplier));
+        dy = Ops::add(dy, Ops::select(inWake, upwash, zero));
+
+        // 2. Ground effect
+        F underCar = Ops::both(Ops::less(ry, Ops::set(params.carHeight * 0.2f)),
+            Ops::both(Ops::less(absX, Ops::set(params.carWidth * 0.4f)),
+                Ops::less(Ops::abs(rz), Ops::set(params.carLength * 0.4f))));
+        dz = Ops::select(underCar, Ops::mul(dz, groundScaleZ), dz);
+        dy = Ops::select(underCar, Ops::mul(dy, Ops::set(0.8f)), dy);
+
+        F pressure = Ops::load(lanes.pressure + i);
+        F lowPressure = Ops::min(Ops::max(Ops::mul(pressure, Ops::set(0.5f)), Ops::set(0.05f)), Ops::set(0.2f));
+        F floorLine = Ops::greater(Ops::load(lanes.floorZone + i), Ops::set(0.5f));
+        Ops::store(lanes.pressure + i, Ops::select(Ops::both(underCar, floorLine), lowPressure, pressure));
+
+        // 3. Turbulence
+        I key = Ops::loadBits(lanes.randomKey + i);
+        F jitterX = Ops::unitFromBits(hashLanes<Ops>(Ops::addBits(key, 1u * 0x632be5abu)));
+        F jitterY = Ops::unitFromBits(hashLanes<Ops>(Ops::addBits(key, 2u * 0x632be5abu)));
+        F jitterZ = Ops::unitFromBits(hashLanes<Ops>(Ops::addBits(key, 3u * 0x632be5abu)));
+        dx = Ops::add(dx, Ops::add(turbulenceMin, Ops::mul(turbulenceRange, jitterX)));
+        dy = Ops::add(dy, Ops::add(turbulenceMin, Ops::mul(turbulenceRange, jitterY)));
+        dz = Ops::add(dz, Ops::add(turbulenceMin, Ops::mul(turbulenceRange, jitterZ)));
+
+        Ops::store(lanes.displacementX + i, dx);
+        Ops::store(lanes.displacementY + i, dy);
+        Ops::store(lanes.displacementZ + i, dz);
+    }
+}
+
+#if defined(AERO_KERNEL_AVX2_RUNTIME)
+static bool cpuSupportsAvx2() {
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+
+    // AVX needs OS support for the YMM state as well
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+}
+#endif
+
+enum AeroKernelKind { AERO_SCALAR, AERO_SSE2, AERO_AVX2, AERO_NEON };
+
+static AeroKernelKind selectKernel() {
+#if defined(AERO_KERNEL_AVX2_RUNTIME)
+    return cpuSupportsAvx2() ? AERO_AVX2 : AERO_SSE2;
+#elif defined(AERO_KERNEL_AVX2)
+    return AERO_AVX2;
+#elif defined(AERO_KERNEL_SSE2)
+    return AERO_SSE2;
+#elif defined(AERO_KERNEL_NEON)
+    return AERO_NEON;
+#else
+    return AERO_SCALAR;
+#endif
+}
+
+static AeroKernelKind activeKernel() {
+    static const AeroKernelKind kind = selectKernel();
+    return kind;
+}
+
+void computeAeroDisplacement(const AeroKernelParams& params, AeroLanes& lanes, int count) {
+    switch (activeKernel()) {
+#if defined(AERO_KERNEL_AVX2)
+    case AERO_AVX2:
+        aeroKernel<Avx2Ops>(params, lanes);
+        break;
+#endif
+#if defined(AERO_KERNEL_SSE2)
+    case AERO_SSE2:
+        aeroKernel<Sse2Ops>(params, lanes);
+        break;
+#endif
+#if defined(AERO_KERNEL_NEON)
+    case AERO_NEON:
+        aeroKernel<NeonOps>(params, lanes);
+        break;
+#endif
+    default:
+        computeAeroDisplacementScalar(params, lanes, count);
+        break;
+    }
+}
+
+const char* aeroKernelName() {
+    switch (activeKernel()) {
+    case AERO_AVX2: return "AVX2";
+    case AERO_SSE2: return "SSE2";
+    case AERO_NEON: return "NEON";
+    default: return "scalar";
+    }
+}
+
+float validateAeroKernel(int batches) {
+    std::mt19937 generator(1234u);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    AeroKernelParams params;
+    params.carLength = 5.7f;
+    params.carWidth = 2.0f;
+    params.carHeight = 1.0f;
+
+    float maxError = 0.0f;
+    for (int batch = 0; batch < batches; batch++) {
+        params.carPosition = unit(generator) * 20.0f - 10.0f;
+        params.carSpeedFactor = unit(generator) * 1.4f;
+        params.simulateDRS = (batch & 1) != 0;
+
+        // Heads spread over and around the car so every branch is taken
+        AeroLanes scalar;
+        for (int i = 0; i < kAeroLanes; i++) {
+            scalar.headX[i] = unit(generator) * 3.0f - 1.5f;
+            scalar.headY[i] = unit(generator) * 1.5f;
+            scalar.headZ[i] = params.carPosition + unit(generator) * 30.0f - 5.0f;
+            scalar.directionX[i] = unit(generator) * 0.4f - 0.2f;
+            scalar.directionY[i] = unit(generator) * 0.2f - 0.1f;
+            scalar.directionZ[i] = 1.0f;
+            scalar.distance[i] = unit(generator) * 0.2f;
+            scalar.floorZone[i] = (i % 3 == 0) ? 1.0f : 0.0f;
+            scalar.randomKey[i] = FlowRandom::lineKey(7u, batch * kAeroLanes + i, batch);
+            scalar.pressure[i] = unit(generator);
+        }
+
+        AeroLanes vectorized = scalar;
+        computeAeroDisplacementScalar(params, scalar, kAeroLanes);
+        computeAeroDisplacement(params, vectorized, kAeroLanes);
+
+        for (int i = 0; i < kAeroLanes; i++) {
+            maxError = std::max(maxError, std::abs(scalar.displacementX[i] - vectorized.displacementX[i]));
+            maxError = std::max(maxError, std::abs(scalar.displacementY[i] - vectorized.displacementY[i]));
+            maxError = std::max(maxError, std::abs(scalar.displacementZ[i] - vectorized.displacementZ[i]));
+            maxError = std::max(maxError, std::abs(scalar.pressure[i] - vectorized.pressure[i]));
+        }
+    }
+    return maxError;
+}
@@ -0,0 +1,63 @@
+#ifndef AERO_KERNEL_H
+#define AERO_KERNEL_H
+
+#include <cstdint>
+
+// Vectorized form of the aerodynamic displacement of non-vortex flow lines
+// (wake curvature, upwash, ground effect and turbulence). A batch holds up to
+// kAeroLanes line heads in structure-of-arrays form; the data-dependent
+// branches of the scalar code become lane masks. The scalar reference is kept
+// next to it so the two can be compared.
+
+static const int kAeroLanes = 8;
+
+// Per-frame constants shared by every lane
+struct AeroKernelParams {
+    float carLength;
+    float carWidth;
+    float carHeight;
+    float carPosition;
+    float carSpeedFactor;    // carSpeed / 250
+    bool simulateDRS;
+};
+
+// One batch of line heads; unused lanes must hold finite values
+struct alignas(32) AeroLanes {
+    // Inputs
+    float headX[kAeroLanes];
+    float headY[kAeroLanes];
+    float headZ[kAeroLanes];
+    float directionX[kAeroLanes];
+    float directionY[kAeroLanes];
+    float directionZ[kAeroLanes];
+    float distance[kAeroLanes];       // Distance to advance this step
+    float floorZone[kAeroLanes];      // 1 for floor zone lines, 0 otherwise
+    uint32_t randomKey[kAeroLanes];   // FlowRandom::lineKey() of the line; draws 0-2 are used
+
+    // In/out
+    float pressure[kAeroLanes];
+
+    // Outputs
+    float displacementX[kAeroLanes];
+    float displacementY[kAeroLanes];
+    float displacementZ[kAeroLanes];
+};
+
+// Reference implementation, one lane at a time
+void computeAeroDisplacementScalar(const AeroKernelParams& params, AeroLanes& lanes, int count);
+
+// Widest kernel the CPU supports (AVX2, SSE2 or NEON), scalar otherwise.
+// All kAeroLanes lanes are computed; only the first count are meaningful.
+void computeAeroDisplacement(const AeroKernelParams& params, AeroLanes& lanes, int count);
+
+// Name of the kernel computeAeroDisplacement() dispatches to
+const char* aeroKernelName();
+
+// Run random batches through both paths and return the largest absolute
+// difference of any output. The only expected source is the polynomial exp(),
+// which stays within kAeroKernelTolerance; FlowBench --validate checks it.
+float validateAeroKernel(int batches);
+
+const float kAeroKernelTolerance = 1e-5f;
+
+#endif
@@ -0,0 +1,34 @@
+#include "CameraUniforms.h"
+#include "FrameProfiler.h"
+
+CameraUniforms::CameraUniforms()
+    : m_buffer(0) {
+}
+
+void CameraUniforms::create() {
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, kBindingPoint, m_buffer);
+}
+
+void CameraUniforms::destroy() {
+    if (m_buffer) {
+        glDeleteBuffers(1, &m_buffer);
+        m_buffer = 0;
+    }
+}
+
+void CameraUniforms::update(const glm::mat4& projection, const glm::mat4& view, const glm::vec2& viewportSize) {
+    Block block;
+    block.projection = projection;
+    block.view = view;
+    block.viewport = glm::vec4(viewportSize, 0.0f, 0.0f);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    FrameProfiler::instance().addUploadedBytes(sizeof(Block));
+}
@@ -0,0 +1,44 @@
+#ifndef CAMERA_UNIFORMS_H
+#define CAMERA_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Camera matrices of the current frame in one uniform buffer, shared by every
+// program that declares the block below and binds it once with
+// Shader::bindUniformBlock("Camera", CameraUniforms::kBindingPoint).
+// Programs that need no viewport may leave the last member out, but all
+// stages of one program have to declare the block alike.
+//
+//     layout (std140) uniform Camera {
+//         mat4 projection;
+//         mat4 view;
+//         vec4 viewport;      // xy: framebuffer size in pixels
+//     };
+class CameraUniforms {
+public:
+    static const GLuint kBindingPoint = 0;
+
+    CameraUniforms();
+
+    // Allocate the buffer and attach it to kBindingPoint
+    void create();
+
+    // Release the buffer
+    void destroy();
+
+    // Upload this frame's matrices and viewport size in pixels, once for all programs
+    void update(const glm::mat4& projection, const glm::mat4& view, const glm::vec2& viewportSize);
+
+private:
+    // std140 layout of the Camera block
+    struct Block {
+        glm::mat4 projection;
+        glm::mat4 view;
+        glm::vec4 viewport;
+    };
+
+    GLuint m_buffer;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#include "FileStamp.h"
+#include "MappedFile.h"
+
+#include <sys/stat.h>
+
+bool FileStamp::read(const std::string& path, FileStamp& stamp) {
+#ifdef _WIN32
+    struct _stat64 fileStat;
+    if (_stat64(path.c_str(), &fileStat) != 0) {
+        return false;
+    }
+    int64_t nanoseconds = 0;
+#else
+    struct stat fileStat;
+    if (stat(path.c_str(), &fileStat) != 0) {
+        return false;
+    }
+#ifdef __APPLE__
+    int64_t nanoseconds = static_cast<int64_t>(fileStat.st_mtimespec.tv_nsec);
+#else
+    int64_t nanoseconds = static_cast<int64_t>(fileStat.st_mtim.tv_nsec);
+#endif
+#endif
+    stamp.size = static_cast<uint64_t>(fileStat.st_size);
+    stamp.modified = static_cast<int64_t>(fileStat.st_mtime) * 1000000000 + nanoseconds;
+    return true;
+}
+
+uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+bool hashFile(const std::string& path, uint64_t& hash) {
+    MappedFile source;
+    if (!source.open(path)) {
+        return false;
+    }
+    hash = hashBytes(kFnvOffsetBasis, source.data(), source.size());
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef FILE_STAMP_H
+#define FILE_STAMP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Size and modification time of a file, to tell whether it may have changed
+// without reading it. Times are in nanoseconds where the platform keeps them;
+// _stat64 on Windows only has whole seconds, so two saves within a second can
+// share a stamp there and only a content hash tells them apart.
+struct FileStamp {
+#ifdef _WIN32
+    static constexpr bool kSubsecond = false;
+#else
+    static constexpr bool kSubsecond = true;
+#endif
+
+    uint64_t size;
+    int64_t modified;       // Nanoseconds since the epoch
+
+    // Stamp of the file at path; false if it cannot be stat'ed
+    static bool read(const std::string& path, FileStamp& stamp);
+
+    bool operator==(const FileStamp& other) const { return size == other.size && modified == other.modified; }
+    bool operator!=(const FileStamp& other) const { return !(*this == other); }
+};
+
+// 64-bit FNV-1a, for cache keys and content checks
+const uint64_t kFnvOffsetBasis = 14695981039346656037ull;
+
+uint64_t hashBytes(uint64_t hash, const void* data, size_t size);
+
+// FNV-1a of the whole file at path; false if it cannot be mapped (or is empty)
+bool hashFile(const std::string& path, uint64_t& hash);
+
+#endif
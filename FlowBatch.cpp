@@ -0,0 +1,370 @@
+// Headless flow generation: runs the FlowSimulation for a sweep of car speeds
+// and DRS states and writes the trails of every run to disk. Needs no window
+// or GL context, so datasets can be made on machines without a GPU.
+//
+// Usage: FlowBatch [--lines N] [--density D] [--steps N] [--every N]
+//                  [--speeds 150,250,350] [--drs closed|open|both]
+//                  [--seed N] [--out DIR] [--aero field|analytic]
+//                  [--field FILE] [--field-drs FILE] [--integrator euler|rk4|rk45]
+//        FlowBatch --convert FILE
+//
+// --field and --field-drs advect through CFD data (see FlowField.h) with DRS
+// closed and open instead of the field baked from the analytic model;
+// --aero analytic evaluates the analytic model per point instead. Files
+// ending in .f1bricks are streamed (see FlowFieldBricks.h) rather than
+// loaded whole. --integrator picks how heads are integrated (see
+// FlowIntegrator.h); rk4 and rk45 place trail points by arc length and
+// curvature instead of one per step. --convert rewrites a .f1field file as
+// a .f1bricks file beside it and exits.
+//
+// Each run writes <DIR>/flow_<speed>kmh_drs_<state>.csv with one row per
+// trail point (newest first): step,line,vortex,point,x,y,z,pressure.
+// Positions are relative to the car, which stands at the origin. DIR is
+// created if it does not exist.
+#include "FlowSimulation.h"
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BatchSettings {
+    int lines = 350;             // Same defaults as the interactive viewer
+    float density = 0.20f;
+    int steps = 1000;            // 10 simulated seconds at the fixed timestep
+    int every = 0;               // Snapshot interval in steps; 0 writes the last step only
+    std::vector<float> speeds = { 150.0f, 250.0f, 350.0f };
+    std::vector<bool> drsStates = { false, true };
+    unsigned int seed = 1;
+    std::string outputDirectory = ".";
+    bool fieldAdvection = true;
+    std::string fieldPaths[2];   // CFD fields with DRS closed and open; empty to bake
+    FlowIntegrator integrator = FlowIntegrator::Euler;
+    std::string convertPath;     // Dense field to rewrite as bricks instead of simulating
+};
+
+struct BatchRun {
+    float speed;
+    bool drsOpen;
+    std::string path;
+    bool written;
+    double seconds;
+};
+
+const float kCarLength = 5.7f;
+const float kCarWidth = 2.0f;
+const float kCarHeight = 1.0f;
+
+void printUsage() {
+    std::cout << "Usage: FlowBatch [--lines N] [--density D] [--steps N] [--every N]\n"
+        << "                 [--speeds 150,250,350] [--drs closed|open|both]\n"
+        << "                 [--seed N] [--out DIR] [--aero field|analytic]\n"
+        << "                 [--field FILE] [--field-drs FILE] [--integrator euler|rk4|rk45]\n"
+        << "       FlowBatch --convert FILE" << std::endl;
+}
+
+const std::string kBrickExtension = ".f1bricks";
+
+bool isBrickFile(const std::string& path) {
+    return path.size() >= kBrickExtension.size() &&
+        path.compare(path.size() - kBrickExtension.size(), kBrickExtension.size(), kBrickExtension) == 0;
+}
+
+// FILE.f1field becomes FILE.f1bricks
+std::string brickPathFor(const std::string& fieldPath) {
+    size_t dot = fieldPath.find_last_of('.');
+    size_t slash = fieldPath.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return fieldPath + kBrickExtension;
+    }
+    return fieldPath.substr(0, dot) + kBrickExtension;
+}
+
+bool parseSpeeds(const std::string& list, std::vector<float>& speeds) {
+    speeds.clear();
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        char* end = nullptr;
+        float speed = std::strtof(item.c_str(), &end);
+        if (item.empty() || *end != '\0' || speed <= 0.0f) {
+            return false;
+        }
+        speeds.push_back(speed);
+    }
+    return !speeds.empty();
+}
+
+bool parseArguments(int argc, char** argv, BatchSettings& settings) {
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--help") {
+            return false;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "ERROR::FLOW_BATCH::MISSING_VALUE: " << option << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (option == "--lines") {
+            settings.lines = std::atoi(value.c_str());
+        }
+        else if (option == "--density") {
+            settings.density = static_cast<float>(std::atof(value.c_str()));
+        }
+        else if (option == "--steps") {
+            settings.steps = std::atoi(value.c_str());
+        }
+        else if (option == "--every") {
+            settings.every = std::atoi(value.c_str());
+        }
+        else if (option == "--speeds") {
+            if (!parseSpeeds(value, settings.speeds)) {
+                std::cerr << "ERROR::FLOW_BATCH::INVALID_SPEEDS: " << value << std::endl;
+                return false;
+            }
+        }
+        else if (option == "--drs") {
+            settings.drsStates.clear();
+            if (value == "closed" || value == "both") {
+                settings.drsStates.push_back(false);
+            }
+            if (value == "open" || value == "both") {
+                settings.drsStates.push_back(true);
+            }
+            if (settings.drsStates.empty()) {
+                std::cerr << "ERROR::FLOW_BATCH::INVALID_DRS: " << value << std::endl;
+                return false;
+            }
+        }
+        else if (option == "--seed") {
+            settings.seed = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (option == "--out") {
+            settings.outputDirectory = value;
+        }
+        else if (option == "--aero") {
+            if (value != "field" && value != "analytic") {
+                std::cerr << "ERROR::FLOW_BATCH::INVALID_AERO: " << value << std::endl;
+                return false;
+            }
+            settings.fieldAdvection = (value == "field");
+        }
+        else if (option == "--field") {
+            settings.fieldPaths[0] = value;
+        }
+        else if (option == "--field-drs") {
+            settings.fieldPaths[1] = value;
+        }
+        else if (option == "--integrator") {
+            if (value == "euler") {
+                settings.integrator = FlowIntegrator::Euler;
+            }
+            else if (value == "rk4") {
+                settings.integrator = FlowIntegrator::RK4;
+            }
+            else if (value == "rk45") {
+                settings.integrator = FlowIntegrator::RK45;
+            }
+            else {
+                std::cerr << "ERROR::FLOW_BATCH::INVALID_INTEGRATOR: " << value << std::endl;
+                return false;
+            }
+        }
+        else if (option == "--convert") {
+            settings.convertPath = value;
+        }
+        else {
+            std::cerr << "ERROR::FLOW_BATCH::UNKNOWN_OPTION: " << option << std::endl;
+            return false;
+        }
+    }
+
+    if (settings.lines <= 0 || settings.steps <= 0 || settings.every < 0 || settings.density <= 0.0f) {
+        std::cerr << "ERROR::FLOW_BATCH::INVALID_SETTINGS" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Whether path names an existing directory
+bool isDirectory(const std::string& path) {
+#ifdef _WIN32
+    struct _stat64 fileStat;
+    return _stat64(path.c_str(), &fileStat) == 0 && (fileStat.st_mode & _S_IFDIR) != 0;
+#else
+    struct stat fileStat;
+    return stat(path.c_str(), &fileStat) == 0 && S_ISDIR(fileStat.st_mode);
+#endif
+}
+
+// Create a directory and any missing parents; false if it still does not exist
+bool createDirectories(const std::string& path) {
+    for (size_t end = 1; end <= path.size(); end++) {
+        if (end < path.size() && path[end] != '/' && path[end] != '\\') {
+            continue;
+        }
+        std::string prefix = path.substr(0, end);
+        if (isDirectory(prefix)) {
+            continue;
+        }
+#ifdef _WIN32
+        _mkdir(prefix.c_str());
+#else
+        mkdir(prefix.c_str(), 0755);
+#endif
+    }
+    return isDirectory(path);
+}
+
+// Append every live trail point of the simulation's current state, in world coordinates
+void writeSnapshot(std::ostream& out, const FlowSimulation& simulation) {
+    const FlowLinePool& pool = simulation.pool();
+    float frameOrigin = simulation.frameOrigin();
+    unsigned int step = simulation.stepIndex();
+    for (int line = 0; line < simulation.lineCount(); line++) {
+        size_t base = pool.slotOffset(line);
+        int vortex = pool.isVortex[line] ? 1 : 0;
+        for (int point = 0; point < pool.pointCount[line]; point++) {
+            const glm::vec3& position = pool.positions[base + (pool.head[line] + point) % pool.maxPoints];
+            out << step << ',' << line << ',' << vortex << ',' << point << ','
+                << position.x << ',' << position.y << ',' << position.z + frameOrigin << ','
+                << pool.pressure[line] << '\n';
+        }
+    }
+}
+
+// Simulate one configuration from a fresh seeding and write its snapshots
+void runConfiguration(const BatchSettings& settings, BatchRun& run) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Every run starts from the same seeding, so runs differ only by speed and DRS
+    FlowSimulation simulation(settings.lines, kCarLength, kCarWidth, kCarHeight, settings.seed);
+    simulation.setIncrementalReseeding(false);
+    simulation.setFlowFieldAdvection(settings.fieldAdvection);
+    simulation.setIntegrator(settings.integrator);
+    for (int state = 0; state < 2; state++) {
+        const std::string& path = settings.fieldPaths[state];
+        if (path.empty()) {
+            continue;
+        }
+        if (isBrickFile(path)) {
+            simulation.loadFlowFieldBricks(path, state == 1);
+        }
+        else {
+            simulation.loadFlowField(path, state == 1);
+        }
+    }
+    simulation.setDensity(settings.density);
+    simulation.setCarPosition(0.0f);
+    simulation.setCarSpeed(run.speed);
+    simulation.setDRS(run.drsOpen);
+    simulation.resetAllFlowLines();
+
+    std::ofstream out(run.path.c_str(), std::ios::trunc);
+    if (!out) {
+        run.written = false;
+        return;
+    }
+    out << "step,line,vortex,point,x,y,z,pressure\n";
+
+    for (int step = 1; step <= settings.steps; step++) {
+        simulation.step(FlowSimulation::kFixedTimestep);
+        bool snapshot = settings.every > 0 ? step % settings.every == 0 : step == settings.steps;
+        if (snapshot) {
+            writeSnapshot(out, simulation);
+        }
+    }
+
+    out.close();
+    run.written = !out.fail();
+    run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+}
+
+int main(int argc, char** argv) {
+    BatchSettings settings;
+    if (!parseArguments(argc, argv, settings)) {
+        printUsage();
+        return 1;
+    }
+
+    if (!settings.convertPath.empty()) {
+        std::string brickPath = brickPathFor(settings.convertPath);
+        FlowFieldBricks bricks;
+        if (!FlowFieldBricks::convert(settings.convertPath, brickPath) || !bricks.open(brickPath)) {
+            return 1;
+        }
+        const glm::ivec3& overview = bricks.overview().dimensions();
+        std::cout << "Wrote " << brickPath << ": " << bricks.brickCount() << " bricks, overview "
+            << overview.x << "x" << overview.y << "x" << overview.z << std::endl;
+        return 0;
+    }
+
+    // Check the fields once here rather than failing every run
+    for (int state = 0; state < 2; state++) {
+        const std::string& path = settings.fieldPaths[state];
+        if (path.empty()) {
+            continue;
+        }
+        FlowField field;
+        FlowFieldBricks bricks;
+        if (isBrickFile(path) ? !bricks.open(path) : !field.load(path)) {
+            return 1;
+        }
+    }
+
+    if (!createDirectories(settings.outputDirectory)) {
+        std::cerr << "ERROR::FLOW_BATCH::OUTPUT_DIRECTORY_NOT_CREATED: " << settings.outputDirectory << std::endl;
+        return 1;
+    }
+
+    std::vector<BatchRun> runs;
+    for (size_t i = 0; i < settings.speeds.size(); i++) {
+        for (size_t j = 0; j < settings.drsStates.size(); j++) {
+            BatchRun run;
+            run.speed = settings.speeds[i];
+            run.drsOpen = settings.drsStates[j];
+            std::stringstream path;
+            path << settings.outputDirectory << "/flow_" << run.speed << "kmh_drs_"
+                << (run.drsOpen ? "open" : "closed") << ".csv";
+            run.path = path.str();
+            run.written = false;
+            run.seconds = 0.0;
+            runs.push_back(run);
+        }
+    }
+
+    std::cout << "Simulating " << runs.size() << " configurations, " << settings.lines << " lines, "
+        << settings.steps << " steps each" << std::endl;
+
+    // Runs are independent, so each worker takes whole runs; a single run's update stays serial
+    JobSystem jobs;
+    jobs.parallelFor(static_cast<int>(runs.size()), 1, [&](int firstRun, int lastRun, int) {
+        for (int i = firstRun; i < lastRun; i++) {
+            runConfiguration(settings, runs[i]);
+        }
+    });
+
+    int failed = 0;
+    for (size_t i = 0; i < runs.size(); i++) {
+        if (!runs[i].written) {
+            std::cerr << "ERROR::FLOW_BATCH::FILE_NOT_WRITTEN: " << runs[i].path << std::endl;
+            failed++;
+            continue;
+        }
+        std::cout << runs[i].path << " (" << runs[i].seconds << " s)" << std::endl;
+    }
+    return failed == 0 ? 0 : 1;
+}
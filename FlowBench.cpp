@@ -0,0 +1,610 @@
+// Benchmarks of the flow simulation and renderer over fixed, seeded
+// scenarios, for tracking performance from commit to commit.
+//
+// Usage: FlowBench [--suite sim|render|all] [--filter TEXT] [--steps N]
+//                  [--frames N] [--repeat N] [--seed N] [--model PATH]
+//                  [--out FILE]
+//        FlowBench --validate BATCHES
+//
+// The sim suite needs no window: it sweeps line counts (350 to 20000), trail
+// lengths (80 to 1000 points), DRS toggling, a moving car, the analytic
+// aerodynamics and the RK integrators through the FlowSimulation, the CPU
+// half of FlowLinesVisualization. The render suite opens a window and drives
+// FlowLinesVisualization on both backends along a fixed camera orbit around
+// the car, with vsync off, and the CPU backend under RK45 too, whose trails
+// are spaced by distance rather than by step and fade by each point's life.
+//
+// Results go to stdout and, one row per scenario, to a CSV (flow_bench.csv
+// by default): suite,scenario,lines,live_lines,points_per_line,steps,seed_ms,
+// ns_per_line_step,allocs_per_step,ring_fill,frames,cpu_frame_ms,gpu_frame_ms,
+// gpu_frame_p95_ms,uploaded_bytes_per_frame,allocs_per_frame.
+// Cells that do not apply to a suite are left empty. ring_fill is the share
+// of the live lines' ring slots holding points after the measured steps; the
+// RK integrators store a point per half meter rather than per step, so their
+// rings hold fewer points than Euler's at the same trail length.
+//
+// --validate runs the vectorized aero kernel against the scalar reference on
+// that many random batches instead of benchmarking, and exits nonzero if any
+// output differs by more than kAeroKernelTolerance.
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "FlowVisualization.h"
+#include "CameraUniforms.h"
+#include "FrameProfiler.h"
+#include "GpuPassTimer.h"
+#include "Model.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchSettings {
+    bool runSim = true;
+    bool runRender = true;
+    std::string filter;          // Only scenarios whose name contains this
+    int steps = 500;             // Measured steps per sim run
+    int frames = 600;            // Measured frames per render run
+    int repeat = 3;              // Sim runs per scenario; the fastest counts
+    unsigned int seed = 1;
+    std::string modelPath;       // Render suite draws a placeholder box without one
+    std::string outputPath = "flow_bench.csv";
+    int validateBatches = 0;     // Check the aero kernel instead of running the suites
+};
+
+struct SimScenario {
+    const char* name;
+    int lines;
+    int pointsPerLine;
+    bool parallel;
+    bool toggleDRS;
+    bool moveCar;
+    bool analytic;       // Per-point analytic aerodynamics instead of the flow field
+    FlowIntegrator integrator;
+};
+
+struct RenderScenario {
+    const char* name;
+    int lines;
+    AdvectionBackend backend;
+    FlowIntegrator integrator;
+};
+
+// One CSV row; negative values are written as empty cells
+struct BenchResult {
+    std::string suite;
+    std::string scenario;
+    int lines = -1;
+    int liveLines = -1;
+    int pointsPerLine = -1;
+    int steps = -1;
+    double seedMilliseconds = -1.0;
+    double nsPerLineStep = -1.0;
+    double allocationsPerStep = -1.0;
+    double ringFill = -1.0;
+    int frames = -1;
+    double cpuFrameMilliseconds = -1.0;
+    double gpuFrameMilliseconds = -1.0;
+    double gpuFrameP95Milliseconds = -1.0;
+    double uploadedBytesPerFrame = -1.0;
+    double allocationsPerFrame = -1.0;
+};
+
+const SimScenario kSimScenarios[] = {
+    { "lines_350",            350,   80,   false, false, false, false, FlowIntegrator::Euler },
+    { "lines_1000",           1000,  80,   false, false, false, false, FlowIntegrator::Euler },
+    { "lines_2500",           2500,  80,   false, false, false, false, FlowIntegrator::Euler },
+    { "lines_5000",           5000,  80,   false, false, false, false, FlowIntegrator::Euler },
+    { "lines_10000",          10000, 80,   false, false, false, false, FlowIntegrator::Euler },
+    { "lines_20000",          20000, 80,   false, false, false, false, FlowIntegrator::Euler },
+    { "points_250",           350,   250,  false, false, false, false, FlowIntegrator::Euler },
+    { "points_500",           350,   500,  false, false, false, false, FlowIntegrator::Euler },
+    { "points_1000",          350,   1000, false, false, false, false, FlowIntegrator::Euler },
+    { "drs_toggle_2500",      2500,  80,   false, true,  false, false, FlowIntegrator::Euler },
+    { "car_moving_2500",      2500,  80,   false, false, true,  false, FlowIntegrator::Euler },
+    { "lines_5000_analytic",  5000,  80,   false, false, false, true,  FlowIntegrator::Euler },
+    { "lines_5000_rk4",       5000,  80,   false, false, false, false, FlowIntegrator::RK4   },
+    { "lines_5000_rk45",      5000,  80,   false, false, false, false, FlowIntegrator::RK45  },
+    { "lines_5000_parallel",  5000,  80,   true,  false, false, false, FlowIntegrator::Euler },
+    { "lines_20000_parallel", 20000, 80,   true,  false, false, false, FlowIntegrator::Euler }
+};
+
+const RenderScenario kRenderScenarios[] = {
+    { "render_cpu_350",       350,  AdvectionBackend::CPU, FlowIntegrator::Euler },
+    { "render_cpu_5000",      5000, AdvectionBackend::CPU, FlowIntegrator::Euler },
+    { "render_cpu_5000_rk45", 5000, AdvectionBackend::CPU, FlowIntegrator::RK45  },
+    { "render_gpu_350",       350,  AdvectionBackend::GPU, FlowIntegrator::Euler },
+    { "render_gpu_5000",      5000, AdvectionBackend::GPU, FlowIntegrator::Euler }
+};
+
+const float kCarLength = 5.7f;
+const float kCarWidth = 2.0f;
+const float kCarHeight = 1.0f;
+const float kCarSpeed = 250.0f;          // km/h, as in the viewer
+const float kCarMovementSpeed = 3.0f;    // m/s along Z in the moving-car scenarios
+const int kDRSTogglePeriod = 50;         // Steps between DRS flips
+const int kMaxWarmupSteps = 1000;        // Past the longest line life (6 s), so every line has respawned
+const int kRenderWarmupFrames = 60;
+const int kWindowWidth = 1280;
+const int kWindowHeight = 720;
+
+// Minimum streamline spacing for a line count. The viewer's 0.20 suits its
+// 350 lines; denser flows shrink it so seeding can actually place them all.
+float densityFor(int lines) {
+    return 0.20f * std::sqrt(350.0f / static_cast<float>(std::max(lines, 350)));
+}
+
+void printUsage() {
+    std::cout << "Usage: FlowBench [--suite sim|render|all] [--filter TEXT] [--steps N]\n"
+        << "                 [--frames N] [--repeat N] [--seed N] [--model PATH]\n"
+        << "                 [--out FILE]\n"
+        << "       FlowBench --validate BATCHES" << std::endl;
+}
+
+bool parseArguments(int argc, char** argv, BenchSettings& settings) {
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--help") {
+            return false;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "ERROR::FLOW_BENCH::MISSING_VALUE: " << option << std::endl;
+            return false;
+        }
+        std::string value = argv[++i];
+
+        if (option == "--suite") {
+            settings.runSim = value == "sim" || value == "all";
+            settings.runRender = value == "render" || value == "all";
+            if (!settings.runSim && !settings.runRender) {
+                std::cerr << "ERROR::FLOW_BENCH::INVALID_SUITE: " << value << std::endl;
+                return false;
+            }
+        }
+        else if (option == "--filter") {
+            settings.filter = value;
+        }
+        else if (option == "--steps") {
+            settings.steps = std::atoi(value.c_str());
+        }
+        else if (option == "--frames") {
+            settings.frames = std::atoi(value.c_str());
+        }
+        else if (option == "--repeat") {
+            settings.repeat = std::atoi(value.c_str());
+        }
+        else if (option == "--seed") {
+            settings.seed = static_cast<unsigned int>(std::strtoul(value.c_str(), nullptr, 10));
+        }
+        else if (option == "--model") {
+            settings.modelPath = value;
+        }
+        else if (option == "--out") {
+            settings.outputPath = value;
+        }
+        else if (option == "--validate") {
+            settings.validateBatches = std::atoi(value.c_str());
+            if (settings.validateBatches <= 0) {
+                std::cerr << "ERROR::FLOW_BENCH::INVALID_SETTINGS" << std::endl;
+                return false;
+            }
+        }
+        else {
+            std::cerr << "ERROR::FLOW_BENCH::UNKNOWN_OPTION: " << option << std::endl;
+            return false;
+        }
+    }
+
+    if (settings.steps <= 0 || settings.frames <= 0 || settings.repeat <= 0) {
+        std::cerr << "ERROR::FLOW_BENCH::INVALID_SETTINGS" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool selected(const BenchSettings& settings, const char* name) {
+    return settings.filter.empty() || std::string(name).find(settings.filter) != std::string::npos;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Share of the live lines' ring slots that hold points
+double meanRingFill(const FlowSimulation& simulation) {
+    const FlowLinePool& pool = simulation.pool();
+    int lines = simulation.lineCount();
+    if (lines <= 0) {
+        return 0.0;
+    }
+    double points = 0.0;
+    for (int line = 0; line < lines; line++) {
+        points += pool.pointCount[line];
+    }
+    return points / (static_cast<double>(lines) * pool.maxPoints);
+}
+
+// One timed run of a sim scenario from a fresh seeding
+void runSimOnce(const BenchSettings& settings, const SimScenario& scenario, BenchResult& result) {
+    FlowSimulation simulation(scenario.lines, kCarLength, kCarWidth, kCarHeight, settings.seed, scenario.pointsPerLine);
+    simulation.setIncrementalReseeding(false);
+    simulation.setParallelUpdate(scenario.parallel);
+    simulation.setFlowFieldAdvection(!scenario.analytic);
+    simulation.setIntegrator(scenario.integrator);
+    simulation.setCarSpeed(kCarSpeed);
+    simulation.setCarPosition(0.0f);
+
+    // Seed placement, timed on a full reseed at the scenario's spacing
+    std::chrono::steady_clock::time_point seedStart = std::chrono::steady_clock::now();
+    simulation.setDensity(densityFor(scenario.lines));
+    simulation.resetAllFlowLines();
+    double seedMilliseconds = secondsSince(seedStart) * 1000.0;
+
+    // Warm up until every live line's ring is full or the line has respawned,
+    // after which its ring holds as many points as its life emits, so the
+    // measured steps write rings as full as they get in the viewer
+    const FlowLinePool& pool = simulation.pool();
+    std::vector<float> lastLife(pool.life.begin(), pool.life.begin() + simulation.lineCount());
+    std::vector<unsigned char> settled(lastLife.size(), 0);
+    size_t settledLines = 0;
+    for (int step = 0; step < kMaxWarmupSteps && settledLines < settled.size(); step++) {
+        simulation.step(FlowSimulation::kFixedTimestep);
+        for (size_t line = 0; line < settled.size(); line++) {
+            if (!settled[line] && (pool.pointCount[line] == pool.maxPoints || pool.life[line] > lastLife[line])) {
+                settled[line] = 1;
+                settledLines++;
+            }
+            lastLife[line] = pool.life[line];
+        }
+    }
+
+    float carPosition = 0.0f;
+    uint64_t allocationStart = FrameProfiler::allocationCount();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int step = 0; step < settings.steps; step++) {
+        if (scenario.moveCar) {
+            carPosition += kCarMovementSpeed * FlowSimulation::kFixedTimestep;
+            simulation.setCarPosition(carPosition);
+        }
+        if (scenario.toggleDRS && step % kDRSTogglePeriod == 0) {
+            simulation.setDRS((step / kDRSTogglePeriod) % 2 == 0);
+        }
+        simulation.step(FlowSimulation::kFixedTimestep);
+    }
+    double seconds = secondsSince(start);
+    uint64_t allocations = FrameProfiler::allocationCount() - allocationStart;
+    double ringFill = meanRingFill(simulation);
+
+    int liveLines = std::max(simulation.lineCount(), 1);
+    double nsPerLineStep = seconds * 1.0e9 / (static_cast<double>(settings.steps) * liveLines);
+
+    // The fastest repeat is the least disturbed by the rest of the machine
+    if (result.nsPerLineStep < 0.0 || nsPerLineStep < result.nsPerLineStep) {
+        result.nsPerLineStep = nsPerLineStep;
+        result.liveLines = simulation.lineCount();
+    }
+    if (result.seedMilliseconds < 0.0 || seedMilliseconds < result.seedMilliseconds) {
+        result.seedMilliseconds = seedMilliseconds;
+    }
+    result.allocationsPerStep = static_cast<double>(allocations) / settings.steps;
+    result.ringFill = ringFill;
+}
+
+BenchResult runSimScenario(const BenchSettings& settings, const SimScenario& scenario) {
+    BenchResult result;
+    result.suite = "sim";
+    result.scenario = scenario.name;
+    result.lines = scenario.lines;
+    result.pointsPerLine = scenario.pointsPerLine;
+    result.steps = settings.steps;
+    for (int i = 0; i < settings.repeat; i++) {
+        runSimOnce(settings, scenario, result);
+    }
+    return result;
+}
+
+// Camera orbiting the car once over the measured frames, rising and falling
+// so both the side and top views are covered
+glm::vec3 cameraEye(int frame, int frameCount, float carPosition) {
+    float angle = glm::radians(360.0f) * static_cast<float>(frame) / static_cast<float>(frameCount);
+    float height = 1.0f + 3.0f * (0.5f - 0.5f * std::cos(angle * 2.0f));
+    return glm::vec3(7.0f * std::sin(angle), 0.5f + height, carPosition + 7.0f * std::cos(angle));
+}
+
+// Shared GL objects of the render suite
+struct RenderContext {
+    GLFWwindow* window;
+    Shader* carShader;
+    Shader* lineShader;
+    Model* model;
+    CameraUniforms cameraUniforms;
+    GpuPassTimer frameTimer;
+
+    RenderContext() : window(nullptr), carShader(nullptr), lineShader(nullptr), model(nullptr), frameTimer("frame") {
+    }
+};
+
+bool createRenderContext(const BenchSettings& settings, RenderContext& context) {
+    if (!glfwInit()) {
+        std::cerr << "ERROR::FLOW_BENCH::GLFW_INIT_FAILED" << std::endl;
+        return false;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_SAMPLES, 4);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+
+    context.window = glfwCreateWindow(kWindowWidth, kWindowHeight, "FlowBench", NULL, NULL);
+    if (!context.window) {
+        std::cerr << "ERROR::FLOW_BENCH::WINDOW_NOT_CREATED" << std::endl;
+        glfwTerminate();
+        return false;
+    }
+    glfwMakeContextCurrent(context.window);
+    glfwSwapInterval(0);   // Frame times, not the display's refresh rate
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+        std::cerr << "ERROR::FLOW_BENCH::GLAD_INIT_FAILED" << std::endl;
+        glfwDestroyWindow(context.window);
+        glfwTerminate();
+        return false;
+    }
+
+    context.carShader = new Shader("vertex.glsl", "fragment.glsl");
+    context.lineShader = new Shader("line_vertex.glsl", "line_ribbon_geometry.glsl", "line_fragment.glsl");
+    context.cameraUniforms.create();
+    context.carShader->bindUniformBlock("Camera", CameraUniforms::kBindingPoint);
+    context.lineShader->bindUniformBlock("Camera", CameraUniforms::kBindingPoint);
+    context.carShader->use();
+    context.carShader->setVec3(context.carShader->uniform("lightPos"), glm::vec3(5.0f, 5.0f, 5.0f));
+    context.carShader->setVec3(context.carShader->uniform("lightColor"), glm::vec3(1.0f, 1.0f, 1.0f));
+    context.carShader->setVec3(context.carShader->uniform("objectColor"), glm::vec3(1.0f, 0.35f, 0.0f));
+    context.frameTimer.create();
+
+    if (!settings.modelPath.empty()) {
+        context.model = new Model(settings.modelPath, false, ModelLoading::Blocking, ModelGeometry::Merged);
+    }
+
+    glViewport(0, 0, kWindowWidth, kWindowHeight);
+    glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_MULTISAMPLE);
+    return true;
+}
+
+void destroyRenderContext(RenderContext& context) {
+    delete context.model;
+    delete context.carShader;
+    delete context.lineShader;
+    context.frameTimer.destroy();
+    context.cameraUniforms.destroy();
+    glfwDestroyWindow(context.window);
+    glfwTerminate();
+}
+
+BenchResult runRenderScenario(const BenchSettings& settings, const RenderScenario& scenario, RenderContext& context) {
+    BenchResult result;
+    result.suite = "render";
+    result.scenario = scenario.name;
+    result.lines = scenario.lines;
+    result.pointsPerLine = FlowSimulation::kDefaultPointsPerLine;
+    result.frames = settings.frames;
+
+    FlowLinesVisualization flow(scenario.lines, kCarLength, kCarWidth, kCarHeight, settings.seed);
+    flow.setIncrementalReseeding(false);
+    flow.setCarSpeed(kCarSpeed);
+    flow.setCarPosition(0.0f);
+    flow.setDensity(densityFor(scenario.lines));
+    flow.setAdvectionBackend(scenario.backend);
+    flow.setIntegrator(scenario.integrator);
+
+    UniformHandle carModelUniform = context.carShader->uniform("model");
+    UniformHandle carViewPosUniform = context.carShader->uniform("viewPos");
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f),
+        static_cast<float>(kWindowWidth) / kWindowHeight, 0.1f, 100.0f);
+
+    FrameProfiler& profiler = FrameProfiler::instance();
+    profiler.setEnabled(true);
+
+    std::vector<double> gpuMilliseconds;
+    gpuMilliseconds.reserve(settings.frames);
+    double cpuMilliseconds = 0.0;
+    double uploadedBytes = 0.0;
+    double allocations = 0.0;
+    FrameProfiler::Summary frameTotals;
+
+    float carPosition = 0.0f;
+    int totalFrames = kRenderWarmupFrames + settings.frames;
+    for (int frame = 0; frame < totalFrames && !glfwWindowShouldClose(context.window); frame++) {
+        profiler.beginFrame();
+
+        // One fixed step per frame, so every run simulates the same flow
+        carPosition += kCarMovementSpeed * FlowSimulation::kFixedTimestep;
+        flow.setCarPosition(carPosition);
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glm::vec3 eye = cameraEye(frame, totalFrames, carPosition);
+        glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f, 0.5f, carPosition), glm::vec3(0.0f, 1.0f, 0.0f));
+        context.cameraUniforms.update(projection, view, glm::vec2(kWindowWidth, kWindowHeight));
+
+        context.frameTimer.begin();
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.5f, carPosition));
+        model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        if (context.model) {
+            context.carShader->use();
+            context.carShader->setVec3(carViewPosUniform, eye);
+            context.carShader->setMat4(carModelUniform, model);
+            context.model->Draw(*context.carShader, ViewFrustum(model, view, projection, static_cast<float>(kWindowHeight)));
+        }
+        else {
+            flow.drawCarPlaceholder(*context.lineShader);
+        }
+        flow.update(FlowSimulation::kFixedTimestep);
+        flow.draw(*context.lineShader);
+        context.frameTimer.end();
+
+        glfwSwapBuffers(context.window);
+        glfwPollEvents();
+        profiler.endFrame();
+
+        if (frame < kRenderWarmupFrames) {
+            continue;
+        }
+        profiler.lastFrame(frameTotals);
+        cpuMilliseconds += frameTotals.frameMilliseconds;
+        uploadedBytes += frameTotals.uploadedBytes;
+        allocations += frameTotals.allocations;
+        for (size_t i = 0; i < frameTotals.sections.size(); i++) {
+            if (frameTotals.sections[i].gpu) {
+                gpuMilliseconds.push_back(frameTotals.sections[i].milliseconds);
+            }
+        }
+    }
+
+    profiler.setEnabled(false);
+    flow.cleanup();
+
+    result.liveLines = flow.lineCount();
+    result.cpuFrameMilliseconds = cpuMilliseconds / settings.frames;
+    result.uploadedBytesPerFrame = uploadedBytes / settings.frames;
+    result.allocationsPerFrame = allocations / settings.frames;
+    if (!gpuMilliseconds.empty()) {
+        double total = 0.0;
+        for (size_t i = 0; i < gpuMilliseconds.size(); i++) {
+            total += gpuMilliseconds[i];
+        }
+        result.gpuFrameMilliseconds = total / gpuMilliseconds.size();
+        std::sort(gpuMilliseconds.begin(), gpuMilliseconds.end());
+        result.gpuFrameP95Milliseconds = gpuMilliseconds[(gpuMilliseconds.size() * 95) / 100];
+    }
+    return result;
+}
+
+void writeCell(std::ostream& out, double value) {
+    out << ',';
+    if (value >= 0.0) {
+        out << value;
+    }
+}
+
+void writeCell(std::ostream& out, int value) {
+    out << ',';
+    if (value >= 0) {
+        out << value;
+    }
+}
+
+void writeRow(std::ostream& out, const BenchResult& result) {
+    out << result.suite << ',' << result.scenario;
+    writeCell(out, result.lines);
+    writeCell(out, result.liveLines);
+    writeCell(out, result.pointsPerLine);
+    writeCell(out, result.steps);
+    writeCell(out, result.seedMilliseconds);
+    writeCell(out, result.nsPerLineStep);
+    writeCell(out, result.allocationsPerStep);
+    writeCell(out, result.ringFill);
+    writeCell(out, result.frames);
+    writeCell(out, result.cpuFrameMilliseconds);
+    writeCell(out, result.gpuFrameMilliseconds);
+    writeCell(out, result.gpuFrameP95Milliseconds);
+    writeCell(out, result.uploadedBytesPerFrame);
+    writeCell(out, result.allocationsPerFrame);
+    out << '\n';
+}
+
+void printResult(const BenchResult& result) {
+    char line[256];
+    if (result.suite == "sim") {
+        std::snprintf(line, sizeof(line), "%-22s %6d lines %5d pts  %8.1f ns/line-step  seed %8.2f ms  %.2f allocs/step  %3.0f%% full",
+            result.scenario.c_str(), result.liveLines, result.pointsPerLine, result.nsPerLineStep,
+            result.seedMilliseconds, result.allocationsPerStep, result.ringFill * 100.0);
+    }
+    else {
+        std::snprintf(line, sizeof(line), "%-22s %6d lines  cpu %6.2f ms  gpu %6.2f ms (p95 %6.2f)  %9.0f B/frame  %.2f allocs/frame",
+            result.scenario.c_str(), result.liveLines, result.cpuFrameMilliseconds, result.gpuFrameMilliseconds,
+            result.gpuFrameP95Milliseconds, result.uploadedBytesPerFrame, result.allocationsPerFrame);
+    }
+    std::cout << line << std::endl;
+}
+
+}
+
+int main(int argc, char** argv) {
+    BenchSettings settings;
+    if (!parseArguments(argc, argv, settings)) {
+        printUsage();
+        return 1;
+    }
+
+    if (settings.validateBatches > 0) {
+        float kernelError = validateAeroKernel(settings.validateBatches);
+        std::cout << "Aero kernel " << aeroKernelName() << " vs scalar over " << settings.validateBatches
+            << " batches: max difference " << kernelError << std::endl;
+        if (!(kernelError <= kAeroKernelTolerance)) {
+            std::cerr << "ERROR::FLOW_BENCH::AERO_KERNEL_MISMATCH: " << kernelError
+                << " exceeds " << kAeroKernelTolerance << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    std::vector<BenchResult> results;
+
+    if (settings.runSim) {
+        std::cout << "Simulation suite: " << settings.steps << " steps, best of " << settings.repeat
+            << ", aero kernel " << aeroKernelName() << std::endl;
+        for (size_t i = 0; i < sizeof(kSimScenarios) / sizeof(kSimScenarios[0]); i++) {
+            if (selected(settings, kSimScenarios[i].name)) {
+                results.push_back(runSimScenario(settings, kSimScenarios[i]));
+                printResult(results.back());
+            }
+        }
+    }
+
+    if (settings.runRender) {
+        RenderContext context;
+        if (!createRenderContext(settings, context)) {
+            return 1;
+        }
+        std::cout << "Render suite: " << settings.frames << " frames at " << kWindowWidth << "x" << kWindowHeight
+            << ", " << glGetString(GL_RENDERER) << std::endl;
+        for (size_t i = 0; i < sizeof(kRenderScenarios) / sizeof(kRenderScenarios[0]); i++) {
+            if (selected(settings, kRenderScenarios[i].name)) {
+                results.push_back(runRenderScenario(settings, kRenderScenarios[i], context));
+                printResult(results.back());
+            }
+        }
+        destroyRenderContext(context);
+    }
+
+    std::ofstream out(settings.outputPath.c_str(), std::ios::trunc);
+    out << std::fixed << std::setprecision(3);
+    out << "suite,scenario,lines,live_lines,points_per_line,steps,seed_ms,ns_per_line_step,allocs_per_step,ring_fill,"
+        << "frames,cpu_frame_ms,gpu_frame_ms,gpu_frame_p95_ms,uploaded_bytes_per_frame,allocs_per_frame\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        writeRow(out, results[i]);
+    }
+    out.close();
+    if (out.fail()) {
+        std::cerr << "ERROR::FLOW_BENCH::FILE_NOT_WRITTEN: " << settings.outputPath << std::endl;
+        return 1;
+    }
+    std::cout << "Results written to " << settings.outputPath << std::endl;
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "FlowColormap.h"
+#include "FrameProfiler.h"
+
+#include <vector>
+
+FlowColormap::FlowColormap()
+    : m_texture(0) {
+}
+
+void FlowColormap::destroy() {
+    if (m_texture != 0) {
+        glDeleteTextures(1, &m_texture);
+    }
+    m_texture = 0;
+}
+
+glm::vec3 FlowColormap::pressureColor(float pressure) {
+    if (pressure < 0.2f) {
+        // Low pressure - blue tones
+        return glm::vec3(0.0f, 0.3f, 1.0f);
+    }
+    if (pressure < 0.4f) {
+        // Medium-low pressure - cyan to teal
+        return glm::mix(glm::vec3(0.0f, 0.3f, 1.0f), glm::vec3(0.0f, 0.7f, 0.7f), (pressure - 0.2f) / 0.2f);
+    }
+    if (pressure < 0.6f) {
+        // Medium pressure - green to yellow
+        return glm::mix(glm::vec3(0.0f, 0.7f, 0.3f), glm::vec3(0.7f, 0.7f, 0.0f), (pressure - 0.4f) / 0.2f);
+    }
+    if (pressure < 0.8f) {
+        // Medium-high pressure - yellow to orange
+        return glm::mix(glm::vec3(0.7f, 0.7f, 0.0f), glm::vec3(1.0f, 0.5f, 0.0f), (pressure - 0.6f) / 0.2f);
+    }
+    // High pressure - orange to red
+    return glm::mix(glm::vec3(1.0f, 0.5f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), (pressure - 0.8f) / 0.2f);
+}
+
+glm::vec3 FlowColormap::zoneColor(int zone) {
+    switch (zone) {
+    case 0: // Front wing
+        return glm::vec3(0.9f, 0.2f, 0.2f); // Red
+    case 1: // Top
+        return glm::vec3(0.2f, 0.7f, 0.2f); // Green
+    case 2: // Side
+        return glm::vec3(0.2f, 0.5f, 0.9f); // Blue
+    case 3: // Rear wing
+        return glm::vec3(0.9f, 0.7f, 0.2f); // Yellow
+    case 4: // Floor
+        return glm::vec3(0.9f, 0.2f, 0.9f); // Magenta
+    default:
+        return glm::vec3(0.7f); // Gray
+    }
+}
+
+void FlowColormap::upload() {
+    std::vector<unsigned char> texels(kWidth * 2 * 3);
+    for (int i = 0; i < kWidth; i++) {
+        glm::vec3 rows[2] = { pressureColor(i / (kWidth - 1.0f)), zoneColor(i) };
+        for (int row = 0; row < 2; row++) {
+            glm::vec3 color = glm::clamp(rows[row], 0.0f, 1.0f);
+            unsigned char* texel = &texels[(row * kWidth + i) * 3];
+            texel[0] = static_cast<unsigned char>(color.r * 255.0f + 0.5f);
+            texel[1] = static_cast<unsigned char>(color.g * 255.0f + 0.5f);
+            texel[2] = static_cast<unsigned char>(color.b * 255.0f + 0.5f);
+        }
+    }
+
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, kWidth, 2, 0, GL_RGB, GL_UNSIGNED_BYTE, texels.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    FrameProfiler::instance().addUploadedBytes(texels.size());
+}
+
+void FlowColormap::bind(int unit) {
+    if (m_texture == 0) {
+        upload();
+    }
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glActiveTexture(GL_TEXTURE0);
+}
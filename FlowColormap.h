@@ -0,0 +1,34 @@
+#ifndef FLOW_COLORMAP_H
+#define FLOW_COLORMAP_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// Lookup texture the line shaders color flow lines with, 256 x 2 RGB8.
+// Row 0 maps pressure 0..1 across its width; row 1 holds one color per
+// emission zone in its first texels. Both are sampled at texel centers with
+// linear filtering, the zones never more than one texel in.
+class FlowColormap {
+public:
+    static const int kWidth = 256;
+    static const int kZoneColors = 6;       // Five zones and the gray every other zone gets
+
+    FlowColormap();
+
+    // Release the texture
+    void destroy();
+
+    // Bind the colormap to texture unit GL_TEXTURE0 + unit, uploading it the first time
+    void bind(int unit);
+
+    // Colors of the two rows, as the texture stores them
+    static glm::vec3 pressureColor(float pressure);
+    static glm::vec3 zoneColor(int zone);
+
+private:
+    void upload();
+
+    GLuint m_texture;
+};
+
+#endif
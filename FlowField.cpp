@@ -0,0 +1,205 @@
+#include "FlowField.h"
+#include "FlowFieldBricks.h"
+#include "FlowRandom.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const char kMagic[4] = { 'F', '1', 'F', 'F' };
+const uint32_t kVersion = 1;
+const int kMaxNodesPerAxis = 1024;
+
+// Baked grid: about 13 cm across the car, 22 cm along it, and far enough
+// behind it that the wake has decayed to nothing at the last face
+const glm::ivec3 kBakeDimensions(48, 24, 96);
+const float kBakeWakeLength = 16.0f;
+
+struct Header {
+    char magic[4];            // "F1FF"
+    uint32_t version;         // kVersion
+    uint32_t dimensions[3];
+    float boundsMin[3];
+    float boundsMax[3];
+    float referenceSpeed;     // km/h
+};
+
+unsigned int nextRevision() {
+    static std::atomic<unsigned int> revision(0);
+    return ++revision;
+}
+
+}
+
+FlowField::FlowField()
+    : m_dimensions(0), m_boundsMin(0.0f), m_boundsMax(0.0f), m_inverseSpacing(0.0f),
+      m_referenceSpeed(0.0f), m_revision(0) {
+}
+
+void FlowField::allocate(const glm::ivec3& dimensions, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+    m_dimensions = dimensions;
+    m_boundsMin = boundsMin;
+    m_boundsMax = boundsMax;
+    m_inverseSpacing = glm::vec3(dimensions - 1) / (boundsMax - boundsMin);
+    m_nodes.assign(static_cast<size_t>(dimensions.x) * dimensions.y * dimensions.z, glm::vec4(0.0f));
+    m_revision = nextRevision();
+}
+
+void FlowField::bake(const AeroKernelParams& params, float timestep) {
+    glm::vec3 boundsMin(-1.5f * params.carWidth, -0.5f * params.carHeight, -0.6f * params.carLength);
+    glm::vec3 boundsMax(1.5f * params.carWidth, 2.5f * params.carHeight, 0.3f * params.carLength + kBakeWakeLength);
+    allocate(kBakeDimensions, boundsMin, boundsMax);
+    m_referenceSpeed = params.carSpeedFactor * 250.0f;
+
+    // The analytic terms of computeAeroDisplacementScalar() that depend on
+    // position only; the per-line base motion and turbulence stay in the kernel
+    float speedMultiplier = 0.8f + (params.carSpeedFactor * 0.4f);
+    glm::vec3 spacing = (boundsMax - boundsMin) / glm::vec3(kBakeDimensions - 1);
+    glm::vec4* node = m_nodes.data();
+    for (int z = 0; z < m_dimensions.z; z++) {
+        float rz = boundsMin.z + z * spacing.z;
+        for (int y = 0; y < m_dimensions.y; y++) {
+            float ry = boundsMin.y + y * spacing.y;
+            for (int x = 0; x < m_dimensions.x; x++, node++) {
+                float rx = boundsMin.x + x * spacing.x;
+
+                // Wake curvature and upwash behind the car
+                glm::vec3 displacement(0.0f);
+                if (rz > params.carLength * 0.3f) {
+                    float wakeStrength = 0.05f * std::exp(-(rz - params.carLength * 0.3f) / 2.0f);
+                    displacement.x = (rx > 0) ? -wakeStrength * speedMultiplier : wakeStrength * speedMultiplier;
+
+                    bool overRearWing = params.simulateDRS && std::abs(rx) < params.carWidth * 0.3f &&
+                        rz < params.carLength * 0.6f;
+                    displacement.y = wakeStrength * (overRearWing ? 0.3f : 0.5f) * speedMultiplier;
+                }
+
+                // Low pressure under the floor
+                bool underCar = ry < params.carHeight * 0.2f &&
+                    std::abs(rx) < params.carWidth * 0.4f &&
+                    std::abs(rz) < params.carLength * 0.4f;
+
+                *node = glm::vec4(displacement / timestep, underCar ? -1.0f : 0.0f);
+            }
+        }
+    }
+}
+
+bool FlowField::load(const std::string& path) {
+    MappedFile file;
+    if (!file.open(path) || file.size() < sizeof(Header)) {
+        std::cerr << "ERROR::FLOW_FIELD::FILE_NOT_READ: " << path << std::endl;
+        return false;
+    }
+
+    Header header;
+    std::memcpy(&header, file.data(), sizeof(Header));
+    glm::ivec3 dimensions(0);
+    bool valid = std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kVersion;
+    for (int axis = 0; axis < 3 && valid; axis++) {
+        valid = header.dimensions[axis] >= 2 && header.dimensions[axis] <= kMaxNodesPerAxis &&
+            header.boundsMax[axis] > header.boundsMin[axis];
+        dimensions[axis] = static_cast<int>(header.dimensions[axis]);
+    }
+    if (!valid) {
+        std::cerr << "ERROR::FLOW_FIELD::NOT_A_FIELD: " << path << std::endl;
+        return false;
+    }
+
+    size_t nodeCount = static_cast<size_t>(dimensions.x) * dimensions.y * dimensions.z;
+    if ((file.size() - sizeof(Header)) / sizeof(glm::vec4) < nodeCount) {
+        std::cerr << "ERROR::FLOW_FIELD::TRUNCATED: " << path << " holds fewer than " << nodeCount << " nodes" << std::endl;
+        return false;
+    }
+
+    assign(dimensions,
+        glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]),
+        glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]),
+        header.referenceSpeed, reinterpret_cast<const glm::vec4*>(file.data() + sizeof(Header)));
+    return true;
+}
+
+void FlowField::assign(const glm::ivec3& dimensions, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+    float referenceSpeed, const glm::vec4* nodes) {
+    allocate(dimensions, boundsMin, boundsMax);
+    m_referenceSpeed = referenceSpeed;
+    std::memcpy(m_nodes.data(), nodes, m_nodes.size() * sizeof(glm::vec4));
+}
+
+glm::vec4 FlowField::sample(const glm::vec3& position) const {
+    // Grid coordinates, clamped onto the outermost nodes
+    glm::vec3 grid = glm::clamp((position - m_boundsMin) * m_inverseSpacing,
+        glm::vec3(0.0f), glm::vec3(m_dimensions - 1));
+    glm::ivec3 cell = glm::min(glm::ivec3(grid), m_dimensions - 2);
+    glm::vec3 f = grid - glm::vec3(cell);
+
+    size_t strideY = static_cast<size_t>(m_dimensions.x);
+    size_t strideZ = strideY * m_dimensions.y;
+    const glm::vec4* n = &m_nodes[cell.z * strideZ + cell.y * strideY + cell.x];
+
+    glm::vec4 y0 = glm::mix(glm::mix(n[0], n[1], f.x), glm::mix(n[strideY], n[strideY + 1], f.x), f.y);
+    n += strideZ;
+    glm::vec4 y1 = glm::mix(glm::mix(n[0], n[1], f.x), glm::mix(n[strideY], n[strideY + 1], f.x), f.y);
+    return glm::mix(y0, y1, f.z);
+}
+
+// Shared by both field types, which only differ in how sample() finds the nodes
+template <class Field>
+static void fieldDisplacement(const Field& field, const AeroKernelParams& params, float deltaTime,
+    AeroLanes& lanes, int count) {
+    float carSpeedFactor = params.carSpeedFactor;
+    float turbulence = 0.01f * (0.5f + carSpeedFactor * 0.5f);
+    float groundScaleZ = 1.2f * (1.0f + (carSpeedFactor * 0.5f));
+
+    // The car's disturbance scales with the free stream
+    float referenceSpeed = field.referenceSpeed();
+    float velocityScale = referenceSpeed > 0.0f ? carSpeedFactor * 250.0f / referenceSpeed : 1.0f;
+
+    for (int i = 0; i < count; i++) {
+        glm::vec4 node = field.sample(glm::vec3(lanes.headX[i], lanes.headY[i], lanes.headZ[i] - params.carPosition));
+        float suction = glm::clamp(-node.w, 0.0f, 1.0f);
+
+        // Base displacement plus the car's disturbance
+        float distance = lanes.distance[i] * carSpeedFactor;
+        float scale = velocityScale * deltaTime;
+        float dx = lanes.directionX[i] * distance + node.x * scale;
+        float dy = lanes.directionY[i] * distance + node.y * scale;
+        float dz = lanes.directionZ[i] * distance;
+
+        // Sped up along Z and held down under the floor
+        dz = dz * (1.0f + (groundScaleZ - 1.0f) * suction) + node.z * scale;
+        dy *= 1.0f - 0.2f * suction;
+
+        if (lanes.floorZone[i] > 0.5f) {
+            float lowPressure = std::min(std::max(lanes.pressure[i] * 0.5f, 0.05f), 0.2f);
+            lanes.pressure[i] += (lowPressure - lanes.pressure[i]) * suction;
+        }
+
+        // Turbulence, from the first three draws of the line's stream
+        float range = turbulence - (-turbulence);
+        uint32_t key = lanes.randomKey[i];
+        dx += -turbulence + range * FlowRandom::toUnit(FlowRandom::bits(key, 0));
+        dy += -turbulence + range * FlowRandom::toUnit(FlowRandom::bits(key, 1));
+        dz += -turbulence + range * FlowRandom::toUnit(FlowRandom::bits(key, 2));
+
+        lanes.displacementX[i] = dx;
+        lanes.displacementY[i] = dy;
+        lanes.displacementZ[i] = dz;
+    }
+}
+
+void computeFieldDisplacement(const FlowField& field, const AeroKernelParams& params, float deltaTime,
+    AeroLanes& lanes, int count) {
+    fieldDisplacement(field, params, deltaTime, lanes, count);
+}
+
+void computeFieldDisplacement(const FlowFieldBricks& field, const AeroKernelParams& params, float deltaTime,
+    AeroLanes& lanes, int count) {
+    fieldDisplacement(field, params, deltaTime, lanes, count);
+}
@@ -0,0 +1,86 @@
+#ifndef FLOW_FIELD_H
+#define FLOW_FIELD_H
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "AeroKernel.h"
+
+class FlowFieldBricks;
+
+// Velocity and pressure around the car on a regular grid of nodes in car
+// coordinates (car origin at zero, flow running toward +Z). Advecting through
+// it is one trilinear lookup per point on the CPU, or one 3D texture fetch on
+// the GPU, however many aerodynamic features went into the field.
+//
+// Each node holds the velocity the car adds to the free stream, in meters per
+// second at the field's reference speed, and a pressure coefficient Cp.
+// Where Cp is negative the flow is sucked along the floor: lines speed up
+// along Z, drop less, and floor lines lose pressure, as the ground effect of
+// the analytic model does.
+//
+// A field is either baked from the analytic model of AeroKernel for one car
+// speed and DRS state, or loaded from a converted CFD export:
+//
+//     char     magic[4]          "F1FF"
+//     uint32   version           1
+//     uint32   dimensions[3]     nodes along X, Y and Z, at least 2 each
+//     float    boundsMin[3]      car coordinates of the first node, meters
+//     float    boundsMax[3]      car coordinates of the last node
+//     float    referenceSpeed    free stream speed of the data, km/h
+//     float    nodes[][4]        velocity.xyz, Cp; X fastest, then Y, then Z
+//
+// Outside the bounds the nodes on the nearest face are used.
+class FlowField {
+public:
+    FlowField();
+
+    // Sample the analytic wake, upwash and ground effect at the speed and DRS
+    // state of params. timestep converts the model's per-step displacements
+    // into velocities.
+    void bake(const AeroKernelParams& params, float timestep);
+
+    // Read a field file; false (and the field unchanged) if it is missing or malformed
+    bool load(const std::string& path);
+
+    // Copy nodes laid out as in the file, dimensions.x * y * z of them
+    void assign(const glm::ivec3& dimensions, const glm::vec3& boundsMin, const glm::vec3& boundsMax,
+        float referenceSpeed, const glm::vec4* nodes);
+
+    bool isEmpty() const { return m_nodes.empty(); }
+
+    // Velocity (xyz) and Cp (w) at a point in car coordinates
+    glm::vec4 sample(const glm::vec3& position) const;
+
+    const glm::ivec3& dimensions() const { return m_dimensions; }
+    const glm::vec3& boundsMin() const { return m_boundsMin; }
+    const glm::vec3& boundsMax() const { return m_boundsMax; }
+    float referenceSpeed() const { return m_referenceSpeed; }
+    const std::vector<glm::vec4>& nodes() const { return m_nodes; }
+
+    // Changes with every bake or load, and differs between fields
+    unsigned int revision() const { return m_revision; }
+
+private:
+    void allocate(const glm::ivec3& dimensions, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
+    glm::ivec3 m_dimensions;
+    glm::vec3 m_boundsMin;
+    glm::vec3 m_boundsMax;
+    glm::vec3 m_inverseSpacing;   // Nodes per meter along each axis
+    float m_referenceSpeed;
+    std::vector<glm::vec4> m_nodes;
+    unsigned int m_revision;
+};
+
+// Field-driven counterpart of computeAeroDisplacement(): the wake and upwash
+// come from the field's velocity, the ground effect from its pressure. The
+// turbulence and every output are as in the analytic kernel.
+void computeFieldDisplacement(const FlowField& field, const AeroKernelParams& params, float deltaTime,
+    AeroLanes& lanes, int count);
+
+// The same through a streamed CFD dataset
+void computeFieldDisplacement(const FlowFieldBricks& field, const AeroKernelParams& params, float deltaTime,
+    AeroLanes& lanes, int count);
+
+#endif
@@ -0,0 +1,413 @@
+#include "FlowFieldBricks.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+namespace {
+
+const char kMagic[4] = { 'F', '1', 'F', 'B' };
+const uint32_t kVersion = 1;
+const int kMaxBrickCells = 64;
+const int kOverviewNodes = 128;         // Upper limit of overview nodes along each axis
+
+// Dense field files as read by FlowField::load(), described in FlowField.h
+const char kFieldMagic[4] = { 'F', '1', 'F', 'F' };
+const uint32_t kFieldVersion = 1;
+
+struct FieldHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t dimensions[3];
+    float boundsMin[3];
+    float boundsMax[3];
+    float referenceSpeed;
+};
+
+struct Header {
+    char magic[4];                  // "F1FB"
+    uint32_t version;               // kVersion
+    uint32_t nodeDimensions[3];     // Nodes of the full field along X, Y and Z
+    uint32_t brickCells;
+    float boundsMin[3];
+    float boundsMax[3];
+    float referenceSpeed;           // km/h
+    uint32_t overviewDimensions[3];
+    float overviewBoundsMax[3];     // Car coordinates of the last overview node
+};
+
+struct BrickEntry {
+    uint64_t offset;                // Byte offset of the brick's nodes, or 0 for a uniform brick
+    float value[4];                 // Value of a uniform brick
+};
+
+int bricksAlong(int nodes, int brickCells) {
+    return (nodes - 2) / brickCells + 1;
+}
+
+// Interleaves the bits of the brick coordinates, 21 bits each
+uint64_t mortonKey(uint32_t x, uint32_t y, uint32_t z) {
+    uint64_t key = 0;
+    for (int bit = 0; bit < 21; bit++) {
+        key |= static_cast<uint64_t>((x >> bit) & 1u) << (3 * bit);
+        key |= static_cast<uint64_t>((y >> bit) & 1u) << (3 * bit + 1);
+        key |= static_cast<uint64_t>((z >> bit) & 1u) << (3 * bit + 2);
+    }
+    return key;
+}
+
+}
+
+const int FlowFieldBricks::kUniformBrick;
+const int FlowFieldBricks::kMissingBrick;
+
+FlowFieldBricks::FlowFieldBricks()
+    : m_nodeDimensions(0), m_brickDimensions(0), m_brickCells(0), m_brickNodes(0),
+      m_boundsMin(0.0f), m_inverseSpacing(0.0f), m_tableOffset(0), m_residentCount(0), m_clock(1) {
+}
+
+bool FlowFieldBricks::open(const std::string& path, int residentBricks) {
+    close();
+
+    if (!m_file.open(path) || m_file.size() < sizeof(Header)) {
+        std::cerr << "ERROR::FLOW_FIELD_BRICKS::FILE_NOT_READ: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    Header header;
+    std::memcpy(&header, m_file.data(), sizeof(Header));
+    bool valid = std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kVersion &&
+        header.brickCells >= 1 && header.brickCells <= static_cast<uint32_t>(kMaxBrickCells);
+    for (int axis = 0; axis < 3 && valid; axis++) {
+        valid = header.nodeDimensions[axis] >= 2 && header.nodeDimensions[axis] <= (1u << 21) &&
+            header.overviewDimensions[axis] >= 2 &&
+            header.overviewDimensions[axis] <= static_cast<uint32_t>(kOverviewNodes) &&
+            header.boundsMax[axis] > header.boundsMin[axis] &&
+            header.overviewBoundsMax[axis] > header.boundsMin[axis];
+        m_nodeDimensions[axis] = static_cast<int>(header.nodeDimensions[axis]);
+    }
+    if (!valid) {
+        std::cerr << "ERROR::FLOW_FIELD_BRICKS::NOT_A_BRICK_FILE: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    m_brickCells = static_cast<int>(header.brickCells);
+    m_brickNodes = (m_brickCells + 1) * (m_brickCells + 1) * (m_brickCells + 1);
+    m_brickDimensions = glm::ivec3(bricksAlong(m_nodeDimensions.x, m_brickCells),
+        bricksAlong(m_nodeDimensions.y, m_brickCells), bricksAlong(m_nodeDimensions.z, m_brickCells));
+    m_boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+    glm::vec3 boundsMax(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+    m_inverseSpacing = glm::vec3(m_nodeDimensions - 1) / (boundsMax - m_boundsMin);
+
+    glm::ivec3 overviewDimensions(static_cast<int>(header.overviewDimensions[0]),
+        static_cast<int>(header.overviewDimensions[1]), static_cast<int>(header.overviewDimensions[2]));
+    size_t overviewCount = static_cast<size_t>(overviewDimensions.x) * overviewDimensions.y * overviewDimensions.z;
+    size_t brickCount = static_cast<size_t>(m_brickDimensions.x) * m_brickDimensions.y * m_brickDimensions.z;
+    m_tableOffset = sizeof(Header) + overviewCount * sizeof(glm::vec4);
+    size_t dataOffset = m_tableOffset + brickCount * sizeof(BrickEntry);
+    if (m_file.size() < dataOffset) {
+        std::cerr << "ERROR::FLOW_FIELD_BRICKS::TRUNCATED: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    glm::vec3 overviewMax(header.overviewBoundsMax[0], header.overviewBoundsMax[1], header.overviewBoundsMax[2]);
+    m_overview.assign(overviewDimensions, m_boundsMin, overviewMax, header.referenceSpeed,
+        reinterpret_cast<const glm::vec4*>(m_file.data() + sizeof(Header)));
+
+    // Check every stored brick up front, so a page-in never reads past the file
+    size_t brickBytes = static_cast<size_t>(m_brickNodes) * sizeof(glm::vec4);
+    size_t storedCount = 0;
+    m_brickSlot.assign(brickCount, kMissingBrick);
+    for (size_t brick = 0; brick < brickCount; brick++) {
+        BrickEntry entry;
+        std::memcpy(&entry, m_file.data() + m_tableOffset + brick * sizeof(BrickEntry), sizeof(BrickEntry));
+        if (entry.offset == 0) {
+            m_brickSlot[brick] = kUniformBrick;
+            continue;
+        }
+        if (entry.offset < dataOffset || entry.offset > m_file.size() - brickBytes) {
+            std::cerr << "ERROR::FLOW_FIELD_BRICKS::CORRUPT_BRICK: " << brick << " in " << path << std::endl;
+            close();
+            return false;
+        }
+        storedCount++;
+    }
+
+    int slotCount = static_cast<int>(std::min<size_t>(std::max(residentBricks, 1), std::max<size_t>(storedCount, 1)));
+    m_slots.assign(static_cast<size_t>(slotCount) * m_brickNodes, glm::vec4(0.0f));
+    m_slotBrick.assign(slotCount, -1);
+    m_brickStamp.reset(new std::atomic<uint32_t>[brickCount]);
+    for (size_t brick = 0; brick < brickCount; brick++) {
+        m_brickStamp[brick].store(0, std::memory_order_relaxed);
+    }
+    m_residentCount = 0;
+    m_clock = 1;
+    m_requests.clear();
+    m_requests.reserve(kMaxRequests);
+    return true;
+}
+
+void FlowFieldBricks::close() {
+    m_file.close();
+    m_overview = FlowField();
+    m_brickSlot.clear();
+    m_slotBrick.clear();
+    m_slots.clear();
+    m_brickStamp.reset();
+    m_residentCount = 0;
+    m_requests.clear();
+}
+
+int FlowFieldBricks::brickAt(const glm::vec3& grid, glm::vec3& local) const {
+    int brick[3];
+    for (int axis = 0; axis < 3; axis++) {
+        brick[axis] = std::min(static_cast<int>(grid[axis]) / m_brickCells, m_brickDimensions[axis] - 1);
+        local[axis] = grid[axis] - static_cast<float>(brick[axis] * m_brickCells);
+    }
+    return (brick[2] * m_brickDimensions.y + brick[1]) * m_brickDimensions.x + brick[0];
+}
+
+void FlowFieldBricks::touch(int brick) const {
+    // Each brick is claimed once per update, so only one thread ever queues it
+    uint32_t stamp = m_brickStamp[brick].load(std::memory_order_relaxed);
+    if (stamp == m_clock || !m_brickStamp[brick].compare_exchange_strong(stamp, m_clock, std::memory_order_relaxed)) {
+        return;
+    }
+    if (m_brickSlot[brick] == kMissingBrick) {
+        std::lock_guard<std::mutex> lock(m_requestMutex);
+        if (m_requests.size() < static_cast<size_t>(kMaxRequests)) {
+            m_requests.push_back(brick);
+        }
+    }
+}
+
+void FlowFieldBricks::request(const glm::vec3& position) const {
+    if (!isOpen()) {
+        return;
+    }
+    glm::vec3 grid = glm::clamp((position - m_boundsMin) * m_inverseSpacing,
+        glm::vec3(0.0f), glm::vec3(m_nodeDimensions - 1));
+    glm::vec3 local;
+    int brick = brickAt(grid, local);
+    if (m_brickSlot[brick] != kUniformBrick) {
+        touch(brick);
+    }
+}
+
+glm::vec4 FlowFieldBricks::sample(const glm::vec3& position) const {
+    glm::vec3 grid = glm::clamp((position - m_boundsMin) * m_inverseSpacing,
+        glm::vec3(0.0f), glm::vec3(m_nodeDimensions - 1));
+    glm::vec3 local;
+    int brick = brickAt(grid, local);
+
+    int slot = m_brickSlot[brick];
+    if (slot == kUniformBrick) {
+        BrickEntry entry;
+        std::memcpy(&entry, m_file.data() + m_tableOffset + brick * sizeof(BrickEntry), sizeof(BrickEntry));
+        return glm::vec4(entry.value[0], entry.value[1], entry.value[2], entry.value[3]);
+    }
+
+    touch(brick);
+    if (slot == kMissingBrick) {
+        return m_overview.sample(position);
+    }
+
+    // Trilinear within the brick, which holds both faces of its last cells
+    int cellLimit = m_brickCells - 1;
+    int cx = std::min(static_cast<int>(local.x), cellLimit);
+    int cy = std::min(static_cast<int>(local.y), cellLimit);
+    int cz = std::min(static_cast<int>(local.z), cellLimit);
+    glm::vec3 f(local.x - cx, local.y - cy, local.z - cz);
+
+    size_t strideY = static_cast<size_t>(m_brickCells + 1);
+    size_t strideZ = strideY * strideY;
+    const glm::vec4* n = &m_slots[static_cast<size_t>(slot) * m_brickNodes + cz * strideZ + cy * strideY + cx];
+
+    glm::vec4 y0 = glm::mix(glm::mix(n[0], n[1], f.x), glm::mix(n[strideY], n[strideY + 1], f.x), f.y);
+    n += strideZ;
+    glm::vec4 y1 = glm::mix(glm::mix(n[0], n[1], f.x), glm::mix(n[strideY], n[strideY + 1], f.x), f.y);
+    return glm::mix(y0, y1, f.z);
+}
+
+int FlowFieldBricks::update(int budget) {
+    if (!isOpen()) {
+        return 0;
+    }
+
+    int loaded = 0;
+    for (size_t i = 0; i < m_requests.size() && loaded < budget; i++) {
+        if (m_brickSlot[m_requests[i]] == kMissingBrick) {
+            pageIn(m_requests[i]);
+            loaded++;
+        }
+    }
+
+    // Requests past the budget are made again by the next samples that need them
+    m_requests.clear();
+    m_clock++;
+    return loaded;
+}
+
+void FlowFieldBricks::pageIn(int brick) {
+    int slotCount = static_cast<int>(m_slotBrick.size());
+    int slot;
+    if (m_residentCount < slotCount) {
+        slot = m_residentCount++;
+    }
+    else {
+        // Evict the brick sampled longest ago
+        slot = 0;
+        uint32_t oldestAge = 0;
+        for (int candidate = 0; candidate < slotCount; candidate++) {
+            uint32_t age = m_clock - m_brickStamp[m_slotBrick[candidate]].load(std::memory_order_relaxed);
+            if (age > oldestAge) {
+                oldestAge = age;
+                slot = candidate;
+            }
+        }
+        m_brickSlot[m_slotBrick[slot]] = kMissingBrick;
+    }
+
+    BrickEntry entry;
+    std::memcpy(&entry, m_file.data() + m_tableOffset + static_cast<size_t>(brick) * sizeof(BrickEntry), sizeof(BrickEntry));
+    std::memcpy(&m_slots[static_cast<size_t>(slot) * m_brickNodes], m_file.data() + entry.offset,
+        static_cast<size_t>(m_brickNodes) * sizeof(glm::vec4));
+    m_brickSlot[brick] = slot;
+    m_slotBrick[slot] = brick;
+}
+
+bool FlowFieldBricks::convert(const std::string& fieldPath, const std::string& brickPath, int brickCells) {
+    MappedFile input;
+    if (!input.open(fieldPath) || input.size() < sizeof(FieldHeader)) {
+        std::cerr << "ERROR::FLOW_FIELD_BRICKS::FILE_NOT_READ: " << fieldPath << std::endl;
+        return false;
+    }
+
+    FieldHeader field;
+    std::memcpy(&field, input.data(), sizeof(FieldHeader));
+    bool valid = std::memcmp(field.magic, kFieldMagic, sizeof(kFieldMagic)) == 0 && field.version == kFieldVersion &&
+        brickCells >= 1 && brickCells <= kMaxBrickCells;
+    glm::ivec3 nodes(0);
+    for (int axis = 0; axis < 3 && valid; axis++) {
+        valid = field.dimensions[axis] >= 2 && field.dimensions[axis] <= (1u << 21) &&
+            field.boundsMax[axis] > field.boundsMin[axis];
+        nodes[axis] = static_cast<int>(field.dimensions[axis]);
+    }
+    size_t nodeCount = static_cast<size_t>(nodes.x) * nodes.y * nodes.z;
+    if (!valid || (input.size() - sizeof(FieldHeader)) / sizeof(glm::vec4) < nodeCount) {
+        std::cerr << "ERROR::FLOW_FIELD_BRICKS::NOT_A_FIELD: " << fieldPath << std::endl;
+        return false;
+    }
+    const unsigned char* source = input.data() + sizeof(FieldHeader);
+
+    std::ofstream out(brickPath.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "ERROR::FLOW_FIELD_BRICKS::FILE_NOT_WRITTEN: " << brickPath << std::endl;
+        return false;
+    }
+
+    // Overview: every stride-th node, few enough to keep resident and upload as a texture
+    int longest = std::max(nodes.x, std::max(nodes.y, nodes.z));
+    int stride = (longest - 2) / (kOverviewNodes - 1) + 1;
+
+    Header header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.brickCells = static_cast<uint32_t>(brickCells);
+    header.referenceSpeed = field.referenceSpeed;
+    glm::ivec3 bricks;
+    glm::ivec3 overview;
+    for (int axis = 0; axis < 3; axis++) {
+        header.nodeDimensions[axis] = field.dimensions[axis];
+        header.boundsMin[axis] = field.boundsMin[axis];
+        header.boundsMax[axis] = field.boundsMax[axis];
+        overview[axis] = std::max((nodes[axis] - 1) / stride + 1, 2);
+        header.overviewDimensions[axis] = static_cast<uint32_t>(overview[axis]);
+
+        // The last overview node may fall short of the last field node
+        int lastNode = std::min((overview[axis] - 1) * stride, nodes[axis] - 1);
+        header.overviewBoundsMax[axis] = field.boundsMin[axis] +
+            (field.boundsMax[axis] - field.boundsMin[axis]) * lastNode / (nodes[axis] - 1);
+        bricks[axis] = bricksAlong(nodes[axis], brickCells);
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+    size_t rowStride = static_cast<size_t>(nodes.x);
+    size_t planeStride = rowStride * nodes.y;
+    for (int z = 0; z < overview.z; z++) {
+        for (int y = 0; y < overview.y; y++) {
+            for (int x = 0; x < overview.x; x++) {
+                size_t node = std::min(z * stride, nodes.z - 1) * planeStride +
+                    std::min(y * stride, nodes.y - 1) * rowStride + std::min(x * stride, nodes.x - 1);
+                out.write(reinterpret_cast<const char*>(source + node * sizeof(glm::vec4)), sizeof(glm::vec4));
+            }
+        }
+    }
+
+    // Table first, filled in once the bricks are written
+    size_t brickCount = static_cast<size_t>(bricks.x) * bricks.y * bricks.z;
+    std::streamoff tableOffset = out.tellp();
+    std::vector<BrickEntry> table(brickCount);
+    std::memset(table.data(), 0, brickCount * sizeof(BrickEntry));
+    out.write(reinterpret_cast<const char*>(table.data()), static_cast<std::streamsize>(brickCount * sizeof(BrickEntry)));
+
+    // Stored in Z-order of the brick coordinates
+    std::vector<std::pair<uint64_t, size_t> > order(brickCount);
+    for (size_t brick = 0; brick < brickCount; brick++) {
+        order[brick] = std::make_pair(mortonKey(static_cast<uint32_t>(brick % bricks.x),
+            static_cast<uint32_t>(brick / bricks.x % bricks.y), static_cast<uint32_t>(brick / bricks.x / bricks.y)), brick);
+    }
+    std::sort(order.begin(), order.end());
+
+    int edge = brickCells + 1;
+    std::vector<glm::vec4> brickNodes(static_cast<size_t>(edge) * edge * edge);
+    for (size_t i = 0; i < brickCount; i++) {
+        size_t brick = order[i].second;
+        int origin[3] = {
+            static_cast<int>(brick % bricks.x) * brickCells,
+            static_cast<int>(brick / bricks.x % bricks.y) * brickCells,
+            static_cast<int>(brick / bricks.x / bricks.y) * brickCells
+        };
+
+        // Gather the brick a row at a time
+        glm::vec4* target = brickNodes.data();
+        int rowLength = std::min(edge, nodes.x - origin[0]);
+        for (int lz = 0; lz < edge; lz++) {
+            size_t z = std::min(origin[2] + lz, nodes.z - 1);
+            for (int ly = 0; ly < edge; ly++, target += edge) {
+                size_t y = std::min(origin[1] + ly, nodes.y - 1);
+                std::memcpy(target, source + (z * planeStride + y * rowStride + origin[0]) * sizeof(glm::vec4),
+                    rowLength * sizeof(glm::vec4));
+                std::fill(target + rowLength, target + edge, target[rowLength - 1]);
+            }
+        }
+
+        // Uniform bricks need no storage
+        bool uniform = true;
+        for (size_t node = 1; node < brickNodes.size() && uniform; node++) {
+            uniform = std::memcmp(&brickNodes[node], &brickNodes[0], sizeof(glm::vec4)) == 0;
+        }
+        if (uniform) {
+            std::memcpy(table[brick].value, &brickNodes[0], sizeof(table[brick].value));
+            continue;
+        }
+
+        table[brick].offset = static_cast<uint64_t>(out.tellp());
+        out.write(reinterpret_cast<const char*>(brickNodes.data()),
+            static_cast<std::streamsize>(brickNodes.size() * sizeof(glm::vec4)));
+    }
+
+    out.seekp(tableOffset);
+    out.write(reinterpret_cast<const char*>(table.data()), static_cast<std::streamsize>(brickCount * sizeof(BrickEntry)));
+    out.close();
+    if (out.fail()) {
+        std::cerr << "ERROR::FLOW_FIELD_BRICKS::FILE_NOT_WRITTEN: " << brickPath << std::endl;
+        return false;
+    }
+    return true;
+}
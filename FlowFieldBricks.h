@@ -0,0 +1,110 @@
+#ifndef FLOW_FIELD_BRICKS_H
+#define FLOW_FIELD_BRICKS_H
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "FlowField.h"
+#include "MappedFile.h"
+
+// A flow field too large for memory, streamed from a memory-mapped file of
+// bricks. Only bricks that line heads actually sample, or that hold seeds in
+// view, are copied into a fixed pool of resident slots. The least recently
+// sampled brick is evicted to make room. Samples that fall in a brick not
+// yet resident use a coarse overview of the whole field, which always stays
+// in memory and is also what the GPU backend advects through.
+//
+// Layout (".f1bricks"), converted once from a dense field by convert():
+//
+//     Header                 see FlowFieldBricks.cpp
+//     overview nodes         vec4, as in a FlowField file
+//     brick table            one entry per brick, X fastest: file offset of
+//                            its nodes, or 0 and the value of a brick that
+//                            is uniform (free stream away from the car)
+//     brick nodes            (brickCells + 1)^3 vec4 per stored brick, X
+//                            fastest; neighbouring bricks repeat their shared
+//                            face so a brick alone interpolates its cells
+//
+// Stored bricks follow a Z-order curve, so bricks near each other in space
+// are also near each other on disk. A page-in is then one contiguous copy
+// into a slot in the layout sample() reads.
+class FlowFieldBricks {
+public:
+    static const int kDefaultBrickCells = 16;       // Cells along each edge of a brick
+    static const int kDefaultResidentBricks = 512;  // About 40 MB of 16-cell bricks
+
+    FlowFieldBricks();
+
+    // Map a brick file and allocate residentBricks slots; false if it is missing or malformed
+    bool open(const std::string& path, int residentBricks = kDefaultResidentBricks);
+
+    void close();
+
+    bool isOpen() const { return m_file.isOpen(); }
+
+    // Velocity (xyz) and Cp (w) at a point in car coordinates. Safe to call
+    // from several threads at once, but not during update().
+    glm::vec4 sample(const glm::vec3& position) const;
+
+    // Ask for the brick holding a point to be paged in, without sampling it
+    void request(const glm::vec3& position) const;
+
+    // Page in up to budget of the bricks requested since the last call.
+    // Call between steps, while nothing samples. Returns the bricks paged in.
+    int update(int budget);
+
+    // Coarse copy of the whole field
+    const FlowField& overview() const { return m_overview; }
+
+    float referenceSpeed() const { return m_overview.referenceSpeed(); }
+    int brickCount() const { return static_cast<int>(m_brickSlot.size()); }
+    int residentCount() const { return m_residentCount; }
+
+    // Rewrite a dense field file as bricks of brickCells cells, reading it
+    // through a memory map so it never has to fit in memory either
+    static bool convert(const std::string& fieldPath, const std::string& brickPath,
+        int brickCells = kDefaultBrickCells);
+
+private:
+    FlowFieldBricks(const FlowFieldBricks&);
+    FlowFieldBricks& operator=(const FlowFieldBricks&);
+
+    static const int kUniformBrick = -2;    // Brick slot value of a brick with one value throughout
+    static const int kMissingBrick = -1;    // Brick slot value of a brick not resident
+    static const int kMaxRequests = 4096;   // Requests kept between updates; later ones wait
+
+    // Brick holding a node-grid point, and the point relative to that brick
+    int brickAt(const glm::vec3& grid, glm::vec3& local) const;
+
+    // Stamp a brick as used this step; queue it once if it is not resident
+    void touch(int brick) const;
+
+    void pageIn(int brick);
+
+    MappedFile m_file;
+    FlowField m_overview;
+    glm::ivec3 m_nodeDimensions;
+    glm::ivec3 m_brickDimensions;
+    int m_brickCells;
+    int m_brickNodes;                       // (brickCells + 1)^3
+    glm::vec3 m_boundsMin;
+    glm::vec3 m_inverseSpacing;             // Nodes per meter along each axis
+    size_t m_tableOffset;
+
+    // Residency
+    std::vector<int> m_brickSlot;           // Slot of every brick, or kMissingBrick / kUniformBrick
+    std::vector<int> m_slotBrick;           // Brick in every slot, -1 if free
+    std::vector<glm::vec4> m_slots;         // Nodes of every slot, m_brickNodes each
+    std::unique_ptr<std::atomic<uint32_t>[]> m_brickStamp;   // Update count a brick was last used in
+    int m_residentCount;
+    uint32_t m_clock;                       // Counts update() calls
+
+    mutable std::mutex m_requestMutex;      // Guards m_requests
+    mutable std::vector<int> m_requests;    // Missing bricks sampled since the last update()
+};
+
+#endif
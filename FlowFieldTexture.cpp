@@ -0,0 +1,58 @@
+#include "FlowFieldTexture.h"
+#include "FrameProfiler.h"
+
+FlowFieldTexture::FlowFieldTexture()
+    : m_texture(0), m_revision(0) {
+}
+
+void FlowFieldTexture::destroy() {
+    if (m_texture != 0) {
+        glDeleteTextures(1, &m_texture);
+    }
+    m_texture = 0;
+    m_revision = 0;
+}
+
+void FlowFieldTexture::upload(const FlowField& field) {
+    if (m_texture == 0) {
+        glGenTextures(1, &m_texture);
+        glBindTexture(GL_TEXTURE_3D, m_texture);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    }
+    else {
+        glBindTexture(GL_TEXTURE_3D, m_texture);
+    }
+
+    const glm::ivec3& dimensions = field.dimensions();
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA32F, dimensions.x, dimensions.y, dimensions.z, 0,
+        GL_RGBA, GL_FLOAT, field.nodes().data());
+    glBindTexture(GL_TEXTURE_3D, 0);
+    m_revision = field.revision();
+
+    FrameProfiler::instance().addUploadedBytes(field.nodes().size() * sizeof(glm::vec4));
+}
+
+void FlowFieldTexture::bind(const FlowField& field, int unit) {
+    if (field.revision() != m_revision) {
+        upload(field);
+    }
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_3D, m_texture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+glm::vec3 FlowFieldTexture::coordinateScale(const FlowField& field) {
+    glm::vec3 dimensions(field.dimensions());
+    glm::vec3 nodesPerMeter = (dimensions - 1.0f) / (field.boundsMax() - field.boundsMin());
+    return nodesPerMeter / dimensions;
+}
+
+glm::vec3 FlowFieldTexture::coordinateOffset(const FlowField& field) {
+    glm::vec3 dimensions(field.dimensions());
+    glm::vec3 nodesPerMeter = (dimensions - 1.0f) / (field.boundsMax() - field.boundsMin());
+    return (0.5f - field.boundsMin() * nodesPerMeter) / dimensions;
+}
@@ -0,0 +1,33 @@
+#ifndef FLOW_FIELD_TEXTURE_H
+#define FLOW_FIELD_TEXTURE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "FlowField.h"
+
+// A FlowField as an RGBA32F 3D texture for the advection shaders. Texel
+// centers sit on the nodes, so linear filtering interpolates like
+// FlowField::sample() and clamping to the edge repeats the outer faces.
+// The texture is uploaded again only when the field's revision changes.
+class FlowFieldTexture {
+public:
+    FlowFieldTexture();
+
+    // Release the texture
+    void destroy();
+
+    // Upload the field if it changed and bind it to texture unit GL_TEXTURE0 + unit
+    void bind(const FlowField& field, int unit);
+
+    // Car coordinates to texture coordinates: position * scale + offset
+    static glm::vec3 coordinateScale(const FlowField& field);
+    static glm::vec3 coordinateOffset(const FlowField& field);
+
+private:
+    void upload(const FlowField& field);
+
+    GLuint m_texture;
+    unsigned int m_revision;    // FlowField::revision() of the contents, 0 before the first upload
+};
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef FLOW_INTEGRATOR_H
+#define FLOW_INTEGRATOR_H
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include "AeroKernel.h"
+
+// How line heads are moved through the flow each step
+enum class FlowIntegrator {
+    Euler,  // One kernel evaluation and one trail point per step
+    RK4,    // Classic fourth order Runge-Kutta over the whole step
+    RK45    // Cash-Karp pair, substeps sized to an error tolerance per line
+};
+
+inline const char* integratorName(FlowIntegrator integrator) {
+    switch (integrator) {
+    case FlowIntegrator::RK4:
+        return "RK4";
+    case FlowIntegrator::RK45:
+        return "RK45";
+    default:
+        return "Euler";
+    }
+}
+
+// Higher-order integration of a batch of line heads through the aerodynamics
+// kernels. Any kernel works: it is treated as the velocity field that moves a
+// head by its displacement over one step, and evaluated again at the
+// intermediate positions. The turbulence of a step is the same at every
+// stage, so it drifts a head as in the Euler step and adds no error.
+//
+// evaluate(lanes) fills the displacements of lanes.head*; emit(lane, position)
+// is called with every accepted head position in order. Pressure is left as
+// the first evaluation set it, as after an Euler step.
+namespace FlowIntegration {
+
+static const int kMaxSubsteps = 16;                 // Shortest RK45 substep is 1/16 of a step
+static constexpr float kTolerance = 0.0005f;        // Meters of estimated error per RK45 substep
+
+struct Stage {
+    glm::vec3 k[kAeroLanes];    // Displacement over a whole step from the stage position
+};
+
+template <class Evaluate>
+void evaluateStage(AeroLanes& lanes, int count, const glm::vec3* positions, const float* pressure,
+    Evaluate& evaluate, Stage& stage) {
+    for (int lane = 0; lane < count; lane++) {
+        lanes.headX[lane] = positions[lane].x;
+        lanes.headY[lane] = positions[lane].y;
+        lanes.headZ[lane] = positions[lane].z;
+        lanes.pressure[lane] = pressure[lane];
+    }
+    evaluate(lanes);
+    for (int lane = 0; lane < count; lane++) {
+        stage.k[lane] = glm::vec3(lanes.displacementX[lane], lanes.displacementY[lane], lanes.displacementZ[lane]);
+    }
+}
+
+template <class Evaluate, class Emit>
+void integrateRK4(AeroLanes& lanes, int count, Evaluate evaluate, Emit emit) {
+    glm::vec3 start[kAeroLanes];
+    glm::vec3 positions[kAeroLanes];
+    float pressure[kAeroLanes];
+    float firstPressure[kAeroLanes];
+    for (int lane = 0; lane < count; lane++) {
+        start[lane] = glm::vec3(lanes.headX[lane], lanes.headY[lane], lanes.headZ[lane]);
+        pressure[lane] = lanes.pressure[lane];
+    }
+
+    Stage k1, k2, k3, k4;
+    evaluateStage(lanes, count, start, pressure, evaluate, k1);
+    std::copy(lanes.pressure, lanes.pressure + count, firstPressure);
+    for (int lane = 0; lane < count; lane++) {
+        positions[lane] = start[lane] + 0.5f * k1.k[lane];
+    }
+    evaluateStage(lanes, count, positions, pressure, evaluate, k2);
+    for (int lane = 0; lane < count; lane++) {
+        positions[lane] = start[lane] + 0.5f * k2.k[lane];
+    }
+    evaluateStage(lanes, count, positions, pressure, evaluate, k3);
+    for (int lane = 0; lane < count; lane++) {
+        positions[lane] = start[lane] + k3.k[lane];
+    }
+    evaluateStage(lanes, count, positions, pressure, evaluate, k4);
+
+    std::copy(firstPressure, firstPressure + count, lanes.pressure);
+    for (int lane = 0; lane < count; lane++) {
+        emit(lane, start[lane] + (k1.k[lane] + 2.0f * (k2.k[lane] + k3.k[lane]) + k4.k[lane]) / 6.0f);
+    }
+}
+
+template <class Evaluate, class Emit>
+void integrateRK45(AeroLanes& lanes, int count, Evaluate evaluate, Emit emit) {
+    // Cash-Karp tableau; b5 is the fifth order solution, b4 the embedded fourth order one
+    static const float a[6][5] = {
+        { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+        { 1.0f / 5.0f, 0.0f, 0.0f, 0.0f, 0.0f },
+        { 3.0f / 40.0f, 9.0f / 40.0f, 0.0f, 0.0f, 0.0f },
+        { 3.0f / 10.0f, -9.0f / 10.0f, 6.0f / 5.0f, 0.0f, 0.0f },
+        { -11.0f / 54.0f, 5.0f / 2.0f, -70.0f / 27.0f, 35.0f / 27.0f, 0.0f },
+        { 1631.0f / 55296.0f, 175.0f / 512.0f, 575.0f / 13824.0f, 44275.0f / 110592.0f, 253.0f / 4096.0f }
+    };
+    static const float b5[6] = { 37.0f / 378.0f, 0.0f, 250.0f / 621.0f, 125.0f / 594.0f, 0.0f, 512.0f / 1771.0f };
+    static const float b4[6] = { 2825.0f / 27648.0f, 0.0f, 18575.0f / 48384.0f, 13525.0f / 55296.0f,
+        277.0f / 14336.0f, 1.0f / 4.0f };
+    const float minSubstep = 1.0f / kMaxSubsteps;
+
+    glm::vec3 current[kAeroLanes];
+    glm::vec3 positions[kAeroLanes];
+    float pressure[kAeroLanes];
+    float firstPressure[kAeroLanes];
+    float remaining[kAeroLanes];    // Fraction of the step still to go; 0 once a lane is done
+    float substep[kAeroLanes];      // Fraction of the step the next attempt covers
+    for (int lane = 0; lane < count; lane++) {
+        current[lane] = glm::vec3(lanes.headX[lane], lanes.headY[lane], lanes.headZ[lane]);
+        pressure[lane] = lanes.pressure[lane];
+        remaining[lane] = 1.0f;
+        substep[lane] = 1.0f;
+    }
+
+    // Every attempt evaluates the whole batch; finished lanes just repeat their position
+    Stage stages[6];
+    bool first = true;
+    const int lastAttempt = 2 * kMaxSubsteps - 1;
+    for (int attempt = 0; attempt <= lastAttempt; attempt++) {
+        bool active = false;
+        for (int lane = 0; lane < count; lane++) {
+            active = active || remaining[lane] > 0.0f;
+
+            // Out of attempts: whatever is left goes in one substep
+            if (attempt == lastAttempt) {
+                substep[lane] = remaining[lane];
+            }
+        }
+        if (!active) {
+            break;
+        }
+
+        for (int s = 0; s < 6; s++) {
+            for (int lane = 0; lane < count; lane++) {
+                glm::vec3 offset(0.0f);
+                for (int j = 0; j < s; j++) {
+                    offset += a[s][j] * stages[j].k[lane];
+                }
+                positions[lane] = current[lane] + substep[lane] * offset;
+            }
+            evaluateStage(lanes, count, positions, pressure, evaluate, stages[s]);
+            if (first && s == 0) {
+                std::copy(lanes.pressure, lanes.pressure + count, firstPressure);
+                first = false;
+            }
+        }
+
+        for (int lane = 0; lane < count; lane++) {
+            if (remaining[lane] <= 0.0f) {
+                continue;
+            }
+            glm::vec3 fifth(0.0f);
+            glm::vec3 fourth(0.0f);
+            for (int s = 0; s < 6; s++) {
+                fifth += b5[s] * stages[s].k[lane];
+                fourth += b4[s] * stages[s].k[lane];
+            }
+            float h = substep[lane];
+            float error = h * glm::length(fifth - fourth);
+
+            // The shortest substeps are taken whatever their error
+            bool lastChance = h <= minSubstep || attempt == lastAttempt;
+            if (error <= kTolerance || lastChance) {
+                current[lane] += h * fifth;
+                remaining[lane] = std::max(remaining[lane] - h, 0.0f);
+                if (remaining[lane] < 1e-4f) {
+                    remaining[lane] = 0.0f;
+                }
+                emit(lane, current[lane]);
+            }
+
+            // Usual step size control for a fifth order error, within a factor of five either way
+            float factor = error > 0.0f ? 0.9f * std::pow(kTolerance / error, 0.2f) : 5.0f;
+            float next = h * std::min(std::max(factor, 0.2f), 5.0f);
+            substep[lane] = std::min(std::max(next, minSubstep), std::max(remaining[lane], minSubstep));
+            if (remaining[lane] > 0.0f && remaining[lane] < substep[lane]) {
+                substep[lane] = remaining[lane];
+            }
+        }
+    }
+
+    std::copy(firstPressure, firstPressure + count, lanes.pressure);
+}
+
+}
+
+#endif
@@ -0,0 +1,293 @@
+#ifndef FLOW_LINE_POOL_H
+#define FLOW_LINE_POOL_H
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Per-line emission parameters; read when a line is seeded or reset
+struct FlowLine {
+    float initialLife;               // Initial life value
+    glm::vec3 initialPosition;       // Initial starting position
+    glm::vec3 direction;             // Main flow direction
+    float velocity;                  // Velocity magnitude
+    glm::vec3 initialOffset;         // Initial offset from car's reference position
+    float vortexStrength;            // Strength of the vortex rotation (if isVortex is true)
+    int vortexSource;                // Vortex center the line was emitted from (vortex lines)
+    int vortexIndex;                 // Index of the line among those of its center
+    bool seededWithDRS;              // DRS state the DRS-dependent parameters were drawn for
+};
+
+// Everything the line shaders color a line by, packed in 8 bytes as they
+// read it (GL_RGBA16UI). Points take the color of their line, faded by the
+// life the line had left when they were emitted, which each FlowPointCode
+// carries, so colors follow the current pressure and coloring mode instead
+// of being stored per point.
+struct FlowLineShade {
+    static constexpr float kLifeScale = 1000.0f;        // Life units per second
+    static constexpr float kBrightnessLevels = 31.0f;   // 5-bit brightness from 0.5 to 1.5
+
+    uint16_t head;              // Ring slot of the newest point
+    uint16_t life;              // Remaining life, in 1/kLifeScale seconds
+    uint16_t initialLife;
+    uint16_t style;             // pressure (8 bits) | zone (3 bits) << 8 | brightness (5 bits) << 11
+};
+
+// A trail point as the line buffers store it: 16-bit fixed point meters from
+// an origin near the car, and the line's life when the point was emitted in
+// FlowLineShade life units, 8 bytes in all. The vertex shaders multiply by
+// kStep and the model matrix adds the origin back. Points stay within a few
+// car lengths of the car, and the origin snaps to a kOriginSpacing grid, so it
+// only moves, and the buffers only have to be rewritten, every 16 m of travel.
+struct FlowPointCode {
+    static constexpr float kRange = 64.0f;              // Meters either side of the origin
+    static constexpr float kStep = kRange / 32767.0f;   // Meters per unit, about 2 mm
+    static constexpr float kOriginSpacing = 16.0f;
+
+    int16_t position[4];        // xyz, and in w the bits of the unsigned emission life
+
+    // Runs for every point uploaded, so it rounds without branches or std::round:
+    // shifted to be positive, truncation rounds down
+    static FlowPointCode encode(const glm::vec3& point, float originZ, uint16_t emissionLife) {
+        FlowPointCode code;
+        code.position[0] = quantize(point.x);
+        code.position[1] = quantize(point.y);
+        code.position[2] = quantize(point.z - originZ);
+        code.position[3] = static_cast<int16_t>(emissionLife);
+        return code;
+    }
+
+    static int16_t quantize(float meters) {
+        float units = std::min(std::max(meters * (1.0f / kStep), -32767.0f), 32767.0f);
+        return static_cast<int16_t>(static_cast<int>(units + 32767.5f) - 32767);
+    }
+
+    glm::vec3 decode(float originZ) const {
+        return glm::vec3(position[0], position[1], position[2]) * kStep + glm::vec3(0.0f, 0.0f, originZ);
+    }
+
+    uint16_t emissionLife() const {
+        return static_cast<uint16_t>(position[3]);
+    }
+
+    // Origin for points around the car at Z position carZ
+    static float originNear(float carZ) {
+        return kOriginSpacing * std::round(carZ / kOriginSpacing);
+    }
+};
+
+// Structure-of-arrays storage for every flow line, allocated once.
+// Line i owns ring slots [i * slotSize, (i + 1) * slotSize) of the shared
+// position array: maxPoints slots plus one mirror of the first slot.
+struct FlowLinePool {
+    // Hot per-line state, touched every frame
+    std::vector<float> life;             // Remaining life of each line
+    std::vector<float> speed;            // Speed of flow line progression
+    std::vector<float> pressure;         // Pressure value for coloring, 0 to 1
+    std::vector<int> zoneType;           // The emission zone each line came from
+    std::vector<unsigned char> isVortex; // Non-zero for vortex flow lines
+    std::vector<float> vortexPhase;      // Phase of the vortex rotation
+    std::vector<int> head;               // Ring slot (within the line) of the newest point
+    std::vector<int> pointCount;         // Number of valid points in each ring
+    std::vector<unsigned int> writeSerial; // Bumped once per point written, for partial uploads
+    std::vector<unsigned int> pushSerial;  // Bumped once per point added; replaceFront() leaves it
+
+    // Cold per-line parameters
+    std::vector<FlowLine> params;
+
+    // Shared point storage for all lines
+    std::vector<glm::vec3> positions;
+    std::vector<uint16_t> emissionLife;  // Line life when each point was emitted or last moved, in FlowLineShade units
+
+    int maxPoints = 0;                   // Maximum number of points in a line
+    int slotSize = 0;                    // Ring slots per line (maxPoints + mirror)
+
+    // Size every array for the given number of lines; nothing is allocated afterwards
+    void allocate(int numLines, int pointsPerLine) {
+        maxPoints = pointsPerLine;
+        slotSize = pointsPerLine + 1;
+
+        life.assign(numLines, 0.0f);
+        speed.assign(numLines, 0.0f);
+        pressure.assign(numLines, 0.0f);
+        zoneType.assign(numLines, 0);
+        isVortex.assign(numLines, 0);
+        vortexPhase.assign(numLines, 0.0f);
+        head.assign(numLines, 0);
+        pointCount.assign(numLines, 0);
+        writeSerial.assign(numLines, 0);
+        pushSerial.assign(numLines, 0);
+        params.assign(numLines, FlowLine());
+
+        positions.assign(static_cast<size_t>(numLines) * slotSize, glm::vec3(0.0f));
+        emissionLife.assign(static_cast<size_t>(numLines) * slotSize, 0);
+    }
+
+    // First ring slot of a line in the shared arrays
+    size_t slotOffset(int line) const {
+        return static_cast<size_t>(line) * slotSize;
+    }
+
+    // Drop all points of a line without touching the storage
+    void clearPoints(int line) {
+        head[line] = 0;
+        pointCount[line] = 0;
+    }
+
+    // Newest point of a line
+    const glm::vec3& front(int line) const {
+        return positions[slotOffset(line) + head[line]];
+    }
+
+    // k-th newest point of a line, k < pointCount
+    const glm::vec3& point(int line, int k) const {
+        return positions[slotOffset(line) + (head[line] + k) % maxPoints];
+    }
+
+    // Move the newest point instead of adding one; it takes the line's current life
+    void replaceFront(int line, const glm::vec3& point) {
+        size_t base = slotOffset(line);
+        int slot = head[line];
+        uint16_t pointLife = lifeUnits(life[line]);
+        positions[base + slot] = point;
+        emissionLife[base + slot] = pointLife;
+        if (slot == 0) {
+            positions[base + maxPoints] = point;
+            emissionLife[base + maxPoints] = pointLife;
+        }
+        writeSerial[line]++;
+    }
+
+    // Add a new head point emitted at the line's current life; once the ring
+    // is full this overwrites the tail
+    void pushFront(int line, const glm::vec3& point) {
+        pushFront(line, point, lifeUnits(life[line]));
+    }
+
+    // Add a new head point emitted with pointLife left, e.g. one read back
+    void pushFront(int line, const glm::vec3& point, uint16_t pointLife) {
+        // Newer points live at lower slots so head-to-tail reads forward through memory
+        int slot = (head[line] == 0) ? maxPoints - 1 : head[line] - 1;
+        head[line] = slot;
+
+        size_t base = slotOffset(line);
+        positions[base + slot] = point;
+        emissionLife[base + slot] = pointLife;
+
+        // Mirror slot 0 past the end so a wrapped line still draws as two connected strips
+        if (slot == 0) {
+            positions[base + maxPoints] = point;
+            emissionLife[base + maxPoints] = pointLife;
+        }
+
+        if (pointCount[line] < maxPoints) {
+            pointCount[line]++;
+        }
+        writeSerial[line]++;
+        pushSerial[line]++;
+    }
+
+    // Copy the count newest points of a line from a pool of the same layout,
+    // mirror slot included, e.g. to bring a copy up to date with its writes
+    void copyNewest(const FlowLinePool& from, int line, int count) {
+        size_t base = slotOffset(line);
+        int first = from.head[line];
+        int end = first + count;
+
+        // The newest points run forward from the head, wrapping into slot 0
+        if (end <= maxPoints) {
+            copySlots(from, base + first, base + end);
+            if (first == 0) {
+                copySlots(from, base + maxPoints, base + maxPoints + 1);
+            }
+        }
+        else {
+            copySlots(from, base + first, base + maxPoints + 1);
+            copySlots(from, base, base + (end - maxPoints));
+        }
+    }
+
+    // Copy the points in slots [first, last) of the shared arrays from another pool
+    void copySlots(const FlowLinePool& from, size_t first, size_t last) {
+        std::copy(from.positions.begin() + first, from.positions.begin() + last, positions.begin() + first);
+        std::copy(from.emissionLife.begin() + first, from.emissionLife.begin() + last, emissionLife.begin() + first);
+    }
+
+    // Coloring inputs of a line, as the line shaders read them
+    FlowLineShade shade(int line) const {
+        float brightness = glm::clamp(params[line].velocity / 10.0f, 0.5f, 1.5f);
+        int pressureLevel = static_cast<int>(glm::clamp(pressure[line], 0.0f, 1.0f) * 255.0f + 0.5f);
+        int brightnessLevel = static_cast<int>((brightness - 0.5f) * FlowLineShade::kBrightnessLevels + 0.5f);
+
+        FlowLineShade result;
+        result.head = static_cast<uint16_t>(head[line]);
+        result.life = lifeUnits(life[line]);
+        result.initialLife = lifeUnits(params[line].initialLife);
+        result.style = static_cast<uint16_t>(pressureLevel | (glm::clamp(zoneType[line], 0, 7) << 8) | (brightnessLevel << 11));
+        return result;
+    }
+
+    // Set the coloring inputs of a line from a shade, e.g. one played back
+    // from a recording; shade(line) then returns it unchanged
+    void setShade(int line, const FlowLineShade& value) {
+        life[line] = value.life / FlowLineShade::kLifeScale;
+        params[line].initialLife = value.initialLife / FlowLineShade::kLifeScale;
+        pressure[line] = (value.style & 0xff) / 255.0f;
+        zoneType[line] = (value.style >> 8) & 7;
+        params[line].velocity = 10.0f * (0.5f + (value.style >> 11) / FlowLineShade::kBrightnessLevels);
+    }
+
+    static uint16_t lifeUnits(float seconds) {
+        return static_cast<uint16_t>(glm::clamp(seconds * FlowLineShade::kLifeScale + 0.5f, 0.0f, 65535.0f));
+    }
+
+    // Flag every point of a line as rewritten (e.g. after moving it to another slot)
+    void markAllPointsWritten(int line) {
+        writeSerial[line] += maxPoints;
+        pushSerial[line] += maxPoints;
+    }
+
+    // Copy line `from`, trail included, over line `to`. The destination keeps
+    // its own serials and is flagged fully rewritten so uploads catch up.
+    void moveLine(int from, int to) {
+        life[to] = life[from];
+        speed[to] = speed[from];
+        pressure[to] = pressure[from];
+        zoneType[to] = zoneType[from];
+        isVortex[to] = isVortex[from];
+        vortexPhase[to] = vortexPhase[from];
+        head[to] = head[from];
+        pointCount[to] = pointCount[from];
+        params[to] = params[from];
+
+        std::copy(positions.begin() + slotOffset(from), positions.begin() + slotOffset(from) + slotSize,
+            positions.begin() + slotOffset(to));
+        std::copy(emissionLife.begin() + slotOffset(from), emissionLife.begin() + slotOffset(from) + slotSize,
+            emissionLife.begin() + slotOffset(to));
+        markAllPointsWritten(to);
+    }
+
+    // Exchange two lines, trails included; both are flagged fully rewritten
+    void swapLines(int a, int b) {
+        std::swap(life[a], life[b]);
+        std::swap(speed[a], speed[b]);
+        std::swap(pressure[a], pressure[b]);
+        std::swap(zoneType[a], zoneType[b]);
+        std::swap(isVortex[a], isVortex[b]);
+        std::swap(vortexPhase[a], vortexPhase[b]);
+        std::swap(head[a], head[b]);
+        std::swap(pointCount[a], pointCount[b]);
+        std::swap(params[a], params[b]);
+
+        std::swap_ranges(positions.begin() + slotOffset(a), positions.begin() + slotOffset(a) + slotSize,
+            positions.begin() + slotOffset(b));
+        std::swap_ranges(emissionLife.begin() + slotOffset(a), emissionLife.begin() + slotOffset(a) + slotSize,
+            emissionLife.begin() + slotOffset(b));
+        markAllPointsWritten(a);
+        markAllPointsWritten(b);
+    }
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef FLOW_RANDOM_H
+#define FLOW_RANDOM_H
+
+#include <cstdint>
+
+// Counter-based random numbers for the flow simulation.
+// Every value is a pure function of (seed, line, frame, draw index), so lines
+// can be advanced in any order, on any thread or on the GPU, and a seed always
+// replays the same flow. The mixing only uses 32-bit multiplies, xors and
+// shifts, which vectorize directly and match flow_advect_vertex.glsl bit for bit.
+class FlowRandom {
+public:
+    // Stream of one line for one frame
+    FlowRandom(uint32_t seed, uint32_t line, uint32_t frame)
+        : m_key(lineKey(seed, line, frame)), m_draw(0) {}
+
+    // Key of this stream, for callers that draw in batches
+    uint32_t key() const { return m_key; }
+
+    // Next value of the stream in [min, max)
+    float uniform(float min, float max) {
+        return min + (max - min) * toUnit(bits(m_key, m_draw++));
+    }
+
+    // Integer finalizer (lowbias32)
+    static uint32_t hash(uint32_t x) {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    // Key of the stream of one line for one frame
+    static uint32_t lineKey(uint32_t seed, uint32_t line, uint32_t frame) {
+        return hash(hash(seed + line * 0x9e3779b9u + 0x6a09e667u) ^ (frame * 0x85ebca6bu));
+    }
+
+    // Raw bits of draw number `draw` of a stream
+    static uint32_t bits(uint32_t key, uint32_t draw) {
+        return hash(key + (draw + 1u) * 0x632be5abu);
+    }
+
+    // Top 24 bits as a float in [0, 1)
+    static float toUnit(uint32_t value) {
+        return static_cast<float>(value >> 8) * (1.0f / 16777216.0f);
+    }
+
+private:
+    uint32_t m_key;
+    uint32_t m_draw;
+};
+
+#endif
@@ -0,0 +1,541 @@
+#include "FlowRecording.h"
+#include "FrameProfiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+const char kMagic[4] = { 'F', '1', 'F', 'R' };
+const uint32_t kVersion = 4;
+const float kPositionScale = 1024.0f;      // Quantization steps per meter
+const unsigned int kFramesPerChunk = 120;  // Frames from one keyframe to the next
+
+struct Header {
+    char magic[4];            // "F1FR"
+    uint32_t version;         // kVersion
+    uint32_t lineCapacity;    // Line slots of the recorded pool
+    uint32_t pointsPerLine;
+};
+
+struct ChunkHeader {
+    uint32_t firstFrame;
+    uint32_t frameCount;
+    uint32_t byteSize;        // Frame data following this header
+};
+
+// Frame: varint step, varint lineCount, varint normalLineCount, float car
+// position, car-relative byte, then per line a varint tag (new points << 3 |
+// head rewritten << 2 | new initial life << 1 | explicit layout), the head
+// and point count as varints if the layout is explicit, the shade's life and
+// style as varints, its initial life as a varint if flagged, and the points
+// sent oldest first as three zigzag varint deltas and the zigzag varint
+// emission life over the shade's life: the new points, preceded by the
+// previous head if it was rewritten.
+
+void putVarint(std::vector<unsigned char>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+void putSigned(std::vector<unsigned char>& out, int32_t value) {
+    putVarint(out, (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31));
+}
+
+void putFloat(std::vector<unsigned char>& out, float value) {
+    unsigned char bytes[sizeof(float)];
+    std::memcpy(bytes, &value, sizeof(float));
+    out.insert(out.end(), bytes, bytes + sizeof(float));
+}
+
+// Bounds-checked reads from the mapped file; any overrun clears ok
+struct ByteReader {
+    const unsigned char* cursor;
+    const unsigned char* end;
+    bool ok;
+
+    uint32_t varint() {
+        uint32_t value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            if (cursor == end) {
+                ok = false;
+                return 0;
+            }
+            unsigned char byte = *cursor++;
+            value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+
+    int32_t signedVarint() {
+        uint32_t value = varint();
+        return static_cast<int32_t>((value >> 1) ^ (0u - (value & 1)));
+    }
+
+    float real() {
+        float value = 0.0f;
+        if (end - cursor < static_cast<ptrdiff_t>(sizeof(float))) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, cursor, sizeof(float));
+        cursor += sizeof(float);
+        return value;
+    }
+
+    unsigned char byte() {
+        if (cursor == end) {
+            ok = false;
+            return 0;
+        }
+        return *cursor++;
+    }
+};
+
+int32_t quantize(float value) {
+    return static_cast<int32_t>(std::lround(value * kPositionScale));
+}
+
+// Ring slot of a line's k-th newest point
+int ringSlot(int head, int k, int maxPoints) {
+    return (head + k) % maxPoints;
+}
+
+}
+
+FlowRecorder::FlowRecorder()
+    : m_pointsPerLine(0), m_frameCount(0), m_chunkFirstFrame(0), m_chunkFrameCount(0) {
+}
+
+FlowRecorder::~FlowRecorder() {
+    close();
+}
+
+bool FlowRecorder::open(const std::string& path, int lineCapacity, int pointsPerLine) {
+    close();
+
+    m_file.open(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!m_file) {
+        std::cerr << "ERROR::FLOW_RECORDING::FILE_NOT_WRITTEN: " << path << std::endl;
+        m_file.close();
+        return false;
+    }
+
+    Header header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.lineCapacity = static_cast<uint32_t>(lineCapacity);
+    header.pointsPerLine = static_cast<uint32_t>(pointsPerLine);
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+
+    m_path = path;
+    m_pointsPerLine = pointsPerLine;
+    m_frameCount = 0;
+    m_chunkFirstFrame = 0;
+    m_chunkFrameCount = 0;
+    m_chunk.clear();
+    m_recordedSerial.assign(lineCapacity, 0);
+    m_recordedPushSerial.assign(lineCapacity, 0);
+    m_recordedHead.assign(lineCapacity, 0);
+    m_recordedCount.assign(lineCapacity, 0);
+    m_quantized.assign(static_cast<size_t>(lineCapacity) * pointsPerLine * 3, 0);
+    m_recordedInitialLife.assign(lineCapacity, -1);
+    return true;
+}
+
+void FlowRecorder::close() {
+    if (!m_file.is_open()) {
+        return;
+    }
+    flushChunk();
+    m_file.close();
+    if (m_file.fail()) {
+        std::cerr << "ERROR::FLOW_RECORDING::FILE_NOT_WRITTEN: " << m_path << std::endl;
+    }
+}
+
+void FlowRecorder::recordFrame(const FlowLinePool& pool, int lineCount, int normalLineCount,
+    unsigned int step, float carPosition, float frameOrigin, bool carRelative) {
+    if (!m_file.is_open()) {
+        return;
+    }
+    ProfileScope scope("recordFrame");
+
+    const int maxPoints = m_pointsPerLine;
+    lineCount = std::min(lineCount, static_cast<int>(m_recordedSerial.size()));
+
+    // A keyframe starts the replay from empty rings, lines beyond lineCount included
+    bool keyframe = (m_chunkFrameCount == 0);
+    if (keyframe) {
+        for (size_t line = 0; line < m_recordedSerial.size(); line++) {
+            m_recordedSerial[line] = pool.writeSerial[line] - static_cast<unsigned int>(maxPoints);
+            m_recordedPushSerial[line] = pool.pushSerial[line] - static_cast<unsigned int>(maxPoints);
+            m_recordedHead[line] = 0;
+            m_recordedCount[line] = 0;
+            m_recordedInitialLife[line] = -1;
+        }
+    }
+
+    putVarint(m_chunk, step);
+    putVarint(m_chunk, static_cast<uint32_t>(lineCount));
+    putVarint(m_chunk, static_cast<uint32_t>(normalLineCount));
+    putFloat(m_chunk, carPosition);
+    m_chunk.push_back(carRelative ? 1 : 0);
+
+    // Points are recorded in car or world coordinates, whatever their flow frame
+    float originZ = (carRelative ? carPosition : 0.0f) - frameOrigin;
+    for (int line = 0; line < lineCount; line++) {
+        int head = pool.head[line];
+        int count = pool.pointCount[line];
+        size_t base = pool.slotOffset(line);
+        int32_t* mirror = &m_quantized[static_cast<size_t>(line) * maxPoints * 3];
+        FlowLineShade shade = pool.shade(line);
+        bool newInitialLife = (shade.initialLife != m_recordedInitialLife[line]);
+
+        // Lines moved to another slot are flagged as fully rewritten; the remainder
+        // of the serial still counts the new points, and the check below the rest
+        unsigned int pending = pool.pushSerial[line] - m_recordedPushSerial[line];
+        unsigned int pushes = (pending >= static_cast<unsigned int>(maxPoints)) ? pending % maxPoints : pending;
+        int newPoints = static_cast<int>(std::min<unsigned int>(pushes, static_cast<unsigned int>(count)));
+
+        // Writes that were not pushes moved the head in place. Only the head
+        // the replay holds can be stale: later moves hit points sent anyway.
+        bool headRewritten = (pool.writeSerial[line] - m_recordedSerial[line]) != pending;
+        int sentPoints = newPoints + (headRewritten ? 1 : 0);
+
+        // Plain pushes move the head back and grow the ring; anything else is spelled out
+        int derivedHead = ((m_recordedHead[line] - newPoints) % maxPoints + maxPoints) % maxPoints;
+        int derivedCount = std::min(m_recordedCount[line] + newPoints, maxPoints);
+        bool explicitLayout = (head != derivedHead || count != derivedCount);
+
+        // The older points must still match what the replay holds, give or
+        // take float rounding; otherwise the line is sent in full
+        bool incremental = !explicitLayout && sentPoints < count;
+        for (int k = sentPoints; k < count && incremental; k++) {
+            int slot = ringSlot(head, k, maxPoints);
+            const glm::vec3& position = pool.positions[base + slot];
+            int32_t value[3] = { quantize(position.x), quantize(position.y), quantize(position.z - originZ) };
+            for (int axis = 0; axis < 3; axis++) {
+                if (std::abs(value[axis] - mirror[slot * 3 + axis]) > 1) {
+                    incremental = false;
+                }
+            }
+        }
+        if (!incremental) {
+            if (newPoints < count) {
+                newPoints = count;
+                derivedHead = ((m_recordedHead[line] - newPoints) % maxPoints + maxPoints) % maxPoints;
+                derivedCount = std::min(m_recordedCount[line] + newPoints, maxPoints);
+                explicitLayout = (head != derivedHead || count != derivedCount);
+            }
+            headRewritten = false;
+            sentPoints = newPoints;
+        }
+
+        putVarint(m_chunk, (static_cast<uint32_t>(newPoints) << 3) | (headRewritten ? 4u : 0u) |
+            (newInitialLife ? 2u : 0u) | (explicitLayout ? 1u : 0u));
+        if (explicitLayout) {
+            putVarint(m_chunk, static_cast<uint32_t>(head));
+            putVarint(m_chunk, static_cast<uint32_t>(count));
+        }
+        putVarint(m_chunk, shade.life);
+        putVarint(m_chunk, shade.style);
+        if (newInitialLife) {
+            putVarint(m_chunk, shade.initialLife);
+            m_recordedInitialLife[line] = shade.initialLife;
+        }
+
+        // Deltas run from the previous head, if the replay has it, to the newest point
+        int32_t previous[3] = { 0, 0, 0 };
+        if (incremental) {
+            int32_t* reference = &mirror[ringSlot(head, sentPoints, maxPoints) * 3];
+            previous[0] = reference[0];
+            previous[1] = reference[1];
+            previous[2] = reference[2];
+        }
+        for (int k = sentPoints - 1; k >= 0; k--) {
+            int slot = ringSlot(head, k, maxPoints);
+            const glm::vec3& position = pool.positions[base + slot];
+            int32_t value[3] = { quantize(position.x), quantize(position.y), quantize(position.z - originZ) };
+            for (int axis = 0; axis < 3; axis++) {
+                putSigned(m_chunk, value[axis] - previous[axis]);
+                previous[axis] = value[axis];
+                mirror[slot * 3 + axis] = value[axis];
+            }
+            putSigned(m_chunk, static_cast<int32_t>(pool.emissionLife[base + slot]) - shade.life);
+        }
+
+        m_recordedSerial[line] = pool.writeSerial[line];
+        m_recordedPushSerial[line] = pool.pushSerial[line];
+        m_recordedHead[line] = head;
+        m_recordedCount[line] = count;
+    }
+
+    m_frameCount++;
+    m_chunkFrameCount++;
+    if (m_chunkFrameCount == kFramesPerChunk) {
+        flushChunk();
+    }
+}
+
+void FlowRecorder::flushChunk() {
+    if (m_chunkFrameCount == 0) {
+        return;
+    }
+
+    ChunkHeader header;
+    header.firstFrame = m_chunkFirstFrame;
+    header.frameCount = m_chunkFrameCount;
+    header.byteSize = static_cast<uint32_t>(m_chunk.size());
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(ChunkHeader));
+    m_file.write(reinterpret_cast<const char*>(m_chunk.data()), static_cast<std::streamsize>(m_chunk.size()));
+
+    m_chunkFirstFrame = m_frameCount;
+    m_chunkFrameCount = 0;
+    m_chunk.clear();
+}
+
+FlowReplay::FlowReplay()
+    : m_frameCount(0), m_lineCapacity(0), m_chunk(-1), m_cursor(0), m_hasFrame(false),
+      m_frame(0), m_step(0), m_carPosition(0.0f), m_carRelative(false), m_lineCount(0), m_normalLineCount(0) {
+}
+
+bool FlowReplay::open(const std::string& path) {
+    close();
+
+    if (!m_file.open(path) || m_file.size() < sizeof(Header)) {
+        std::cerr << "ERROR::FLOW_REPLAY::FILE_NOT_READ: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    Header header;
+    std::memcpy(&header, m_file.data(), sizeof(Header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+        header.lineCapacity == 0 || header.pointsPerLine < 2 || header.pointsPerLine > 0xffff) {
+        std::cerr << "ERROR::FLOW_REPLAY::NOT_A_RECORDING: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    // Index the chunks; a chunk cut off by an interrupted recording ends the session
+    size_t offset = sizeof(Header);
+    while (m_file.size() - offset >= sizeof(ChunkHeader)) {
+        ChunkHeader chunkHeader;
+        std::memcpy(&chunkHeader, m_file.data() + offset, sizeof(ChunkHeader));
+        offset += sizeof(ChunkHeader);
+        if (chunkHeader.byteSize > m_file.size() - offset ||
+            chunkHeader.firstFrame != m_frameCount || chunkHeader.frameCount == 0) {
+            std::cerr << "WARNING::FLOW_REPLAY::TRUNCATED: " << path << " ends after frame " << m_frameCount << std::endl;
+            break;
+        }
+
+        Chunk chunk;
+        chunk.firstFrame = chunkHeader.firstFrame;
+        chunk.frameCount = chunkHeader.frameCount;
+        chunk.offset = offset;
+        chunk.size = chunkHeader.byteSize;
+        m_chunks.push_back(chunk);
+
+        m_frameCount += chunkHeader.frameCount;
+        offset += chunkHeader.byteSize;
+    }
+
+    if (m_frameCount == 0) {
+        std::cerr << "ERROR::FLOW_REPLAY::EMPTY: " << path << std::endl;
+        close();
+        return false;
+    }
+
+    m_lineCapacity = static_cast<int>(header.lineCapacity);
+    m_pool.allocate(m_lineCapacity, static_cast<int>(header.pointsPerLine));
+    m_quantized.assign(m_pool.positions.size() * 3, 0);
+    return true;
+}
+
+void FlowReplay::close() {
+    m_file.close();
+    m_chunks.clear();
+    m_frameCount = 0;
+    m_lineCapacity = 0;
+    m_chunk = -1;
+    m_cursor = 0;
+    m_hasFrame = false;
+    m_frame = 0;
+    m_lineCount = 0;
+    m_normalLineCount = 0;
+}
+
+bool FlowReplay::seek(unsigned int frame) {
+    if (!isOpen() || frame >= m_frameCount) {
+        return false;
+    }
+    if (m_hasFrame && frame == m_frame) {
+        return true;
+    }
+
+    // Chunk holding the frame
+    int chunk = 0;
+    int first = 0;
+    int last = static_cast<int>(m_chunks.size()) - 1;
+    while (first <= last) {
+        int middle = (first + last) / 2;
+        if (m_chunks[middle].firstFrame <= frame) {
+            chunk = middle;
+            first = middle + 1;
+        }
+        else {
+            last = middle - 1;
+        }
+    }
+
+    // Decoding only runs forward, from the current frame or from the keyframe
+    if (!m_hasFrame || chunk != m_chunk || frame < m_frame) {
+        m_chunk = chunk;
+        m_cursor = m_chunks[chunk].offset;
+        m_frame = m_chunks[chunk].firstFrame;
+        if (!decodeFrame(true)) {
+            return false;
+        }
+    }
+    while (m_frame < frame) {
+        m_frame++;
+        if (!decodeFrame(false)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FlowReplay::nextFrameStep(unsigned int& step) const {
+    if (!m_hasFrame || m_frame + 1 >= m_frameCount) {
+        return false;
+    }
+
+    // Every frame starts with its step, so peeking needs no decoding
+    int chunk = m_chunk;
+    size_t offset = m_cursor;
+    if (m_frame + 1 == m_chunks[chunk].firstFrame + m_chunks[chunk].frameCount) {
+        chunk++;
+        offset = m_chunks[chunk].offset;
+    }
+    ByteReader reader = { m_file.data() + offset, m_file.data() + m_chunks[chunk].offset + m_chunks[chunk].size, true };
+    step = reader.varint();
+    return reader.ok;
+}
+
+bool FlowReplay::decodeFrame(bool keyframe) {
+    const Chunk& chunk = m_chunks[m_chunk];
+    ByteReader reader = { m_file.data() + m_cursor, m_file.data() + chunk.offset + chunk.size, true };
+    const int maxPoints = m_pool.maxPoints;
+
+    m_step = reader.varint();
+    int lineCount = static_cast<int>(reader.varint());
+    int normalLineCount = static_cast<int>(reader.varint());
+    m_carPosition = reader.real();
+    m_carRelative = reader.byte() != 0;
+    if (!reader.ok || lineCount < 0 || lineCount > m_lineCapacity || normalLineCount < 0 ||
+        normalLineCount > lineCount) {
+        reader.ok = false;
+    }
+
+    if (reader.ok && keyframe) {
+        for (int line = 0; line < m_lineCapacity; line++) {
+            m_pool.clearPoints(line);
+        }
+    }
+
+    for (int line = 0; line < lineCount && reader.ok; line++) {
+        uint32_t tag = reader.varint();
+        int newPoints = static_cast<int>(tag >> 3);
+        int sentPoints = newPoints + ((tag & 4) != 0 ? 1 : 0);
+        bool newInitialLife = (tag & 2) != 0;
+        bool explicitLayout = (tag & 1) != 0;
+
+        int head;
+        int count;
+        if (explicitLayout) {
+            // Range-check before casting so a corrupt file cannot yield a
+            // negative ring position
+            uint32_t rawHead = reader.varint();
+            uint32_t rawCount = reader.varint();
+            if (rawHead >= static_cast<uint32_t>(maxPoints) || rawCount > static_cast<uint32_t>(maxPoints)) {
+                reader.ok = false;
+                break;
+            }
+            head = static_cast<int>(rawHead);
+            count = static_cast<int>(rawCount);
+        }
+        else {
+            head = ((m_pool.head[line] - newPoints) % maxPoints + maxPoints) % maxPoints;
+            count = std::min(m_pool.pointCount[line] + newPoints, maxPoints);
+        }
+
+        // Lines keep the initial life of the last frame that sent one
+        FlowLineShade shade = m_pool.shade(line);
+        shade.life = static_cast<uint16_t>(reader.varint());
+        shade.style = static_cast<uint16_t>(reader.varint());
+        if (newInitialLife) {
+            shade.initialLife = static_cast<uint16_t>(reader.varint());
+        }
+        if (!reader.ok || head < 0 || head >= maxPoints || count < 0 || count > maxPoints ||
+            sentPoints > count || (sentPoints > newPoints && explicitLayout)) {
+            reader.ok = false;
+            break;
+        }
+        m_pool.setShade(line, shade);
+
+        size_t base = m_pool.slotOffset(line);
+        int32_t previous[3] = { 0, 0, 0 };
+        if (!explicitLayout && sentPoints < count) {
+            const int32_t* reference = &m_quantized[(base + ringSlot(head, sentPoints, maxPoints)) * 3];
+            previous[0] = reference[0];
+            previous[1] = reference[1];
+            previous[2] = reference[2];
+        }
+
+        for (int k = sentPoints - 1; k >= 0; k--) {
+            int slot = ringSlot(head, k, maxPoints);
+            int32_t* quantized = &m_quantized[(base + slot) * 3];
+            for (int axis = 0; axis < 3; axis++) {
+                previous[axis] += reader.signedVarint();
+                quantized[axis] = previous[axis];
+            }
+            glm::vec3 position(previous[0] / kPositionScale, previous[1] / kPositionScale, previous[2] / kPositionScale);
+            uint16_t emissionLife = static_cast<uint16_t>(shade.life + reader.signedVarint());
+
+            m_pool.positions[base + slot] = position;
+            m_pool.emissionLife[base + slot] = emissionLife;
+            if (slot == 0) {
+                m_pool.positions[base + maxPoints] = position;    // Mirror of slot 0
+                m_pool.emissionLife[base + maxPoints] = emissionLife;
+            }
+        }
+
+        m_pool.head[line] = head;
+        m_pool.pointCount[line] = count;
+        m_pool.writeSerial[line] += static_cast<unsigned int>(sentPoints);
+        m_pool.pushSerial[line] += static_cast<unsigned int>(newPoints);
+    }
+
+    if (!reader.ok) {
+        std::cerr << "ERROR::FLOW_REPLAY::CORRUPT_FRAME: " << m_frame << std::endl;
+        m_hasFrame = false;
+        return false;
+    }
+
+    m_lineCount = lineCount;
+    m_normalLineCount = normalLineCount;
+    m_cursor = reader.cursor - m_file.data();
+    m_hasFrame = true;
+    return true;
+}
@@ -0,0 +1,139 @@
+#ifndef FLOW_RECORDING_H
+#define FLOW_RECORDING_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "FlowLinePool.h"
+#include "MappedFile.h"
+
+// Flow sessions on disk, recorded once per published frame and played back
+// without the simulation.
+//
+// Layout: a header, then chunks of consecutive frames, each with its own
+// size so a reader can walk from chunk to chunk. The first frame of every
+// chunk is a keyframe that holds every line in full; the others hold only
+// the points each line wrote since the frame before, which for the ring
+// buffers is the new head points, plus the previous head if it was moved in
+// place. Positions are quantized to about a millimeter and stored as zigzag
+// varint deltas along the trail, each with the life its line had when it was
+// emitted; colors are not stored, only each line's FlowLineShade that they
+// derive from. Trails
+// that move with the car are stored in car coordinates, where moving the car
+// changes nothing, so a steadily advancing line costs a tag byte plus one
+// point of a few bytes per frame either way.
+
+// Writes a session frame by frame. A chunk is packed in memory and appended
+// whole, so a session that is cut short loses at most its last chunk.
+class FlowRecorder {
+public:
+    FlowRecorder();
+    ~FlowRecorder();
+
+    // Start a recording of pools with the given layout; false if the file cannot be written
+    bool open(const std::string& path, int lineCapacity, int pointsPerLine);
+
+    // Write out the last chunk and close the file
+    void close();
+
+    bool isOpen() const { return m_file.is_open(); }
+
+    // Append the state of lines [0, lineCount) as it is after simulation step `step`.
+    // The pool's points are frameOrigin along Z from the world's; carRelative
+    // says the trails move with the car (relative dynamics).
+    void recordFrame(const FlowLinePool& pool, int lineCount, int normalLineCount,
+        unsigned int step, float carPosition, float frameOrigin, bool carRelative);
+
+    unsigned int frameCount() const { return m_frameCount; }
+
+private:
+    FlowRecorder(const FlowRecorder&);
+    FlowRecorder& operator=(const FlowRecorder&);
+
+    void flushChunk();
+
+    std::ofstream m_file;
+    std::string m_path;
+    int m_pointsPerLine;
+    unsigned int m_frameCount;
+    unsigned int m_chunkFirstFrame;
+    unsigned int m_chunkFrameCount;
+    std::vector<unsigned char> m_chunk;
+
+    // Ring layout the replay holds for each line slot after the last frame
+    std::vector<unsigned int> m_recordedSerial;
+    std::vector<unsigned int> m_recordedPushSerial;
+    std::vector<int> m_recordedHead;
+    std::vector<int> m_recordedCount;
+    std::vector<int32_t> m_quantized;       // Positions the replay holds, maxPoints per line
+    std::vector<int> m_recordedInitialLife; // Shade initial life the replay holds, -1 if none
+};
+
+// Plays a recorded session back from a memory-mapped file. Only the frames
+// between the current one and its chunk's keyframe are ever decoded, into a
+// pool laid out like the simulation's: the renderer streams it into the line
+// buffers exactly as it does live state.
+class FlowReplay {
+public:
+    FlowReplay();
+
+    // Map a recording and index its chunks; false if it is missing or not a recording
+    bool open(const std::string& path);
+
+    void close();
+
+    bool isOpen() const { return m_file.isOpen(); }
+
+    unsigned int frameCount() const { return m_frameCount; }
+    int lineCapacity() const { return m_lineCapacity; }
+    int pointsPerLine() const { return m_pool.maxPoints; }
+
+    // Decode a frame into pool(). The frame after the current one costs one
+    // delta; any other frame is decoded forward from its chunk's keyframe.
+    bool seek(unsigned int frame);
+
+    // Simulation step the next frame was recorded at; false at the last frame
+    bool nextFrameStep(unsigned int& step) const;
+
+    // State of the current frame. When carRelative(), pool() positions are
+    // relative to the car's Z position rather than the world origin.
+    unsigned int frame() const { return m_frame; }
+    unsigned int step() const { return m_step; }
+    float carPosition() const { return m_carPosition; }
+    bool carRelative() const { return m_carRelative; }
+    int lineCount() const { return m_lineCount; }
+    int normalLineCount() const { return m_normalLineCount; }
+    const FlowLinePool& pool() const { return m_pool; }
+
+private:
+    struct Chunk {
+        unsigned int firstFrame;
+        unsigned int frameCount;
+        size_t offset;         // Start of the frame data in the file
+        size_t size;
+    };
+
+    bool decodeFrame(bool keyframe);
+
+    MappedFile m_file;
+    std::vector<Chunk> m_chunks;
+    unsigned int m_frameCount;
+    int m_lineCapacity;
+
+    // Decoding position: the frame held in the pool and where the next one starts
+    int m_chunk;
+    size_t m_cursor;
+    bool m_hasFrame;
+
+    unsigned int m_frame;
+    unsigned int m_step;
+    float m_carPosition;
+    bool m_carRelative;
+    int m_lineCount;
+    int m_normalLineCount;
+    FlowLinePool m_pool;
+    std::vector<int32_t> m_quantized;   // Pool positions as stored, for exact deltas
+};
+
+#endif
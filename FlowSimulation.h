@@ -0,0 +1,1135 @@
+#ifndef FLOW_SIMULATION_H
+#define FLOW_SIMULATION_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <memory>
+#include <iostream>
+#include <string>
+#include "FlowLinePool.h"
+#include "JobSystem.h"
+#include "FlowRandom.h"
+#include "AeroKernel.h"
+#include "FlowField.h"
+#include "FlowFieldBricks.h"
+#include "FlowIntegrator.h"
+#include "SeedGrid.h"
+#include "ViewFrustum.h"
+#include "FrameProfiler.h"
+
+// The CPU flow line simulation: seeding, incremental reseeding and the
+// per-line aerodynamics. It owns no GL state and needs no context, so it
+// also runs headless (see FlowBatch.cpp); FlowLinesVisualization adds the
+// buffers, the GPU backend and the simulation thread on top of it.
+class FlowSimulation {
+public:
+    static constexpr float kFixedTimestep = 0.01f;   // Simulated seconds per step (100 Hz)
+    static const int kDefaultPointsPerLine = 80;
+
+    // The seed fixes both the seeding and the turbulence, so the same seed replays the same flow
+    FlowSimulation(int numLines, float carLength, float carWidth, float carHeight,
+        unsigned int seed = std::random_device{}(), int pointsPerLine = kDefaultPointsPerLine) {
+        // Initialize flow lines
+        m_numLines = numLines;
+        m_carLength = carLength;
+        m_carWidth = carWidth;
+        m_carHeight = carHeight;
+        m_pointsPerLine = pointsPerLine;   // Number of points per flow line
+        m_slotSize = m_pointsPerLine + 1;  // Ring slots per line (including the wrap mirror)
+        m_totalPoints = m_numLines * m_slotSize;
+        m_minDistance = 0.05f;       // Minimum distance between streamlines
+        m_adaptiveDensity = true;    // Enable adaptive density
+        m_carPosition = -50.0f;        // Current car Z position
+        m_frameOrigin = m_carPosition;        // Points start out in car coordinates
+        m_carSpeed = 400.0f;         // Car speed in km/h
+        m_simulateDRS = false;       // DRS state
+        m_relativeDynamics = true;   // Enable relative dynamics (flow moves with car)
+        m_visualizePressure = true;  // Show pressure differences in color 
+        m_vortexIntensity = 2.0f;    // Vortex visualization intensity
+        m_dirtyFirst = m_numLines;
+        m_dirtyLast = 0;
+        m_parallelUpdate = false;
+        m_randomSeed = seed;
+        m_frameIndex = 0;
+        m_generator.seed(seed);
+        m_simdAdvection = true;
+        m_fieldAdvection = true;
+        m_integrator = FlowIntegrator::Euler;
+        for (int state = 0; state < 2; state++) {
+            m_flowFieldLoaded[state] = false;
+            m_flowFieldSpeed[state] = -1.0f;
+        }
+        m_incrementalReseed = true;
+        m_reseedPhase = ReseedPhase::Idle;
+
+        // Allocate the line pool once, then seed it
+        m_pool.allocate(m_numLines, m_pointsPerLine);
+        buildVortexSources(false, m_vortexSources[0]);
+        buildVortexSources(true, m_vortexSources[1]);
+        initFlowLines();
+    }
+
+    // Advance every line by one step of deltaTime on the calling thread
+    // (or the job pool, with parallel update on)
+    void step(float deltaTime) {
+        beginStep();
+        advanceAllLines(deltaTime);
+    }
+
+    // Lines [0, lineCount()) of the pool are live; vortex lines start at normalLineCount().
+    // Positions are in the flow frame, frameOrigin() along Z from the world's.
+    const FlowLinePool& pool() const {
+        return m_pool;
+    }
+
+    // World Z of the flow frame. With relative dynamics the frame moves with
+    // the car, which carries every trail along without touching a single
+    // stored point.
+    float frameOrigin() const {
+        return m_frameOrigin;
+    }
+
+    int lineCount() const {
+        return m_lineCount;
+    }
+
+    int normalLineCount() const {
+        return m_normalLineCount;
+    }
+
+    // Steps taken since construction
+    unsigned int stepIndex() const {
+        return m_frameIndex;
+    }
+
+    // Use the vectorized aerodynamics kernel (on by default) or the scalar reference
+    void setSimdAdvection(bool enable) {
+        m_simdAdvection = enable;
+    }
+
+    // Integrate non-vortex heads with one Euler step per step (the default), or
+    // with RK4 / adaptive RK45 substeps. The higher orders emit trail points by
+    // arc length and curvature rather than one per step, so points gather where
+    // the flow bends and a line of the same point count reaches further.
+    void setIntegrator(FlowIntegrator integrator) {
+        m_integrator = integrator;
+    }
+
+    FlowIntegrator integrator() const {
+        return m_integrator;
+    }
+
+    // Look the aerodynamics up in a precomputed flow field (on by default)
+    // instead of evaluating the analytic model at every head point
+    void setFlowFieldAdvection(bool enable) {
+        m_fieldAdvection = enable;
+    }
+
+    bool usesFlowField() const {
+        return m_fieldAdvection;
+    }
+
+    // Advect through CFD data instead of the baked field while DRS is in the
+    // given state; false if the file cannot be used
+    bool loadFlowField(const std::string& path, bool drsOpen) {
+        int state = drsOpen ? 1 : 0;
+        if (!m_flowFields[state].load(path)) {
+            return false;
+        }
+        m_flowFieldLoaded[state] = true;
+        m_fieldBricks[state].reset();
+        return true;
+    }
+
+    // Stream a CFD dataset too large to load whole (see FlowFieldBricks) for
+    // the given DRS state. Its overview stands in for bricks not yet paged in,
+    // and is the field the GPU backend uses.
+    bool loadFlowFieldBricks(const std::string& path, bool drsOpen) {
+        int state = drsOpen ? 1 : 0;
+        std::unique_ptr<FlowFieldBricks> bricks(new FlowFieldBricks());
+        if (!bricks->open(path)) {
+            return false;
+        }
+        m_flowFields[state] = bricks->overview();
+        m_flowFieldLoaded[state] = true;
+        m_fieldBricks[state] = std::move(bricks);
+        return true;
+    }
+
+    // Streamed dataset of the current DRS state, or null
+    const FlowFieldBricks* flowFieldBricks() const {
+        return m_fieldBricks[m_simulateDRS ? 1 : 0].get();
+    }
+
+    // Ask for the bricks holding the seeds of lines in view, so lines are
+    // already in full resolution data when they spawn. The frustum is in car
+    // coordinates.
+    void prefetchFlowField(const ViewFrustum& frustum) {
+        const FlowFieldBricks* bricks = flowFieldBricks();
+        if (!m_fieldAdvection || !bricks) {
+            return;
+        }
+        for (int line = 0; line < m_lineCount; line++) {
+            const glm::vec3& seed = m_pool.params[line].initialOffset;
+            BoundingBox box = { seed - kSeedPrefetchRadius, seed + kSeedPrefetchRadius };
+            if (frustum.isVisible(box)) {
+                bricks->request(seed);
+            }
+        }
+    }
+
+    // Field of the current DRS state: the loaded one, or the analytic model
+    // baked for the current speed, rebaked after the speed changed
+    const FlowField& flowField() {
+        int state = m_simulateDRS ? 1 : 0;
+        if (!m_flowFieldLoaded[state] && m_flowFieldSpeed[state] != m_carSpeed) {
+            ProfileScope scope("bakeFlowField");
+            m_flowFields[state].bake(aeroKernelParams(), kFixedTimestep);
+            m_flowFieldSpeed[state] = m_carSpeed;
+        }
+        return m_flowFields[state];
+    }
+
+    // Split the CPU update across a pool of worker threads
+    void setParallelUpdate(bool enable) {
+        m_parallelUpdate = enable;
+        if (enable && !m_jobs) {
+            m_jobs.reset(new JobSystem());
+        }
+    }
+
+    unsigned int getRandomSeed() const {
+        return m_randomSeed;
+    }
+
+    // Apply density, DRS and vortex intensity changes as an in-place delta
+    // spread over the next steps (on by default) instead of rebuilding the flow
+    void setIncrementalReseeding(bool enable) {
+        m_incrementalReseed = enable;
+    }
+
+    // True while a delta is still being applied
+    bool isReseeding() const {
+        return m_reseedPhase != ReseedPhase::Idle;
+    }
+
+    // Set adaptive density flag (closer spacing at the front wing and floor); respaces the flow
+    void setAdaptiveDensity(bool enable) {
+        if (enable != m_adaptiveDensity) {
+            m_adaptiveDensity = enable;
+            respaceFlowLines();
+        }
+    }
+
+    // Set minimum distance between streamlines; respaces the flow
+    void setDensity(float minDistance) {
+        if (minDistance != m_minDistance) {
+            m_minDistance = minDistance;
+            respaceFlowLines();
+        }
+    }
+
+    // Set car position (for moving car functionality)
+    void setCarPosition(float position) {
+        if (m_relativeDynamics) {
+            m_frameOrigin += position - m_carPosition;
+        }
+        m_carPosition = position;
+    }
+
+    // Set car speed in km/h (affects flow behavior)
+    void setCarSpeed(float speed) {
+        m_carSpeed = speed;
+    }
+
+    // Set DRS state (open/closed)
+    void setDRS(bool isOpen) {
+        bool stateChanged = (m_simulateDRS != isOpen);
+        m_simulateDRS = isOpen;
+
+        // Update vortices when DRS state changes
+        if (stateChanged) {
+            updateVortices();
+        }
+    }
+
+    // Set relative dynamics (flow moves with car)
+    void setRelativeDynamics(bool enable) {
+        m_relativeDynamics = enable;
+    }
+
+    // Toggle pressure visualization
+    void setPressureVisualization(bool enable) {
+        m_visualizePressure = enable;
+    }
+
+    // Set vortex visualization intensity (0.0 - 2.0)
+    void setVortexIntensity(float intensity) {
+        float clamped = glm::clamp(intensity, 0.0f, 2.0f);
+        if (clamped != m_vortexIntensity) {
+            m_vortexIntensity = clamped;
+            updateVortices();
+        }
+    }
+
+    // Reset all flow lines with the current car position
+    void resetAllFlowLines() {
+        for (int line = 0; line < m_lineCount; line++) {
+            FlowRandom random(m_randomSeed, line, m_frameIndex);
+            resetFlowLine(line, random);
+        }
+        markLinesDirty(0, m_lineCount);
+
+        // Ensure vortices are properly generated
+        regenerateVortices();
+    }
+
+protected:
+    // Start a step: count it
+    void beginStep() {
+        m_frameIndex++;
+    }
+
+    // Car Z position in the flow frame
+    float carInFrame() const {
+        return m_carPosition - m_frameOrigin;
+    }
+
+    // The CPU half of a step, once beginStep() has run
+    void advanceAllLines(float deltaTime) {
+        // Spread pending reseeding over steps so tuning never stalls one
+        applyReseedDelta(kReseedLinesPerStep);
+
+        // Bake before the lines are split, so the workers only read the field
+        if (m_fieldAdvection) {
+            flowField();
+
+            // Page in what the last step and prefetchFlowField() asked for
+            if (FlowFieldBricks* bricks = m_fieldBricks[m_simulateDRS ? 1 : 0].get()) {
+                ProfileScope scope("pageFlowBricks");
+                bricks->update(kBrickLoadsPerStep);
+            }
+        }
+
+        // Lines only touch their own pool slots, so they can be split across threads freely
+        if (m_parallelUpdate && m_jobs) {
+            m_jobs->parallelFor(m_lineCount, kLinesPerJob, [&](int firstLine, int lastLine, int) {
+                advanceLines(firstLine, lastLine, deltaTime);
+            });
+        }
+        else {
+            advanceLines(0, m_lineCount, deltaTime);
+        }
+    }
+
+    // Initialize flow lines with random positions around the car
+    void initFlowLines() {
+        m_lineCount = 0;
+        m_normalLineCount = 0;
+
+        int lineCount = 0;
+
+        // Seeds placed so far, bucketed by the largest spacing tested below
+        m_seedGrid.reset(m_minDistance, m_numLines);
+
+        // Fill the zones in order; a slot whose seed found no room is reused by the next try
+        for (int zone = 0; zone < kSeedZoneCount; zone++) {
+            int zoneLines = zoneQuota(zone);
+            for (int i = 0; i < zoneLines && lineCount < m_numLines; i++) {
+                if (seedNormalLine(zone, i, lineCount)) {
+                    lineCount++;
+                }
+            }
+        }
+
+        // Add vortex flow lines after normal lines
+        m_normalLineCount = lineCount;
+        m_reseedPhase = ReseedPhase::Idle;
+        regenerateVortices();
+    }
+
+    // Number of lines allotted to an emission zone
+    int zoneQuota(int zone) const {
+        // Front wing 25%, top 15%, sides 15%, rear wing 15%, floor/diffuser 20%;
+        // the rest is left for vortices
+        static const float kZoneShare[kSeedZoneCount] = { 0.25f, 0.15f, 0.15f, 0.15f, 0.2f };
+        return static_cast<int>(m_numLines * kZoneShare[zone]);
+    }
+
+    // Spacing between seeds of one zone. Adaptive density packs the zones
+    // with the most detail (front wing, floor) tighter.
+    float zoneSpacing(int zone) const {
+        static const float kAdaptiveFactor[kSeedZoneCount] = { 0.8f, 1.0f, 1.0f, 1.0f, 0.7f };
+        return m_adaptiveDensity ? m_minDistance * kAdaptiveFactor[zone] : m_minDistance;
+    }
+
+    // Try to place a seed of the given zone into pool slot `line`, keeping it
+    // clear of the seeds in m_seedGrid. Seeds are spaced by their offset from
+    // the car, so the result does not depend on where the car is.
+    // zoneIndex alternates the side pod lines between left and right.
+    bool seedNormalLine(int zone, int zoneIndex, int line) {
+        FlowLine& flowLine = m_pool.params[line];
+        m_pool.zoneType[line] = zone;
+        m_pool.isVortex[line] = 0;
+        m_pool.clearPoints(line);
+        flowLine.vortexSource = -1;
+        flowLine.vortexIndex = -1;
+        flowLine.seededWithDRS = m_simulateDRS;
+
+        bool leftSide = (zoneIndex % 2 == 0);
+
+        // Try several positions until we find one with proper spacing
+        for (int attempt = 0; attempt < 10; attempt++) {
+            glm::vec3 position;
+            switch (zone) {
+            case 0:  // Front wing
+                position.x = generateRandomFloat(-m_carWidth * 1.2f / 2, m_carWidth * 1.2f / 2);
+                position.y = generateRandomFloat(0.05f, m_carHeight * 0.3f);
+                position.z = -m_carLength * 0.5f - generateRandomFloat(0.0f, 0.2f);
+                break;
+            case 1:  // Top of car (airbox/engine cover)
+                position.x = generateRandomFloat(-m_carWidth * 0.5f / 2, m_carWidth * 0.5f / 2);
+                position.y = m_carHeight + generateRandomFloat(0.0f, 0.2f);
+                position.z = generateRandomFloat(-m_carLength * 0.3f, m_carLength * 0.3f);
+                break;
+            case 2:  // Side pods
+                position.x = leftSide ? m_carWidth * 0.5f / 2 : -m_carWidth * 0.5f / 2;  // Left or right
+                position.y = generateRandomFloat(0.2f, m_carHeight * 0.5f);
+                position.z = generateRandomFloat(-m_carLength * 0.2f, m_carLength * 0.2f);
+                break;
+            case 3:  // Rear wing
+                position.x = generateRandomFloat(-m_carWidth * 0.9f / 2, m_carWidth * 0.9f / 2);
+                position.y = generateRandomFloat(m_carHeight * 0.9f * 0.5f, m_carHeight * 0.9f);
+                position.z = m_carLength * 0.4f;
+                break;
+            default:  // Floor/diffuser
+                position.x = generateRandomFloat(-m_carWidth * 0.8f / 2, m_carWidth * 0.8f / 2);
+                position.y = 0.05f;
+                position.z = generateRandomFloat(-m_carLength * 0.3f, m_carLength * 0.3f);
+                break;
+            }
+
+            if (!m_seedGrid.isFree(position, zoneSpacing(zone))) {
+                continue;
+            }
+            m_seedGrid.insert(position);
+
+            // Store initial offset from car reference position
+            flowLine.initialOffset = position;
+
+            // Add car position to get the position in the flow frame
+            position.z += carInFrame();
+            flowLine.initialPosition = position;
+
+            switch (zone) {
+            case 0:
+                flowLine.direction = glm::normalize(glm::vec3(0.0f, 0.0f, 1.0f));
+                m_pool.pressure[line] = generateRandomFloat(0.7f, 1.0f);  // Higher pressure in front
+                flowLine.velocity = generateRandomFloat(5.0f, 8.0f);
+                break;
+            case 1:
+                flowLine.direction = glm::normalize(glm::vec3(0.0f, 0.0f, 1.0f));
+                m_pool.pressure[line] = generateRandomFloat(0.3f, 0.6f);  // Medium pressure on top
+                flowLine.velocity = generateRandomFloat(7.0f, 10.0f);
+                break;
+            case 2:
+                flowLine.direction = glm::normalize(glm::vec3(leftSide ? 0.2f : -0.2f, 0.0f, 1.0f));
+                m_pool.pressure[line] = generateRandomFloat(0.4f, 0.7f);
+                flowLine.velocity = generateRandomFloat(6.0f, 9.0f);
+                break;
+            case 3:
+                // Consider DRS state for rear wing flow
+                if (m_simulateDRS) {
+                    // DRS open - less drag, straighter flow
+                    flowLine.direction = glm::normalize(glm::vec3(0.0f, 0.05f, 1.0f));
+                    m_pool.pressure[line] = generateRandomFloat(0.1f, 0.3f);
+                    flowLine.velocity = generateRandomFloat(5.0f, 8.0f); // Faster with DRS open
+                }
+                else {
+                    // DRS closed - more drag, more turbulent flow
+                    flowLine.direction = glm::normalize(glm::vec3(0.0f, 0.1f, 1.0f));
+                    m_pool.pressure[line] = generateRandomFloat(0.1f, 0.4f);
+                    flowLine.velocity = generateRandomFloat(4.0f, 6.0f);
+                }
+                break;
+            default:
+                flowLine.direction = glm::normalize(glm::vec3(0.0f, -0.05f, 1.0f));
+                m_pool.pressure[line] = generateRandomFloat(0.1f, 0.3f);  // Low pressure under floor
+                flowLine.velocity = generateRandomFloat(8.0f, 12.0f);  // Faster flow under floor
+                break;
+            }
+
+            m_pool.speed[line] = flowLine.velocity * (m_carSpeed / 250.0f); // Scale with car speed
+            flowLine.initialLife = generateRandomFloat(3.0f, 5.0f);
+            m_pool.life[line] = flowLine.initialLife;
+
+            // Initialize with starting point
+            m_pool.pushFront(line, position);
+            return true;
+        }
+        return false;
+    }
+
+    // Rebuild every line for the current spacing settings
+    void reseedFlowLines() {
+        initFlowLines();
+        markLinesDirty(0, m_lineCount);
+    }
+
+    // Apply vortex motion to vortex flow lines
+    glm::vec3 applyVortexMotion(int line, float distanceToAdvance, FlowRandom& random) {
+        glm::vec3 currentHead = m_pool.front(line);
+
+        // Calculate relative position to car's current position
+        glm::vec3 relativePos = currentHead;
+        relativePos.z -= carInFrame();  // Adjust Z to get position relative to car
+
+        // Base forward motion
+        float carSpeedFactor = m_carSpeed / 250.0f;
+        glm::vec3 displacement = glm::vec3(0.0f, 0.0f, distanceToAdvance * carSpeedFactor);
+
+        // Calculate vortex rotation
+        float vortexPhase = m_pool.vortexPhase[line] += 0.1f * carSpeedFactor;
+
+        // Apply vortex rotation - depends on the vortex strength and phase
+        float rotationRadius = m_pool.params[line].vortexStrength * 0.1f * m_vortexIntensity;
+        float rotationSpeed = 0.5f + (carSpeedFactor * 0.5f);
+
+        // Vortex motion depends on distance from origin
+        float distFromOrigin = glm::length(glm::vec2(relativePos.x, relativePos.y));
+        rotationRadius *= (1.0f - std::min(1.0f, distFromOrigin / 2.0f));
+
+        // Apply spiral motion
+        displacement.x += rotationRadius * std::cos(vortexPhase * rotationSpeed);
+        displacement.y += rotationRadius * std::sin(vortexPhase * rotationSpeed);
+
+        // Add some random turbulence to make it look more realistic
+        float turbulence = 0.005f * (0.5f + carSpeedFactor * 0.5f);
+        displacement.x += random.uniform(-turbulence, turbulence);
+        displacement.y += random.uniform(-turbulence, turbulence);
+
+        return displacement;
+    }
+
+    // Vortex centers at the wing tips for one DRS state, with their base strengths
+    void buildVortexSources(bool drsOpen, std::vector<std::pair<glm::vec3, float>>& vortexPositions) const {
+        vortexPositions.clear();
+
+        // Wing dimensions for vortex positioning
+        float frontWingZ = -m_carLength * 0.5f;
+        float rearWingZ = m_carLength * 0.4f;
+        float wingWidth = m_carWidth * 0.9f;
+        float rearWingHeight = m_carHeight * 0.9f;
+        float frontWingHeight = m_carHeight * 0.3f;
+
+        // Front wing tip vortices
+        vortexPositions.push_back(std::make_pair(
+            glm::vec3(wingWidth * 0.5f, frontWingHeight * 0.7f, frontWingZ),
+            0.8f  // Strength
+        ));
+        vortexPositions.push_back(std::make_pair(
+            glm::vec3(-wingWidth * 0.5f, frontWingHeight * 0.7f, frontWingZ),
+            0.8f  // Strength
+        ));
+
+        // Rear wing tip vortices - strength affected by DRS
+        float rearVortexStrength = drsOpen ? 0.5f : 1.0f;  // Weaker vortices with DRS open
+
+        vortexPositions.push_back(std::make_pair(
+            glm::vec3(wingWidth * 0.45f, rearWingHeight * 0.9f, rearWingZ),
+            rearVortexStrength
+        ));
+        vortexPositions.push_back(std::make_pair(
+            glm::vec3(-wingWidth * 0.45f, rearWingHeight * 0.9f, rearWingZ),
+            rearVortexStrength
+        ));
+
+        // Add DRS-specific vortices when DRS is closed
+        if (!drsOpen) {
+            // Center vortex from DRS flap trailing edge
+            vortexPositions.push_back(std::make_pair(
+                glm::vec3(0.0f, rearWingHeight * 0.95f, rearWingZ + 0.1f),
+                0.9f
+            ));
+
+            // Additional vortices from DRS flap edges
+            vortexPositions.push_back(std::make_pair(
+                glm::vec3(wingWidth * 0.3f, rearWingHeight * 0.93f, rearWingZ + 0.05f),
+                0.7f
+            ));
+            vortexPositions.push_back(std::make_pair(
+                glm::vec3(-wingWidth * 0.3f, rearWingHeight * 0.93f, rearWingZ + 0.05f),
+                0.7f
+            ));
+        }
+    }
+
+    // Vortex centers emitting lines at the current intensity and DRS state
+    int vortexCenterCount() const {
+        int vortexLines = std::min(int(m_numLines * 0.1f * m_vortexIntensity), int(m_numLines * 0.2f));
+        return std::min(vortexLines, static_cast<int>(m_vortexSources[m_simulateDRS].size()));
+    }
+
+    // Flow lines emitted by each vortex center
+    int vortexLinesPerCenter() const {
+        return std::max(1, static_cast<int>(3 * m_vortexIntensity));
+    }
+
+    // Seed line `index` of vortex center `source` into pool slot `line`
+    void seedVortexLine(int line, int source, int index) {
+        const glm::vec3& basePosition = m_vortexSources[m_simulateDRS][source].first;
+        float strength = m_vortexSources[m_simulateDRS][source].second;
+
+        FlowLine& flowLine = m_pool.params[line];
+        m_pool.clearPoints(line);
+        m_pool.zoneType[line] = (basePosition.z < 0) ? 0 : 3;  // Front or rear wing
+        m_pool.isVortex[line] = 1;
+        flowLine.vortexSource = source;
+        flowLine.vortexIndex = index;
+        flowLine.seededWithDRS = m_simulateDRS;
+        flowLine.vortexStrength = strength * (1.0f + generateRandomFloat(-0.2f, 0.2f));
+        m_pool.vortexPhase[line] = generateRandomFloat(0.0f, 6.28f);  // Random start phase
+
+        // Add small random offset from vortex center
+        glm::vec3 position = basePosition;
+        position.x += generateRandomFloat(-0.05f, 0.05f);
+        position.y += generateRandomFloat(-0.05f, 0.05f);
+        position.z += generateRandomFloat(-0.05f, 0.05f);
+
+        // Store initial offset from car reference position
+        flowLine.initialOffset = position;
+
+        // Add car position to get the position in the flow frame
+        position.z += carInFrame();
+
+        flowLine.initialPosition = position;
+        flowLine.direction = glm::normalize(glm::vec3(0.0f, 0.0f, 1.0f));
+
+        // Differentiate vortex pressure values
+        if (m_pool.zoneType[line] == 0) {  // Front wing
+            m_pool.pressure[line] = generateRandomFloat(0.2f, 0.4f);  // Lower pressure
+        }
+        else {  // Rear wing
+            m_pool.pressure[line] = rearVortexPressure();
+        }
+
+        flowLine.velocity = generateRandomFloat(6.0f, 10.0f) * (m_carSpeed / 250.0f);
+        m_pool.speed[line] = flowLine.velocity;
+        flowLine.initialLife = generateRandomFloat(4.0f, 6.0f);  // Longer life for vortices
+        m_pool.life[line] = flowLine.initialLife;
+
+        m_pool.pushFront(line, position);
+    }
+
+    // Pressure drawn for a rear wing vortex line in the current DRS state
+    float rearVortexPressure() {
+        return m_simulateDRS ?
+            generateRandomFloat(0.1f, 0.2f) :  // Very low pressure with DRS open
+            generateRandomFloat(0.3f, 0.5f);   // Moderate pressure with DRS closed
+    }
+
+    // Generate vortex flow lines around wing tip areas
+    void regenerateVortices() {
+        // Remove existing vortex lines; they always occupy the slots after the normal lines
+        m_lineCount = m_normalLineCount;
+
+        // Create multiple flow lines per vortex center
+        int centers = vortexCenterCount();
+        int linesPerVortex = vortexLinesPerCenter();
+        for (int i = 0; i < centers; i++) {
+            for (int j = 0; j < linesPerVortex && m_lineCount < m_numLines; j++) {
+                seedVortexLine(m_lineCount, i, j);
+                m_lineCount++;
+            }
+        }
+        markLinesDirty(m_normalLineCount, m_lineCount);
+
+        // Nothing is left for a pending vortex delta to do
+        if (m_reseedPhase == ReseedPhase::Vortices) {
+            m_reseedPhase = ReseedPhase::Idle;
+        }
+    }
+
+    // Bring the vortex lines in line with the current DRS state and intensity
+    void updateVortices() {
+        if (!m_incrementalReseed) {
+            regenerateVortices();
+            return;
+        }
+
+        // A density delta in flight reconciles the vortices once it is done
+        if (m_reseedPhase == ReseedPhase::Retire || m_reseedPhase == ReseedPhase::Add) {
+            return;
+        }
+        beginVortexPass();
+    }
+
+    // Respace the normal lines after a density setting changed
+    void respaceFlowLines() {
+        if (m_incrementalReseed) {
+            beginRetirePass();
+        }
+        else {
+            reseedFlowLines();
+        }
+    }
+
+    // Start a density delta: every normal seed is checked against the new
+    // spacing and retired if it crowds a seed kept before it, then the zones
+    // are topped back up to their quota. Restarting mid-way is safe, since
+    // the kept seeds are simply checked again.
+    void beginRetirePass() {
+        m_seedGrid.reset(m_minDistance, m_numLines);
+        for (int zone = 0; zone < kSeedZoneCount; zone++) {
+            m_zoneLineCount[zone] = 0;
+        }
+        m_reseedCursor = 0;
+        m_reseedPhase = ReseedPhase::Retire;
+    }
+
+    // Start a vortex delta: lines of centers no longer in use are retired,
+    // lines seeded for the other DRS state are updated in place, and lines
+    // still missing are added
+    void beginVortexPass() {
+        m_vortexCenters = vortexCenterCount();
+        m_vortexLinesPerCenter = vortexLinesPerCenter();
+        m_vortexPresent.assign(m_vortexCenters * m_vortexLinesPerCenter, 0);
+        m_vortexFill = 0;
+        m_reseedCursor = m_normalLineCount;
+        m_reseedPhase = ReseedPhase::Vortices;
+    }
+
+    // Work on the pending delta; budget counts the lines examined or seeded
+    void applyReseedDelta(int budget) {
+        if (m_reseedPhase == ReseedPhase::Idle) {
+            return;
+        }
+        ProfileScope scope("reseed");
+        while (budget > 0 && m_reseedPhase != ReseedPhase::Idle) {
+            switch (m_reseedPhase) {
+            case ReseedPhase::Retire:
+                retireStep(budget);
+                break;
+            case ReseedPhase::Add:
+                addStep(budget);
+                break;
+            case ReseedPhase::Vortices:
+                vortexStep(budget);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    void retireStep(int& budget) {
+        while (budget > 0 && m_reseedCursor < m_normalLineCount) {
+            budget--;
+            int line = m_reseedCursor;
+            int zone = m_pool.zoneType[line];
+            const glm::vec3& offset = m_pool.params[line].initialOffset;
+
+            if (m_zoneLineCount[zone] < zoneQuota(zone) && m_seedGrid.isFree(offset, zoneSpacing(zone))) {
+                m_seedGrid.insert(offset);
+                m_zoneLineCount[zone]++;
+                m_reseedCursor++;
+            }
+            else {
+                // The slot now holds a line that has not been checked yet
+                retireNormalLine(line);
+            }
+        }
+
+        if (m_reseedCursor >= m_normalLineCount) {
+            // Every zone gets as many tries as it is short of its quota
+            for (int zone = 0; zone < kSeedZoneCount; zone++) {
+                m_zoneTriesLeft[zone] = zoneQuota(zone) - m_zoneLineCount[zone];
+            }
+            m_reseedZone = 0;
+            m_reseedPhase = ReseedPhase::Add;
+        }
+    }
+
+    void addStep(int& budget) {
+        while (budget > 0 && m_reseedZone < kSeedZoneCount) {
+            int zone = m_reseedZone;
+            if (m_zoneTriesLeft[zone] <= 0) {
+                m_reseedZone++;
+                continue;
+            }
+
+            // Normal lines take precedence over vortex lines, as in initFlowLines()
+            if (m_lineCount == m_numLines) {
+                if (m_lineCount == m_normalLineCount) {
+                    m_reseedZone = kSeedZoneCount;
+                    break;
+                }
+                m_lineCount--;
+            }
+
+            budget--;
+            m_zoneTriesLeft[zone]--;
+
+            // Seed into the free slot past the last line, then swap it in front of the vortex lines
+            int line = m_lineCount;
+            if (seedNormalLine(zone, m_zoneLineCount[zone], line)) {
+                if (line != m_normalLineCount) {
+                    m_pool.swapLines(line, m_normalLineCount);
+                }
+                markLinesDirty(m_normalLineCount, line + 1);
+                m_zoneLineCount[zone]++;
+                m_normalLineCount++;
+                m_lineCount++;
+            }
+        }
+
+        if (m_reseedZone >= kSeedZoneCount) {
+            beginVortexPass();
+        }
+    }
+
+    void vortexStep(int& budget) {
+        // Keep, refresh or retire the existing vortex lines
+        while (budget > 0 && m_reseedCursor < m_lineCount) {
+            budget--;
+            int line = m_reseedCursor;
+            const FlowLine& flowLine = m_pool.params[line];
+
+            if (flowLine.vortexSource >= m_vortexCenters || flowLine.vortexIndex >= m_vortexLinesPerCenter ||
+                m_vortexPresent[flowLine.vortexSource * m_vortexLinesPerCenter + flowLine.vortexIndex]) {
+                retireVortexLine(line);
+                continue;
+            }
+
+            m_vortexPresent[flowLine.vortexSource * m_vortexLinesPerCenter + flowLine.vortexIndex] = 1;
+            if (flowLine.seededWithDRS != m_simulateDRS) {
+                refreshVortexLine(line);
+            }
+            m_reseedCursor++;
+        }
+
+        // Then add the lines still missing
+        while (budget > 0 && m_reseedCursor >= m_lineCount) {
+            if (m_vortexFill >= static_cast<int>(m_vortexPresent.size()) || m_lineCount >= m_numLines) {
+                m_reseedPhase = ReseedPhase::Idle;
+                break;
+            }
+
+            int slot = m_vortexFill++;
+            if (m_vortexPresent[slot]) {
+                continue;
+            }
+
+            budget--;
+            seedVortexLine(m_lineCount, slot / m_vortexLinesPerCenter, slot % m_vortexLinesPerCenter);
+            markLinesDirty(m_lineCount, m_lineCount + 1);
+            m_lineCount++;
+            m_reseedCursor = m_lineCount;
+        }
+    }
+
+    // Drop normal line `line`, keeping normal and vortex lines packed
+    void retireNormalLine(int line) {
+        int lastNormal = m_normalLineCount - 1;
+        if (line != lastNormal) {
+            m_pool.moveLine(lastNormal, line);
+        }
+
+        int lastLine = m_lineCount - 1;
+        if (lastLine != lastNormal) {
+            m_pool.moveLine(lastLine, lastNormal);
+        }
+
+        m_normalLineCount--;
+        m_lineCount--;
+        markLinesDirty(line, m_lineCount);
+    }
+
+    // Drop vortex line `line`, keeping the vortex lines packed
+    void retireVortexLine(int line) {
+        int lastLine = m_lineCount - 1;
+        if (line != lastLine) {
+            m_pool.moveLine(lastLine, line);
+        }
+
+        m_lineCount--;
+        markLinesDirty(line, line + 1);
+    }
+
+    // Update a vortex line seeded for the other DRS state without restarting it.
+    // The centers in use in both states sit in the same place, so only the
+    // strength (keeping its jitter) and the rear wing pressure change.
+    void refreshVortexLine(int line) {
+        FlowLine& flowLine = m_pool.params[line];
+        float oldStrength = m_vortexSources[flowLine.seededWithDRS][flowLine.vortexSource].second;
+        float newStrength = m_vortexSources[m_simulateDRS][flowLine.vortexSource].second;
+        flowLine.vortexStrength *= newStrength / oldStrength;
+
+        if (m_pool.zoneType[line] == 3) {
+            m_pool.pressure[line] = rearVortexPressure();
+        }
+
+        flowLine.seededWithDRS = m_simulateDRS;
+        markLinesDirty(line, line + 1);
+    }
+
+    // Reset a flow line to its initial state with updated car position
+    void resetFlowLine(int line, FlowRandom& random) {
+        const FlowLine& flowLine = m_pool.params[line];
+
+        // Clear existing points (the ring storage is kept)
+        m_pool.clearPoints(line);
+
+        // Reset life
+        m_pool.life[line] = flowLine.initialLife;
+
+        // Update position based on car's current position
+        glm::vec3 newPosition = flowLine.initialOffset;
+        newPosition.z += carInFrame();
+
+        // Initialize with starting point
+        m_pool.pushFront(line, newPosition);
+
+        // For vortices, reset phase but keep the strength
+        if (m_pool.isVortex[line]) {
+            m_pool.vortexPhase[line] = random.uniform(0.0f, 6.28f);
+        }
+
+        // Adjust speed based on current car speed
+        m_pool.speed[line] = flowLine.velocity * (m_carSpeed / 250.0f);
+    }
+
+    // Advance lines [firstLine, lastLine) by one step.
+    // Lines are taken kAeroLanes at a time: the per-line bookkeeping runs first,
+    // then the non-vortex heads of the batch go through one vectorized kernel call.
+    void advanceLines(int firstLine, int lastLine, float deltaTime) {
+        ProfileScope scope("advanceLines");
+        AeroKernelParams aeroParams = aeroKernelParams();
+        const FlowField* field = m_fieldAdvection ? &m_flowFields[m_simulateDRS ? 1 : 0] : nullptr;
+        const FlowFieldBricks* bricks = m_fieldAdvection ? flowFieldBricks() : nullptr;
+
+        // Walk the lines in slot order so every array streams linearly
+        for (int batchStart = firstLine; batchStart < lastLine; batchStart += kAeroLanes) {
+            int batchEnd = std::min(batchStart + kAeroLanes, lastLine);
+            AeroLanes lanes = {};    // Unused lanes stay zero
+            int laneLines[kAeroLanes];
+            int laneCount = 0;
+
+            for (int line = batchStart; line < batchEnd; line++) {
+                // Turbulence of this line in this frame, independent of thread and order
+                FlowRandom random(m_randomSeed, line, m_frameIndex);
+
+                // Update life
+                m_pool.life[line] -= deltaTime;
+
+                // If life is over, reset the flow line
+                if (m_pool.life[line] <= 0.0f) {
+                    resetFlowLine(line, random);
+                }
+
+                // Calculate how much to advance the flow line
+                float distanceToAdvance = m_pool.speed[line] * deltaTime;
+
+                if (m_pool.pointCount[line] == 0) {
+                    continue;
+                }
+
+                // Vortex lines keep the scalar path; the rest join the batch
+                if (m_pool.isVortex[line]) {
+                    advanceHead(line, applyVortexMotion(line, distanceToAdvance, random));
+                    continue;
+                }
+
+                const glm::vec3& head = m_pool.front(line);
+                const glm::vec3& direction = m_pool.params[line].direction;
+                lanes.headX[laneCount] = head.x;
+                lanes.headY[laneCount] = head.y;
+                lanes.headZ[laneCount] = head.z;
+                lanes.directionX[laneCount] = direction.x;
+                lanes.directionY[laneCount] = direction.y;
+                lanes.directionZ[laneCount] = direction.z;
+                lanes.distance[laneCount] = distanceToAdvance;
+                lanes.floorZone[laneCount] = (m_pool.zoneType[line] == 4) ? 1.0f : 0.0f;
+                lanes.randomKey[laneCount] = random.key();
+                lanes.pressure[laneCount] = m_pool.pressure[line];
+                laneLines[laneCount] = line;
+                laneCount++;
+            }
+
+            if (laneCount == 0) {
+                continue;
+            }
+
+            // Calculate new head positions with aerodynamic effects
+            auto evaluate = [&](AeroLanes& batch) {
+                if (bricks) {
+                    computeFieldDisplacement(*bricks, aeroParams, deltaTime, batch, laneCount);
+                }
+                else if (field) {
+                    computeFieldDisplacement(*field, aeroParams, deltaTime, batch, laneCount);
+                }
+                else if (m_simdAdvection) {
+                    computeAeroDisplacement(aeroParams, batch, laneCount);
+                }
+                else {
+                    computeAeroDisplacementScalar(aeroParams, batch, laneCount);
+                }
+            };
+            auto emit = [&](int lane, const glm::vec3& position) {
+                emitHead(laneLines[lane], position);
+            };
+
+            if (m_integrator == FlowIntegrator::RK4) {
+                FlowIntegration::integrateRK4(lanes, laneCount, evaluate, emit);
+            }
+            else if (m_integrator == FlowIntegrator::RK45) {
+                FlowIntegration::integrateRK45(lanes, laneCount, evaluate, emit);
+            }
+            else {
+                evaluate(lanes);
+                for (int lane = 0; lane < laneCount; lane++) {
+                    advanceHead(laneLines[lane],
+                        glm::vec3(lanes.displacementX[lane], lanes.displacementY[lane], lanes.displacementZ[lane]));
+                }
+            }
+
+            for (int lane = 0; lane < laneCount; lane++) {
+                m_pool.pressure[laneLines[lane]] = lanes.pressure[lane];    // Lowered under the floor
+            }
+        }
+    }
+
+    // Car state for the aerodynamics kernels
+    AeroKernelParams aeroKernelParams() const {
+        AeroKernelParams params;
+        params.carLength = m_carLength;
+        params.carWidth = m_carWidth;
+        params.carHeight = m_carHeight;
+        params.carPosition = carInFrame();
+        params.carSpeedFactor = m_carSpeed / 250.0f;
+        params.simulateDRS = m_simulateDRS;
+        return params;
+    }
+
+    // Append the displaced head of a line
+    void advanceHead(int line, const glm::vec3& displacement) {
+        glm::vec3 newHeadPos = m_pool.front(line) + displacement;
+
+        // Insert new head; the oldest point is overwritten once the line is full
+        m_pool.pushFront(line, newHeadPos);
+    }
+
+    // Move the head of a line to position. The newest point travels with the
+    // head until the segment behind it grows too long or turns too far from
+    // the one before; then it stays where it is and a new point carries on.
+    void emitHead(int line, const glm::vec3& position) {
+        if (m_pool.pointCount[line] >= 3) {
+            const glm::vec3& anchor = m_pool.point(line, 1);
+            glm::vec3 segment = position - anchor;
+            glm::vec3 previous = anchor - m_pool.point(line, 2);
+            float length = glm::length(segment);
+            bool stretched = length > kMaxPointSpacing;
+            bool turned = length > kMinPointSpacing &&
+                glm::dot(segment, previous) < kMaxTurnCosine * length * glm::length(previous);
+            if (!stretched && !turned) {
+                m_pool.replaceFront(line, position);
+                return;
+            }
+        }
+        m_pool.pushFront(line, position);
+    }
+
+    // Record that lines [firstLine, lastLine) were re-seeded or moved between slots,
+    // for state kept outside the pool (the GPU backend's copy) to catch up on
+    void markLinesDirty(int firstLine, int lastLine) {
+        m_dirtyFirst = std::min(m_dirtyFirst, firstLine);
+        m_dirtyLast = std::max(m_dirtyLast, lastLine);
+    }
+
+    // Generate random float in range
+    // Only used for seeding; per-frame jitter comes from FlowRandom
+    float generateRandomFloat(float min, float max) {
+        std::uniform_real_distribution<float> distribution(min, max);
+        return distribution(m_generator);
+    }
+
+protected:
+    // Parallel CPU update
+    static const int kLinesPerJob = 32;     // Lines claimed by a thread at a time
+    bool m_parallelUpdate;
+    std::unique_ptr<JobSystem> m_jobs;
+    bool m_simdAdvection;
+
+    // Integration and adaptive point emission
+    FlowIntegrator m_integrator;
+    static constexpr float kMaxPointSpacing = 0.5f;      // Meters of straight flow between trail points
+    static constexpr float kMinPointSpacing = 0.05f;     // Shortest segment a bend may end
+    static constexpr float kMaxTurnCosine = 0.9945f;     // cos(6 degrees) of turn between segments
+
+    // Precomputed aerodynamics, by DRS state
+    bool m_fieldAdvection;
+    FlowField m_flowFields[2];
+    bool m_flowFieldLoaded[2];       // Loaded from a file rather than baked
+    float m_flowFieldSpeed[2];       // Car speed a baked field was made for, -1 before the first bake
+    std::unique_ptr<FlowFieldBricks> m_fieldBricks[2];   // Streamed datasets, which override the fields
+    static const int kBrickLoadsPerStep = 32;            // About 2.5 MB of 16-cell bricks
+    static constexpr float kSeedPrefetchRadius = 0.05f;  // Margin around a seed in the frustum test
+
+    // Random numbers
+    unsigned int m_randomSeed;
+    unsigned int m_frameIndex;   // Counts steps; keys the per-step turbulence
+    std::mt19937 m_generator;    // Seeding stream
+
+    // Flow lines data
+    FlowLinePool m_pool;
+    int m_lineCount;             // Active lines, packed at the front of the pool
+    int m_normalLineCount;       // Non-vortex lines; vortex lines follow them
+    int m_numLines;
+    int m_pointsPerLine;
+    int m_slotSize;
+    int m_totalPoints;
+
+    // Car properties
+    float m_carLength;
+    float m_carWidth;
+    float m_carHeight;
+    float m_carPosition;
+    float m_frameOrigin;         // World Z of the flow frame the pool's points are stored in
+    float m_carSpeed;
+
+    // Visualization parameters
+    float m_minDistance;
+    SeedGrid m_seedGrid;         // Seeds placed by initFlowLines() or kept by the current delta
+    bool m_adaptiveDensity;
+    bool m_simulateDRS;
+    bool m_relativeDynamics;
+    bool m_visualizePressure;
+    float m_vortexIntensity;
+
+    // Incremental reseeding
+    enum class ReseedPhase {
+        Idle,
+        Retire,      // Re-checking normal seeds against the new spacing
+        Add,         // Topping the zones back up
+        Vortices     // Reconciling vortex lines with DRS state and intensity
+    };
+    static const int kSeedZoneCount = 5;
+    static const int kReseedLinesPerStep = 512;   // CPU backend delta budget
+    bool m_incrementalReseed;
+    ReseedPhase m_reseedPhase;
+    int m_reseedCursor;                      // Next line to examine
+    int m_reseedZone;                        // Zone being topped up
+    int m_zoneLineCount[kSeedZoneCount];     // Seeds kept or added per zone
+    int m_zoneTriesLeft[kSeedZoneCount];
+    std::vector<std::pair<glm::vec3, float>> m_vortexSources[2];  // Vortex centers and strengths, by DRS state
+    std::vector<unsigned char> m_vortexPresent;  // Center/line pairs found by the vortex delta
+    int m_vortexCenters;
+    int m_vortexLinesPerCenter;
+    int m_vortexFill;                        // Next center/line pair to add if missing
+    int m_dirtyFirst;                        // Lines [first, last) marked since the range was last taken
+    int m_dirtyLast;
+};
+
+#endif // FLOW_SIMULATION_H
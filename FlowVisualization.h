@@ -1,169 +1,157 @@
-﻿#define FLOW_VISUALIZATION_H
+﻿#ifndef FLOW_VISUALIZATION_H
+#define FLOW_VISUALIZATION_H
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <vector>
 #include <random>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <iostream>
+#include <string>
+#include <limits>
+#include <thread>
 #include "Shader.h"
-
-// Flow line for visualization
-struct FlowLine {
-    std::vector<glm::vec3> points;   // Points forming the flow line
-    std::vector<glm::vec3> colors;   // Color for each point
-    float life;                      // Life of the entire flow line
-    float initialLife;               // Initial life value
-    float speed;                     // Speed of flow line progression
-    glm::vec3 initialPosition;       // Initial starting position
-    glm::vec3 direction;             // Main flow direction
-    int maxPoints;                   // Maximum number of points in line
-    float pressure;                  // Pressure value for coloring
-    float velocity;                  // Velocity magnitude
-    int zoneType;                    // The emission zone this flow line came from
-    glm::vec3 initialOffset;         // Initial offset from car's reference position
-    float lastCarPosition;           // Last known car position for this flow line
-    bool isVortex;                   // Flag to indicate if this is a vortex flow line
-    float vortexStrength;            // Strength of the vortex rotation (if isVortex is true)
-    float vortexPhase;               // Phase of the vortex rotation (if isVortex is true)
+#include "StreamingBuffer.h"
+#include "FlowColormap.h"
+#include "GpuFlowAdvection.h"
+#include "FlowSimulation.h"
+#include "FlowRecording.h"
+
+// Where flow lines are advected
+enum class AdvectionBackend {
+    CPU,    // Per-line physics on the CPU, trails streamed to the GPU every frame
+    GPU     // Transform feedback advection; line state never leaves the GPU
 };
 
-// Main class for flow line visualization
-class FlowLinesVisualization {
+// Main class for flow line visualization: the FlowSimulation plus its GL
+// buffers, the GPU backend and an optional simulation thread.
+// The simulation advances in fixed steps of kFixedTimestep, either inside
+// update() or on a simulation thread of its own. While that thread runs,
+// every setter call must hold stateMutex(). update() holds it only to copy
+// the points written since the last frame into the renderer's own pool;
+// encoding, uploading and recording them run without it, so they never
+// hold up a step.
+class FlowLinesVisualization : public FlowSimulation {
 public:
-    FlowLinesVisualization(int numLines, float carLength, float carWidth, float carHeight) {
-        // Initialize flow lines
-        m_numLines = numLines;
-        m_carLength = carLength;
-        m_carWidth = carWidth;
-        m_carHeight = carHeight;
-        m_pointsPerLine = 80;        // Number of points per flow line
-        m_totalPoints = m_numLines * m_pointsPerLine;
-        m_minDistance = 0.05f;       // Minimum distance between streamlines
-        m_adaptiveDensity = true;    // Enable adaptive density
-        m_carPosition = -50.0f;        // Current car Z position
-        m_prevCarPosition = 0.0f;    // Previous car Z position
-        m_carSpeed = 400.0f;         // Car speed in km/h
-        m_simulateDRS = false;       // DRS state
-        m_relativeDynamics = true;   // Enable relative dynamics (flow moves with car)
-        m_visualizePressure = true;  // Show pressure differences in color 
-        m_vortexIntensity = 2.0f;    // Vortex visualization intensity
-
-        // Initialize flow line segments
-        initFlowLines();
+    static const int kMaxStepsPerUpdate = 8;         // Longer stalls are dropped, not caught up
+    static constexpr float kLineWidth = 1.2f;        // Pixels; thin, for less congestion
+    static constexpr float kVortexLineWidth = 1.8f;  // Pixels; vortex lines stand out
+
+    FlowLinesVisualization(int numLines, float carLength, float carWidth, float carHeight,
+        unsigned int seed = std::random_device{}(), int pointsPerLine = kDefaultPointsPerLine)
+        : FlowSimulation(numLines, carLength, carWidth, carHeight, seed, pointsPerLine) {
+        m_backend = AdvectionBackend::CPU;
+        m_flowAnchor = 0.0f;
+        m_stepAccumulator = 0.0f;
+        m_publishedFrame = 0;
+        m_published.lineCount = 0;
+        m_published.normalLineCount = 0;
+        m_published.step = 0;
+        m_published.carPosition = 0.0f;
+        m_published.frameOrigin = 0.0f;
+        m_published.carZ = 0.0f;
+        m_published.carRelative = false;
+        m_published.pending = false;
+        m_published.replay = false;
+        m_simulationPaused = false;
+        m_stopSimulation = false;
+        m_replaying = false;
+        m_replayClock = 0.0;
+
         setupBuffers();
     }
 
-    // Update flow line positions
-    void update(float deltaTime) {
-        // Calculate car movement delta
-        float carMovementDelta = m_carPosition - m_prevCarPosition;
-        m_prevCarPosition = m_carPosition;
-
-        std::vector<glm::vec3> vertices;
-        std::vector<glm::vec3> colors;
-
-        // For each flow line
-        for (auto& flowLine : m_flowLines) {
-            // Update life
-            flowLine.life -= deltaTime;
-
-            // If life is over, reset the flow line
-            if (flowLine.life <= 0.0f) {
-                resetFlowLine(flowLine);
-            }
-
-            // Calculate how much to advance the flow line
-            float distanceToAdvance = flowLine.speed * deltaTime;
-
-            // If relative dynamics is enabled, adjust for car movement
-            if (m_relativeDynamics) {
-                // Calculate relative movement delta for this specific flow line
-                float relativeDelta = m_carPosition - flowLine.lastCarPosition;
-                flowLine.lastCarPosition = m_carPosition;
+    ~FlowLinesVisualization() {
+        stopSimulationThread();
+    }
 
-                // Apply car movement to existing points (they move with the car)
-                for (auto& point : flowLine.points) {
-                    point.z += relativeDelta;
-                }
+    // Run the fixed steps that deltaTime of real time calls for and hand the newest
+    // state to the renderer. While the simulation thread runs CPU steps, this only
+    // publishes what it produced. During a replay it plays the recording instead.
+    void update(float deltaTime) {
+        ProfileScope scope("update");
+        {
+            std::lock_guard<std::mutex> lock(m_stateMutex);
+            if (m_replaying) {
+                advanceReplay(deltaTime);
             }
-
-            // Shift all points forward
-            if (flowLine.points.size() > 0) {
-                // Remove tail if we reached max points
-                if (flowLine.points.size() >= flowLine.maxPoints) {
-                    flowLine.points.pop_back();
-                    flowLine.colors.pop_back();
+            else if (!m_simulationThread.joinable() || m_backend != AdvectionBackend::CPU) {
+                m_stepAccumulator += deltaTime;
+                int steps = 0;
+                while (m_stepAccumulator >= kFixedTimestep && steps < kMaxStepsPerUpdate) {
+                    simulateStep(kFixedTimestep);
+                    m_stepAccumulator -= kFixedTimestep;
+                    steps++;
                 }
-
-                // Calculate new head position with aerodynamic effects
-                glm::vec3 displacement;
-                if (flowLine.isVortex) {
-                    displacement = applyVortexMotion(flowLine, distanceToAdvance);
+                if (steps == kMaxStepsPerUpdate) {
+                    m_stepAccumulator = std::min(m_stepAccumulator, kFixedTimestep);
                 }
-                else {
-                    displacement = applyAerodynamics(flowLine, distanceToAdvance);
-                }
-                glm::vec3 newHeadPos = flowLine.points.front() + displacement;
-
-                // Insert new head at the beginning
-                flowLine.points.insert(flowLine.points.begin(), newHeadPos);
-
-                // Calculate color for the new head
-                float lifeRatio = flowLine.life / flowLine.initialLife;
-                float pointPosition = 0.0f; // Head position is 0
-                glm::vec3 color = calculateFlowColor(lifeRatio, pointPosition, flowLine);
-                flowLine.colors.insert(flowLine.colors.begin(), color);
-            }
-
-            // Add all points and colors to rendering vectors
-            for (size_t i = 0; i < flowLine.points.size(); i++) {
-                vertices.push_back(flowLine.points[i]);
-                colors.push_back(flowLine.colors[i]);
             }
+            snapshotState();
         }
 
-        // Update VBO data
-        updateBuffers(vertices, colors);
+        publishSnapshot();
     }
 
-    // Draw flow lines
-    void draw(Shader& shader, const glm::mat4& view, const glm::mat4& projection) {
+    // Draw flow lines; the camera comes from the shared Camera uniform block
+    void draw(Shader& shader) {
+        ProfileScope scope("draw flow");
+        if (m_backend == AdvectionBackend::GPU && !m_replaying) {
+            drawGpu();
+            return;
+        }
+
+        // Points are stored as FlowPointCodes around the drawn region's origin;
+        // moving the car only moves the flow frame they are drawn in
+        float origin = publishedFrameOrigin() + m_regionOrigin[m_drawRegion];
         shader.use();
-        shader.setMat4("projection", projection);
-        shader.setMat4("view", view);
-        shader.setMat4("model", glm::mat4(1.0f));
+        shader.setMat4("model", glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, origin)));
+        shader.setFloat("positionScale", FlowPointCode::kStep);
+
+        // The shader widens each strip into a ribbon; vortex lines, the slots from
+        // the published normal line count on, come out wider in the same draw
+        shader.setFloat("lineWidth", kLineWidth);
+        shader.setFloat("vortexLineWidth", kVortexLineWidth);
+        shader.setInt("firstVortexLine", m_publishedNormalLines);
+        shader.setInt("slotSize", m_slotSize);
+        shader.setInt("numLines", m_numLines);
+
+        // Colors come from the region's line shades and the colormap, so the
+        // coloring mode applies to whole trails at once
+        shader.setInt("lineShades", kShadeUnit);
+        shader.setInt("shadeBase", m_drawRegion * m_numLines);
+        shader.setInt("flowColormap", kColormapUnit);
+        shader.setBool("visualizePressure", m_visualizePressure);
+        glActiveTexture(GL_TEXTURE0 + kShadeUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, m_shadeTexture);
+        glActiveTexture(GL_TEXTURE0);
+        m_colormap.bind(kColormapUnit);
 
         glBindVertexArray(m_VAO);
 
-        // Enable line smoothing and set line width
-        glEnable(GL_LINE_SMOOTH);
-        glLineWidth(1.2f);  // Thinner lines for less congestion
-
-        // Enable alpha blending for better visualization
+        // Enable alpha blending for better visualization and for the ribbons' antialiased edges
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-        // Draw lines instead of points
-        int offset = 0;
-        for (const auto& flowLine : m_flowLines) {
-            if (flowLine.points.size() > 1) {
-                // Use thicker lines for vortex flows
-                if (flowLine.isVortex) {
-                    glLineWidth(1.8f);
-                }
-                else {
-                    glLineWidth(1.2f);
-                }
-                glDrawArrays(GL_LINE_STRIP, offset, flowLine.points.size());
-            }
-            offset += flowLine.points.size();
+        // Draw lines instead of points, from the region published last, in one multi-draw
+        int stripCount = m_normalStrips + m_vortexStrips;
+        if (stripCount > 0) {
+            glMultiDrawArrays(GL_LINE_STRIP, m_stripFirsts.data(), m_stripCounts.data(), stripCount);
         }
 
-        glDisable(GL_LINE_SMOOTH);
+        // Keep the CPU from overwriting this region until the GPU has drawn it
+        m_positionBuffer.fence();
+        m_shadeBuffer.fence();
+
         glBindVertexArray(0);
     }
 
-    void drawReferenceMarker(Shader& shader, const glm::mat4& view, const glm::mat4& projection) {
+    void drawReferenceMarker(Shader& shader) {
         // Initialize buffers if not already done
         static GLuint refVAO = 0, refVBO = 0, refColorVBO = 0;
 
@@ -209,12 +197,10 @@ public:
 
         // Draw reference marker
         shader.use();
-        shader.setMat4("projection", projection);
-        shader.setMat4("view", view);
         shader.setMat4("model", glm::mat4(1.0f));
+        setPlainGeometry(shader, 3.0f);
 
         glBindVertexArray(refVAO);
-        glLineWidth(3.0f);
 
         // Draw pole
         glDrawArrays(GL_LINES, 0, 2);
@@ -225,789 +211,638 @@ public:
         glBindVertexArray(0);
     }
 
+    // Wireframe box the size of the car at its current position, drawn while the model is loading
+    void drawCarPlaceholder(Shader& shader) {
+        static GLuint boxVAO = 0, boxVBO = 0;
+        static const int kBoxVertices = 24;
+
+        if (boxVAO == 0) {
+            // Unit box corners, scaled to the car by the model matrix
+            glm::vec3 corners[8];
+            for (int i = 0; i < 8; i++) {
+                corners[i] = glm::vec3((i & 1) ? 0.5f : -0.5f, (i & 2) ? 1.0f : 0.0f, (i & 4) ? 0.5f : -0.5f);
+            }
+
+            // 12 edges: pairs of corners differing in one axis, position then color
+            std::vector<glm::vec3> boxVertices;
+            glm::vec3 edgeColor(1.0f, 0.35f, 0.0f);  // McLaren orange, like the car
+            for (int i = 0; i < 8; i++) {
+                for (int axis = 1; axis < 8; axis <<= 1) {
+                    if (!(i & axis)) {
+                        boxVertices.push_back(corners[i]);
+                        boxVertices.push_back(edgeColor);
+                        boxVertices.push_back(corners[i | axis]);
+                        boxVertices.push_back(edgeColor);
+                    }
+                }
+            }
+
+            glGenVertexArrays(1, &boxVAO);
+            glGenBuffers(1, &boxVBO);
+
+            glBindVertexArray(boxVAO);
+            glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+            glBufferData(GL_ARRAY_BUFFER, boxVertices.size() * sizeof(glm::vec3), boxVertices.data(), GL_STATIC_DRAW);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*)0);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*)sizeof(glm::vec3));
+            glEnableVertexAttribArray(1);
+
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            glBindVertexArray(0);
+        }
+
+        glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, m_carPosition));
+        model = glm::scale(model, glm::vec3(m_carWidth, m_carHeight, m_carLength));
+
+        shader.use();
+        shader.setMat4("model", model);
+        setPlainGeometry(shader, 2.0f);
+
+        glBindVertexArray(boxVAO);
+        glDrawArrays(GL_LINES, 0, kBoxVertices);
+        glBindVertexArray(0);
+    }
+
     // Cleanup resources
     void cleanup() {
+        stopSimulationThread();
+        m_recorder.close();
+        m_replay.close();
         glDeleteVertexArrays(1, &m_VAO);
-        glDeleteBuffers(1, &m_VBO);
-        glDeleteBuffers(1, &m_colorVBO);
+        glDeleteTextures(1, &m_shadeTexture);
+        m_positionBuffer.destroy();
+        m_shadeBuffer.destroy();
+        m_colormap.destroy();
+        m_gpu.destroy();
     }
 
-    // Set adaptive density flag
-    void setAdaptiveDensity(bool enable) {
-        m_adaptiveDensity = enable;
+    // Run CPU steps on a thread of their own, paced by the clock at kFixedTimestep
+    // instead of by frames. The GPU backend keeps stepping in update(), which
+    // owns the GL context.
+    void startSimulationThread() {
+        if (m_simulationThread.joinable()) {
+            return;
+        }
+        m_stopSimulation = false;
+        m_simulationThread = std::thread(&FlowLinesVisualization::simulationLoop, this);
     }
 
-    // Set minimum distance between streamlines
-    void setDensity(float minDistance) {
-        m_minDistance = minDistance;
+    void stopSimulationThread() {
+        if (!m_simulationThread.joinable()) {
+            return;
+        }
+        m_stopSimulation = true;
+        m_simulationThread.join();
+
+        // update() takes over from the next step onwards
+        m_stepAccumulator = 0.0f;
     }
 
-    // Set car position (for moving car functionality)
-    void setCarPosition(float position) {
-        m_carPosition = position;
+    bool isSimulationThreadRunning() const {
+        return m_simulationThread.joinable();
     }
 
-    // Set car speed in km/h (affects flow behavior)
-    void setCarSpeed(float speed) {
-        m_carSpeed = speed;
+    // Hold the simulation thread's steps, e.g. while the flow is paused or hidden
+    void setSimulationPaused(bool paused) {
+        m_simulationPaused = paused;
     }
 
-    // Set DRS state (open/closed)
-    void setDRS(bool isOpen) {
-        bool stateChanged = (m_simulateDRS != isOpen);
-        m_simulateDRS = isOpen;
+    // Held by each step and by update(); lock it around setters while the thread runs
+    std::mutex& stateMutex() {
+        return m_stateMutex;
+    }
 
-        // Regenerate vortices when DRS state changes
-        if (stateChanged) {
-            regenerateVortices();
+    // Write every published frame to a session file until stopRecording().
+    // Only the CPU backend's state is recorded.
+    bool startRecording(const std::string& path) {
+        if (m_replaying) {
+            return false;
+        }
+        if (m_backend == AdvectionBackend::GPU) {
+            std::cerr << "WARNING::FLOW::RECORDING_GPU_BACKEND: frames are recorded on the CPU backend only" << std::endl;
         }
+        return m_recorder.open(path, m_numLines, m_pointsPerLine);
     }
 
-    // Set relative dynamics (flow moves with car)
-    void setRelativeDynamics(bool enable) {
-        m_relativeDynamics = enable;
+    void stopRecording() {
+        m_recorder.close();
     }
 
-    // Toggle pressure visualization
-    void setPressureVisualization(bool enable) {
-        m_visualizePressure = enable;
+    bool isRecording() const {
+        return m_recorder.isOpen();
     }
 
-    // Set vortex visualization intensity (0.0 - 2.0)
-    void setVortexIntensity(float intensity) {
-        m_vortexIntensity = glm::clamp(intensity, 0.0f, 2.0f);
-        regenerateVortices();
+    // Show a recorded session, played at the speed it was recorded at, instead of
+    // the live flow. The simulation holds still until stopReplay(). Call it, like
+    // seekReplay() and stopReplay(), from the thread that owns the GL context.
+    bool startReplay(const std::string& path) {
+        stopRecording();
+        if (!m_replay.open(path)) {
+            return false;
+        }
+        if (m_replay.lineCapacity() > m_numLines || m_replay.pointsPerLine() != m_pointsPerLine) {
+            std::cerr << "ERROR::FLOW::REPLAY_LAYOUT_MISMATCH: " << path << " holds " << m_replay.lineCapacity()
+                << " lines of " << m_replay.pointsPerLine() << " points" << std::endl;
+            m_replay.close();
+            return false;
+        }
+        if (!m_replay.seek(0)) {
+            m_replay.close();
+            return false;
+        }
+
+        m_replaying = true;
+        m_replayClock = m_replay.step();
+        invalidateRegions(m_replay.pool());
+        m_publishedFrame = m_replay.frame() - 1;
+        publishState();
+        return true;
     }
 
-    // Reset all flow lines with the current car position
-    void resetAllFlowLines() {
-        for (auto& flowLine : m_flowLines) {
-            resetFlowLine(flowLine);
+    void stopReplay() {
+        if (!m_replaying) {
+            return;
         }
+        m_replay.close();
+        m_replaying = false;
 
-        // Ensure vortices are properly generated
-        regenerateVortices();
+        // Back to the live state, which the regions have to catch up with in full
+        invalidateRegions(m_published.pool);
+        m_publishedFrame = m_frameIndex - 1;
+        publishState();
     }
 
-private:
-    // Initialize flow lines with random positions around the car
-    void initFlowLines() {
-        m_flowLines.clear();
-
-        // Define the emission zones around the car
-        // Front wing
-        float frontWingZ = -m_carLength * 0.5f;
-        float frontWingWidth = m_carWidth * 1.2f;
-        float frontWingHeight = m_carHeight * 0.3f;
-
-        // Top of car (airbox/engine cover)
-        float topZ = 0.0f;
-        float topWidth = m_carWidth * 0.5f;
-        float topHeight = m_carHeight;
-
-        // Side pods
-        float sideZ = 0.0f;
-        float sideWidth = m_carWidth * 0.5f;
-        float sideHeight = m_carHeight * 0.5f;
-
-        // Rear wing
-        float rearWingZ = m_carLength * 0.4f;
-        float rearWingWidth = m_carWidth * 0.9f;
-        float rearWingHeight = m_carHeight * 0.9f;
-
-        // Floor/diffuser
-        float floorZ = 0.0f;
-        float floorWidth = m_carWidth * 0.8f;
-        float floorHeight = 0.05f;
-
-        // Define reserved lines for vortices
-        int vortexLines = m_numLines * 0.1f;  // 10% for vortices
-
-        // Determine how many lines to allocate to each zone
-        int frontWingLines = m_numLines * 0.25f;  // 25% for front wing
-        int topLines = m_numLines * 0.15f;        // 15% for top
-        int sideLines = m_numLines * 0.15f;       // 15% for sides
-        int rearWingLines = m_numLines * 0.15f;   // 15% for rear wing
-        int floorLines = m_numLines * 0.2f;       // 20% for floor/diffuser
-
-        int lineCount = 0;
-        std::vector<glm::vec3> existingPositions;
-
-        // Add front wing lines
-        for (int i = 0; i < frontWingLines && lineCount < m_numLines; i++) {
-            FlowLine flowLine;
-            flowLine.maxPoints = m_pointsPerLine;
-            flowLine.zoneType = 0;  // Front wing zone
-            flowLine.lastCarPosition = m_carPosition;  // Initialize with current car position
-            flowLine.isVortex = false;
-
-            // Try several positions until we find one with proper spacing
-            bool positionFound = false;
-            for (int attempt = 0; attempt < 10 && !positionFound; attempt++) {
-                glm::vec3 position;
-                position.x = generateRandomFloat(-frontWingWidth / 2, frontWingWidth / 2);
-                position.y = generateRandomFloat(0.05f, frontWingHeight);
-                position.z = frontWingZ - generateRandomFloat(0.0f, 0.2f);
-
-                // Store initial offset from car reference position
-                flowLine.initialOffset = position;
-
-                // Add car position to get world position
-                position.z += m_carPosition;
-
-                // Check distance to existing positions
-                if (checkMinimumDistance(position, existingPositions, m_minDistance * 0.8f)) {
-                    flowLine.initialPosition = position;
-                    flowLine.direction = glm::normalize(glm::vec3(0.0f, 0.0f, 1.0f));
-                    flowLine.pressure = generateRandomFloat(0.7f, 1.0f);  // Higher pressure in front
-                    flowLine.velocity = generateRandomFloat(5.0f, 8.0f);
-                    flowLine.speed = flowLine.velocity * (m_carSpeed / 250.0f); // Scale with car speed
-                    flowLine.initialLife = generateRandomFloat(3.0f, 5.0f);
-                    flowLine.life = flowLine.initialLife;
-
-                    // Initialize with starting point
-                    flowLine.points.push_back(position);
-                    flowLine.colors.push_back(calculateFlowColor(1.0f, 0.0f, flowLine));
-
-                    m_flowLines.push_back(flowLine);
-                    existingPositions.push_back(position);
-                    positionFound = true;
-                    lineCount++;
-                }
-            }
+    bool isReplaying() const {
+        return m_replaying;
+    }
+
+    // Jump to a frame of the replay; clamped to the session
+    void seekReplay(int frame) {
+        if (!m_replaying) {
+            return;
+        }
+        int lastFrame = static_cast<int>(m_replay.frameCount()) - 1;
+        if (!m_replay.seek(static_cast<unsigned int>(glm::clamp(frame, 0, lastFrame)))) {
+            stopReplay();
+            return;
         }
+        m_replayClock = m_replay.step();
+        publishState();
+    }
 
-        // Add top lines
-        for (int i = 0; i < topLines && lineCount < m_numLines; i++) {
-            FlowLine flowLine;
-            flowLine.maxPoints = m_pointsPerLine;
-            flowLine.zoneType = 1;  // Top zone
-            flowLine.lastCarPosition = m_carPosition;  // Initialize with current car position
-            flowLine.isVortex = false;
-
-            bool positionFound = false;
-            for (int attempt = 0; attempt < 10 && !positionFound; attempt++) {
-                glm::vec3 position;
-                position.x = generateRandomFloat(-topWidth / 2, topWidth / 2);
-                position.y = topHeight + generateRandomFloat(0.0f, 0.2f);
-                position.z = topZ + generateRandomFloat(-m_carLength * 0.3f, m_carLength * 0.3f);
-
-                // Store initial offset from car reference position
-                flowLine.initialOffset = position;
-
-                // Add car position to get world position
-                position.z += m_carPosition;
-
-                if (checkMinimumDistance(position, existingPositions, m_minDistance)) {
-                    flowLine.initialPosition = position;
-                    flowLine.direction = glm::normalize(glm::vec3(0.0f, 0.0f, 1.0f));
-                    flowLine.pressure = generateRandomFloat(0.3f, 0.6f);  // Medium pressure on top
-                    flowLine.velocity = generateRandomFloat(7.0f, 10.0f);
-                    flowLine.speed = flowLine.velocity * (m_carSpeed / 250.0f); // Scale with car speed
-                    flowLine.initialLife = generateRandomFloat(3.0f, 5.0f);
-                    flowLine.life = flowLine.initialLife;
-
-                    flowLine.points.push_back(position);
-                    flowLine.colors.push_back(calculateFlowColor(1.0f, 0.0f, flowLine));
-
-                    m_flowLines.push_back(flowLine);
-                    existingPositions.push_back(position);
-                    positionFound = true;
-                    lineCount++;
-                }
-            }
+    int replayFrame() const {
+        return static_cast<int>(m_replay.frame());
+    }
+
+    int replayFrameCount() const {
+        return static_cast<int>(m_replay.frameCount());
+    }
+
+    // Select where flow lines are advected. Switching back to the CPU reads
+    // the GPU state back once so the lines continue where they were.
+    void setAdvectionBackend(AdvectionBackend backend) {
+        if (backend == m_backend) {
+            return;
         }
 
-        // Add side lines
-        for (int i = 0; i < sideLines && lineCount < m_numLines; i++) {
-            FlowLine flowLine;
-            flowLine.maxPoints = m_pointsPerLine;
-            flowLine.zoneType = 2;  // Side zone
-            flowLine.lastCarPosition = m_carPosition;  // Initialize with current car position
-            flowLine.isVortex = false;
-
-            bool positionFound = false;
-            for (int attempt = 0; attempt < 10 && !positionFound; attempt++) {
-                glm::vec3 position;
-                position.x = (i % 2 == 0) ? sideWidth / 2 : -sideWidth / 2; // Left or right
-                position.y = generateRandomFloat(0.2f, sideHeight);
-                position.z = sideZ + generateRandomFloat(-m_carLength * 0.2f, m_carLength * 0.2f);
-
-                // Store initial offset from car reference position
-                flowLine.initialOffset = position;
-
-                // Add car position to get world position
-                position.z += m_carPosition;
-
-                if (checkMinimumDistance(position, existingPositions, m_minDistance)) {
-                    flowLine.initialPosition = position;
-                    flowLine.direction = glm::normalize(glm::vec3((i % 2 == 0) ? 0.2f : -0.2f, 0.0f, 1.0f));
-                    flowLine.pressure = generateRandomFloat(0.4f, 0.7f);
-                    flowLine.velocity = generateRandomFloat(6.0f, 9.0f);
-                    flowLine.speed = flowLine.velocity * (m_carSpeed / 250.0f); // Scale with car speed
-                    flowLine.initialLife = generateRandomFloat(3.0f, 5.0f);
-                    flowLine.life = flowLine.initialLife;
-
-                    flowLine.points.push_back(position);
-                    flowLine.colors.push_back(calculateFlowColor(1.0f, 0.0f, flowLine));
-
-                    m_flowLines.push_back(flowLine);
-                    existingPositions.push_back(position);
-                    positionFound = true;
-                    lineCount++;
-                }
+        if (backend == AdvectionBackend::GPU) {
+            if (!m_gpu.isCreated()) {
+                m_gpu.create(m_numLines, m_pointsPerLine);
             }
+            m_flowAnchor = FlowPointCode::originNear(carInFrame());
+            markLinesDirty(0, m_lineCount);
+        }
+        else {
+            m_gpu.readback(m_pool, m_lineCount, m_flowAnchor);
+            m_publishedFrame = m_frameIndex - 1;    // Publish the read-back state on the next update()
         }
 
-        // Add rear wing lines
-        for (int i = 0; i < rearWingLines && lineCount < m_numLines; i++) {
-            FlowLine flowLine;
-            flowLine.maxPoints = m_pointsPerLine;
-            flowLine.zoneType = 3;  // Rear wing zone
-            flowLine.lastCarPosition = m_carPosition;  // Initialize with current car position
-            flowLine.isVortex = false;
-
-            bool positionFound = false;
-            for (int attempt = 0; attempt < 10 && !positionFound; attempt++) {
-                glm::vec3 position;
-                position.x = generateRandomFloat(-rearWingWidth / 2, rearWingWidth / 2);
-                position.y = generateRandomFloat(rearWingHeight * 0.5f, rearWingHeight);
-                position.z = rearWingZ;
-
-                // Store initial offset from car reference position
-                flowLine.initialOffset = position;
-
-                // Add car position to get world position
-                position.z += m_carPosition;
-
-                if (checkMinimumDistance(position, existingPositions, m_minDistance)) {
-                    flowLine.initialPosition = position;
-
-                    // Consider DRS state for rear wing flow
-                    if (m_simulateDRS) {
-                        // DRS open - less drag, straighter flow
-                        flowLine.direction = glm::normalize(glm::vec3(0.0f, 0.05f, 1.0f));
-                        flowLine.pressure = generateRandomFloat(0.1f, 0.3f);
-                        flowLine.velocity = generateRandomFloat(5.0f, 8.0f); // Faster with DRS open
-                    }
-                    else {
-                        // DRS closed - more drag, more turbulent flow
-                        flowLine.direction = glm::normalize(glm::vec3(0.0f, 0.1f, 1.0f));
-                        flowLine.pressure = generateRandomFloat(0.1f, 0.4f);
-                        flowLine.velocity = generateRandomFloat(4.0f, 6.0f);
-                    }
+        m_backend = backend;
+    }
+
+    AdvectionBackend getAdvectionBackend() const {
+        return m_backend;
+    }
 
-                    flowLine.speed = flowLine.velocity * (m_carSpeed / 250.0f); // Scale with car speed
-                    flowLine.initialLife = generateRandomFloat(3.0f, 5.0f);
-                    flowLine.life = flowLine.initialLife;
+private:
+    // Advance every line by one fixed step on the selected backend. Touches no
+    // GL state on the CPU backend, so it may run on the simulation thread.
+    void simulateStep(float deltaTime) {
+        ProfileScope scope("step");
+        beginStep();
+
+        if (m_backend == AdvectionBackend::GPU) {
+            updateGpu(deltaTime);
+            return;
+        }
+        advanceAllLines(deltaTime);
+    }
 
-                    flowLine.points.push_back(position);
-                    flowLine.colors.push_back(calculateFlowColor(1.0f, 0.0f, flowLine));
+    // Hand the steps taken since the last call to the renderer, for callers
+    // that hold the state mutex anyway
+    void publishState() {
+        snapshotState();
+        publishSnapshot();
+    }
 
-                    m_flowLines.push_back(flowLine);
-                    existingPositions.push_back(position);
-                    positionFound = true;
-                    lineCount++;
-                }
+    // With the state mutex held: bring the published pool up to date with the
+    // points each line wrote since the last snapshot, plus the heads, counts
+    // and shades, which change every step. Replays need no copy, as only this
+    // thread touches the replay pool.
+    void snapshotState() {
+        if (m_replaying) {
+            if (m_publishedFrame != m_replay.frame()) {
+                m_published.pending = true;
+                m_published.replay = true;
+                m_publishedFrame = m_replay.frame();
             }
+            return;
         }
 
-        // Add floor/diffuser lines
-        for (int i = 0; i < floorLines && lineCount < m_numLines; i++) {
-            FlowLine flowLine;
-            flowLine.maxPoints = m_pointsPerLine;
-            flowLine.zoneType = 4;  // Floor zone
-            flowLine.lastCarPosition = m_carPosition;  // Initialize with current car position
-            flowLine.isVortex = false;
-
-            bool positionFound = false;
-            for (int attempt = 0; attempt < 10 && !positionFound; attempt++) {
-                glm::vec3 position;
-                position.x = generateRandomFloat(-floorWidth / 2, floorWidth / 2);
-                position.y = floorHeight;
-                position.z = floorZ + generateRandomFloat(-m_carLength * 0.3f, m_carLength * 0.3f);
-
-                // Store initial offset from car reference position
-                flowLine.initialOffset = position;
-
-                // Add car position to get world position
-                position.z += m_carPosition;
-
-                if (checkMinimumDistance(position, existingPositions, m_minDistance * 0.7f)) {  // Allow closer spacing under floor
-                    flowLine.initialPosition = position;
-                    flowLine.direction = glm::normalize(glm::vec3(0.0f, -0.05f, 1.0f));
-                    flowLine.pressure = generateRandomFloat(0.1f, 0.3f);  // Low pressure under floor
-                    flowLine.velocity = generateRandomFloat(8.0f, 12.0f);  // Faster flow under floor
-                    flowLine.speed = flowLine.velocity * (m_carSpeed / 250.0f); // Scale with car speed
-                    flowLine.initialLife = generateRandomFloat(3.0f, 5.0f);
-                    flowLine.life = flowLine.initialLife;
-
-                    flowLine.points.push_back(position);
-                    flowLine.colors.push_back(calculateFlowColor(1.0f, 0.0f, flowLine));
-
-                    m_flowLines.push_back(flowLine);
-                    existingPositions.push_back(position);
-                    positionFound = true;
-                    lineCount++;
+        if (m_backend == AdvectionBackend::CPU && m_publishedFrame != m_frameIndex) {
+            ProfileScope scope("snapshot");
+            FlowLinePool& copy = m_published.pool;
+            for (int line = 0; line < m_lineCount; line++) {
+                unsigned int pending = m_pool.writeSerial[line] - copy.writeSerial[line];
+                copy.head[line] = m_pool.head[line];
+                copy.pointCount[line] = m_pool.pointCount[line];
+                copy.writeSerial[line] = m_pool.writeSerial[line];
+                copy.pushSerial[line] = m_pool.pushSerial[line];
+                copy.setShade(line, m_pool.shade(line));
+                if (pending != 0) {
+                    copy.copyNewest(m_pool, line, static_cast<int>(std::min<unsigned int>(pending, m_pool.pointCount[line])));
                 }
             }
-        }
-
-        // Add vortex flow lines after normal lines
-        regenerateVortices();
-    }
 
-    // Check if a position maintains minimum distance from existing positions
-    bool checkMinimumDistance(const glm::vec3& position, const std::vector<glm::vec3>& existingPositions, float minDistance) {
-        for (const auto& existingPos : existingPositions) {
-            if (glm::length(position - existingPos) < minDistance) {
-                return false;
-            }
+            m_published.lineCount = m_lineCount;
+            m_published.normalLineCount = m_normalLineCount;
+            m_published.step = m_frameIndex;
+            m_published.carPosition = m_carPosition;
+            m_published.frameOrigin = m_frameOrigin;
+            m_published.carZ = carInFrame();
+            m_published.carRelative = m_relativeDynamics;
+            m_published.pending = true;
+            m_published.replay = false;
         }
-        return true;
+        m_publishedFrame = m_frameIndex;
     }
 
-    // Apply aerodynamic effects to flow direction
-    glm::vec3 applyAerodynamics(const FlowLine& flowLine, float distanceToAdvance) {
-        glm::vec3 currentHead = flowLine.points.front();
-        glm::vec3 baseDirection = flowLine.direction;
+    // Without the mutex: copy the last snapshot into the next streaming region,
+    // collect the strips to draw, so draw() never reads a pool itself, and
+    // record the frame
+    void publishSnapshot() {
+        if (!m_published.pending) {
+            return;
+        }
+        m_published.pending = false;
 
-        // Base displacement
-        glm::vec3 displacement = baseDirection * distanceToAdvance;
+        if (m_published.replay) {
+            float carZ = m_replay.carRelative() ? 0.0f : m_replay.carPosition();
+            publishPool(m_replay.pool(), m_replay.lineCount(), m_replay.normalLineCount(), carZ);
+            return;
+        }
 
-        // Calculate relative position to car's current position
-        glm::vec3 relativePos = currentHead;
-        relativePos.z -= m_carPosition;  // Adjust Z to get position relative to car
+        const FlowLinePool& pool = m_published.pool;
+        publishPool(pool, m_published.lineCount, m_published.normalLineCount, m_published.carZ);
+        m_recorder.recordFrame(pool, m_published.lineCount, m_published.normalLineCount, m_published.step,
+            m_published.carPosition, m_published.frameOrigin, m_published.carRelative);
+    }
 
-        // Apply car speed effects to flow velocity
-        float carSpeedFactor = m_carSpeed / 250.0f;
-        displacement *= carSpeedFactor;
+    // carZ is where the car is in the coordinates of the pool's points
+    void publishPool(const FlowLinePool& pool, int lineCount, int normalLineCount, float carZ) {
+        updateBuffers(pool, lineCount, FlowPointCode::originNear(carZ));
 
-        // 1. Wake effect - streamlines should curve behind the car
-        float wakeStrength = 0.0f;
-        if (relativePos.z > m_carLength * 0.3f) {  // Behind car
-            float distanceFromCenterline = std::abs(relativePos.x);
-            wakeStrength = 0.05f * std::exp(-(relativePos.z - m_carLength * 0.3f) / 2.0f);
+        int regionBase = m_drawRegion * m_totalPoints;
+        m_publishedNormalLines = normalLineCount;
+        m_normalStrips = collectStrips(pool, 0, normalLineCount, regionBase, 0);
+        m_vortexStrips = collectStrips(pool, normalLineCount, lineCount, regionBase, m_normalStrips);
+    }
 
-            // Inward curvature in wake (stronger at higher car speeds)
-            float speedMultiplier = 0.8f + (carSpeedFactor * 0.4f);
-            if (relativePos.x > 0) {
-                displacement.x -= wakeStrength * speedMultiplier;
-            }
-            else {
-                displacement.x += wakeStrength * speedMultiplier;
-            }
+    // Move the replay on to the last frame recorded no later than the replay
+    // clock, which runs in simulation steps
+    void advanceReplay(float deltaTime) {
+        m_replayClock += deltaTime / kFixedTimestep;
 
-            // Upwash in wake - modified by DRS state for rear wing area
-            if (m_simulateDRS && std::abs(relativePos.x) < m_carWidth * 0.3f &&
-                relativePos.z < m_carLength * 0.6f) {
-                displacement.y += wakeStrength * 0.3f * speedMultiplier;  // Less upwash with DRS open
-            }
-            else {
-                displacement.y += wakeStrength * 0.5f * speedMultiplier;  // Normal upwash
+        unsigned int nextStep = 0;
+        while (m_replay.nextFrameStep(nextStep) && nextStep <= m_replayClock) {
+            if (!m_replay.seek(m_replay.frame() + 1)) {
+                stopReplay();
+                return;
             }
         }
+    }
 
-        // 2. Ground effect - flow accelerates under the car
-        if (relativePos.y < m_carHeight * 0.2f &&
-            std::abs(relativePos.x) < m_carWidth * 0.4f &&
-            std::abs(relativePos.z) < m_carLength * 0.4f) {
+    // Make every streaming region re-upload each line of `pool` in full, for
+    // when the regions last caught up with a different pool
+    void invalidateRegions(const FlowLinePool& pool) {
+        for (int region = 0; region < StreamingBuffer::kRegionCount; region++) {
+            invalidateRegion(region, pool);
+        }
+    }
 
-            // Stronger ground effect at higher speeds
-            float speedEffect = 1.0f + (carSpeedFactor * 0.5f);
-            displacement.z *= 1.2f * speedEffect;  // Accelerate flow under car
-            displacement.y *= 0.8f;  // Keep flow close to ground
+    void invalidateRegion(int region, const FlowLinePool& pool) {
+        int lines = std::min(m_numLines, static_cast<int>(pool.writeSerial.size()));
+        for (int line = 0; line < lines; line++) {
+            m_regionSerial[region][line] = pool.writeSerial[line] - static_cast<unsigned int>(m_pointsPerLine);
+        }
+    }
 
-            // Modify pressure for flow lines under the car
-            // This will be used in color calculations
-            if (flowLine.zoneType == 4) { // Floor zone
-                // Update pressure value for this flow line if it's under the car
-                // We'll later use this in color calculations
-                const_cast<FlowLine&>(flowLine).pressure =
-                    glm::clamp(flowLine.pressure * 0.5f, 0.05f, 0.2f); // Very low pressure under car
-            }
+    // World Z to draw the published points at. Live, that is the flow frame,
+    // which setCarPosition() moves with the car under relative dynamics: the
+    // trails line up with the car as drawn this frame without being rewritten.
+    float publishedFrameOrigin() const {
+        if (m_replaying) {
+            // Replayed trails that moved with the car are stored relative to it
+            return m_replay.carRelative() ? m_carPosition : 0.0f;
         }
+        return m_frameOrigin;
+    }
 
-        // 3. Wing vortices - generate tip vortices from wings (handled separately in vortex flows)
-        float wingTipDistance = std::min(
-            std::abs(relativePos.x - m_carWidth * 0.4f),
-            std::abs(relativePos.x + m_carWidth * 0.4f)
-        );
-
-        // 4. Add small turbulence - increases with car speed
-        float turbulence = 0.01f * (0.5f + carSpeedFactor * 0.5f);
-        displacement.x += generateRandomFloat(-turbulence, turbulence);
-        displacement.y += generateRandomFloat(-turbulence, turbulence);
-        displacement.z += generateRandomFloat(-turbulence, turbulence);
-
-        return displacement;
-    }
-
-    // Apply vortex motion to vortex flow lines
-    glm::vec3 applyVortexMotion(const FlowLine& flowLine, float distanceToAdvance) {
-        glm::vec3 currentHead = flowLine.points.front();
-
-        // Calculate relative position to car's current position
-        glm::vec3 relativePos = currentHead;
-        relativePos.z -= m_carPosition;  // Adjust Z to get position relative to car
-
-        // Base forward motion
-        float carSpeedFactor = m_carSpeed / 250.0f;
-        glm::vec3 displacement = glm::vec3(0.0f, 0.0f, distanceToAdvance * carSpeedFactor);
-
-        // Calculate vortex rotation
-        float vortexPhase = const_cast<FlowLine&>(flowLine).vortexPhase += 0.1f * carSpeedFactor;
-
-        // Apply vortex rotation - depends on the vortex strength and phase
-        float rotationRadius = flowLine.vortexStrength * 0.1f * m_vortexIntensity;
-        float rotationSpeed = 0.5f + (carSpeedFactor * 0.5f);
-
-        // Vortex motion depends on distance from origin
-        float distFromOrigin = glm::length(glm::vec2(relativePos.x, relativePos.y));
-        rotationRadius *= (1.0f - std::min(1.0f, distFromOrigin / 2.0f));
-
-        // Apply spiral motion
-        displacement.x += rotationRadius * std::cos(vortexPhase * rotationSpeed);
-        displacement.y += rotationRadius * std::sin(vortexPhase * rotationSpeed);
-
-        // Add some random turbulence to make it look more realistic
-        float turbulence = 0.005f * (0.5f + carSpeedFactor * 0.5f);
-        displacement.x += generateRandomFloat(-turbulence, turbulence);
-        displacement.y += generateRandomFloat(-turbulence, turbulence);
-
-        return displacement;
-    }
-
-    // Generate vortex flow lines around wing tip areas
-    void regenerateVortices() {
-        // Remove existing vortex lines
-        m_flowLines.erase(
-            std::remove_if(m_flowLines.begin(), m_flowLines.end(),
-                [](const FlowLine& line) { return line.isVortex; }),
-            m_flowLines.end()
-        );
-
-        // Calculate how many vortex lines to generate
-        int vortexLines = std::min(int(m_numLines * 0.1f * m_vortexIntensity), int(m_numLines * 0.2f));
-
-        // Wing dimensions for vortex positioning
-        float frontWingZ = -m_carLength * 0.5f;
-        float rearWingZ = m_carLength * 0.4f;
-        float wingWidth = m_carWidth * 0.9f;
-        float rearWingHeight = m_carHeight * 0.9f;
-        float frontWingHeight = m_carHeight * 0.3f;
-
-        // Generate vortices at wing tips
-        std::vector<std::pair<glm::vec3, float>> vortexPositions;
-
-        // Front wing tip vortices
-        vortexPositions.push_back(std::make_pair(
-            glm::vec3(wingWidth * 0.5f, frontWingHeight * 0.7f, frontWingZ),
-            0.8f  // Strength
-        ));
-        vortexPositions.push_back(std::make_pair(
-            glm::vec3(-wingWidth * 0.5f, frontWingHeight * 0.7f, frontWingZ),
-            0.8f  // Strength
-        ));
-
-        // Rear wing tip vortices - strength affected by DRS
-        float rearVortexStrength = m_simulateDRS ? 0.5f : 1.0f;  // Weaker vortices with DRS open
-
-        vortexPositions.push_back(std::make_pair(
-            glm::vec3(wingWidth * 0.45f, rearWingHeight * 0.9f, rearWingZ),
-            rearVortexStrength
-        ));
-        vortexPositions.push_back(std::make_pair(
-            glm::vec3(-wingWidth * 0.45f, rearWingHeight * 0.9f, rearWingZ),
-            rearVortexStrength
-        ));
-
-        // Add DRS-specific vortices when DRS is closed
-        if (!m_simulateDRS) {
-            // Center vortex from DRS flap trailing edge
-            vortexPositions.push_back(std::make_pair(
-                glm::vec3(0.0f, rearWingHeight * 0.95f, rearWingZ + 0.1f),
-                0.9f
-            ));
-
-            // Additional vortices from DRS flap edges
-            vortexPositions.push_back(std::make_pair(
-                glm::vec3(wingWidth * 0.3f, rearWingHeight * 0.93f, rearWingZ + 0.05f),
-                0.7f
-            ));
-            vortexPositions.push_back(std::make_pair(
-                glm::vec3(-wingWidth * 0.3f, rearWingHeight * 0.93f, rearWingZ + 0.05f),
-                0.7f
-            ));
-        }
-
-        // Generate vortex flow lines
-        for (int i = 0; i < vortexLines && i < vortexPositions.size(); i++) {
-            const glm::vec3& basePosition = vortexPositions[i].first;
-            float strength = vortexPositions[i].second;
-
-            // Create multiple flow lines per vortex center
-            int linesPerVortex = std::max(1, static_cast<int>(3 * m_vortexIntensity));
-            for (int j = 0; j < linesPerVortex && m_flowLines.size() < m_numLines; j++) {
-                FlowLine flowLine;
-                flowLine.maxPoints = m_pointsPerLine;
-                flowLine.zoneType = (basePosition.z < 0) ? 0 : 3;  // Front or rear wing
-                flowLine.lastCarPosition = m_carPosition;
-                flowLine.isVortex = true;
-                flowLine.vortexStrength = strength * (1.0f + generateRandomFloat(-0.2f, 0.2f));
-                flowLine.vortexPhase = generateRandomFloat(0.0f, 6.28f);  // Random start phase
-
-                // Add small random offset from vortex center
-                glm::vec3 position = basePosition;
-                position.x += generateRandomFloat(-0.05f, 0.05f);
-                position.y += generateRandomFloat(-0.05f, 0.05f);
-                position.z += generateRandomFloat(-0.05f, 0.05f);
-
-                // Store initial offset from car reference position
-                flowLine.initialOffset = position;
-
-                // Add car position to get world position
-                position.z += m_carPosition;
-
-                flowLine.initialPosition = position;
-                flowLine.direction = glm::normalize(glm::vec3(0.0f, 0.0f, 1.0f));
-
-                // Differentiate vortex pressure values
-                if (flowLine.zoneType == 0) {  // Front wing
-                    flowLine.pressure = generateRandomFloat(0.2f, 0.4f);  // Lower pressure
+    void simulationLoop() {
+        typedef std::chrono::steady_clock Clock;
+        const Clock::duration stepDuration =
+            std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(kFixedTimestep));
+
+        Clock::time_point nextStep = Clock::now();
+        while (!m_stopSimulation) {
+            {
+                std::lock_guard<std::mutex> lock(m_stateMutex);
+                if (!m_simulationPaused && !m_replaying && m_backend == AdvectionBackend::CPU) {
+                    simulateStep(kFixedTimestep);
                 }
-                else {  // Rear wing
-                    flowLine.pressure = m_simulateDRS ?
-                        generateRandomFloat(0.1f, 0.2f) :  // Very low pressure with DRS open
-                        generateRandomFloat(0.3f, 0.5f);   // Moderate pressure with DRS closed
-                }
-
-                flowLine.velocity = generateRandomFloat(6.0f, 10.0f) * (m_carSpeed / 250.0f);
-                flowLine.speed = flowLine.velocity;
-                flowLine.initialLife = generateRandomFloat(4.0f, 6.0f);  // Longer life for vortices
-                flowLine.life = flowLine.initialLife;
-
-                flowLine.points.push_back(position);
-
-                // Use special color for vortex lines
-                glm::vec3 vortexColor = calculateVortexColor(flowLine);
-                flowLine.colors.push_back(vortexColor);
+            }
 
-                m_flowLines.push_back(flowLine);
+            // Steps that fall behind are caught up back to back, up to a limit
+            nextStep += stepDuration;
+            Clock::time_point now = Clock::now();
+            if (now - nextStep > stepDuration * kMaxStepsPerUpdate) {
+                nextStep = now;
             }
+            std::this_thread::sleep_until(nextStep);
         }
     }
 
-    // Calculate flow line color based on pressure, life, and position
-    glm::vec3 calculateFlowColor(float lifeRatio, float pointPosition, const FlowLine& flowLine) {
-        // Default color scheme based on pressure areas
-        glm::vec3 color;
+    // Initialize OpenGL buffers for flow line rendering
+    // Each streaming buffer holds one copy of every line slot, or every line, per region
+    void setupBuffers() {
+        glGenVertexArrays(1, &m_VAO);
+        m_positionBuffer.create(m_totalPoints * sizeof(FlowPointCode));
 
-        // Base color selection depends on visualization mode
-        if (m_visualizePressure) {
-            // Improved pressure-based coloring
-            if (flowLine.pressure < 0.2f) {
-                // Low pressure - blue tones
-                color = glm::vec3(0.0f, 0.3f, 1.0f); // Vibrant blue for very low pressure
-            }
-            else if (flowLine.pressure < 0.4f) {
-                // Medium-low pressure - cyan to teal
-                float t = (flowLine.pressure - 0.2f) / 0.2f;
-                color = glm::mix(glm::vec3(0.0f, 0.3f, 1.0f), glm::vec3(0.0f, 0.7f, 0.7f), t);
-            }
-            else if (flowLine.pressure < 0.6f) {
-                // Medium pressure - green to yellow
-                float t = (flowLine.pressure - 0.4f) / 0.2f;
-                color = glm::mix(glm::vec3(0.0f, 0.7f, 0.3f), glm::vec3(0.7f, 0.7f, 0.0f), t);
-            }
-            else if (flowLine.pressure < 0.8f) {
-                // Medium-high pressure - yellow to orange
-                float t = (flowLine.pressure - 0.6f) / 0.2f;
-                color = glm::mix(glm::vec3(0.7f, 0.7f, 0.0f), glm::vec3(1.0f, 0.5f, 0.0f), t);
-            }
-            else {
-                // High pressure - orange to red
-                float t = (flowLine.pressure - 0.8f) / 0.2f;
-                color = glm::mix(glm::vec3(1.0f, 0.5f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), t);
-            }
+        // The published pool starts out behind the live one by every line's full ring
+        m_published.pool.allocate(m_numLines, m_pointsPerLine);
+        for (int line = 0; line < m_numLines; line++) {
+            m_published.pool.writeSerial[line] = 0u - static_cast<unsigned int>(m_pointsPerLine);
+            m_published.pool.pushSerial[line] = 0u - static_cast<unsigned int>(m_pointsPerLine);
         }
-        else {
-            // Zone-based coloring when pressure visualization is off
-            switch (flowLine.zoneType) {
-            case 0: // Front wing
-                color = glm::vec3(0.9f, 0.2f, 0.2f); // Red
-                break;
-            case 1: // Top
-                color = glm::vec3(0.2f, 0.7f, 0.2f); // Green
-                break;
-            case 2: // Side
-                color = glm::vec3(0.2f, 0.5f, 0.9f); // Blue
-                break;
-            case 3: // Rear wing
-                color = glm::vec3(0.9f, 0.7f, 0.2f); // Yellow
-                break;
-            case 4: // Floor
-                color = glm::vec3(0.9f, 0.2f, 0.9f); // Magenta
-                break;
-            default:
-                color = glm::vec3(0.7f); // Gray
-            }
+        m_encodedSlots.resize(m_slotSize);
+        m_shadeBuffer.create(m_numLines * sizeof(FlowLineShade));
+        m_shades.assign(m_numLines, FlowLineShade());
+
+        // The line shader reads the shades as a buffer texture, all regions at once
+        glGenTextures(1, &m_shadeTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, m_shadeTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA16UI, m_shadeBuffer.id());
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+        // Every region starts out behind the pool by the full ring of each line
+        for (int region = 0; region < StreamingBuffer::kRegionCount; region++) {
+            m_regionSerial[region].assign(m_numLines, 0u - static_cast<unsigned int>(m_pointsPerLine));
+            m_regionOrigin[region] = 0.0f;
         }
+        m_drawRegion = 0;
 
-        // Apply fade effect based on life and position in line
-        float fadeByLife = lifeRatio;
-        float fadeByPosition = 1.0f - pointPosition; // Fade tail
-        float totalFade = fadeByLife * fadeByPosition;
+        // At most two strips per line
+        m_stripFirsts.assign(m_numLines * 2, 0);
+        m_stripCounts.assign(m_numLines * 2, 0);
+        m_normalStrips = 0;
+        m_vortexStrips = 0;
+        m_publishedNormalLines = 0;
 
-        // Apply velocity effect to brightness
-        float velocityFactor = glm::clamp(flowLine.velocity / 10.0f, 0.5f, 1.5f);
-        color *= velocityFactor;
+        glBindVertexArray(m_VAO);
 
-        // Apply additional alpha fade based on total fade value
-        float alpha = glm::clamp(totalFade, 0.1f, 1.0f);
+        // Position buffer, read as plain integers that the shader scales, as for
+        // MergedGeometry, with the emission life in w; colors are worked out in the shader
+        glBindBuffer(GL_ARRAY_BUFFER, m_positionBuffer.id());
+        glVertexAttribPointer(0, 4, GL_SHORT, GL_FALSE, sizeof(FlowPointCode), (void*)0);
+        glEnableVertexAttribArray(0);
 
-        // Return final color with alpha component
-        return glm::vec3(color.r, color.g, color.b) * alpha;
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
     }
 
-    // Special color calculation for vortex flow lines
-    glm::vec3 calculateVortexColor(const FlowLine& flowLine) {
-        // Vortices get special colors to make them stand out
-        glm::vec3 color;
-
-        if (flowLine.zoneType == 0) {  // Front wing vortices
-            // Blue-cyan spiral
-            color = glm::vec3(0.2f, 0.5f, 1.0f);
+    // Bring the next streaming region up to date with the pool.
+    // A region was last written a few frames ago, so only the points each
+    // line has written since then are copied; everything else is still valid.
+    // The shades of every line change each step and are copied in full.
+    // Points are encoded around origin; a region encoded around another one
+    // is rewritten in full.
+    void updateBuffers(const FlowLinePool& pool, int lineCount, float origin) {
+        ProfileScope scope("updateBuffers");
+        m_positionBuffer.beginWrite();
+        m_shadeBuffer.beginWrite();
+        int region = m_positionBuffer.region();
+        std::vector<unsigned int>& regionSerial = m_regionSerial[region];
+        if (m_regionOrigin[region] != origin) {
+            invalidateRegion(region, pool);
+            m_regionOrigin[region] = origin;
         }
-        else {  // Rear wing vortices
-            if (m_simulateDRS) {
-                // DRS open - golden yellow vortices
-                color = glm::vec3(1.0f, 0.8f, 0.2f);
+
+        for (int line = 0; line < lineCount; line++) {
+            unsigned int pending = pool.writeSerial[line] - regionSerial[line];
+            regionSerial[line] = pool.writeSerial[line];
+            if (pending == 0) {
+                continue;
+            }
+
+            // Only points still in the ring matter; older writes were overwritten
+            int count = static_cast<int>(std::min<unsigned int>(pending, pool.pointCount[line]));
+            int head = pool.head[line];
+            int end = head + count;
+            int cap = pool.maxPoints;
+            size_t base = pool.slotOffset(line);
+
+            // The newest points run forward from the head, wrapping into slot 0
+            if (end <= cap) {
+                uploadSlots(pool, origin, base, head, count);
+                if (head == 0) {
+                    uploadSlots(pool, origin, base, cap, 1);  // Mirror of slot 0
+                }
             }
             else {
-                // DRS closed - reddish orange vortices
-                color = glm::vec3(1.0f, 0.4f, 0.1f);
+                uploadSlots(pool, origin, base, head, cap + 1 - head);  // Up to and including the mirror
+                uploadSlots(pool, origin, base, 0, end - cap);
             }
         }
 
-        // Intensity affected by vortex strength
-        float intensityFactor = 0.7f + (flowLine.vortexStrength * 0.3f);
-        color *= intensityFactor;
-
-        // Make vortices more visible with higher alpha
-        float alpha = 0.9f;
+        for (int line = 0; line < lineCount; line++) {
+            m_shades[line] = pool.shade(line);
+        }
+        m_shadeBuffer.write(0, m_shades.data(), lineCount * sizeof(FlowLineShade));
 
-        return color * alpha;
+        m_positionBuffer.endWrite();
+        m_shadeBuffer.endWrite();
+        m_drawRegion = region;
     }
 
-    // Reset a flow line to its initial state with updated car position
-    void resetFlowLine(FlowLine& flowLine) {
-        // Clear existing points
-        flowLine.points.clear();
-        flowLine.colors.clear();
-
-        // Reset life
-        flowLine.life = flowLine.initialLife;
-
-        // Update position based on car's current position
-        glm::vec3 newPosition = flowLine.initialOffset;
-        newPosition.z += m_carPosition;
-
-        // Update last known car position
-        flowLine.lastCarPosition = m_carPosition;
-
-        // Initialize with starting point
-        flowLine.points.push_back(newPosition);
+    // Append the line strips of lines [firstLine, lastLine) to the multi-draw arrays.
+    // A ring reads as one strip, or two when it wraps past the end of its slot.
+    int collectStrips(const FlowLinePool& pool, int firstLine, int lastLine, int regionBase, int stripIndex) {
+        int firstStrip = stripIndex;
+        for (int line = firstLine; line < lastLine; line++) {
+            int pointCount = pool.pointCount[line];
+            if (pointCount <= 1) {
+                continue;
+            }
 
-        // Calculate initial color based on flow type
-        glm::vec3 initialColor;
-        if (flowLine.isVortex) {
-            initialColor = calculateVortexColor(flowLine);
-        }
-        else {
-            initialColor = calculateFlowColor(1.0f, 0.0f, flowLine);
+            int offset = regionBase + static_cast<int>(pool.slotOffset(line));
+            int head = pool.head[line];
+            int firstRun = std::min(pointCount, pool.maxPoints + 1 - head);
+            m_stripFirsts[stripIndex] = offset + head;
+            m_stripCounts[stripIndex] = firstRun;
+            stripIndex++;
+
+            // The mirror slot ends the first run, so the second starts one point back
+            int secondRun = pointCount - firstRun + 1;
+            if (firstRun < pointCount && secondRun > 1) {
+                m_stripFirsts[stripIndex] = offset;
+                m_stripCounts[stripIndex] = secondRun;
+                stripIndex++;
+            }
         }
+        return stripIndex - firstStrip;
+    }
 
-        flowLine.colors.push_back(initialColor);
-
-        // For vortices, reset phase but keep the strength
-        if (flowLine.isVortex) {
-            flowLine.vortexPhase = generateRandomFloat(0.0f, 6.28f);
+    // Encode a run of ring slots of one line into the current streaming region
+    void uploadSlots(const FlowLinePool& pool, float origin, size_t lineBase, int firstSlot, int slotCount) {
+        size_t first = lineBase + firstSlot;
+        for (int i = 0; i < slotCount; i++) {
+            m_encodedSlots[i] = FlowPointCode::encode(pool.positions[first + i], origin, pool.emissionLife[first + i]);
         }
-
-        // Adjust speed based on current car speed
-        flowLine.speed = flowLine.velocity * (m_carSpeed / 250.0f);
+        GLintptr offset = static_cast<GLintptr>(first * sizeof(FlowPointCode));
+        GLsizeiptr size = static_cast<GLsizeiptr>(slotCount * sizeof(FlowPointCode));
+        m_positionBuffer.write(offset, m_encodedSlots.data(), size);
     }
 
-    // Initialize OpenGL buffers for flow line rendering
-    void setupBuffers() {
-        glGenVertexArrays(1, &m_VAO);
-        glGenBuffers(1, &m_VBO);
-        glGenBuffers(1, &m_colorVBO);
-
-        glBindVertexArray(m_VAO);
-
-        // Position buffer
-        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-        glBufferData(GL_ARRAY_BUFFER, m_totalPoints * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
-        glEnableVertexAttribArray(0);
-
-        // Color buffer
-        glBindBuffer(GL_ARRAY_BUFFER, m_colorVBO);
-        glBufferData(GL_ARRAY_BUFFER, m_totalPoints * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
-        glEnableVertexAttribArray(1);
+    // Advance all lines with the GPU backend. Lines re-seeded on the CPU since
+    // the last step are uploaded first; nothing else crosses the bus.
+    void updateGpu(float deltaTime) {
+        uploadDirtyGpuLines();
+
+        // When the car moves in the flow frame, trails left behind are re-encoded
+        // around it before its new points run out of FlowPointCode range
+        bool rebase = FlowPointCode::originNear(carInFrame()) != m_flowAnchor;
+
+        // A delta moves lines between slots, so it needs the current state on the
+        // CPU; it is applied in one go to pay for the readback only once
+        if (rebase || m_reseedPhase != ReseedPhase::Idle) {
+            m_gpu.readback(m_pool, m_lineCount, m_flowAnchor);
+            if (rebase) {
+                m_flowAnchor = FlowPointCode::originNear(carInFrame());
+                markLinesDirty(0, m_lineCount);
+            }
+            if (m_reseedPhase != ReseedPhase::Idle) {
+                applyReseedDelta(std::numeric_limits<int>::max());
+            }
+            uploadDirtyGpuLines();
+        }
 
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        GpuFlowStepParams params;
+        params.deltaTime = deltaTime;
+        params.carLength = m_carLength;
+        params.carWidth = m_carWidth;
+        params.carHeight = m_carHeight;
+        params.carSpeed = m_carSpeed;
+        params.carPosition = carInFrame();
+        params.anchor = m_flowAnchor;
+        params.vortexIntensity = m_vortexIntensity;
+        params.simulateDRS = m_simulateDRS;
+        params.randomSeed = m_randomSeed;
+        params.frameIndex = m_frameIndex;
+        params.flowField = m_fieldAdvection ? &flowField() : nullptr;
+        m_gpu.step(params, m_lineCount);
     }
 
-    // Update buffer data with current flow line points and colors
-    void updateBuffers(const std::vector<glm::vec3>& vertices, const std::vector<glm::vec3>& colors) {
-        // Update vertex positions
-        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), vertices.data(), GL_DYNAMIC_DRAW);
+    // Draw the GPU backend's trails, every line width in one instanced draw
+    void drawGpu() {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-        // Update vertex colors
-        glBindBuffer(GL_ARRAY_BUFFER, m_colorVBO);
-        glBufferData(GL_ARRAY_BUFFER, colors.size() * sizeof(glm::vec3), colors.data(), GL_DYNAMIC_DRAW);
+        float anchor = publishedFrameOrigin() + m_flowAnchor;
+        m_gpu.draw(anchor, m_lineCount, m_normalLineCount, kLineWidth, kVortexLineWidth, m_colormap, m_visualizePressure);
+    }
 
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    // Set the line shader up for geometry that does not come from the flow line
+    // slots: float positions, and one ribbon width for every vertex
+    static void setPlainGeometry(Shader& shader, float width) {
+        shader.setFloat("positionScale", 1.0f);
+        shader.setFloat("lineWidth", width);
+        shader.setInt("slotSize", 0);
     }
 
-    // Generate random float in range
-    float generateRandomFloat(float min, float max) {
-        static std::mt19937 generator(std::random_device{}());
-        std::uniform_real_distribution<float> distribution(min, max);
-        return distribution(generator);
+    // Upload the lines the simulation re-seeded or moved since the last upload
+    void uploadDirtyGpuLines() {
+        if (m_dirtyLast > m_dirtyFirst) {
+            m_gpu.uploadLines(m_pool, m_dirtyFirst, std::min(m_dirtyLast, m_lineCount), m_flowAnchor);
+            m_dirtyFirst = m_numLines;
+            m_dirtyLast = 0;
+        }
     }
 
 private:
+    static const int kShadeUnit = 1;         // Texture units of the line shader
+    static const int kColormapUnit = 2;
+
     // OpenGL buffer objects
-    GLuint m_VAO, m_VBO, m_colorVBO;
-
-    // Flow lines data
-    std::vector<FlowLine> m_flowLines;
-    int m_numLines;
-    int m_pointsPerLine;
-    int m_totalPoints;
-
-    // Car properties
-    float m_carLength;
-    float m_carWidth;
-    float m_carHeight;
-    float m_carPosition;
-    float m_prevCarPosition;
-    float m_carSpeed;
-
-    // Visualization parameters
-    float m_minDistance;
-    bool m_adaptiveDensity;
-    bool m_simulateDRS;
-    bool m_relativeDynamics;
-    bool m_visualizePressure;
-    float m_vortexIntensity;
+    GLuint m_VAO;
+    StreamingBuffer m_positionBuffer;
+    StreamingBuffer m_shadeBuffer;       // One FlowLineShade per line
+    GLuint m_shadeTexture;               // GL_RGBA16UI view of m_shadeBuffer
+    std::vector<FlowLineShade> m_shades; // Shades of the region being written
+    FlowColormap m_colormap;
+    std::vector<unsigned int> m_regionSerial[StreamingBuffer::kRegionCount];  // Pool write serial each region has caught up to
+    float m_regionOrigin[StreamingBuffer::kRegionCount];    // Z origin of each region's FlowPointCodes
+    std::vector<FlowPointCode> m_encodedSlots;              // One line of slots, encoded for upload
+    int m_drawRegion;            // Streaming region holding the newest data
+    std::vector<GLint> m_stripFirsts;    // glMultiDrawArrays start vertices, rebuilt every draw
+    std::vector<GLsizei> m_stripCounts;  // glMultiDrawArrays vertex counts
+    int m_normalStrips;          // Strips of each bucket in the published state
+    int m_vortexStrips;
+    int m_publishedNormalLines;  // First vortex line of the published state
+
+    // GPU advection backend
+    AdvectionBackend m_backend;
+    GpuFlowAdvection m_gpu;
+    float m_flowAnchor;          // Flow frame Z the GPU positions are relative to
+
+    // Fixed-step simulation
+    std::mutex m_stateMutex;
+    std::thread m_simulationThread;
+    std::atomic<bool> m_simulationPaused;
+    std::atomic<bool> m_stopSimulation;
+    float m_stepAccumulator;     // Real time not yet simulated (update() stepping)
+    unsigned int m_publishedFrame;   // Step (replay frame while replaying) the renderer's copy is at
+
+    // The renderer's copy of the live state as of the last snapshot
+    struct PublishedState {
+        FlowLinePool pool;       // Lines [0, lineCount) match the simulation's pool
+        int lineCount;
+        int normalLineCount;
+        unsigned int step;
+        float carPosition;       // Recorded with the frame
+        float frameOrigin;
+        float carZ;              // Car in the pool's coordinates
+        bool carRelative;
+        bool pending;            // Taken but not yet uploaded
+        bool replay;             // Upload the replay pool instead
+    };
+    PublishedState m_published;
+
+    // Session recording and replay
+    FlowRecorder m_recorder;
+    FlowReplay m_replay;
+    bool m_replaying;
+    double m_replayClock;        // Recorded simulation step the replay has reached
 };
 
-// FLOW_VISUALIZATIO
\ No newline at end of file
+#endif // FLOW_VISUALIZATION_H
@@ -0,0 +1,372 @@
+#include "FrameProfiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> g_allocationCount(0);
+std::atomic<uint64_t> g_allocatedBytes(0);
+
+const double kSummarySmoothing = 0.1;     // Weight of the newest frame in summary()
+const size_t kCapturedScopesPerFrame = 64;   // Reserved up front so capturing allocates little
+
+double toMilliseconds(int64_t nanoseconds) {
+    return static_cast<double>(nanoseconds) / 1.0e6;
+}
+
+// Trace timestamps are microseconds from the start of the capture
+double toTraceMicroseconds(int64_t nanoseconds, int64_t origin) {
+    return static_cast<double>(nanoseconds - origin) / 1.0e3;
+}
+
+}
+
+// Every heap allocation of the process goes through these, so the profiler can
+// count them without hooking each container
+void* operator new(std::size_t size) {
+    g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    g_allocatedBytes.fetch_add(static_cast<uint64_t>(size), std::memory_order_relaxed);
+    void* memory = std::malloc(size > 0 ? size : 1);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+FrameProfiler& FrameProfiler::instance() {
+    static FrameProfiler profiler;
+    return profiler;
+}
+
+FrameProfiler::FrameProfiler()
+    : m_enabled(false), m_uploadedBytes(0), m_threadCount(0),
+      m_frameAllocationStart(0), m_frameUploadStart(0), m_hasSummary(false),
+      m_enabledBeforeCapture(false), m_captureFramesLeft(0) {
+    m_current.begin = now();
+    m_current.end = m_current.begin;
+    m_current.allocations = 0;
+    m_current.uploadedBytes = 0;
+    m_current.sectionCount = 0;
+    m_last = m_current;
+    m_summary.frameMilliseconds = 0.0;
+    m_summary.allocations = 0.0;
+    m_summary.uploadedBytes = 0.0;
+}
+
+int64_t FrameProfiler::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t FrameProfiler::allocationCount() {
+    return g_allocationCount.load(std::memory_order_relaxed);
+}
+
+uint64_t FrameProfiler::allocatedBytes() {
+    return g_allocatedBytes.load(std::memory_order_relaxed);
+}
+
+void FrameProfiler::setEnabled(bool enabled) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (enabled && !m_enabled) {
+        // Start from a clean frame rather than one that piled up while disabled
+        m_hasSummary = false;
+        m_summary.sections.clear();
+        m_current.sectionCount = 0;
+    }
+    m_enabled = enabled;
+}
+
+void FrameProfiler::beginFrame() {
+    if (!isEnabled()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_current.begin = now();
+    m_current.sectionCount = 0;
+    m_frameAllocationStart = allocationCount();
+    m_frameUploadStart = m_uploadedBytes.load(std::memory_order_relaxed);
+}
+
+void FrameProfiler::endFrame() {
+    if (!isEnabled()) {
+        return;
+    }
+
+    std::vector<FrameRecord> capturedFrames;
+    std::vector<ScopeEvent> capturedScopes;
+    std::string tracePath;
+    std::string csvPath;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_current.end = now();
+        m_current.allocations = allocationCount() - m_frameAllocationStart;
+        m_current.uploadedBytes = m_uploadedBytes.load(std::memory_order_relaxed) - m_frameUploadStart;
+
+        // Smooth toward this frame; sections it lacks decay toward zero
+        double weight = m_hasSummary ? kSummarySmoothing : 1.0;
+        m_summary.frameMilliseconds += (toMilliseconds(m_current.end - m_current.begin) - m_summary.frameMilliseconds) * weight;
+        m_summary.allocations += (static_cast<double>(m_current.allocations) - m_summary.allocations) * weight;
+        m_summary.uploadedBytes += (static_cast<double>(m_current.uploadedBytes) - m_summary.uploadedBytes) * weight;
+        for (size_t i = 0; i < m_summary.sections.size(); i++) {
+            m_summary.sections[i].milliseconds *= 1.0 - weight;
+        }
+        for (int i = 0; i < m_current.sectionCount; i++) {
+            const Section& section = m_current.sections[i];
+            size_t row = 0;
+            while (row < m_summary.sections.size() &&
+                (m_summary.sections[row].gpu != section.gpu || std::strcmp(m_summary.sections[row].name, section.name) != 0)) {
+                row++;
+            }
+            if (row == m_summary.sections.size()) {
+                Section added = section;
+                added.milliseconds = 0.0;
+                m_summary.sections.push_back(added);
+            }
+            m_summary.sections[row].milliseconds += section.milliseconds * weight;
+            m_summary.sections[row].calls = section.calls;
+        }
+        m_hasSummary = true;
+        m_last = m_current;
+
+        if (m_captureFramesLeft > 0) {
+            m_capturedFrames.push_back(m_current);
+            m_captureFramesLeft--;
+            if (m_captureFramesLeft == 0) {
+                capturedFrames.swap(m_capturedFrames);
+                capturedScopes.swap(m_capturedScopes);
+                tracePath = m_tracePath;
+                csvPath = m_csvPath;
+                m_enabled = m_enabledBeforeCapture;
+            }
+        }
+    }
+
+    // Written outside the lock so the simulation thread keeps going meanwhile
+    if (!capturedFrames.empty()) {
+        writeCapture(tracePath, csvPath, capturedFrames, capturedScopes);
+    }
+}
+
+FrameProfiler::Section* FrameProfiler::currentSection(const char* name, bool gpu) {
+    for (int i = 0; i < m_current.sectionCount; i++) {
+        Section& section = m_current.sections[i];
+        if (section.gpu == gpu && (section.name == name || std::strcmp(section.name, name) == 0)) {
+            return &section;
+        }
+    }
+    if (m_current.sectionCount == kMaxSections) {
+        return nullptr;
+    }
+    Section& section = m_current.sections[m_current.sectionCount++];
+    section.name = name;
+    section.gpu = gpu;
+    section.milliseconds = 0.0;
+    section.calls = 0;
+    return &section;
+}
+
+int FrameProfiler::threadIndex() {
+    thread_local int index = -1;
+    if (index < 0) {
+        index = m_threadCount.fetch_add(1);
+    }
+    return index;
+}
+
+void FrameProfiler::recordScope(const char* name, int64_t begin, int64_t end) {
+    int thread = threadIndex();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Section* section = currentSection(name, false);
+    if (section) {
+        section->milliseconds += toMilliseconds(end - begin);
+        section->calls++;
+    }
+    if (m_captureFramesLeft > 0) {
+        ScopeEvent event = { name, begin, end, thread };
+        m_capturedScopes.push_back(event);
+    }
+}
+
+void FrameProfiler::recordGpuPass(const char* name, double milliseconds) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Section* section = currentSection(name, true);
+    if (section) {
+        section->milliseconds += milliseconds;
+        section->calls++;
+    }
+}
+
+void FrameProfiler::startCapture(int frameCount, const std::string& tracePath, const std::string& csvPath) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_captureFramesLeft > 0 || frameCount <= 0) {
+        return;
+    }
+    m_enabledBeforeCapture = m_enabled;
+    m_enabled = true;
+    m_captureFramesLeft = frameCount;
+    m_tracePath = tracePath;
+    m_csvPath = csvPath;
+    m_capturedFrames.clear();
+    m_capturedFrames.reserve(frameCount);
+    m_capturedScopes.clear();
+    m_capturedScopes.reserve(static_cast<size_t>(frameCount) * kCapturedScopesPerFrame);
+}
+
+void FrameProfiler::lastFrame(Summary& out) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    out.frameMilliseconds = toMilliseconds(m_last.end - m_last.begin);
+    out.allocations = static_cast<double>(m_last.allocations);
+    out.uploadedBytes = static_cast<double>(m_last.uploadedBytes);
+    out.sections.assign(m_last.sections, m_last.sections + m_last.sectionCount);
+}
+
+bool FrameProfiler::isCapturing() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_captureFramesLeft > 0;
+}
+
+void FrameProfiler::summary(Summary& out) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    out = m_summary;
+}
+
+void FrameProfiler::writeCapture(const std::string& tracePath, const std::string& csvPath,
+    const std::vector<FrameRecord>& frames, const std::vector<ScopeEvent>& scopes) {
+    bool traceWritten = writeTrace(tracePath, frames, scopes);
+    bool csvWritten = writeCsv(csvPath, frames);
+    if (!traceWritten) {
+        std::cerr << "ERROR::FRAME_PROFILER::FILE_NOT_WRITTEN: " << tracePath << std::endl;
+    }
+    if (!csvWritten) {
+        std::cerr << "ERROR::FRAME_PROFILER::FILE_NOT_WRITTEN: " << csvPath << std::endl;
+    }
+    if (traceWritten && csvWritten) {
+        std::cout << "Profile of " << frames.size() << " frames written to "
+            << tracePath << " and " << csvPath << std::endl;
+    }
+}
+
+// Scopes become complete events on their thread's track; the per-frame
+// counters and GPU pass times become counter tracks
+bool FrameProfiler::writeTrace(const std::string& path,
+    const std::vector<FrameRecord>& frames, const std::vector<ScopeEvent>& scopes) {
+    std::ofstream out(path.c_str(), std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+
+    int64_t origin = frames.front().begin;
+    for (size_t i = 0; i < scopes.size(); i++) {
+        origin = std::min(origin, scopes[i].begin);
+    }
+
+    out << std::fixed << std::setprecision(3);
+    out << "{\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"F1 Aero Visualization\"}}";
+
+    for (size_t i = 0; i < scopes.size(); i++) {
+        const ScopeEvent& event = scopes[i];
+        out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+            << ",\"ts\":" << toTraceMicroseconds(event.begin, origin)
+            << ",\"dur\":" << toTraceMicroseconds(event.end, event.begin) << "}";
+    }
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        const FrameRecord& frame = frames[i];
+        double ts = toTraceMicroseconds(frame.end, origin);
+        out << ",\n{\"name\":\"frame ms\",\"ph\":\"C\",\"pid\":1,\"ts\":" << toTraceMicroseconds(frame.begin, origin)
+            << ",\"args\":{\"ms\":" << toMilliseconds(frame.end - frame.begin) << "}}";
+        out << ",\n{\"name\":\"allocations\",\"ph\":\"C\",\"pid\":1,\"ts\":" << ts
+            << ",\"args\":{\"count\":" << frame.allocations << "}}";
+        out << ",\n{\"name\":\"uploaded bytes\",\"ph\":\"C\",\"pid\":1,\"ts\":" << ts
+            << ",\"args\":{\"bytes\":" << frame.uploadedBytes << "}}";
+        for (int j = 0; j < frame.sectionCount; j++) {
+            if (frame.sections[j].gpu) {
+                out << ",\n{\"name\":\"gpu " << frame.sections[j].name << " ms\",\"ph\":\"C\",\"pid\":1,\"ts\":" << ts
+                    << ",\"args\":{\"ms\":" << frame.sections[j].milliseconds << "}}";
+            }
+        }
+    }
+
+    out << "\n]}\n";
+    out.close();
+    return !out.fail();
+}
+
+// One row per frame and one column per section seen anywhere in the capture
+bool FrameProfiler::writeCsv(const std::string& path, const std::vector<FrameRecord>& frames) {
+    std::vector<Section> columns;
+    for (size_t i = 0; i < frames.size(); i++) {
+        const FrameRecord& frame = frames[i];
+        for (int j = 0; j < frame.sectionCount; j++) {
+            size_t column = 0;
+            while (column < columns.size() &&
+                (columns[column].gpu != frame.sections[j].gpu || std::strcmp(columns[column].name, frame.sections[j].name) != 0)) {
+                column++;
+            }
+            if (column == columns.size()) {
+                columns.push_back(frame.sections[j]);
+            }
+        }
+    }
+
+    std::ofstream out(path.c_str(), std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+
+    out << "frame,frame_ms,allocations,uploaded_bytes";
+    for (size_t i = 0; i < columns.size(); i++) {
+        out << ',' << (columns[i].gpu ? "gpu " : "") << columns[i].name << " ms";
+    }
+    out << '\n';
+
+    out << std::fixed << std::setprecision(4);
+    for (size_t i = 0; i < frames.size(); i++) {
+        const FrameRecord& frame = frames[i];
+        out << i << ',' << toMilliseconds(frame.end - frame.begin) << ','
+            << frame.allocations << ',' << frame.uploadedBytes;
+        for (size_t column = 0; column < columns.size(); column++) {
+            double milliseconds = 0.0;
+            for (int j = 0; j < frame.sectionCount; j++) {
+                if (frame.sections[j].gpu == columns[column].gpu &&
+                    std::strcmp(frame.sections[j].name, columns[column].name) == 0) {
+                    milliseconds = frame.sections[j].milliseconds;
+                }
+            }
+            out << ',' << milliseconds;
+        }
+        out << '\n';
+    }
+
+    out.close();
+    return !out.fail();
+}
@@ -0,0 +1,157 @@
+#ifndef FRAME_PROFILER_H
+#define FRAME_PROFILER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Per-frame costs of the hot paths, for the overlay and for captures to disk.
+// CPU work is timed by ProfileScope objects on any thread, GPU passes by
+// GpuPassTimer once their queries resolve. Every frame also counts the heap
+// allocations the process made and the bytes copied into GL buffers.
+//
+// A capture keeps every scope of the next frames and then writes them as a
+// Chrome trace (chrome://tracing or Perfetto) plus a CSV with one row per frame.
+// Scopes count toward the frame in which they end, so work on the simulation
+// thread shows up in whichever frame it overlapped.
+class FrameProfiler {
+public:
+    static const int kMaxSections = 24;       // Distinct scope and pass names per frame
+
+    // Total time of one named scope or GPU pass over a frame
+    struct Section {
+        const char* name;
+        bool gpu;
+        double milliseconds;
+        int calls;
+    };
+
+    // Smoothed recent frames, as shown by the overlay
+    struct Summary {
+        double frameMilliseconds;
+        double allocations;
+        double uploadedBytes;
+        std::vector<Section> sections;
+    };
+
+    static FrameProfiler& instance();
+
+    // Scopes and passes record nothing while disabled; counters always run
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // Frame boundaries, from the render thread
+    void beginFrame();
+    void endFrame();
+
+    // Record a CPU scope that ran from begin to end, in now() ticks.
+    // The name must outlive the profiler; string literals do.
+    void recordScope(const char* name, int64_t begin, int64_t end);
+
+    // Record the duration of a GPU pass
+    void recordGpuPass(const char* name, double milliseconds);
+
+    // Count bytes copied into buffer objects
+    void addUploadedBytes(size_t bytes) {
+        m_uploadedBytes.fetch_add(static_cast<uint64_t>(bytes), std::memory_order_relaxed);
+    }
+
+    // Keep the next frameCount frames and write them out after the last one.
+    // Enables the profiler for the duration of the capture.
+    void startCapture(int frameCount, const std::string& tracePath, const std::string& csvPath);
+    bool isCapturing() const;
+
+    // Copy of the summary; reuses the sections storage of `out`
+    void summary(Summary& out) const;
+
+    // Exact totals of the last completed frame, in the same form
+    void lastFrame(Summary& out) const;
+
+    // Nanoseconds on a steady clock
+    static int64_t now();
+
+    // Heap allocations and allocated bytes since the process started
+    static uint64_t allocationCount();
+    static uint64_t allocatedBytes();
+
+private:
+    struct FrameRecord {
+        int64_t begin;
+        int64_t end;
+        uint64_t allocations;
+        uint64_t uploadedBytes;
+        int sectionCount;
+        Section sections[kMaxSections];
+    };
+
+    struct ScopeEvent {
+        const char* name;
+        int64_t begin;
+        int64_t end;
+        int thread;
+    };
+
+    FrameProfiler();
+    FrameProfiler(const FrameProfiler&);
+    FrameProfiler& operator=(const FrameProfiler&);
+
+    // Section of the current frame with this name, nullptr once the frame is full
+    Section* currentSection(const char* name, bool gpu);
+
+    // Small sequential id of the calling thread, for the trace
+    int threadIndex();
+
+    static void writeCapture(const std::string& tracePath, const std::string& csvPath,
+        const std::vector<FrameRecord>& frames, const std::vector<ScopeEvent>& scopes);
+    static bool writeTrace(const std::string& path,
+        const std::vector<FrameRecord>& frames, const std::vector<ScopeEvent>& scopes);
+    static bool writeCsv(const std::string& path, const std::vector<FrameRecord>& frames);
+
+    std::atomic<bool> m_enabled;
+    std::atomic<uint64_t> m_uploadedBytes;
+    std::atomic<int> m_threadCount;
+
+    mutable std::mutex m_mutex;       // Guards everything below
+    FrameRecord m_current;
+    FrameRecord m_last;
+    uint64_t m_frameAllocationStart;
+    uint64_t m_frameUploadStart;
+    Summary m_summary;
+    bool m_hasSummary;
+
+    // Capture in progress
+    bool m_enabledBeforeCapture;
+    int m_captureFramesLeft;
+    std::string m_tracePath;
+    std::string m_csvPath;
+    std::vector<FrameRecord> m_capturedFrames;
+    std::vector<ScopeEvent> m_capturedScopes;
+};
+
+// Times the enclosing block as one scope of the current frame:
+//
+//     { ProfileScope scope("updateBuffers"); ... }
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name)
+        : m_name(name), m_begin(FrameProfiler::instance().isEnabled() ? FrameProfiler::now() : -1) {
+    }
+
+    ~ProfileScope() {
+        if (m_begin >= 0) {
+            FrameProfiler::instance().recordScope(m_name, m_begin, FrameProfiler::now());
+        }
+    }
+
+private:
+    ProfileScope(const ProfileScope&);
+    ProfileScope& operator=(const ProfileScope&);
+
+    const char* m_name;
+    int64_t m_begin;
+};
+
+#endif
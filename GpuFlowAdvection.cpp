@@ -0,0 +1,356 @@
+#include "GpuFlowAdvection.h"
+#include "CameraUniforms.h"
+#include "FrameProfiler.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+
+GpuFlowAdvection::GpuFlowAdvection()
+    : m_numLines(0), m_maxPoints(0), m_newestSlot(0), m_current(0),
+      m_paramBuffer(0), m_trailPositionBuffer(0), m_feedback(0),
+      m_trailPositionTexture(0), m_headTexture(0), m_dynamicsTexture(0), m_paramTexture(0), m_drawVAO(0),
+      m_advectShader(nullptr), m_renderShader(nullptr) {
+    for (int i = 0; i < kStateBufferCount; i++) {
+        m_stateVAO[i] = 0;
+        m_headBuffer[i] = 0;
+        m_dynamicsBuffer[i] = 0;
+    }
+}
+
+GLuint GpuFlowAdvection::createBuffer(GLsizeiptr size, GLenum usage) {
+    GLuint buffer;
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glBufferData(GL_ARRAY_BUFFER, size, nullptr, usage);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return buffer;
+}
+
+GLuint GpuFlowAdvection::createBufferTexture(GLuint buffer, GLenum format) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    return texture;
+}
+
+void GpuFlowAdvection::bindFlowField(const FlowField& field, float carSpeed) {
+    float velocityScale = field.referenceSpeed() > 0.0f ? carSpeed / field.referenceSpeed() : 1.0f;
+    m_advectShader->setBool(m_advectUniforms.useFlowField, true);
+    m_advectShader->setVec3(m_advectUniforms.fieldScale, FlowFieldTexture::coordinateScale(field));
+    m_advectShader->setVec3(m_advectUniforms.fieldOffset, FlowFieldTexture::coordinateOffset(field));
+    m_advectShader->setFloat(m_advectUniforms.fieldVelocityScale, velocityScale);
+    m_fieldTexture.bind(field, 0);
+}
+
+void GpuFlowAdvection::readBuffer(GLuint buffer, GLintptr offset, GLsizeiptr size, void* data) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glGetBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GpuFlowAdvection::create(int numLines, int pointsPerLine) {
+    m_numLines = numLines;
+    m_maxPoints = pointsPerLine;
+    m_newestSlot = 0;
+    m_current = 0;
+
+    GLsizeiptr stateSize = m_numLines * sizeof(glm::vec4);
+    GLsizeiptr trailSize = static_cast<GLsizeiptr>(m_numLines) * m_maxPoints * sizeof(FlowPointCode);
+
+    m_paramBuffer = createBuffer(stateSize * 3, GL_STATIC_DRAW);
+    m_trailPositionBuffer = createBuffer(trailSize, GL_DYNAMIC_COPY);
+
+    // One VAO per state copy, each reading its own state plus the shared parameters
+    glGenVertexArrays(kStateBufferCount, m_stateVAO);
+    for (int i = 0; i < kStateBufferCount; i++) {
+        m_headBuffer[i] = createBuffer(stateSize, GL_DYNAMIC_COPY);
+        m_dynamicsBuffer[i] = createBuffer(stateSize, GL_DYNAMIC_COPY);
+
+        glBindVertexArray(m_stateVAO[i]);
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_headBuffer[i]);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glEnableVertexAttribArray(0);
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_dynamicsBuffer[i]);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glEnableVertexAttribArray(1);
+
+        glBindBuffer(GL_ARRAY_BUFFER, m_paramBuffer);
+        for (int p = 0; p < 3; p++) {
+            glVertexAttribPointer(2 + p, 4, GL_FLOAT, GL_FALSE, 3 * sizeof(glm::vec4), (void*)(p * sizeof(glm::vec4)));
+            glEnableVertexAttribArray(2 + p);
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    glGenTransformFeedbacks(1, &m_feedback);
+    glGenVertexArrays(1, &m_drawVAO);
+
+    m_trailPositionTexture = createBufferTexture(m_trailPositionBuffer, GL_RGBA16I);
+    m_headTexture = createBufferTexture(m_headBuffer[m_current], GL_RGBA32F);
+    m_dynamicsTexture = createBufferTexture(m_dynamicsBuffer[m_current], GL_RGBA32F);
+    m_paramTexture = createBufferTexture(m_paramBuffer, GL_RGBA32F);
+
+    const char* varyings[] = { "outHeadLife", "outDynamics", "outTrailPosition" };
+    m_advectShader = new Shader("flow_advect_vertex.glsl", varyings, 3);
+    m_renderShader = new Shader("line_gpu_vertex.glsl", "line_ribbon_geometry.glsl", "line_fragment.glsl");
+
+    // Texture units stay fixed for the lifetime of the program
+    m_renderShader->use();
+    m_renderShader->setInt("trailPositions", 0);
+    m_renderShader->setInt("lineHeads", 1);
+    m_renderShader->setInt("lineDynamics", 2);
+    m_renderShader->setInt("lineParams", 3);
+    m_renderShader->setInt("flowColormap", kColormapUnit);
+    m_renderShader->setInt("numLines", m_numLines);
+    m_renderShader->setInt("maxPoints", m_maxPoints);
+    m_renderShader->setFloat("positionScale", FlowPointCode::kStep);
+    m_renderShader->setFloat("lifeScale", FlowLineShade::kLifeScale);
+
+    m_advectShader->use();
+    m_advectShader->setInt("maxPoints", m_maxPoints);
+    m_advectShader->setFloat("positionScale", FlowPointCode::kStep);
+    m_advectShader->setFloat("lifeScale", FlowLineShade::kLifeScale);
+    m_advectShader->setInt("flowField", 0);
+
+    m_renderShader->bindUniformBlock("Camera", CameraUniforms::kBindingPoint);
+    m_renderUniforms.model = m_renderShader->uniform("model");
+    m_renderUniforms.lineWidth = m_renderShader->uniform("lineWidth");
+    m_renderUniforms.vortexLineWidth = m_renderShader->uniform("vortexLineWidth");
+    m_renderUniforms.firstVortexLine = m_renderShader->uniform("firstVortexLine");
+    m_renderUniforms.newestSlot = m_renderShader->uniform("newestSlot");
+    m_renderUniforms.visualizePressure = m_renderShader->uniform("visualizePressure");
+
+    m_advectUniforms.deltaTime = m_advectShader->uniform("deltaTime");
+    m_advectUniforms.carLength = m_advectShader->uniform("carLength");
+    m_advectUniforms.carWidth = m_advectShader->uniform("carWidth");
+    m_advectUniforms.carHeight = m_advectShader->uniform("carHeight");
+    m_advectUniforms.carSpeed = m_advectShader->uniform("carSpeed");
+    m_advectUniforms.carPosition = m_advectShader->uniform("carPosition");
+    m_advectUniforms.anchor = m_advectShader->uniform("anchor");
+    m_advectUniforms.vortexIntensity = m_advectShader->uniform("vortexIntensity");
+    m_advectUniforms.simulateDRS = m_advectShader->uniform("simulateDRS");
+    m_advectUniforms.randomSeed = m_advectShader->uniform("randomSeed");
+    m_advectUniforms.frameIndex = m_advectShader->uniform("frameIndex");
+    m_advectUniforms.useFlowField = m_advectShader->uniform("useFlowField");
+    m_advectUniforms.fieldScale = m_advectShader->uniform("fieldScale");
+    m_advectUniforms.fieldOffset = m_advectShader->uniform("fieldOffset");
+    m_advectUniforms.fieldVelocityScale = m_advectShader->uniform("fieldVelocityScale");
+}
+
+void GpuFlowAdvection::destroy() {
+    if (!isCreated()) {
+        return;
+    }
+
+    glDeleteProgram(m_advectShader->ID);
+    glDeleteProgram(m_renderShader->ID);
+    delete m_advectShader;
+    delete m_renderShader;
+    m_advectShader = nullptr;
+    m_renderShader = nullptr;
+
+    GLuint textures[] = { m_trailPositionTexture, m_headTexture, m_dynamicsTexture, m_paramTexture };
+    glDeleteTextures(4, textures);
+    m_fieldTexture.destroy();
+
+    glDeleteVertexArrays(kStateBufferCount, m_stateVAO);
+    glDeleteVertexArrays(1, &m_drawVAO);
+    glDeleteTransformFeedbacks(1, &m_feedback);
+
+    glDeleteBuffers(kStateBufferCount, m_headBuffer);
+    glDeleteBuffers(kStateBufferCount, m_dynamicsBuffer);
+    glDeleteBuffers(1, &m_paramBuffer);
+    glDeleteBuffers(1, &m_trailPositionBuffer);
+}
+
+void GpuFlowAdvection::uploadLines(const FlowLinePool& pool, int firstLine, int lastLine, float anchor) {
+    int count = lastLine - firstLine;
+    if (!isCreated() || count <= 0) {
+        return;
+    }
+
+    GLintptr stateOffset = firstLine * sizeof(glm::vec4);
+    GLsizeiptr stateSize = count * sizeof(glm::vec4);
+
+    // Head and life
+    m_staging.resize(count * 3);
+    for (int i = 0; i < count; i++) {
+        int line = firstLine + i;
+        glm::vec3 head = pool.pointCount[line] > 0 ? pool.front(line) : glm::vec3(0.0f);
+        m_staging[i] = glm::vec4(head.x, head.y, head.z - anchor, pool.life[line]);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_headBuffer[m_current]);
+    glBufferSubData(GL_ARRAY_BUFFER, stateOffset, stateSize, m_staging.data());
+
+    // Dynamic scalars
+    for (int i = 0; i < count; i++) {
+        int line = firstLine + i;
+        m_staging[i] = glm::vec4(pool.speed[line], pool.pressure[line], pool.vortexPhase[line],
+            static_cast<float>(pool.pointCount[line]));
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_dynamicsBuffer[m_current]);
+    glBufferSubData(GL_ARRAY_BUFFER, stateOffset, stateSize, m_staging.data());
+
+    // Per-line constants
+    for (int i = 0; i < count; i++) {
+        int line = firstLine + i;
+        const FlowLine& flowLine = pool.params[line];
+        m_staging[i * 3 + 0] = glm::vec4(flowLine.initialOffset, flowLine.initialLife);
+        m_staging[i * 3 + 1] = glm::vec4(flowLine.direction, flowLine.velocity);
+        m_staging[i * 3 + 2] = glm::vec4(static_cast<float>(pool.zoneType[line]),
+            static_cast<float>(pool.isVortex[line]), flowLine.vortexStrength, 0.0f);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, m_paramBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, stateOffset * 3, stateSize * 3, m_staging.data());
+
+    // Trails: the k-th newest point of every line shares one trail slot,
+    // so each slot of the line range is a single contiguous write
+    int longest = 0;
+    for (int line = firstLine; line < lastLine; line++) {
+        longest = std::max(longest, pool.pointCount[line]);
+    }
+
+    m_trailStaging.assign(static_cast<size_t>(count) * longest, FlowPointCode::encode(glm::vec3(0.0f), 0.0f, 0));
+    FlowPointCode* positions = m_trailStaging.data();
+    for (int i = 0; i < count; i++) {
+        int line = firstLine + i;
+        size_t base = pool.slotOffset(line);
+        for (int k = 0; k < pool.pointCount[line]; k++) {
+            size_t point = base + (pool.head[line] + k) % pool.maxPoints;
+            positions[k * count + i] = FlowPointCode::encode(pool.positions[point], anchor, pool.emissionLife[point]);
+        }
+    }
+
+    GLsizeiptr trailSize = count * sizeof(FlowPointCode);
+    for (int k = 0; k < longest; k++) {
+        GLintptr trailOffset = (static_cast<GLintptr>(trailSlot(k)) * m_numLines + firstLine) * sizeof(FlowPointCode);
+        glBindBuffer(GL_ARRAY_BUFFER, m_trailPositionBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, trailOffset, trailSize, positions + k * count);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Five state vectors per line plus one code per trail point
+    FrameProfiler::instance().addUploadedBytes(static_cast<size_t>(stateSize) * 5 + static_cast<size_t>(trailSize) * longest);
+}
+
+void GpuFlowAdvection::step(const GpuFlowStepParams& params, int lineCount) {
+    if (!isCreated() || lineCount <= 0) {
+        return;
+    }
+
+    int next = 1 - m_current;
+    m_newestSlot = (m_newestSlot + 1) % m_maxPoints;
+
+    m_advectShader->use();
+    m_advectShader->setFloat(m_advectUniforms.deltaTime, params.deltaTime);
+    m_advectShader->setFloat(m_advectUniforms.carLength, params.carLength);
+    m_advectShader->setFloat(m_advectUniforms.carWidth, params.carWidth);
+    m_advectShader->setFloat(m_advectUniforms.carHeight, params.carHeight);
+    m_advectShader->setFloat(m_advectUniforms.carSpeed, params.carSpeed);
+    m_advectShader->setFloat(m_advectUniforms.carPosition, params.carPosition);
+    m_advectShader->setFloat(m_advectUniforms.anchor, params.anchor);
+    m_advectShader->setFloat(m_advectUniforms.vortexIntensity, params.vortexIntensity);
+    m_advectShader->setBool(m_advectUniforms.simulateDRS, params.simulateDRS);
+    m_advectShader->setInt(m_advectUniforms.randomSeed, static_cast<int>(params.randomSeed));
+    m_advectShader->setInt(m_advectUniforms.frameIndex, static_cast<int>(params.frameIndex));
+    if (params.flowField && !params.flowField->isEmpty()) {
+        bindFlowField(*params.flowField, params.carSpeed);
+    }
+    else {
+        m_advectShader->setBool(m_advectUniforms.useFlowField, false);
+    }
+
+    // New state goes to the other copy, the new heads to this step's trail slot
+    GLintptr trailOffset = static_cast<GLintptr>(m_newestSlot) * m_numLines * sizeof(FlowPointCode);
+    GLsizeiptr size = lineCount * sizeof(glm::vec4);
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, m_feedback);
+    glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_headBuffer[next], 0, size);
+    glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 1, m_dynamicsBuffer[next], 0, size);
+    glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 2, m_trailPositionBuffer, trailOffset, lineCount * sizeof(FlowPointCode));
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(m_stateVAO[m_current]);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, lineCount);
+    glEndTransformFeedback();
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+
+    m_current = next;
+}
+
+void GpuFlowAdvection::draw(float anchor, int lineCount, int firstVortexLine, float lineWidth, float vortexLineWidth,
+    FlowColormap& colormap, bool visualizePressure) {
+    if (!isCreated() || lineCount <= 0) {
+        return;
+    }
+
+    m_renderShader->use();
+    m_renderShader->setMat4(m_renderUniforms.model, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, anchor)));
+    m_renderShader->setFloat(m_renderUniforms.lineWidth, lineWidth);
+    m_renderShader->setFloat(m_renderUniforms.vortexLineWidth, vortexLineWidth);
+    m_renderShader->setInt(m_renderUniforms.firstVortexLine, firstVortexLine);
+    m_renderShader->setInt(m_renderUniforms.newestSlot, m_newestSlot);
+    m_renderShader->setBool(m_renderUniforms.visualizePressure, visualizePressure);
+
+    // Lives, pressures and point counts of the latest step
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, m_trailPositionTexture);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, m_headTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_headBuffer[m_current]);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_BUFFER, m_dynamicsTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_dynamicsBuffer[m_current]);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_BUFFER, m_paramTexture);
+    glActiveTexture(GL_TEXTURE0);
+    colormap.bind(kColormapUnit);
+
+    // One strip instance per line, widened into a ribbon by the geometry shader;
+    // vertices past a line's point count collapse onto its tail and draw nothing
+    glBindVertexArray(m_drawVAO);
+    glDrawArraysInstanced(GL_LINE_STRIP, 0, m_maxPoints, lineCount);
+    glBindVertexArray(0);
+}
+
+void GpuFlowAdvection::readback(FlowLinePool& pool, int lineCount, float anchor) {
+    if (!isCreated() || lineCount <= 0) {
+        return;
+    }
+
+    GLsizeiptr stateSize = lineCount * sizeof(glm::vec4);
+    size_t trailCount = static_cast<size_t>(m_numLines) * m_maxPoints;
+
+    m_staging.resize(lineCount * 2);
+    m_trailStaging.resize(trailCount);
+    glm::vec4* heads = m_staging.data();
+    glm::vec4* dynamics = heads + lineCount;
+    const FlowPointCode* positions = m_trailStaging.data();
+
+    readBuffer(m_headBuffer[m_current], 0, stateSize, heads);
+    readBuffer(m_dynamicsBuffer[m_current], 0, stateSize, dynamics);
+    readBuffer(m_trailPositionBuffer, 0, trailCount * sizeof(FlowPointCode), m_trailStaging.data());
+
+    for (int line = 0; line < lineCount; line++) {
+        pool.life[line] = heads[line].w;
+        pool.speed[line] = dynamics[line].x;
+        pool.pressure[line] = dynamics[line].y;
+        pool.vortexPhase[line] = dynamics[line].z;
+
+        // Rebuild the ring from the oldest point so the newest ends up at the head
+        int count = std::min(static_cast<int>(dynamics[line].w), pool.maxPoints);
+        pool.clearPoints(line);
+        for (int k = count - 1; k >= 0; k--) {
+            size_t texel = static_cast<size_t>(trailSlot(k)) * m_numLines + line;
+            pool.pushFront(line, positions[texel].decode(anchor), positions[texel].emissionLife());
+        }
+    }
+}
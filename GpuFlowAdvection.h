@@ -0,0 +1,131 @@
+#ifndef GPU_FLOW_ADVECTION_H
+#define GPU_FLOW_ADVECTION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "FlowColormap.h"
+#include "FlowField.h"
+#include "FlowFieldTexture.h"
+#include "FlowLinePool.h"
+#include "Shader.h"
+
+// Simulation inputs for one GPU advection step
+struct GpuFlowStepParams {
+    float deltaTime;
+    float carLength;
+    float carWidth;
+    float carHeight;
+    float carSpeed;
+    float carPosition;         // In the flow frame, like the pool's points
+    float anchor;              // Flow frame Z the GPU positions are stored around
+    float vortexIntensity;
+    bool simulateDRS;
+    unsigned int randomSeed;   // Same stream keys as FlowRandom
+    unsigned int frameIndex;
+    const FlowField* flowField;   // Aerodynamics to sample, or nullptr for the analytic model
+};
+
+// Flow line advection running entirely on the GPU.
+// Line state lives in two ping-ponged vertex buffers that a transform
+// feedback pass reads and rewrites once per step, appending the new head of
+// every line to a shared trail ring. Trails are drawn straight from those
+// buffers, so nothing crosses the bus unless lines are uploaded or read back.
+// Positions are in the simulation's flow frame, which follows the car without
+// touching the stored points, relative to an anchor along Z; trail points are
+// FlowPointCodes around the anchor, half the size of float positions.
+class GpuFlowAdvection {
+public:
+    GpuFlowAdvection();
+
+    // Allocate state and trail storage for numLines lines of pointsPerLine points
+    void create(int numLines, int pointsPerLine);
+
+    // Release buffers, textures and programs
+    void destroy();
+
+    bool isCreated() const { return m_advectShader != nullptr; }
+
+    // Copy lines [firstLine, lastLine) of the pool, trails included, into GPU state
+    void uploadLines(const FlowLinePool& pool, int firstLine, int lastLine, float anchor);
+
+    // Advance the first lineCount lines by one step
+    void step(const GpuFlowStepParams& params, int lineCount);
+
+    // Draw the first lineCount lines as one instanced line strip draw, as ribbons
+    // lineWidth pixels wide, or vortexLineWidth from line firstVortexLine on,
+    // colored through colormap by pressure or else by emission zone.
+    // The camera comes from the shared Camera uniform block.
+    void draw(float anchor, int lineCount, int firstVortexLine, float lineWidth, float vortexLineWidth,
+        FlowColormap& colormap, bool visualizePressure);
+
+    // Copy the GPU state of the first lineCount lines back into the pool
+    void readback(FlowLinePool& pool, int lineCount, float anchor);
+
+private:
+    static const int kStateBufferCount = 2;   // Ping-pong copies of the line state
+    static const int kColormapUnit = 4;       // Texture units 0 to 3 hold the render shader's buffer views
+
+    int m_numLines;
+    int m_maxPoints;
+    int m_newestSlot;            // Trail slot holding the latest head of every line
+    int m_current;               // State copy written by the last step
+
+    GLuint m_stateVAO[kStateBufferCount];
+    GLuint m_headBuffer[kStateBufferCount];      // vec4: head.xyz (anchor frame), life
+    GLuint m_dynamicsBuffer[kStateBufferCount];  // vec4: speed, pressure, vortexPhase, pointCount
+    GLuint m_paramBuffer;                        // 3 x vec4 per line, constant between uploads
+    GLuint m_trailPositionBuffer;                // FlowPointCode per point, [slot][line], around the anchor
+    GLuint m_feedback;
+
+    GLuint m_trailPositionTexture;   // GL_RGBA16I
+    GLuint m_headTexture;        // Views of the current state copy and the parameters,
+    GLuint m_dynamicsTexture;    // for the render shader to color lines by
+    GLuint m_paramTexture;
+    GLuint m_drawVAO;            // Attribute-less; the render shader fetches from textures
+    FlowFieldTexture m_fieldTexture;   // Sampled by the advect shader on unit 0
+
+    Shader* m_advectShader;
+    Shader* m_renderShader;
+
+    // Uniform handles, looked up once in create()
+    struct AdvectUniforms {
+        UniformHandle deltaTime;
+        UniformHandle carLength;
+        UniformHandle carWidth;
+        UniformHandle carHeight;
+        UniformHandle carSpeed;
+        UniformHandle carPosition;
+        UniformHandle anchor;
+        UniformHandle vortexIntensity;
+        UniformHandle simulateDRS;
+        UniformHandle randomSeed;
+        UniformHandle frameIndex;
+        UniformHandle useFlowField;
+        UniformHandle fieldScale;
+        UniformHandle fieldOffset;
+        UniformHandle fieldVelocityScale;
+    } m_advectUniforms;
+
+    struct RenderUniforms {
+        UniformHandle model;
+        UniformHandle lineWidth;
+        UniformHandle vortexLineWidth;
+        UniformHandle firstVortexLine;
+        UniformHandle newestSlot;
+        UniformHandle visualizePressure;
+    } m_renderUniforms;
+
+    std::vector<glm::vec4> m_staging;   // Reused upload/readback scratch
+    std::vector<FlowPointCode> m_trailStaging;
+
+    // Trail slot of the k-th newest point
+    int trailSlot(int k) const { return (m_newestSlot - k + m_maxPoints) % m_maxPoints; }
+
+    GLuint createBuffer(GLsizeiptr size, GLenum usage);
+    GLuint createBufferTexture(GLuint buffer, GLenum format);
+    void bindFlowField(const FlowField& field, float carSpeed);
+    void readBuffer(GLuint buffer, GLintptr offset, GLsizeiptr size, void* data);
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "GpuPassTimer.h"
+#include "FrameProfiler.h"
+
+GpuPassTimer::GpuPassTimer(const char* name)
+    : m_name(name), m_next(0), m_active(false) {
+    for (int i = 0; i < kQueryCount; i++) {
+        m_queries[i] = 0;
+        m_pending[i] = false;
+    }
+}
+
+void GpuPassTimer::create() {
+    glGenQueries(kQueryCount, m_queries);
+}
+
+void GpuPassTimer::destroy() {
+    if (m_queries[0]) {
+        glDeleteQueries(kQueryCount, m_queries);
+    }
+    for (int i = 0; i < kQueryCount; i++) {
+        m_queries[i] = 0;
+        m_pending[i] = false;
+    }
+    m_active = false;
+}
+
+void GpuPassTimer::begin() {
+    if (!m_queries[0]) {
+        return;
+    }
+    collect();
+    if (!FrameProfiler::instance().isEnabled() || m_pending[m_next]) {
+        return;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, m_queries[m_next]);
+    m_active = true;
+}
+
+void GpuPassTimer::end() {
+    if (!m_active) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    m_pending[m_next] = true;
+    m_next = (m_next + 1) % kQueryCount;
+    m_active = false;
+}
+
+void GpuPassTimer::collect() {
+    // Oldest first; results arrive in issue order, so stop at the first one not ready
+    for (int i = 0; i < kQueryCount; i++) {
+        int query = (m_next + i) % kQueryCount;
+        if (!m_pending[query]) {
+            continue;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(m_queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(m_queries[query], GL_QUERY_RESULT, &elapsed);
+        m_pending[query] = false;
+        FrameProfiler::instance().recordGpuPass(m_name, static_cast<double>(elapsed) / 1.0e6);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef GPU_PASS_TIMER_H
+#define GPU_PASS_TIMER_H
+
+#include <glad/glad.h>
+
+// GPU time of one render pass, measured with GL_TIME_ELAPSED queries and
+// reported to the FrameProfiler. Each frame's pass takes the next query of a
+// small ring and results are collected only once the GPU has them, a few
+// frames later, so timing never stalls the pipeline. Elapsed-time queries
+// cannot nest, so passes timed this way must not overlap.
+class GpuPassTimer {
+public:
+    static const int kQueryCount = 4;
+
+    // The name must outlive the timer; string literals do
+    explicit GpuPassTimer(const char* name);
+
+    // Create and release the queries; need a current GL context
+    void create();
+    void destroy();
+
+    // Bracket the GL commands of the pass. Both do nothing while the profiler
+    // is disabled or every query of the ring is still waiting on the GPU.
+    void begin();
+    void end();
+
+private:
+    // Report every query the GPU has finished with
+    void collect();
+
+    const char* m_name;
+    GLuint m_queries[kQueryCount];
+    bool m_pending[kQueryCount];  // Issued, result not yet read
+    int m_next;                   // Query the next pass uses
+    bool m_active;                // Between a begin() that started a query and end()
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+JobSystem::JobSystem(int workerCount)
+    : m_job(nullptr), m_count(0), m_chunkSize(1), m_nextIndex(0),
+      m_generation(0), m_busyWorkers(0), m_quit(false) {
+    if (workerCount < 0) {
+        workerCount = std::max(0, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+    }
+
+    for (int i = 0; i < workerCount; i++) {
+        m_workers.emplace_back(&JobSystem::workerLoop, this, i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+    m_wake.notify_all();
+
+    for (std::thread& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void JobSystem::parallelFor(int count, int chunkSize, const RangeFunction& fn) {
+    if (count <= 0) {
+        return;
+    }
+
+    chunkSize = std::max(1, chunkSize);
+
+    // Not worth waking anyone for a single chunk
+    if (m_workers.empty() || count <= chunkSize) {
+        fn(0, count, threadCount() - 1);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = &fn;
+        m_count = count;
+        m_chunkSize = chunkSize;
+        m_nextIndex.store(0, std::memory_order_relaxed);
+        m_busyWorkers = static_cast<int>(m_workers.size());
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    // The caller takes the last thread index
+    runChunks(threadCount() - 1);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_busyWorkers == 0; });
+    m_job = nullptr;
+}
+
+void JobSystem::workerLoop(int threadIndex) {
+    unsigned int seenGeneration = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_quit || m_generation != seenGeneration; });
+            if (m_quit) {
+                return;
+            }
+            seenGeneration = m_generation;
+        }
+
+        runChunks(threadIndex);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busyWorkers--;
+        }
+        m_done.notify_one();
+    }
+}
+
+void JobSystem::runChunks(int threadIndex) {
+    while (true) {
+        int begin = m_nextIndex.fetch_add(m_chunkSize, std::memory_order_relaxed);
+        if (begin >= m_count) {
+            return;
+        }
+        (*m_job)(begin, std::min(begin + m_chunkSize, m_count), threadIndex);
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads for data-parallel loops.
+// parallelFor() hands out the index range in small chunks that idle threads
+// claim from a shared counter, so a slow chunk never holds up the rest.
+// The calling thread works on chunks too and the call returns once every
+// chunk is done.
+class JobSystem {
+public:
+    // Range callback: fn(begin, end, threadIndex) with threadIndex in [0, threadCount())
+    typedef std::function<void(int, int, int)> RangeFunction;
+
+    // workerCount < 0 uses one worker per hardware thread besides the caller
+    explicit JobSystem(int workerCount = -1);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Workers plus the calling thread
+    int threadCount() const { return static_cast<int>(m_workers.size()) + 1; }
+
+    // Run fn over [0, count) in chunks of chunkSize indices; blocks until done
+    void parallelFor(int count, int chunkSize, const RangeFunction& fn);
+
+private:
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    // Current job
+    const RangeFunction* m_job;
+    int m_count;
+    int m_chunkSize;
+    std::atomic<int> m_nextIndex;
+    unsigned int m_generation;   // Bumped per job so workers never run one twice
+    int m_busyWorkers;
+    bool m_quit;
+
+    void workerLoop(int threadIndex);
+    void runChunks(int threadIndex);
+};
+
+#endif
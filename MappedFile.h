@@ -0,0 +1,39 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory map of a whole file. The pages are loaded by the OS on
+// first touch, so large files are only read as far as they are used.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    // Map the file at path; false if it cannot be opened or is empty
+    bool open(const std::string& path);
+
+    // Unmap the file
+    void close();
+
+    bool isOpen() const { return m_data != nullptr; }
+    const unsigned char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const unsigned char* m_data;
+    size_t m_size;
+
+#ifdef _WIN32
+    void* m_file;       // HANDLE of the open file
+    void* m_mapping;    // HANDLE of the file mapping
+#else
+    int m_fd;
+#endif
+};
+
+#endif
@@ -0,0 +1,192 @@
+#include "MergedGeometry.h"
+#include "FrameProfiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+MergedGeometry::MergedGeometry()
+    : m_vao(0), m_vbo(0), m_ebo(0), m_positionOffset(0.0f), m_positionScale(1.0f), m_gpuBytes(0) {}
+
+uint32_t MergedGeometry::packNormal(const glm::vec3& normal) {
+    uint32_t packed = 0;
+    for (int i = 0; i < 3; i++) {
+        int value = static_cast<int>(std::lround(std::min(std::max(normal[i], -1.0f), 1.0f) * 511.0f));
+        packed |= (static_cast<uint32_t>(value) & 0x3ffu) << (10 * i);
+    }
+    return packed;
+}
+
+bool MergedGeometry::build(const std::vector<MeshArrays>& meshes) {
+    destroy();
+
+    // Bounds of every mesh and of the whole model, and the index width each mesh needs
+    size_t vertexCount = 0;
+    size_t shortIndexCount = 0;
+    size_t intIndexCount = 0;
+    glm::vec3 boundsMin(INFINITY);
+    glm::vec3 boundsMax(-INFINITY);
+    m_meshes.resize(meshes.size());
+    for (size_t m = 0; m < meshes.size(); m++) {
+        const MeshArrays& mesh = meshes[m];
+        MeshRange& range = m_meshes[m];
+        range.bounds.min = glm::vec3(INFINITY);
+        range.bounds.max = glm::vec3(-INFINITY);
+        for (size_t i = 0; i < mesh.vertexCount; i++) {
+            range.bounds.min = glm::min(range.bounds.min, mesh.vertices[i].Position);
+            range.bounds.max = glm::max(range.bounds.max, mesh.vertices[i].Position);
+        }
+        boundsMin = glm::min(boundsMin, range.bounds.min);
+        boundsMax = glm::max(boundsMax, range.bounds.max);
+
+        unsigned int maxIndex = 0;
+        for (size_t i = 0; i < mesh.indexCount; i++) {
+            maxIndex = std::max(maxIndex, mesh.indices[i]);
+        }
+        range.lods = mesh.lods;
+        range.baseVertex = static_cast<GLint>(vertexCount);
+        range.indexOffset = 0;
+        range.shortIndices = (maxIndex <= 0xffffu);
+        (range.shortIndices ? shortIndexCount : intIndexCount) += mesh.indexCount;
+        vertexCount += mesh.vertexCount;
+    }
+    if (shortIndexCount + intIndexCount == 0) {
+        m_meshes.clear();
+        return false;
+    }
+
+    // Quantize around the box center so the full 16-bit range covers the box
+    m_positionOffset = (boundsMin + boundsMax) * 0.5f;
+    m_positionScale = glm::max((boundsMax - boundsMin) * 0.5f / 32767.0f, glm::vec3(1e-20f));
+
+    std::vector<PackedVertex> vertices(vertexCount);
+    size_t shortBytes = (shortIndexCount * sizeof(uint16_t) + 3) & ~static_cast<size_t>(3);
+    std::vector<unsigned char> indices(shortBytes + intIndexCount * sizeof(uint32_t));
+
+    size_t vertexBase = 0;
+    size_t shortOffset = 0;
+    size_t intOffset = shortBytes;
+    for (size_t m = 0; m < meshes.size(); m++) {
+        const MeshArrays& mesh = meshes[m];
+        for (size_t i = 0; i < mesh.vertexCount; i++) {
+            PackedVertex& packed = vertices[vertexBase + i];
+            glm::vec3 q = glm::round((mesh.vertices[i].Position - m_positionOffset) / m_positionScale);
+            q = glm::clamp(q, glm::vec3(-32767.0f), glm::vec3(32767.0f));
+            packed.position[0] = static_cast<int16_t>(q.x);
+            packed.position[1] = static_cast<int16_t>(q.y);
+            packed.position[2] = static_cast<int16_t>(q.z);
+            packed.position[3] = 0;
+            packed.normal = packNormal(mesh.vertices[i].Normal);
+        }
+
+        if (mesh.indexCount > 0) {
+            bool shortIndices = m_meshes[m].shortIndices;
+            size_t& offset = shortIndices ? shortOffset : intOffset;
+            m_meshes[m].indexOffset = offset;
+
+            if (shortIndices) {
+                uint16_t* out = reinterpret_cast<uint16_t*>(indices.data() + offset);
+                for (size_t i = 0; i < mesh.indexCount; i++) {
+                    out[i] = static_cast<uint16_t>(mesh.indices[i]);
+                }
+                offset += mesh.indexCount * sizeof(uint16_t);
+            }
+            else {
+                std::memcpy(indices.data() + offset, mesh.indices, mesh.indexCount * sizeof(uint32_t));
+                offset += mesh.indexCount * sizeof(uint32_t);
+            }
+        }
+        vertexBase += mesh.vertexCount;
+    }
+
+    glGenVertexArrays(1, &m_vao);
+    glGenBuffers(1, &m_vbo);
+    glGenBuffers(1, &m_ebo);
+
+    glBindVertexArray(m_vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(PackedVertex), vertices.data(), GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size(), indices.data(), GL_STATIC_DRAW);
+    FrameProfiler::instance().addUploadedBytes(vertices.size() * sizeof(PackedVertex) + indices.size());
+
+    // Positions are read as plain integers; the shader applies the scale, which
+    // avoids the snorm conversion rule that differs between GL versions
+    glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+    glEnableVertexAttribArray(0);
+    // Normals
+    glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+    glEnableVertexAttribArray(1);
+
+    glBindVertexArray(0);
+
+    m_gpuBytes = vertices.size() * sizeof(PackedVertex) + indices.size();
+    return true;
+}
+
+void MergedGeometry::destroy() {
+    if (m_vao != 0) {
+        glDeleteVertexArrays(1, &m_vao);
+        glDeleteBuffers(1, &m_vbo);
+        glDeleteBuffers(1, &m_ebo);
+    }
+    m_vao = 0;
+    m_vbo = 0;
+    m_ebo = 0;
+    m_meshes.clear();
+    m_shortDraws = DrawList();
+    m_intDraws = DrawList();
+    m_gpuBytes = 0;
+}
+
+void MergedGeometry::addDraw(const MeshRange& mesh, int level) {
+    GLsizei count = static_cast<GLsizei>(mesh.lods.indexCount[level]);
+    if (count == 0) {
+        return;
+    }
+    size_t indexSize = mesh.shortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+    DrawList& list = mesh.shortIndices ? m_shortDraws : m_intDraws;
+    list.counts.push_back(count);
+    list.offsets.push_back(reinterpret_cast<const void*>(mesh.indexOffset + mesh.lods.firstIndex(level) * indexSize));
+    list.baseVertices.push_back(mesh.baseVertex);
+}
+
+void MergedGeometry::draw() {
+    for (size_t m = 0; m < m_meshes.size(); m++) {
+        addDraw(m_meshes[m], 0);
+    }
+    flushDraws();
+}
+
+void MergedGeometry::draw(const ViewFrustum& frustum) {
+    for (size_t m = 0; m < m_meshes.size(); m++) {
+        const MeshRange& mesh = m_meshes[m];
+        if (frustum.isVisible(mesh.bounds)) {
+            addDraw(mesh, mesh.lods.selectLevel(frustum.projectedSize(mesh.bounds)));
+        }
+    }
+    flushDraws();
+}
+
+void MergedGeometry::flushDraws() {
+    glBindVertexArray(m_vao);
+    if (!m_shortDraws.counts.empty()) {
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, m_shortDraws.counts.data(), GL_UNSIGNED_SHORT,
+            m_shortDraws.offsets.data(),
+            static_cast<GLsizei>(m_shortDraws.counts.size()), m_shortDraws.baseVertices.data());
+    }
+    if (!m_intDraws.counts.empty()) {
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, m_intDraws.counts.data(), GL_UNSIGNED_INT,
+            m_intDraws.offsets.data(),
+            static_cast<GLsizei>(m_intDraws.counts.size()), m_intDraws.baseVertices.data());
+    }
+    glBindVertexArray(0);
+
+    // Keep the capacity; the lists are rebuilt every frame
+    for (DrawList* list : { &m_shortDraws, &m_intDraws }) {
+        list->counts.clear();
+        list->offsets.clear();
+        list->baseVertices.clear();
+    }
+}
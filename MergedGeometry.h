@@ -0,0 +1,85 @@
+#ifndef MERGED_GEOMETRY_H
+#define MERGED_GEOMETRY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "MeshCache.h"
+#include "ViewFrustum.h"
+
+// Every mesh of a model packed into one vertex and one index buffer and
+// drawn with glMultiDrawElementsBaseVertex, one call per index type.
+//
+// Vertices are 12 bytes instead of sizeof(Vertex) = 32: positions are
+// 16-bit integers on the model's bounding box, which the vertex shader
+// decodes with positionOffset + positionScale * aPos, and normals are
+// 10:10:10:2 signed normalized. Texture coordinates are not stored, the
+// car shader does not read them. Meshes with at most 65536 vertices use
+// 16-bit indices relative to their base vertex, larger ones 32-bit. Every
+// level of each mesh's LOD chain is kept, so culling and level selection
+// only change the draw lists.
+class MergedGeometry {
+public:
+    MergedGeometry();
+
+    // Pack and upload the meshes; false if there is nothing to draw
+    bool build(const std::vector<MeshArrays>& meshes);
+
+    // Release the buffers
+    void destroy();
+
+    // Issue the draws at full detail; the shader must have the decode uniforms set
+    void draw();
+
+    // Draw only the meshes inside the frustum, each at the level its size calls for
+    void draw(const ViewFrustum& frustum);
+
+    bool isBuilt() const { return m_vao != 0; }
+
+    // Dequantization of the stored positions
+    const glm::vec3& positionOffset() const { return m_positionOffset; }
+    const glm::vec3& positionScale() const { return m_positionScale; }
+
+    // Bytes of vertex and index data on the GPU
+    size_t gpuBytes() const { return m_gpuBytes; }
+
+private:
+    struct PackedVertex {
+        int16_t position[4];   // xyz quantized, w unused
+        uint32_t normal;       // GL_INT_2_10_10_10_REV
+    };
+
+    // Where one mesh lives in the buffers
+    struct MeshRange {
+        BoundingBox bounds;
+        MeshLods lods;
+        GLint baseVertex;
+        size_t indexOffset;    // Byte offset of level 0
+        bool shortIndices;
+    };
+
+    // Parameters of one multi-draw call, refilled every draw
+    struct DrawList {
+        std::vector<GLsizei> counts;
+        std::vector<const void*> offsets;   // Byte offsets into the index buffer
+        std::vector<GLint> baseVertices;
+    };
+
+    static uint32_t packNormal(const glm::vec3& normal);
+
+    void addDraw(const MeshRange& mesh, int level);
+    void flushDraws();
+
+    GLuint m_vao;
+    GLuint m_vbo;
+    GLuint m_ebo;
+    std::vector<MeshRange> m_meshes;
+    DrawList m_shortDraws;
+    DrawList m_intDraws;
+    glm::vec3 m_positionOffset;
+    glm::vec3 m_positionScale;
+    size_t m_gpuBytes;
+};
+
+#endif
@@ -1,11 +1,31 @@
 #include "Mesh.h"
+#include "FrameProfiler.h"
+#include <utility>
 
 Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices)
-    : vertices(vertices), indices(indices) {
-    setupMesh();
+    : vertices(std::move(vertices)), indices(std::move(indices)), lods(MeshLods::single(this->indices.size())) {
+    setupMesh(this->vertices.data(), this->vertices.size(), this->indices.data(), this->indices.size());
 }
 
-void Mesh::setupMesh() {
+Mesh::Mesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, const MeshLods& lods)
+    : lods(lods) {
+    setupMesh(vertexData, vertexCount, indexData, lods.totalIndexCount());
+}
+
+void Mesh::setupMesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount) {
+    this->indexCount = static_cast<unsigned int>(indexCount);
+
+    bounds.min = glm::vec3(0.0f);
+    bounds.max = glm::vec3(0.0f);
+    if (vertexCount > 0) {
+        bounds.min = vertexData[0].Position;
+        bounds.max = vertexData[0].Position;
+    }
+    for (size_t i = 1; i < vertexCount; i++) {
+        bounds.min = glm::min(bounds.min, vertexData[i].Position);
+        bounds.max = glm::max(bounds.max, vertexData[i].Position);
+    }
+
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
@@ -13,10 +33,11 @@ void Mesh::setupMesh() {
     glBindVertexArray(VAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertexData, GL_STATIC_DRAW);
 
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indexData, GL_STATIC_DRAW);
+    FrameProfiler::instance().addUploadedBytes(vertexCount * sizeof(Vertex) + indexCount * sizeof(unsigned int));
 
     // Vertex Positions
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
@@ -31,8 +52,33 @@ void Mesh::setupMesh() {
     glBindVertexArray(0);
 }
 
+void Mesh::releaseCpuData() {
+    std::vector<Vertex>().swap(vertices);
+    std::vector<unsigned int>().swap(indices);
+}
+
+void Mesh::releaseGpuData() {
+    if (VAO != 0) {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+    }
+    VAO = 0;
+    VBO = 0;
+    EBO = 0;
+    indexCount = 0;
+}
+
 void Mesh::Draw(Shader& shader) {
+    Draw(shader, 0);
+}
+
+void Mesh::Draw(Shader&, int level) {
+    if (indexCount == 0 || lods.indexCount[level] == 0) {
+        return;
+    }
     glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, lods.indexCount[level], GL_UNSIGNED_INT,
+        (void*)(lods.firstIndex(level) * sizeof(unsigned int)));
     glBindVertexArray(0);
 }
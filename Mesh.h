@@ -5,6 +5,8 @@
 #include <glm/glm.hpp>
 #include <vector>
 #include "Shader.h"
+#include "MeshLod.h"
+#include "ViewFrustum.h"
 
 struct Vertex {
     glm::vec3 Position;
@@ -18,17 +20,33 @@ public:
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     unsigned int VAO;
+    unsigned int indexCount;        // Indices in the buffer, all levels
+    MeshLods lods;
+    BoundingBox bounds;
 
-    // Constructor
+    // Constructor for a mesh without coarser levels; pass the arrays with
+    // std::move to hand them over without a copy
     Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices);
 
-    // Render
+    // Upload straight from caller-owned arrays (e.g. a mapped mesh cache);
+    // indexData holds lods.totalIndexCount() indices and the vertices and
+    // indices members stay empty
+    Mesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, const MeshLods& lods);
+
+    // Free the CPU-side vertices and indices; the GPU buffers keep the mesh drawable
+    void releaseCpuData();
+
+    // Delete the GL buffers (e.g. once the mesh lives in merged geometry); Draw then does nothing
+    void releaseGpuData();
+
+    // Render the full mesh, or one level of its chain
     void Draw(Shader& shader);
+    void Draw(Shader& shader, int level);
 
 private:
     unsigned int VBO, EBO;
 
-    void setupMesh();
+    void setupMesh(const Vertex* vertexData, size_t vertexCount, const unsigned int* indexData, size_t indexCount);
 };
 
 #endif
@@ -0,0 +1,172 @@
+#include "MeshCache.h"
+#include "FileStamp.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+const char kMagic[4] = { 'F', '1', 'M', 'C' };
+const uint64_t kAlignment = 16;
+
+uint64_t alignOffset(uint64_t offset) {
+    return (offset + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+}
+
+// Refresh the stamp of a cache whose source was touched but not changed,
+// so the next launch does not have to hash the source again. The cache must
+// not be mapped: Windows refuses to open a mapped file for writing.
+bool MeshCache::patchStamp(const std::string& cachePath, const Header& header) {
+    std::fstream file(cachePath.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    return static_cast<bool>(file);
+}
+
+bool MeshCache::open(const std::string& cachePath, const std::string& sourcePath) {
+    close();
+
+    if (!m_file.open(cachePath) || m_file.size() < sizeof(Header)) {
+        close();
+        return false;
+    }
+
+    Header header;
+    std::memcpy(&header, m_file.data(), sizeof(Header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+        header.version != kVersion || header.vertexSize != sizeof(Vertex)) {
+        close();
+        return false;
+    }
+
+    FileStamp source;
+    if (!FileStamp::read(sourcePath, source) || source.size != header.sourceSize) {
+        close();
+        return false;
+    }
+
+    bool touched = (source.modified != header.sourceModified);
+    if (touched) {
+        uint64_t sourceHash = 0;
+        if (!hashFile(sourcePath, sourceHash) || sourceHash != header.sourceHash) {
+            close();
+            return false;
+        }
+        header.sourceModified = source.modified;
+    }
+
+    // Every array must lie inside the file
+    uint64_t tableEnd = sizeof(Header) + static_cast<uint64_t>(header.meshCount) * sizeof(MeshEntry);
+    if (tableEnd > m_file.size()) {
+        close();
+        return false;
+    }
+
+    m_entries.resize(header.meshCount);
+    if (header.meshCount > 0) {
+        std::memcpy(m_entries.data(), m_file.data() + sizeof(Header), header.meshCount * sizeof(MeshEntry));
+    }
+    for (size_t i = 0; i < m_entries.size(); i++) {
+        const MeshEntry& entry = m_entries[i];
+        if (entry.vertexOffset % kAlignment != 0 || entry.indexOffset % kAlignment != 0 ||
+            entry.vertexOffset + static_cast<uint64_t>(entry.vertexCount) * sizeof(Vertex) > m_file.size() ||
+            entry.indexOffset + static_cast<uint64_t>(entry.indexCount) * sizeof(unsigned int) > m_file.size() ||
+            entry.lods.levelCount < 1 || entry.lods.levelCount > MeshLods::kMaxLevels ||
+            entry.lods.totalIndexCount() != entry.indexCount) {
+            std::cerr << "ERROR::MESH_CACHE::CORRUPT: " << cachePath << std::endl;
+            close();
+            return false;
+        }
+    }
+
+    if (touched) {
+        m_file.close();
+        if (!patchStamp(cachePath, header)) {
+            std::cerr << "WARNING::MESH_CACHE::STAMP_NOT_UPDATED: " << cachePath << std::endl;
+        }
+        if (!m_file.open(cachePath)) {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void MeshCache::close() {
+    m_file.close();
+    m_entries.clear();
+}
+
+const Vertex* MeshCache::vertices(int mesh) const {
+    return reinterpret_cast<const Vertex*>(m_file.data() + m_entries[mesh].vertexOffset);
+}
+
+const unsigned int* MeshCache::indices(int mesh) const {
+    return reinterpret_cast<const unsigned int*>(m_file.data() + m_entries[mesh].indexOffset);
+}
+
+bool MeshCache::write(const std::string& cachePath, const std::string& sourcePath, const std::vector<MeshArrays>& meshes) {
+    Header header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.vertexSize = sizeof(Vertex);
+    header.meshCount = static_cast<uint32_t>(meshes.size());
+    FileStamp source;
+    if (!FileStamp::read(sourcePath, source) || !hashFile(sourcePath, header.sourceHash)) {
+        return false;
+    }
+    header.sourceSize = source.size;
+    header.sourceModified = source.modified;
+
+    // Lay the arrays out after the mesh table
+    std::vector<MeshEntry> entries(meshes.size());
+    uint64_t offset = sizeof(Header) + meshes.size() * sizeof(MeshEntry);
+    for (size_t i = 0; i < meshes.size(); i++) {
+        entries[i].vertexCount = static_cast<uint32_t>(meshes[i].vertexCount);
+        entries[i].indexCount = static_cast<uint32_t>(meshes[i].indexCount);
+        entries[i].lods = meshes[i].lods;
+        entries[i].vertexOffset = alignOffset(offset);
+        offset = entries[i].vertexOffset + meshes[i].vertexCount * sizeof(Vertex);
+        entries[i].indexOffset = alignOffset(offset);
+        offset = entries[i].indexOffset + meshes[i].indexCount * sizeof(unsigned int);
+    }
+
+    // Write to a temporary file first so an interrupted write never leaves a valid-looking cache
+    std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream file(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!file) {
+            return false;
+        }
+
+        static const char padding[kAlignment] = {};
+        uint64_t written = 0;
+        auto writeAt = [&](uint64_t at, const void* data, uint64_t size) {
+            file.write(padding, static_cast<std::streamsize>(at - written));
+            file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+            written = at + size;
+        };
+
+        writeAt(0, &header, sizeof(Header));
+        writeAt(written, entries.data(), entries.size() * sizeof(MeshEntry));
+        for (size_t i = 0; i < meshes.size(); i++) {
+            writeAt(entries[i].vertexOffset, meshes[i].vertices, meshes[i].vertexCount * sizeof(Vertex));
+            writeAt(entries[i].indexOffset, meshes[i].indices, meshes[i].indexCount * sizeof(unsigned int));
+        }
+
+        if (!file) {
+            file.close();
+            std::remove(tempPath.c_str());
+            return false;
+        }
+    }
+
+    std::remove(cachePath.c_str());
+    return std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
+}
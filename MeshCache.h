@@ -0,0 +1,74 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Mesh.h"
+#include "MappedFile.h"
+
+// Vertex and index arrays of one mesh, owned elsewhere. indices holds
+// indexCount = lods.totalIndexCount() entries, every level of the chain.
+struct MeshArrays {
+    const Vertex* vertices;
+    size_t vertexCount;
+    const unsigned int* indices;
+    size_t indexCount;
+    MeshLods lods;
+};
+
+// Binary copy of an imported model, stored next to the source asset so
+// later launches skip the importer. The file is memory mapped and its
+// vertex and index arrays are handed to the GL as they are.
+//
+// Layout: Header, then Header::meshCount MeshEntry records, then the
+// vertex and index arrays of every mesh at the offsets the entries give
+// (16-byte aligned). The cache is stale when the source's size and
+// modification time no longer match, unless its content hash still does.
+class MeshCache {
+public:
+    static const uint32_t kVersion = 2;
+
+    // Map the cache for sourcePath; false if it is missing, stale or unreadable
+    bool open(const std::string& cachePath, const std::string& sourcePath);
+
+    // Unmap the cache
+    void close();
+
+    int meshCount() const { return static_cast<int>(m_entries.size()); }
+    const Vertex* vertices(int mesh) const;
+    size_t vertexCount(int mesh) const { return m_entries[mesh].vertexCount; }
+    const unsigned int* indices(int mesh) const;
+    size_t indexCount(int mesh) const { return m_entries[mesh].indexCount; }
+    const MeshLods& lods(int mesh) const { return m_entries[mesh].lods; }
+
+    // Write the arrays of every mesh as the cache of sourcePath
+    static bool write(const std::string& cachePath, const std::string& sourcePath, const std::vector<MeshArrays>& meshes);
+
+private:
+    struct Header {
+        char magic[4];            // "F1MC"
+        uint32_t version;         // kVersion
+        uint32_t vertexSize;      // sizeof(Vertex) when written
+        uint32_t meshCount;
+        uint64_t sourceSize;      // Stamp of the source asset
+        int64_t sourceModified;   // FileStamp::modified
+        uint64_t sourceHash;      // FNV-1a of the source bytes
+    };
+
+    struct MeshEntry {
+        uint64_t vertexOffset;    // Byte offsets from the start of the file
+        uint64_t indexOffset;
+        uint32_t vertexCount;
+        uint32_t indexCount;      // All levels of lods
+        MeshLods lods;
+        uint32_t reserved;
+    };
+
+    MappedFile m_file;
+    std::vector<MeshEntry> m_entries;
+
+    static bool patchStamp(const std::string& cachePath, const Header& header);
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "MeshLod.h"
+#include "Mesh.h"
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+
+// Cells along the longest side for levels 1 and up
+const uint32_t kGridResolutions[MeshLods::kMaxLevels - 1] = { 48, 16, 6 };
+
+// Keep a level only if it has at most this fraction of the previous level's indices
+const float kMinReduction = 0.75f;
+
+}
+
+MeshLods MeshLods::single(size_t indexCount) {
+    MeshLods lods = {};
+    lods.levelCount = 1;
+    lods.indexCount[0] = static_cast<uint32_t>(indexCount);
+    return lods;
+}
+
+uint32_t MeshLods::firstIndex(int level) const {
+    uint32_t first = 0;
+    for (int i = 0; i < level; i++) {
+        first += indexCount[i];
+    }
+    return first;
+}
+
+int MeshLods::selectLevel(float projectedSize) const {
+    for (int level = static_cast<int>(levelCount) - 1; level > 0; level--) {
+        if (projectedSize <= kLodPixelError * gridResolution[level]) {
+            return level;
+        }
+    }
+    return 0;
+}
+
+MeshLods buildMeshLods(const Vertex* vertices, size_t vertexCount, std::vector<unsigned int>& indices) {
+    MeshLods lods = MeshLods::single(indices.size());
+    if (vertexCount == 0 || indices.empty()) {
+        return lods;
+    }
+
+    glm::vec3 boundsMin = vertices[0].Position;
+    glm::vec3 boundsMax = vertices[0].Position;
+    for (size_t i = 1; i < vertexCount; i++) {
+        boundsMin = glm::min(boundsMin, vertices[i].Position);
+        boundsMax = glm::max(boundsMax, vertices[i].Position);
+    }
+    glm::vec3 extent = boundsMax - boundsMin;
+    float longestSide = std::max(extent.x, std::max(extent.y, extent.z));
+    if (longestSide <= 0.0f) {
+        return lods;
+    }
+
+    const size_t fullCount = indices.size();
+    std::vector<unsigned int> representative(vertexCount);
+    std::unordered_map<uint32_t, unsigned int> cells;
+    cells.reserve(vertexCount);
+
+    for (int r = 0; r < MeshLods::kMaxLevels - 1; r++) {
+        uint32_t resolution = kGridResolutions[r];
+        float inverseCell = resolution / longestSide;
+
+        // The first vertex to land in a cell stands in for the whole cell
+        cells.clear();
+        for (size_t i = 0; i < vertexCount; i++) {
+            glm::vec3 cell = (vertices[i].Position - boundsMin) * inverseCell;
+            uint32_t x = std::min(static_cast<uint32_t>(cell.x), resolution);
+            uint32_t y = std::min(static_cast<uint32_t>(cell.y), resolution);
+            uint32_t z = std::min(static_cast<uint32_t>(cell.z), resolution);
+            uint32_t key = x + (resolution + 1) * (y + (resolution + 1) * z);
+            representative[i] = cells.emplace(key, static_cast<unsigned int>(i)).first->second;
+        }
+
+        // Remap the full mesh and drop the triangles that collapsed
+        size_t levelStart = indices.size();
+        for (size_t i = 0; i + 2 < fullCount; i += 3) {
+            unsigned int a = representative[indices[i]];
+            unsigned int b = representative[indices[i + 1]];
+            unsigned int c = representative[indices[i + 2]];
+            if (a != b && b != c && a != c) {
+                indices.push_back(a);
+                indices.push_back(b);
+                indices.push_back(c);
+            }
+        }
+
+        size_t levelIndexCount = indices.size() - levelStart;
+        if (levelIndexCount > kMinReduction * lods.indexCount[lods.levelCount - 1]) {
+            indices.resize(levelStart);
+            continue;
+        }
+        lods.indexCount[lods.levelCount] = static_cast<uint32_t>(levelIndexCount);
+        lods.gridResolution[lods.levelCount] = resolution;
+        lods.levelCount++;
+
+        // Nothing is left to simplify once a level collapses completely
+        if (levelIndexCount == 0) {
+            break;
+        }
+    }
+    return lods;
+}
@@ -0,0 +1,43 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Vertex;
+
+// Level-of-detail chain of one mesh. Every level indexes the mesh's own
+// vertices; the index lists are stored back to back in the mesh's index
+// array, level 0 (the full mesh) first. Coarser levels come from vertex
+// clustering on a grid of gridResolution cells along the longest side of
+// the mesh's bounding box.
+struct MeshLods {
+    static const int kMaxLevels = 4;
+
+    uint32_t levelCount;
+    uint32_t indexCount[kMaxLevels];
+    uint32_t gridResolution[kMaxLevels];   // 0 for level 0
+
+    // Just the full mesh
+    static MeshLods single(size_t indexCount);
+
+    uint32_t firstIndex(int level) const;
+
+    // Total length of the index array
+    uint32_t totalIndexCount() const { return firstIndex(levelCount); }
+
+    // Coarsest level whose grid cells stay below kLodPixelError pixels when
+    // the mesh's bounding box spans projectedSize pixels on screen
+    int selectLevel(float projectedSize) const;
+};
+
+// Largest on-screen size, in pixels, of the detail a level may drop
+static const float kLodPixelError = 2.0f;
+
+// Append the coarser levels of a mesh to its index list, which must hold
+// the full mesh; returns the resulting chain. Levels that remove less than
+// a quarter of the previous level's triangles are not kept.
+MeshLods buildMeshLods(const Vertex* vertices, size_t vertexCount, std::vector<unsigned int>& indices);
+
+#endif
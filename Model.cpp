@@ -1,17 +1,159 @@
 #include "Model.h"
+#include "MeshCache.h"
+#include "JobSystem.h"
+#include "FrameProfiler.h"
+#include <algorithm>
+#include <climits>
 #include <iostream>
+#include <utility>
+
+Model::Model(const std::string& path, bool keepCpuData, ModelLoading loading, ModelGeometry geometry)
+    : keepCpuData(keepCpuData), loaded(false), geometry(geometry),
+      totalMeshes(-1), loaderDone(false), cancelLoad(false) {
+    if (loading == ModelLoading::Background) {
+        loader = std::thread(&Model::loadModel, this, path);
+        return;
+    }
 
-Model::Model(const std::string& path) {
     loadModel(path);
+    uploadPending(INT_MAX);
+}
+
+Model::~Model() {
+    cancelLoad = true;
+    if (loader.joinable()) {
+        loader.join();
+    }
+    merged.destroy();
 }
 
 void Model::Draw(Shader& shader) {
+    ProfileScope scope("Model::Draw");
+    if (merged.isBuilt()) {
+        shader.setVec3("positionOffset", merged.positionOffset());
+        shader.setVec3("positionScale", merged.positionScale());
+        merged.draw();
+        return;
+    }
+
+    // Per-mesh buffers hold plain float positions
+    shader.setVec3("positionOffset", glm::vec3(0.0f));
+    shader.setVec3("positionScale", glm::vec3(1.0f));
     for (unsigned int i = 0; i < meshes.size(); i++) {
         meshes[i].Draw(shader);
     }
 }
 
+void Model::Draw(Shader& shader, const ViewFrustum& frustum) {
+    ProfileScope scope("Model::Draw");
+    if (merged.isBuilt()) {
+        shader.setVec3("positionOffset", merged.positionOffset());
+        shader.setVec3("positionScale", merged.positionScale());
+        merged.draw(frustum);
+        return;
+    }
+
+    shader.setVec3("positionOffset", glm::vec3(0.0f));
+    shader.setVec3("positionScale", glm::vec3(1.0f));
+    for (unsigned int i = 0; i < meshes.size(); i++) {
+        if (frustum.isVisible(meshes[i].bounds)) {
+            meshes[i].Draw(shader, meshes[i].lods.selectLevel(frustum.projectedSize(meshes[i].bounds)));
+        }
+    }
+}
+
+float Model::loadProgress() const {
+    if (loaded) {
+        return 1.0f;
+    }
+    int total = totalMeshes;
+    return (total > 0) ? static_cast<float>(meshes.size()) / total : 0.0f;
+}
+
+void Model::queueReady(int slot) {
+    std::lock_guard<std::mutex> lock(readyMutex);
+    readyMeshes.push_back(slot);
+}
+
+bool Model::uploadPending(int maxMeshes) {
+    if (loaded) {
+        return true;
+    }
+
+    std::vector<int> batch;
+    {
+        std::lock_guard<std::mutex> lock(readyMutex);
+        int count = std::min(maxMeshes, static_cast<int>(readyMeshes.size()));
+        batch.assign(readyMeshes.begin(), readyMeshes.begin() + count);
+        readyMeshes.erase(readyMeshes.begin(), readyMeshes.begin() + count);
+    }
+
+    // The GL copies the arrays; the CPU side is only handed over once the loader is done with it
+    for (size_t i = 0; i < batch.size(); i++) {
+        const PendingMesh& mesh = pending[batch[i]];
+        meshes.emplace_back(mesh.vertexData, mesh.vertexCount, mesh.indexData, mesh.lods);
+        meshSource.push_back(batch[i]);
+    }
+
+    if (loaderDone && static_cast<int>(meshes.size()) == totalMeshes) {
+        finishLoading();
+    }
+    return loaded;
+}
+
+void Model::finishLoading() {
+    if (loader.joinable()) {
+        loader.join();
+    }
+
+    // Pack everything while the loader's arrays are still around, then drop the per-mesh buffers
+    if (geometry == ModelGeometry::Merged) {
+        std::vector<MeshArrays> arrays(meshSource.size());
+        for (size_t i = 0; i < meshSource.size(); i++) {
+            const PendingMesh& source = pending[meshSource[i]];
+            arrays[i].vertices = source.vertexData;
+            arrays[i].vertexCount = source.vertexCount;
+            arrays[i].indices = source.indexData;
+            arrays[i].indexCount = source.indexCount;
+            arrays[i].lods = source.lods;
+        }
+        if (merged.build(arrays)) {
+            for (size_t i = 0; i < meshes.size(); i++) {
+                meshes[i].releaseGpuData();
+            }
+        }
+    }
+
+    if (keepCpuData) {
+        for (size_t i = 0; i < meshes.size(); i++) {
+            PendingMesh& source = pending[meshSource[i]];
+            if (source.vertices.empty() && source.vertexCount > 0) {
+                // Came from the cache mapping
+                meshes[i].vertices.assign(source.vertexData, source.vertexData + source.vertexCount);
+                meshes[i].indices.assign(source.indexData, source.indexData + source.indexCount);
+            }
+            else {
+                meshes[i].vertices = std::move(source.vertices);
+                meshes[i].indices = std::move(source.indices);
+            }
+        }
+    }
+
+    std::vector<PendingMesh>().swap(pending);
+    std::vector<int>().swap(meshSource);
+    cache.reset();
+    loaded = true;
+}
+
 void Model::loadModel(const std::string& path) {
+    directory = path.substr(0, path.find_last_of('/'));
+
+    std::string cachePath = path + ".meshcache";
+    if (loadCachedModel(cachePath, path)) {
+        loaderDone = true;
+        return;
+    }
+
     Assimp::Importer importer;
     const aiScene* scene = importer.ReadFile(path,
         aiProcess_Triangulate |
@@ -20,33 +162,96 @@ void Model::loadModel(const std::string& path) {
 
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
         std::cerr << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
+        totalMeshes = 0;
+        loaderDone = true;
         return;
     }
 
-    directory = path.substr(0, path.find_last_of('/'));
+    std::vector<aiMesh*> sceneMeshes;
+    sceneMeshes.reserve(scene->mNumMeshes);
+    collectMeshes(scene->mRootNode, scene, sceneMeshes);
+
+    pending.resize(sceneMeshes.size());
+    totalMeshes = static_cast<int>(sceneMeshes.size());
 
-    processNode(scene->mRootNode, scene);
+    // One task per mesh; each is queued for upload as soon as it is done
+    {
+        JobSystem jobs;
+        jobs.parallelFor(static_cast<int>(sceneMeshes.size()), 1, [&](int first, int last, int) {
+            for (int i = first; i < last && !cancelLoad; i++) {
+                processMesh(sceneMeshes[i], pending[i]);
+                queueReady(i);
+            }
+        });
+    }
+
+    // The meshes own everything now; drop the importer's copy before writing the cache
+    importer.FreeScene();
+    if (cancelLoad) {
+        return;
+    }
+
+    // Import once; later launches map the cache instead
+    std::vector<MeshArrays> arrays(pending.size());
+    for (size_t i = 0; i < pending.size(); i++) {
+        arrays[i].vertices = pending[i].vertexData;
+        arrays[i].vertexCount = pending[i].vertexCount;
+        arrays[i].indices = pending[i].indexData;
+        arrays[i].indexCount = pending[i].indexCount;
+        arrays[i].lods = pending[i].lods;
+    }
+    if (!MeshCache::write(cachePath, path, arrays)) {
+        std::cerr << "WARNING::MODEL::MESH_CACHE_NOT_WRITTEN: " << cachePath << std::endl;
+    }
+    loaderDone = true;
+}
+
+bool Model::loadCachedModel(const std::string& cachePath, const std::string& path) {
+    std::unique_ptr<MeshCache> meshCache(new MeshCache());
+    if (!meshCache->open(cachePath, path)) {
+        return false;
+    }
+
+    // Uploads read straight from the mapping, which stays open until the model is complete
+    pending.resize(meshCache->meshCount());
+    for (int i = 0; i < meshCache->meshCount(); i++) {
+        pending[i].vertexData = meshCache->vertices(i);
+        pending[i].vertexCount = meshCache->vertexCount(i);
+        pending[i].indexData = meshCache->indices(i);
+        pending[i].indexCount = meshCache->indexCount(i);
+        pending[i].lods = meshCache->lods(i);
+    }
+    cache = std::move(meshCache);
+    totalMeshes = static_cast<int>(pending.size());
+
+    std::lock_guard<std::mutex> lock(readyMutex);
+    for (int i = 0; i < static_cast<int>(pending.size()); i++) {
+        readyMeshes.push_back(i);
+    }
+    return true;
 }
 
-void Model::processNode(aiNode* node, const aiScene* scene) {
+void Model::collectMeshes(aiNode* node, const aiScene* scene, std::vector<aiMesh*>& sceneMeshes) {
     // Process all the node's meshes
     for (unsigned int i = 0; i < node->mNumMeshes; i++) {
-        aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        meshes.push_back(processMesh(mesh, scene));
+        sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
     }
 
     // Then do the same for each child node
     for (unsigned int i = 0; i < node->mNumChildren; i++) {
-        processNode(node->mChildren[i], scene);
+        collectMeshes(node->mChildren[i], scene, sceneMeshes);
     }
 }
 
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene) {
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
+void Model::processMesh(aiMesh* mesh, PendingMesh& result) {
+    // Sized up front and written in place; after aiProcess_Triangulate every face is a triangle
+    std::vector<Vertex>& vertices = result.vertices;
+    std::vector<unsigned int>& indices = result.indices;
+    vertices.resize(mesh->mNumVertices);
+    indices.reserve(static_cast<size_t>(mesh->mNumFaces) * 3);
 
     for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
-        Vertex vertex;
+        Vertex& vertex = vertices[i];
 
         vertex.Position = glm::vec3(
             mesh->mVertices[i].x,
@@ -69,16 +274,20 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene) {
         else {
             vertex.TexCoords = glm::vec2(0.0f, 0.0f);
         }
-
-        vertices.push_back(vertex);
     }
 
     for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-        aiFace face = mesh->mFaces[i];
+        const aiFace& face = mesh->mFaces[i];
         for (unsigned int j = 0; j < face.mNumIndices; j++) {
             indices.push_back(face.mIndices[j]);
         }
     }
 
-    return Mesh(vertices, indices);
+    // Simplified once at import; the chain is stored in the mesh cache with the rest
+    result.lods = buildMeshLods(vertices.data(), vertices.size(), indices);
+
+    result.vertexData = vertices.data();
+    result.vertexCount = vertices.size();
+    result.indexData = indices.data();
+    result.indexCount = indices.size();
 }
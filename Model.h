@@ -6,33 +6,109 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Mesh.h"
+#include "MergedGeometry.h"
 #include "Shader.h"
+#include "ViewFrustum.h"
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <assimp/scene.h>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 
+class MeshCache;
+
+// How the constructor loads the model
+enum class ModelLoading {
+    Blocking,     // Everything is loaded and uploaded before the constructor returns
+    Background    // Import runs on a loader thread; uploadPending() brings meshes in per frame
+};
+
+// How the loaded model is drawn
+enum class ModelGeometry {
+    PerMesh,      // One VAO and draw call per mesh
+    Merged        // Once loaded, all meshes in one compressed buffer and one multi-draw
+};
+
 class Model {
 public:
-    // Constructor
-    Model(const std::string& path);
+    // Constructor. Without keepCpuData the meshes only live in GPU buffers
+    // once loaded, which halves the memory a large model occupies. Merged
+    // geometry still uploads mesh by mesh while loading and is packed at the end.
+    Model(const std::string& path, bool keepCpuData = true, ModelLoading loading = ModelLoading::Blocking,
+        ModelGeometry geometry = ModelGeometry::PerMesh);
+    ~Model();
+
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
 
-    // Draw the model
+    // Draw the model (while loading in the background, the meshes uploaded so far)
     void Draw(Shader& shader);
 
+    // Same, skipping meshes outside the frustum and drawing each at the level
+    // of detail its on-screen size calls for
+    void Draw(Shader& shader, const ViewFrustum& frustum);
+
+    // Upload at most maxMeshes meshes the loader has finished. Must be called
+    // on the thread owning the GL context; returns true once the model is complete.
+    bool uploadPending(int maxMeshes);
+
+    bool isLoaded() const { return loaded; }
+
+    // Fraction of the meshes uploaded so far
+    float loadProgress() const;
+
 private:
+    // Mesh processed by the loader, waiting for its GL upload. The arrays
+    // point into the vectors, or into the mesh cache mapping.
+    struct PendingMesh {
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        const Vertex* vertexData;
+        size_t vertexCount;
+        const unsigned int* indexData;
+        size_t indexCount;
+        MeshLods lods;
+    };
+
     // Model data
     std::vector<Mesh> meshes;
     std::string directory;
+    bool keepCpuData;
+    bool loaded;
+    ModelGeometry geometry;
+    MergedGeometry merged;
+
+    // Loader state. pending is sized once before any mesh is queued; a
+    // slot belongs to the loader until its index is pushed to readyMeshes.
+    std::thread loader;
+    std::vector<PendingMesh> pending;
+    std::unique_ptr<MeshCache> cache;
+    std::vector<int> meshSource;            // Pending slot each entry of meshes came from
+    std::mutex readyMutex;
+    std::vector<int> readyMeshes;           // Processed slots not uploaded yet
+    std::atomic<int> totalMeshes;           // -1 until the loader has counted the meshes
+    std::atomic<bool> loaderDone;
+    std::atomic<bool> cancelLoad;
 
-    // Loads a model with supported ASSIMP extensions
+    // Loads a model with supported ASSIMP extensions; runs on the loader thread when loading in the background
     void loadModel(const std::string& path);
 
+    // Queues the meshes of the binary cache next to the source, if it is current
+    bool loadCachedModel(const std::string& cachePath, const std::string& path);
+
     // Recursive processing
-    void processNode(aiNode* node, const aiScene* scene);
-    Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+    void collectMeshes(aiNode* node, const aiScene* scene, std::vector<aiMesh*>& sceneMeshes);
+    void processMesh(aiMesh* mesh, PendingMesh& result);
+
+    void queueReady(int slot);
+
+    // Hand over CPU data and release loader state once everything is uploaded
+    void finishLoading();
 };
 
 #endif
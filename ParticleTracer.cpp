@@ -0,0 +1,175 @@
+#include "ParticleTracer.h"
+#include "CameraUniforms.h"
+#include "FlowSimulation.h"
+#include "FrameProfiler.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+const float kStreamSpeed = 8.0f;        // m/s at 250 km/h, as fast as the flow lines' emitters
+const float kParticleSize = 3.0f;       // Pixels at 10 m; small enough for a million particles not to swamp fill rate
+
+}
+
+ParticleTracer::ParticleTracer()
+    : m_particleCount(0), m_current(0), m_stepIndex(0), m_wandStart(0.0f), m_wandEnd(0.0f),
+      m_feedback(0), m_advectShader(nullptr), m_renderShader(nullptr) {
+    for (int i = 0; i < kStateBufferCount; i++) {
+        m_stateVAO[i] = 0;
+        m_stateBuffer[i] = 0;
+    }
+}
+
+void ParticleTracer::create(int particleCount) {
+    m_particleCount = particleCount;
+    m_current = 0;
+    m_stepIndex = 0;
+
+    // Emission times spread evenly over one lifetime, so the wand starts a steady stream
+    std::vector<glm::vec4> state(m_particleCount);
+    for (int i = 0; i < m_particleCount; i++) {
+        state[i] = glm::vec4(0.0f, 0.0f, 0.0f, -kLifetime * (i + 1) / m_particleCount);
+    }
+
+    // One VAO per state copy, read as a whole vec4 by the advect shader and as position and age by the render shader
+    GLsizeiptr stateSize = static_cast<GLsizeiptr>(m_particleCount) * sizeof(glm::vec4);
+    glGenBuffers(kStateBufferCount, m_stateBuffer);
+    glGenVertexArrays(kStateBufferCount, m_stateVAO);
+    for (int i = 0; i < kStateBufferCount; i++) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_stateBuffer[i]);
+        glBufferData(GL_ARRAY_BUFFER, stateSize, state.data(), GL_DYNAMIC_COPY);
+
+        glBindVertexArray(m_stateVAO[i]);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    FrameProfiler::instance().addUploadedBytes(static_cast<size_t>(stateSize) * kStateBufferCount);
+
+    glGenTransformFeedbacks(1, &m_feedback);
+
+    const char* varyings[] = { "outState" };
+    m_advectShader = new Shader("particle_advect_vertex.glsl", varyings, 1);
+    m_renderShader = new Shader("particle_vertex.glsl", "particle_fragment.glsl");
+
+    m_advectShader->use();
+    m_advectShader->setInt("flowField", 0);
+    m_advectUniforms.deltaTime = m_advectShader->uniform("deltaTime");
+    m_advectUniforms.lifetime = m_advectShader->uniform("lifetime");
+    m_advectUniforms.streamSpeed = m_advectShader->uniform("streamSpeed");
+    m_advectUniforms.groundScaleZ = m_advectShader->uniform("groundScaleZ");
+    m_advectUniforms.turbulence = m_advectShader->uniform("turbulence");
+    m_advectUniforms.stepIndex = m_advectShader->uniform("stepIndex");
+    m_advectUniforms.wandStart = m_advectShader->uniform("wandStart");
+    m_advectUniforms.wandEnd = m_advectShader->uniform("wandEnd");
+    m_advectUniforms.fieldScale = m_advectShader->uniform("fieldScale");
+    m_advectUniforms.fieldOffset = m_advectShader->uniform("fieldOffset");
+    m_advectUniforms.fieldVelocityScale = m_advectShader->uniform("fieldVelocityScale");
+    m_advectUniforms.boundsMin = m_advectShader->uniform("boundsMin");
+    m_advectUniforms.boundsMax = m_advectShader->uniform("boundsMax");
+
+    m_renderShader->bindUniformBlock("Camera", CameraUniforms::kBindingPoint);
+    m_renderUniforms.model = m_renderShader->uniform("model");
+    m_renderUniforms.particleColor = m_renderShader->uniform("particleColor");
+    m_renderUniforms.particleAlpha = m_renderShader->uniform("particleAlpha");
+    m_renderUniforms.particleLifetime = m_renderShader->uniform("particleLifetime");
+    m_renderUniforms.particleSize = m_renderShader->uniform("particleSize");
+}
+
+void ParticleTracer::destroy() {
+    if (!isCreated()) {
+        return;
+    }
+
+    glDeleteProgram(m_advectShader->ID);
+    glDeleteProgram(m_renderShader->ID);
+    delete m_advectShader;
+    delete m_renderShader;
+    m_advectShader = nullptr;
+    m_renderShader = nullptr;
+
+    m_fieldTexture.destroy();
+    glDeleteVertexArrays(kStateBufferCount, m_stateVAO);
+    glDeleteBuffers(kStateBufferCount, m_stateBuffer);
+    glDeleteTransformFeedbacks(1, &m_feedback);
+}
+
+void ParticleTracer::setWand(const glm::vec3& start, const glm::vec3& end) {
+    m_wandStart = start;
+    m_wandEnd = end;
+}
+
+void ParticleTracer::step(const FlowField& field, float deltaTime, float carSpeed) {
+    if (!isCreated() || field.isEmpty() || deltaTime <= 0.0f) {
+        return;
+    }
+    ProfileScope scope("advectParticles");
+
+    // As in the line kernels, with the per-step turbulence of the fixed
+    // timestep scaled as a random walk to this step's length
+    float carSpeedFactor = carSpeed / 250.0f;
+    float turbulence = 0.01f * (0.5f + carSpeedFactor * 0.5f) *
+        std::sqrt(deltaTime / FlowSimulation::kFixedTimestep);
+    float velocityScale = field.referenceSpeed() > 0.0f ? carSpeed / field.referenceSpeed() : 1.0f;
+
+    m_advectShader->use();
+    m_advectShader->setFloat(m_advectUniforms.deltaTime, deltaTime);
+    m_advectShader->setFloat(m_advectUniforms.lifetime, kLifetime);
+    m_advectShader->setFloat(m_advectUniforms.streamSpeed, kStreamSpeed * carSpeedFactor);
+    m_advectShader->setFloat(m_advectUniforms.groundScaleZ, 1.2f * (1.0f + carSpeedFactor * 0.5f));
+    m_advectShader->setFloat(m_advectUniforms.turbulence, turbulence);
+    m_advectShader->setInt(m_advectUniforms.stepIndex, static_cast<int>(m_stepIndex));
+    m_advectShader->setVec3(m_advectUniforms.wandStart, m_wandStart);
+    m_advectShader->setVec3(m_advectUniforms.wandEnd, m_wandEnd);
+    m_advectShader->setVec3(m_advectUniforms.fieldScale, FlowFieldTexture::coordinateScale(field));
+    m_advectShader->setVec3(m_advectUniforms.fieldOffset, FlowFieldTexture::coordinateOffset(field));
+    m_advectShader->setFloat(m_advectUniforms.fieldVelocityScale, velocityScale);
+    m_advectShader->setVec3(m_advectUniforms.boundsMin, field.boundsMin());
+    m_advectShader->setVec3(m_advectUniforms.boundsMax, field.boundsMax());
+    m_fieldTexture.bind(field, 0);
+
+    int next = 1 - m_current;
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, m_feedback);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_stateBuffer[next]);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindVertexArray(m_stateVAO[m_current]);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, m_particleCount);
+    glEndTransformFeedback();
+    glBindVertexArray(0);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+
+    m_current = next;
+    m_stepIndex++;
+}
+
+void ParticleTracer::draw(float carPosition, const glm::vec3& color, float alpha) {
+    if (!isCreated()) {
+        return;
+    }
+
+    m_renderShader->use();
+    m_renderShader->setMat4(m_renderUniforms.model, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, carPosition)));
+    m_renderShader->setVec3(m_renderUniforms.particleColor, color);
+    m_renderShader->setFloat(m_renderUniforms.particleAlpha, alpha);
+    m_renderShader->setFloat(m_renderUniforms.particleLifetime, kLifetime);
+    m_renderShader->setFloat(m_renderUniforms.particleSize, kParticleSize);
+
+    // Translucent smoke is not sorted, so it tests against the depth buffer without writing it
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    glDepthMask(GL_FALSE);
+    glBindVertexArray(m_stateVAO[m_current]);
+    glDrawArrays(GL_POINTS, 0, m_particleCount);
+    glBindVertexArray(0);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+}
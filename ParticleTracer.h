@@ -0,0 +1,89 @@
+#ifndef PARTICLE_TRACER_H
+#define PARTICLE_TRACER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "FlowField.h"
+#include "FlowFieldTexture.h"
+#include "Shader.h"
+
+// Smoke-wand particles, alongside the flow lines. Each particle is one vec4
+// (position in car coordinates, age) in a pair of ping-ponged vertex buffers:
+// a transform feedback pass advects all of them through the flow field
+// texture, and one point draw renders them as soft discs. The CPU only sets
+// uniforms, so a million particles cost the same CPU time as a thousand.
+//
+// Particles leave a wand, a segment in car coordinates, at a steady rate:
+// every particle is emitted once per lifetime, staggered from the others. A
+// particle that leaves the field early waits, hidden, until its turn comes.
+class ParticleTracer {
+public:
+    static const int kDefaultParticleCount = 1 << 20;
+    static constexpr float kLifetime = 2.5f;          // Seconds from emission to reuse
+
+    ParticleTracer();
+
+    // Allocate particleCount particles, none emitted yet
+    void create(int particleCount = kDefaultParticleCount);
+
+    // Release buffers, textures and programs
+    void destroy();
+
+    bool isCreated() const { return m_advectShader != nullptr; }
+
+    // Segment particles are emitted from, in car coordinates
+    void setWand(const glm::vec3& start, const glm::vec3& end);
+
+    // Advance every particle by deltaTime through the field at carSpeed (km/h)
+    void step(const FlowField& field, float deltaTime, float carSpeed);
+
+    // Draw every emitted particle around the car at carPosition, in one draw call.
+    // The camera comes from the shared Camera uniform block.
+    void draw(float carPosition, const glm::vec3& color, float alpha);
+
+    int particleCount() const { return m_particleCount; }
+
+private:
+    static const int kStateBufferCount = 2;           // Ping-pong copies of the particle state
+
+    int m_particleCount;
+    int m_current;                  // State copy written by the last step
+    unsigned int m_stepIndex;       // Keys the per-step random draws
+    glm::vec3 m_wandStart;
+    glm::vec3 m_wandEnd;
+
+    GLuint m_stateVAO[kStateBufferCount];
+    GLuint m_stateBuffer[kStateBufferCount];    // vec4: position.xyz (car coordinates), age
+    GLuint m_feedback;
+    FlowFieldTexture m_fieldTexture;            // Sampled by the advect shader on unit 0
+
+    Shader* m_advectShader;
+    Shader* m_renderShader;
+
+    // Uniform handles, looked up once in create()
+    struct AdvectUniforms {
+        UniformHandle deltaTime;
+        UniformHandle lifetime;
+        UniformHandle streamSpeed;
+        UniformHandle groundScaleZ;
+        UniformHandle turbulence;
+        UniformHandle stepIndex;
+        UniformHandle wandStart;
+        UniformHandle wandEnd;
+        UniformHandle fieldScale;
+        UniformHandle fieldOffset;
+        UniformHandle fieldVelocityScale;
+        UniformHandle boundsMin;
+        UniformHandle boundsMax;
+    } m_advectUniforms;
+
+    struct RenderUniforms {
+        UniformHandle model;
+        UniformHandle particleColor;
+        UniformHandle particleAlpha;
+        UniformHandle particleLifetime;
+        UniformHandle particleSize;
+    } m_renderUniforms;
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include "ProfilerOverlay.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
+
+namespace {
+
+const float kMargin = 8.0f;
+const float kRowHeight = 16.0f;
+const float kGlyphWidth = 6.0f;
+const float kGlyphHeight = 10.0f;
+const float kGlyphAdvance = 9.0f;
+const float kLabelColumns = 20.0f;         // Characters before the value column
+const float kValueColumns = 8.0f;
+const float kPixelsPerMillisecond = 20.0f;
+const double kFrameBudgetMilliseconds = 1000.0 / 60.0;
+const int kMaxRows = FrameProfiler::kMaxSections + 3;
+
+// Sixteen segments in a unit cell, y down: the top and bottom bars split in
+// half, four outer verticals, the middle bar split in half, two inner
+// verticals and four diagonals through the center. Glyphs name their
+// segments with the letters of `kSegmentNames`, in this order.
+const char kSegmentNames[] = "aAbcdDefgGhijklm";
+const float kSegments[16][4] = {
+    { 0.0f, 0.0f, 0.5f, 0.0f }, { 0.5f, 0.0f, 1.0f, 0.0f },     // a A  top
+    { 1.0f, 0.0f, 1.0f, 0.5f }, { 1.0f, 0.5f, 1.0f, 1.0f },     // b c  right
+    { 0.0f, 1.0f, 0.5f, 1.0f }, { 0.5f, 1.0f, 1.0f, 1.0f },     // d D  bottom
+    { 0.0f, 0.5f, 0.0f, 1.0f }, { 0.0f, 0.0f, 0.0f, 0.5f },     // e f  left
+    { 0.0f, 0.5f, 0.5f, 0.5f }, { 0.5f, 0.5f, 1.0f, 0.5f },     // g G  middle
+    { 0.0f, 0.0f, 0.5f, 0.5f }, { 0.5f, 0.0f, 0.5f, 0.5f },     // h i  upper left diagonal, upper center
+    { 1.0f, 0.0f, 0.5f, 0.5f }, { 0.5f, 0.5f, 1.0f, 1.0f },     // j k  upper right, lower right diagonals
+    { 0.5f, 0.5f, 0.5f, 1.0f }, { 0.5f, 0.5f, 0.0f, 1.0f }      // l m  lower center, lower left diagonal
+};
+
+struct Glyph {
+    char character;
+    const char* segments;
+};
+
+// Upper case only; lower case letters are drawn as upper case
+const Glyph kGlyphs[] = {
+    { '0', "aAbcdDefjm" }, { '1', "bc" }, { '2', "aAbGgedD" }, { '3', "aAbGcdD" },
+    { '4', "fgGbc" }, { '5', "aAfgGcdD" }, { '6', "aAfgGecdD" }, { '7', "aAbc" },
+    { '8', "aAbcdDefgG" }, { '9', "aAbcdDfgG" },
+    { 'A', "aAbcefgG" }, { 'B', "aAbcdDilG" }, { 'C', "aAfedD" }, { 'D', "aAbcdDil" },
+    { 'E', "aAfegdD" }, { 'F', "aAfeg" }, { 'G', "aAfedDcG" }, { 'H', "fegGbc" },
+    { 'I', "aAildD" }, { 'J', "bcdDe" }, { 'K', "fegjk" }, { 'L', "fedD" },
+    { 'M', "febchj" }, { 'N', "febchk" }, { 'O', "aAbcdDef" }, { 'P', "aAbfegG" },
+    { 'Q', "aAbcdDefk" }, { 'R', "aAbfegGk" }, { 'S', "aAfgGcdD" }, { 'T', "aAil" },
+    { 'U', "fedDcb" }, { 'V', "femj" }, { 'W', "febckm" }, { 'X', "hjkm" },
+    { 'Y', "hjl" }, { 'Z', "aAjmdD" },
+    { '-', "gG" }, { '/', "jm" }, { '_', "dD" }
+};
+
+// Bar colors, cycled by row
+const glm::vec4 kRowColors[] = {
+    glm::vec4(0.35f, 0.75f, 1.00f, 1.0f),
+    glm::vec4(1.00f, 0.60f, 0.20f, 1.0f),
+    glm::vec4(0.45f, 0.90f, 0.45f, 1.0f),
+    glm::vec4(1.00f, 0.40f, 0.45f, 1.0f),
+    glm::vec4(0.80f, 0.55f, 1.00f, 1.0f),
+    glm::vec4(1.00f, 0.90f, 0.30f, 1.0f)
+};
+const int kRowColorCount = sizeof(kRowColors) / sizeof(kRowColors[0]);
+
+const glm::vec4 kTextColor(0.95f, 0.95f, 0.95f, 1.0f);
+const glm::vec4 kBackgroundColor(0.0f, 0.0f, 0.0f, 0.6f);
+const glm::vec4 kBudgetColor(1.0f, 1.0f, 1.0f, 0.5f);
+
+}
+
+ProfilerOverlay::ProfilerOverlay()
+    : m_shader(nullptr), m_viewportUniform(-1), m_VAO(0), m_VBO(0) {
+}
+
+void ProfilerOverlay::create() {
+    m_shader = new Shader("overlay_vertex.glsl", "overlay_fragment.glsl");
+    m_viewportUniform = m_shader->uniform("viewport");
+
+    glGenVertexArrays(1, &m_VAO);
+    glGenBuffers(1, &m_VBO);
+    glBindVertexArray(m_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, color));
+    glEnableVertexAttribArray(1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void ProfilerOverlay::destroy() {
+    if (m_VBO) {
+        glDeleteBuffers(1, &m_VBO);
+        m_VBO = 0;
+    }
+    if (m_VAO) {
+        glDeleteVertexArrays(1, &m_VAO);
+        m_VAO = 0;
+    }
+    if (m_shader) {
+        glDeleteProgram(m_shader->ID);
+        delete m_shader;
+        m_shader = nullptr;
+    }
+}
+
+void ProfilerOverlay::draw(int viewportWidth, int viewportHeight) {
+    if (!m_shader || viewportWidth <= 0 || viewportHeight <= 0) {
+        return;
+    }
+
+    FrameProfiler::instance().summary(m_summary);
+    m_triangles.clear();
+    m_lines.clear();
+
+    int rows = std::min(static_cast<int>(m_summary.sections.size()) + 3, kMaxRows);
+    float barLeft = kMargin * 2.0f + (kLabelColumns + kValueColumns) * kGlyphAdvance;
+    float budgetX = barLeft + static_cast<float>(kFrameBudgetMilliseconds) * kPixelsPerMillisecond;
+    float barRight = barLeft + static_cast<float>(kFrameBudgetMilliseconds * 2.0) * kPixelsPerMillisecond;
+    addRect(kMargin, kMargin, barRight - kMargin, rows * kRowHeight + kMargin, kBackgroundColor);
+
+    char value[32];
+    std::snprintf(value, sizeof(value), "%.2f", m_summary.frameMilliseconds);
+    addRow(0, "frame ms", value, m_summary.frameMilliseconds, kTextColor);
+
+    int row = 1;
+    for (size_t i = 0; i < m_summary.sections.size() && row < rows - 2; i++, row++) {
+        const FrameProfiler::Section& section = m_summary.sections[i];
+        char label[48];
+        std::snprintf(label, sizeof(label), "%s%s", section.gpu ? "gpu " : "", section.name);
+        std::snprintf(value, sizeof(value), "%.2f", section.milliseconds);
+        addRow(row, label, value, section.milliseconds, kRowColors[i % kRowColorCount]);
+    }
+
+    std::snprintf(value, sizeof(value), "%.0f", m_summary.allocations);
+    addRow(row++, "allocs/frame", value, -1.0, kTextColor);
+    std::snprintf(value, sizeof(value), "%.1f", m_summary.uploadedBytes / 1024.0);
+    addRow(row++, "upload kb/frame", value, -1.0, kTextColor);
+
+    // Budget marker across the bar rows
+    addLine(glm::vec2(budgetX, kMargin), glm::vec2(budgetX, kMargin + (rows - 2) * kRowHeight), kBudgetColor);
+
+    // Triangles first, then lines, in one buffer. The overlay's own upload is
+    // left out of the upload counter.
+    size_t triangleCount = m_triangles.size();
+    size_t lineCount = m_lines.size();
+    m_triangles.insert(m_triangles.end(), m_lines.begin(), m_lines.end());
+
+    bool depthTest = glIsEnabled(GL_DEPTH_TEST) == GL_TRUE;
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    m_shader->use();
+    m_shader->setVec2(m_viewportUniform, glm::vec2(static_cast<float>(viewportWidth), static_cast<float>(viewportHeight)));
+
+    glBindVertexArray(m_VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+    glBufferData(GL_ARRAY_BUFFER, m_triangles.size() * sizeof(Vertex), m_triangles.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glLineWidth(1.0f);
+    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(triangleCount));
+    glDrawArrays(GL_LINES, static_cast<GLint>(triangleCount), static_cast<GLsizei>(lineCount));
+    glBindVertexArray(0);
+
+    if (depthTest) {
+        glEnable(GL_DEPTH_TEST);
+    }
+}
+
+void ProfilerOverlay::addRow(int row, const char* label, const char* value, double barMilliseconds, const glm::vec4& color) {
+    float y = kMargin * 1.5f + row * kRowHeight;
+    addText(kMargin * 2.0f, y, label, color);
+    addText(kMargin * 2.0f + kLabelColumns * kGlyphAdvance, y, value, kTextColor);
+
+    if (barMilliseconds >= 0.0) {
+        float barLeft = kMargin * 2.0f + (kLabelColumns + kValueColumns) * kGlyphAdvance;
+        float width = static_cast<float>(barMilliseconds) * kPixelsPerMillisecond;
+        // Long bars are cut at twice the budget so the overlay keeps its size
+        width = std::min(width, static_cast<float>(kFrameBudgetMilliseconds * 2.0) * kPixelsPerMillisecond);
+        addRect(barLeft, y, std::max(width, 1.0f), kGlyphHeight, color);
+    }
+}
+
+void ProfilerOverlay::addRect(float x, float y, float width, float height, const glm::vec4& color) {
+    Vertex corners[4] = {
+        { glm::vec2(x, y), color },
+        { glm::vec2(x + width, y), color },
+        { glm::vec2(x + width, y + height), color },
+        { glm::vec2(x, y + height), color }
+    };
+    m_triangles.push_back(corners[0]);
+    m_triangles.push_back(corners[1]);
+    m_triangles.push_back(corners[2]);
+    m_triangles.push_back(corners[0]);
+    m_triangles.push_back(corners[2]);
+    m_triangles.push_back(corners[3]);
+}
+
+void ProfilerOverlay::addLine(const glm::vec2& from, const glm::vec2& to, const glm::vec4& color) {
+    Vertex ends[2] = { { from, color }, { to, color } };
+    m_lines.push_back(ends[0]);
+    m_lines.push_back(ends[1]);
+}
+
+void ProfilerOverlay::addText(float x, float y, const char* text, const glm::vec4& color) {
+    for (const char* c = text; *c; c++, x += kGlyphAdvance) {
+        // Dots and colons are short strokes rather than segments
+        if (*c == '.' || *c == ':') {
+            float dotX = x + kGlyphWidth * 0.5f;
+            addLine(glm::vec2(dotX, y + kGlyphHeight - 1.5f), glm::vec2(dotX, y + kGlyphHeight), color);
+            if (*c == ':') {
+                addLine(glm::vec2(dotX, y + 2.0f), glm::vec2(dotX, y + 3.5f), color);
+            }
+            continue;
+        }
+
+        unsigned int segments = glyphSegments(*c);
+        for (int s = 0; s < 16; s++) {
+            if (segments & (1u << s)) {
+                addLine(glm::vec2(x + kSegments[s][0] * kGlyphWidth, y + kSegments[s][1] * kGlyphHeight),
+                    glm::vec2(x + kSegments[s][2] * kGlyphWidth, y + kSegments[s][3] * kGlyphHeight), color);
+            }
+        }
+    }
+}
+
+unsigned int ProfilerOverlay::glyphSegments(char c) {
+    char upper = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    for (size_t i = 0; i < sizeof(kGlyphs) / sizeof(kGlyphs[0]); i++) {
+        if (kGlyphs[i].character != upper) {
+            continue;
+        }
+        unsigned int mask = 0;
+        for (const char* s = kGlyphs[i].segments; *s; s++) {
+            for (int bit = 0; bit < 16; bit++) {
+                if (kSegmentNames[bit] == *s) {
+                    mask |= 1u << bit;
+                }
+            }
+        }
+        return mask;
+    }
+    return 0;
+}
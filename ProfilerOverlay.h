@@ -0,0 +1,51 @@
+#ifndef PROFILER_OVERLAY_H
+#define PROFILER_OVERLAY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "FrameProfiler.h"
+#include "Shader.h"
+
+// FrameProfiler summary drawn over the top left of the window: one row per
+// scope and GPU pass with its time in milliseconds and a bar against the
+// 60 Hz frame budget, followed by the allocation and upload counters.
+// Text uses a built-in segment font drawn as lines, so no font is needed.
+class ProfilerOverlay {
+public:
+    ProfilerOverlay();
+
+    // Load the overlay program and allocate its buffer
+    void create();
+
+    // Release buffers and program
+    void destroy();
+
+    // Draw the current summary over a viewport of the given size
+    void draw(int viewportWidth, int viewportHeight);
+
+private:
+    struct Vertex {
+        glm::vec2 position;
+        glm::vec4 color;
+    };
+
+    // Append one row: label, value and, when barMilliseconds >= 0, a bar
+    void addRow(int row, const char* label, const char* value, double barMilliseconds, const glm::vec4& color);
+    void addRect(float x, float y, float width, float height, const glm::vec4& color);
+    void addLine(const glm::vec2& from, const glm::vec2& to, const glm::vec4& color);
+    void addText(float x, float y, const char* text, const glm::vec4& color);
+
+    // Segments of a character as a bit mask, see the table in the .cpp
+    static unsigned int glyphSegments(char c);
+
+    Shader* m_shader;
+    UniformHandle m_viewportUniform;
+    GLuint m_VAO;
+    GLuint m_VBO;
+    std::vector<Vertex> m_triangles;   // Rebuilt every draw; capacity is kept
+    std::vector<Vertex> m_lines;
+    FrameProfiler::Summary m_summary;
+};
+
+#endif
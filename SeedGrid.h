@@ -0,0 +1,81 @@
+#ifndef SEED_GRID_H
+#define SEED_GRID_H
+
+#include <glm/glm.hpp>
+#include <cmath>
+#include <vector>
+
+// Uniform spatial hash over placed seed points, answering "is any seed
+// closer than r" by visiting only the cells the query sphere overlaps.
+// Cells are hashed into a fixed power-of-two bucket table, so distinct cells
+// may share a bucket; the distance test filters those out. Storage is kept
+// between reset() calls, so reseeding does not allocate once warmed up.
+class SeedGrid {
+public:
+    SeedGrid() : m_inverseCellSize(1.0f), m_mask(0) {}
+
+    // Drop all points; queries are cheapest with cellSize close to the query radius
+    void reset(float cellSize, int expectedPoints) {
+        m_inverseCellSize = 1.0f / cellSize;
+
+        // About two buckets per point keeps the chains short
+        size_t bucketCount = 1;
+        while (bucketCount < static_cast<size_t>(expectedPoints) * 2) {
+            bucketCount <<= 1;
+        }
+        m_bucketHead.assign(bucketCount, -1);
+        m_mask = static_cast<unsigned int>(bucketCount - 1);
+
+        m_points.clear();
+        m_next.clear();
+    }
+
+    // True when no stored point lies closer than radius to position
+    bool isFree(const glm::vec3& position, float radius) const {
+        int minX = cellCoordinate(position.x - radius);
+        int maxX = cellCoordinate(position.x + radius);
+        int minY = cellCoordinate(position.y - radius);
+        int maxY = cellCoordinate(position.y + radius);
+        int minZ = cellCoordinate(position.z - radius);
+        int maxZ = cellCoordinate(position.z + radius);
+
+        for (int z = minZ; z <= maxZ; z++) {
+            for (int y = minY; y <= maxY; y++) {
+                for (int x = minX; x <= maxX; x++) {
+                    for (int i = m_bucketHead[bucket(x, y, z)]; i >= 0; i = m_next[i]) {
+                        if (glm::length(position - m_points[i]) < radius) {
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    void insert(const glm::vec3& position) {
+        unsigned int b = bucket(cellCoordinate(position.x), cellCoordinate(position.y), cellCoordinate(position.z));
+        m_points.push_back(position);
+        m_next.push_back(m_bucketHead[b]);
+        m_bucketHead[b] = static_cast<int>(m_points.size()) - 1;
+    }
+
+private:
+    int cellCoordinate(float value) const {
+        return static_cast<int>(std::floor(value * m_inverseCellSize));
+    }
+
+    unsigned int bucket(int x, int y, int z) const {
+        return (static_cast<unsigned int>(x) * 73856093u ^
+                static_cast<unsigned int>(y) * 19349663u ^
+                static_cast<unsigned int>(z) * 83492791u) & m_mask;
+    }
+
+    float m_inverseCellSize;
+    unsigned int m_mask;
+    std::vector<int> m_bucketHead;   // First point of each bucket, -1 when empty
+    std::vector<int> m_next;         // Next point in the same bucket
+    std::vector<glm::vec3> m_points;
+};
+
+#endif
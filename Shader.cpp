@@ -1,117 +1,514 @@
 #include "Shader.h"
+#include "FileStamp.h"
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath) {
-    // 1. Read shader files
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 
-    // Ensure ifstream objects can throw exceptions
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+namespace {
 
-    try {
-        // Open files
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
+const char kCacheMagic[4] = { 'F', '1', 'P', 'B' };
+
+// Strings are hashed with their terminator so "ab" + "c" differs from "a" + "bc"
+uint64_t hashString(uint64_t hash, const char* text) {
+    return hashBytes(hash, text, std::strlen(text) + 1);
+}
+
+const char* stageLabel(GLenum type) {
+    switch (type) {
+    case GL_VERTEX_SHADER: return "VERTEX";
+    case GL_GEOMETRY_SHADER: return "GEOMETRY";
+    default: return "FRAGMENT";
+    }
+}
+
+std::vector<Shader*>& shaderRegistry() {
+    static std::vector<Shader*> shaders;
+    return shaders;
+}
 
-        std::stringstream vShaderStream, fShaderStream;
+// Copy the value of one uniform, read with the getter matching its type
+void copyUniform(GLuint from, GLint source, GLint target, GLenum type) {
+    GLfloat floats[16];
+    GLint ints[4];
+    GLuint uints[4];
+    switch (type) {
+    case GL_FLOAT: glGetUniformfv(from, source, floats); glUniform1fv(target, 1, floats); break;
+    case GL_FLOAT_VEC2: glGetUniformfv(from, source, floats); glUniform2fv(target, 1, floats); break;
+    case GL_FLOAT_VEC3: glGetUniformfv(from, source, floats); glUniform3fv(target, 1, floats); break;
+    case GL_FLOAT_VEC4: glGetUniformfv(from, source, floats); glUniform4fv(target, 1, floats); break;
+    case GL_FLOAT_MAT3: glGetUniformfv(from, source, floats); glUniformMatrix3fv(target, 1, GL_FALSE, floats); break;
+    case GL_FLOAT_MAT4: glGetUniformfv(from, source, floats); glUniformMatrix4fv(target, 1, GL_FALSE, floats); break;
+    case GL_UNSIGNED_INT: glGetUniformuiv(from, source, uints); glUniform1uiv(target, 1, uints); break;
+    case GL_INT_VEC2: case GL_BOOL_VEC2: glGetUniformiv(from, source, ints); glUniform2iv(target, 1, ints); break;
+    case GL_INT_VEC3: case GL_BOOL_VEC3: glGetUniformiv(from, source, ints); glUniform3iv(target, 1, ints); break;
+    case GL_INT_VEC4: case GL_BOOL_VEC4: glGetUniformiv(from, source, ints); glUniform4iv(target, 1, ints); break;
+    default:
+        // int, bool and the sampler types, which hold a texture unit
+        glGetUniformiv(from, source, ints);
+        glUniform1iv(target, 1, ints);
+        break;
+    }
+}
+
+}
 
-        // Read file's buffer contents into streams
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
+std::string Shader::readShaderFile(const char* path) {
+    std::ifstream shaderFile;
+
+    // Ensure ifstream objects can throw exceptions
+    shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+
+    try {
+        shaderFile.open(path);
 
-        // Close file handlers
-        vShaderFile.close();
-        fShaderFile.close();
+        std::stringstream shaderStream;
+        shaderStream << shaderFile.rdbuf();
+        shaderFile.close();
 
-        // Convert stream into string
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+        return shaderStream.str();
     }
     catch (const std::ifstream::failure& e) {
         std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-        std::cerr << "Vertex shader path: " << vertexPath << std::endl;
-        std::cerr << "Fragment shader path: " << fragmentPath << std::endl;
+        std::cerr << "Shader path: " << path << std::endl;
     }
+    return std::string();
+}
 
-    const char* vShaderCode = vertexCode.c_str();
-    const char* fShaderCode = fragmentCode.c_str();
-
-    // 2. Compile shaders
-    unsigned int vertex, fragment;
+unsigned int Shader::compileShader(GLenum type, const char* source, const char* label) {
     int success;
     char infoLog[512];
 
-    // Vertex shader
-    vertex = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertex, 1, &vShaderCode, NULL);
-    glCompileShader(vertex);
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
 
     // Print compile errors if any
-    glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
     if (!success) {
-        glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-        std::cerr << "Vertex shader source:\n" << vShaderCode << std::endl;
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        std::cerr << "ERROR::SHADER::" << label << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+        std::cerr << "Shader source:\n" << source << std::endl;
     }
+    return shader;
+}
 
-    // Fragment shader
-    fragment = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragment, 1, &fShaderCode, NULL);
-    glCompileShader(fragment);
-
-    // Print compile errors if any
-    glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-        std::cerr << "Fragment shader source:\n" << fShaderCode << std::endl;
-    }
+bool Shader::linkProgram(unsigned int program) {
+    int success;
+    char infoLog[512];
 
-    // Shader program
-    ID = glCreateProgram();
-    glAttachShader(ID, vertex);
-    glAttachShader(ID, fragment);
-    glLinkProgram(ID);
+    glLinkProgram(program);
 
     // Print linking errors if any
-    glGetProgramiv(ID, GL_LINK_STATUS, &success);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success) {
-        glGetProgramInfoLog(ID, 512, NULL, infoLog);
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
         std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
     }
+    return success != 0;
+}
+
+bool Shader::programBinarySupported() {
+    bool available = false;
+#if defined(GL_VERSION_4_1)
+    if (GLAD_GL_VERSION_4_1) {
+        available = true;
+    }
+#endif
+#if defined(GL_ARB_get_program_binary)
+    if (GLAD_GL_ARB_get_program_binary) {
+        available = true;
+    }
+#endif
+    if (!available) {
+        return false;
+    }
 
-    // Delete the shaders as they're linked into our program now and no longer necessary
-    glDeleteShader(vertex);
-    glDeleteShader(fragment);
+    // Some drivers expose the entry points without any format to store
+    GLint formatCount = 0;
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+#endif
+    return formatCount > 0;
+}
+
+uint64_t Shader::programKey(const std::vector<std::string>& sources) const {
+    uint64_t hash = kFnvOffsetBasis;
+
+    // A driver update invalidates every binary
+    const GLenum driverStrings[3] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+    for (int i = 0; i < 3; i++) {
+        const GLubyte* text = glGetString(driverStrings[i]);
+        hash = hashString(hash, text ? reinterpret_cast<const char*>(text) : "");
+    }
+
+    for (size_t i = 0; i < m_stages.size(); i++) {
+        hash = hashBytes(hash, &m_stages[i].type, sizeof(GLenum));
+        hash = hashString(hash, sources[i].c_str());
+    }
+    for (size_t i = 0; i < m_feedbackVaryings.size(); i++) {
+        hash = hashString(hash, m_feedbackVaryings[i].c_str());
+    }
+    return hash;
+}
+
+bool Shader::loadProgramBinary(unsigned int program, uint64_t key) const {
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+    std::ifstream file(cachePath().c_str(), std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    CacheHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(CacheHeader)) ||
+        std::memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+        header.version != kCacheVersion || header.key != key || header.binaryLength == 0) {
+        return false;
+    }
+
+    std::vector<char> binary(header.binaryLength);
+    if (!file.read(binary.data(), binary.size())) {
+        return false;
+    }
+
+    // The driver may still reject a binary it wrote, e.g. after a settings change
+    glProgramBinary(program, header.binaryFormat, binary.data(), static_cast<GLsizei>(binary.size()));
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    return success != 0;
+#else
+    (void)program;
+    (void)key;
+    return false;
+#endif
+}
+
+void Shader::saveProgramBinary(unsigned int program, uint64_t key) const {
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    std::vector<char> binary(length);
+    GLsizei written = 0;
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0) {
+        return;
+    }
+
+    CacheHeader header;
+    std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+    header.version = kCacheVersion;
+    header.key = key;
+    header.binaryFormat = format;
+    header.binaryLength = static_cast<uint32_t>(written);
+
+    // Written aside and renamed over the old cache, so a crash never leaves half a binary
+    std::string path = cachePath();
+    std::string tempPath = path + ".tmp";
+    bool ok;
+    {
+        std::ofstream file(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+        file.write(binary.data(), written);
+        ok = static_cast<bool>(file);
+    }
+    if (ok) {
+        std::remove(path.c_str());
+        ok = std::rename(tempPath.c_str(), path.c_str()) == 0;
+    }
+    if (!ok) {
+        std::remove(tempPath.c_str());
+        std::cerr << "WARNING::SHADER::PROGRAM_CACHE_NOT_WRITTEN: " << path << std::endl;
+    }
+#else
+    (void)program;
+    (void)key;
+#endif
+}
+
+unsigned int Shader::buildProgram(bool& linked) const {
+    std::vector<std::string> sources;
+    for (size_t i = 0; i < m_stages.size(); i++) {
+        sources.push_back(readShaderFile(m_stages[i].path.c_str()));
+    }
+
+    bool useCache = programBinarySupported();
+    uint64_t key = useCache ? programKey(sources) : 0;
+
+    unsigned int program = glCreateProgram();
+    if (useCache && loadProgramBinary(program, key)) {
+        linked = true;
+        return program;
+    }
+    if (useCache) {
+        // Start over from a fresh program rather than one a rejected binary left behind
+        glDeleteProgram(program);
+        program = glCreateProgram();
+    }
+
+    std::vector<unsigned int> shaders;
+    for (size_t i = 0; i < m_stages.size(); i++) {
+        shaders.push_back(compileShader(m_stages[i].type, sources[i].c_str(), stageLabel(m_stages[i].type)));
+        glAttachShader(program, shaders.back());
+    }
+
+    // Varyings must be declared before linking
+    if (!m_feedbackVaryings.empty()) {
+        std::vector<const char*> varyings;
+        for (size_t i = 0; i < m_feedbackVaryings.size(); i++) {
+            varyings.push_back(m_feedbackVaryings[i].c_str());
+        }
+        glTransformFeedbackVaryings(program, static_cast<GLsizei>(varyings.size()), varyings.data(), GL_SEPARATE_ATTRIBS);
+    }
+
+#if defined(GL_VERSION_4_1) || defined(GL_ARB_get_program_binary)
+    if (useCache) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+#endif
+    linked = linkProgram(program);
+
+    // Delete the shaders as they're linked into the program now and no longer necessary
+    for (size_t i = 0; i < shaders.size(); i++) {
+        glDeleteShader(shaders[i]);
+    }
+
+    if (linked && useCache) {
+        saveProgramBinary(program, key);
+    }
+    return program;
+}
+
+void Shader::create(const std::vector<Stage>& stages) {
+    m_stages = stages;
+
+    bool linked = false;
+    ID = buildProgram(linked);
+    cacheUniformLocations();
+
+    shaderRegistry().push_back(this);
+}
+
+bool Shader::reload() {
+    bool linked = false;
+    unsigned int program = buildProgram(linked);
+    if (!linked) {
+        glDeleteProgram(program);
+        return false;
+    }
+
+    copyProgramState(ID, program);
+    glDeleteProgram(ID);
+    ID = program;
+    cacheUniformLocations();
+    return true;
+}
+
+void Shader::copyProgramState(unsigned int from, unsigned int to) {
+    // glUniform writes to the bound program; a caller that had the old one
+    // bound gets the new one instead
+    GLint previous = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previous);
+    glUseProgram(to);
+
+    GLint uniformCount = 0;
+    GLint maxNameLength = 0;
+    glGetProgramiv(from, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(from, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    std::vector<GLchar> nameBuffer(std::max(maxNameLength, 1));
+    for (GLint i = 0; i < uniformCount; i++) {
+        GLsizei nameLength = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(from, static_cast<GLuint>(i), static_cast<GLsizei>(nameBuffer.size()), &nameLength, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data(), nameLength);
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+            name.erase(name.size() - 3);
+        }
+
+        // Arrays are copied element by element
+        for (GLint element = 0; element < size; element++) {
+            std::string elementName = (size > 1) ? name + "[" + std::to_string(element) + "]" : name;
+            GLint source = glGetUniformLocation(from, elementName.c_str());
+            GLint target = glGetUniformLocation(to, elementName.c_str());
+            if (source >= 0 && target >= 0) {
+                copyUniform(from, source, target, type);
+            }
+        }
+    }
+    glUseProgram(static_cast<GLuint>(previous) == from ? to : static_cast<GLuint>(previous));
+
+    GLint blockCount = 0;
+    GLint maxBlockNameLength = 0;
+    glGetProgramiv(from, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+    glGetProgramiv(from, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxBlockNameLength);
+
+    std::vector<GLchar> blockName(std::max(maxBlockNameLength, 1));
+    for (GLint block = 0; block < blockCount; block++) {
+        GLint binding = 0;
+        glGetActiveUniformBlockName(from, static_cast<GLuint>(block), static_cast<GLsizei>(blockName.size()), NULL, blockName.data());
+        glGetActiveUniformBlockiv(from, static_cast<GLuint>(block), GL_UNIFORM_BLOCK_BINDING, &binding);
+
+        GLuint blockIndex = glGetUniformBlockIndex(to, blockName.data());
+        if (blockIndex != GL_INVALID_INDEX) {
+            glUniformBlockBinding(to, blockIndex, static_cast<GLuint>(binding));
+        }
+    }
+}
+
+std::vector<std::string> Shader::files() const {
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < m_stages.size(); i++) {
+        paths.push_back(m_stages[i].path);
+    }
+    return paths;
+}
+
+const std::vector<Shader*>& Shader::liveShaders() {
+    return shaderRegistry();
+}
+
+Shader::~Shader() {
+    std::vector<Shader*>& shaders = shaderRegistry();
+    shaders.erase(std::remove(shaders.begin(), shaders.end(), this), shaders.end());
+}
+
+void Shader::cacheUniformLocations() {
+    m_uniformLocations.clear();
+
+    GLint uniformCount = 0;
+    GLint maxNameLength = 0;
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    std::vector<GLchar> nameBuffer(std::max(maxNameLength, 1));
+    for (GLint i = 0; i < uniformCount; i++) {
+        GLsizei nameLength = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(ID, static_cast<GLuint>(i), static_cast<GLsizei>(nameBuffer.size()), &nameLength, &size, &type, nameBuffer.data());
+        std::string name(nameBuffer.data(), nameLength);
+
+        // Uniforms inside blocks have no location
+        GLint uniformLocation = glGetUniformLocation(ID, name.c_str());
+        if (uniformLocation < 0) {
+            continue;
+        }
+        m_uniformLocations[name] = uniformLocation;
+
+        // Arrays are reported as "name[0]"; make the plain name work too
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+            m_uniformLocations[name.substr(0, name.size() - 3)] = uniformLocation;
+        }
+    }
+
+    for (size_t handle = 0; handle < m_handleNames.size(); handle++) {
+        m_handleLocations[handle] = location(m_handleNames[handle]);
+    }
+}
+
+GLint Shader::location(const std::string& name) const {
+    std::unordered_map<std::string, GLint>::const_iterator it = m_uniformLocations.find(name);
+    return (it != m_uniformLocations.end()) ? it->second : -1;
+}
+
+UniformHandle Shader::uniform(const char* name) {
+    for (size_t handle = 0; handle < m_handleNames.size(); handle++) {
+        if (m_handleNames[handle] == name) {
+            return static_cast<UniformHandle>(handle);
+        }
+    }
+
+    m_handleNames.push_back(name);
+    m_handleLocations.push_back(location(m_handleNames.back()));
+    return static_cast<UniformHandle>(m_handleNames.size() - 1);
+}
+
+void Shader::bindUniformBlock(const char* blockName, GLuint bindingPoint) {
+    GLuint blockIndex = glGetUniformBlockIndex(ID, blockName);
+    if (blockIndex == GL_INVALID_INDEX) {
+        std::cerr << "ERROR::SHADER::UNIFORM_BLOCK_NOT_FOUND: " << blockName << std::endl;
+        return;
+    }
+    glUniformBlockBinding(ID, blockIndex, bindingPoint);
+}
+
+Shader::Shader(const char* vertexPath, const char* fragmentPath) {
+    std::vector<Stage> stages;
+    stages.push_back({ GL_VERTEX_SHADER, vertexPath });
+    stages.push_back({ GL_FRAGMENT_SHADER, fragmentPath });
+    create(stages);
+}
+
+Shader::Shader(const char* vertexPath, const char* geometryPath, const char* fragmentPath) {
+    std::vector<Stage> stages;
+    stages.push_back({ GL_VERTEX_SHADER, vertexPath });
+    stages.push_back({ GL_GEOMETRY_SHADER, geometryPath });
+    stages.push_back({ GL_FRAGMENT_SHADER, fragmentPath });
+    create(stages);
+}
+
+Shader::Shader(const char* vertexPath, const char* const* feedbackVaryings, int varyingCount) {
+    m_feedbackVaryings.assign(feedbackVaryings, feedbackVaryings + varyingCount);
+
+    std::vector<Stage> stages;
+    stages.push_back({ GL_VERTEX_SHADER, vertexPath });
+    create(stages);
 }
 
 void Shader::use() {
     glUseProgram(ID);
 }
 
+void Shader::setBool(UniformHandle handle, bool value) const {
+    glUniform1i(m_handleLocations[handle], (int)value);
+}
+
+void Shader::setInt(UniformHandle handle, int value) const {
+    glUniform1i(m_handleLocations[handle], value);
+}
+
+void Shader::setFloat(UniformHandle handle, float value) const {
+    glUniform1f(m_handleLocations[handle], value);
+}
+
+void Shader::setVec2(UniformHandle handle, const glm::vec2& value) const {
+    glUniform2fv(m_handleLocations[handle], 1, &value[0]);
+}
+
+void Shader::setVec3(UniformHandle handle, const glm::vec3& value) const {
+    glUniform3fv(m_handleLocations[handle], 1, &value[0]);
+}
+
+void Shader::setMat4(UniformHandle handle, const glm::mat4& mat) const {
+    glUniformMatrix4fv(m_handleLocations[handle], 1, GL_FALSE, &mat[0][0]);
+}
+
 void Shader::setBool(const std::string& name, bool value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1i(location(name), (int)value);
 }
 
 void Shader::setInt(const std::string& name, int value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(location(name), value);
 }
 
 void Shader::setFloat(const std::string& name, float value) const {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(location(name), value);
 }
 
 void Shader::setVec3(const std::string& name, const glm::vec3& value) const {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    glUniform3fv(location(name), 1, &value[0]);
 }
 
 void Shader::setVec3(const std::string& name, float x, float y, float z) const {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+    glUniform3f(location(name), x, y, z);
 }
 
 void Shader::setMat4(const std::string& name, const glm::mat4& mat) const {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]);
 }
\ No newline at end of file
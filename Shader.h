@@ -4,11 +4,23 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <cstdint>
 #include <string>
+#include <vector>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
+// Handle of a uniform, returned by Shader::uniform(). It indexes a table
+// owned by the shader, so it stays valid if the program is linked again.
+typedef int UniformHandle;
+
+// A program built from GLSL files. Linked programs are kept in a binary
+// cache next to the vertex shader (<vertexPath>.progcache) when the driver
+// supports program binaries, so later launches skip compiling. The cache is
+// keyed by a hash of the stage sources and the GL vendor, renderer and
+// version strings; a stale or rejected binary is rebuilt from the sources.
 class Shader {
 public:
     unsigned int ID;
@@ -16,16 +28,117 @@ public:
     // Constructor generates the shader on the fly
     Shader(const char* vertexPath, const char* fragmentPath);
 
+    // Program with a geometry stage between the vertex and fragment shaders
+    Shader(const char* vertexPath, const char* geometryPath, const char* fragmentPath);
+
+    // Vertex-only program whose outputs are captured with transform feedback,
+    // one buffer binding per varying (GL_SEPARATE_ATTRIBS)
+    Shader(const char* vertexPath, const char* const* feedbackVaryings, int varyingCount);
+
+    // The program itself is deleted by the owner, with glDeleteProgram(ID)
+    ~Shader();
+
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+
+    // Build the program again from its files. If it links, it replaces ID
+    // with the uniform values and block bindings of the old program carried
+    // over, and handles keep working; otherwise the old program stays.
+    bool reload();
+
+    // The GLSL files the program is built from, vertex stage first
+    std::vector<std::string> files() const;
+
+    // Every shader alive, in construction order, for ShaderWatcher
+    static const std::vector<Shader*>& liveShaders();
+
     // Activate the shader
     void use();
 
-    // Utility uniform functions
+    // Handle of a named uniform for the handle overloads below. Look it up
+    // once, after construction; uniforms that are not active ignore writes.
+    UniformHandle uniform(const char* name);
+
+    // Bind a uniform block of the program to a uniform buffer binding point
+    void bindUniformBlock(const char* blockName, GLuint bindingPoint);
+
+    // Uniform setters by handle; no lookup at all
+    void setBool(UniformHandle handle, bool value) const;
+    void setInt(UniformHandle handle, int value) const;
+    void setFloat(UniformHandle handle, float value) const;
+    void setVec2(UniformHandle handle, const glm::vec2& value) const;
+    void setVec3(UniformHandle handle, const glm::vec3& value) const;
+    void setMat4(UniformHandle handle, const glm::mat4& mat) const;
+
+    // Utility uniform functions, looked up by name in the link-time cache
     void setBool(const std::string& name, bool value) const;
     void setInt(const std::string& name, int value) const;
     void setFloat(const std::string& name, float value) const;
     void setVec3(const std::string& name, const glm::vec3& value) const;
     void setVec3(const std::string& name, float x, float y, float z) const;
     void setMat4(const std::string& name, const glm::mat4& mat) const;
+
+private:
+    struct Stage {
+        GLenum type;
+        std::string path;
+    };
+
+    struct CacheHeader {
+        char magic[4];            // "F1PB"
+        uint32_t version;         // kCacheVersion
+        uint64_t key;             // programKey() of the sources the binary was linked from
+        uint32_t binaryFormat;    // As glGetProgramBinary reported it
+        uint32_t binaryLength;    // Bytes of binary after the header
+    };
+
+    static const uint32_t kCacheVersion = 1;
+
+    // Record the stages, build the program and register the shader
+    void create(const std::vector<Stage>& stages);
+
+    // Link a new program from the stage files, or load it from the binary
+    // cache. linked tells whether it linked; the program is returned either way.
+    unsigned int buildProgram(bool& linked) const;
+
+    // Read a whole shader file into a string
+    static std::string readShaderFile(const char* path);
+
+    // Compile one shader stage, printing errors if any
+    static unsigned int compileShader(GLenum type, const char* source, const char* label);
+
+    // Link a program and report errors if any
+    static bool linkProgram(unsigned int program);
+
+    // Hash of the stage sources, the feedback varyings and the GL driver
+    uint64_t programKey(const std::vector<std::string>& sources) const;
+
+    // glGetProgramBinary and glProgramBinary are available, with at least one format
+    static bool programBinarySupported();
+
+    // Load the cached binary into program if its key matches; false on any mismatch
+    bool loadProgramBinary(unsigned int program, uint64_t key) const;
+
+    // Store the binary of a linked program, replacing the cache file
+    void saveProgramBinary(unsigned int program, uint64_t key) const;
+
+    std::string cachePath() const { return m_stages[0].path + ".progcache"; }
+
+    // Copy the default-block uniform values and uniform block bindings of one program to another
+    static void copyProgramState(unsigned int from, unsigned int to);
+
+    // Record the location of every active uniform and re-resolve the handles
+    void cacheUniformLocations();
+
+    // Cached location of a uniform, -1 if it is not active
+    GLint location(const std::string& name) const;
+
+    std::unordered_map<std::string, GLint> m_uniformLocations;   // Filled at link time
+    std::vector<std::string> m_handleNames;                      // Uniform of each handle
+    std::vector<GLint> m_handleLocations;                        // Its location in the current program
+
+    std::vector<Stage> m_stages;                                 // Vertex stage first
+    std::vector<std::string> m_feedbackVaryings;                 // Empty unless captured with transform feedback
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,112 @@
+#include "ShaderWatcher.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+ShaderWatcher::ShaderWatcher(int pollMilliseconds)
+    : m_running(true), m_pollMilliseconds(pollMilliseconds) {
+    m_thread = std::thread(&ShaderWatcher::watchLoop, this);
+}
+
+ShaderWatcher::~ShaderWatcher() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_wake.notify_all();
+    m_thread.join();
+}
+
+void ShaderWatcher::watchLoop() {
+    std::vector<std::string> paths;
+    std::vector<std::string> changed;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_running) {
+        paths = m_paths;
+        lock.unlock();
+
+        changed.clear();
+        for (size_t i = 0; i < paths.size(); i++) {
+            // A file that is missing or empty, e.g. halfway through an editor's
+            // save, is looked at again next poll
+            FileStamp stamp;
+            if (!FileStamp::read(paths[i], stamp)) {
+                continue;
+            }
+
+            std::map<std::string, WatchedFile>::iterator it = m_files.find(paths[i]);
+            if (it != m_files.end() && it->second.stamp == stamp && FileStamp::kSubsecond) {
+                continue;
+            }
+
+            uint64_t hash = 0;
+            if (!hashFile(paths[i], hash)) {
+                continue;
+            }
+            if (it == m_files.end()) {
+                WatchedFile file = { stamp, hash };
+                m_files[paths[i]] = file;
+            }
+            else {
+                // A save that rewrote the same bytes moves the stamp but reloads nothing
+                it->second.stamp = stamp;
+                if (it->second.hash != hash) {
+                    it->second.hash = hash;
+                    changed.push_back(paths[i]);
+                }
+            }
+        }
+
+        lock.lock();
+        m_changedPaths.insert(m_changedPaths.end(), changed.begin(), changed.end());
+        m_wake.wait_for(lock, std::chrono::milliseconds(m_pollMilliseconds), [this] { return !m_running; });
+    }
+}
+
+int ShaderWatcher::update() {
+    std::vector<std::string> changed;
+    const std::vector<Shader*>& shaders = Shader::liveShaders();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_shaders != shaders) {
+            m_shaders = shaders;
+            m_paths.clear();
+            for (size_t i = 0; i < m_shaders.size(); i++) {
+                const std::vector<std::string> files = m_shaders[i]->files();
+                for (size_t j = 0; j < files.size(); j++) {
+                    if (std::find(m_paths.begin(), m_paths.end(), files[j]) == m_paths.end()) {
+                        m_paths.push_back(files[j]);
+                    }
+                }
+            }
+        }
+        if (m_changedPaths.empty()) {
+            return 0;
+        }
+        changed.swap(m_changedPaths);
+    }
+
+    int reloaded = 0;
+    for (size_t i = 0; i < m_shaders.size(); i++) {
+        Shader* shader = m_shaders[i];
+        const std::vector<std::string> files = shader->files();
+        bool affected = false;
+        for (size_t j = 0; j < changed.size() && !affected; j++) {
+            affected = std::find(files.begin(), files.end(), changed[j]) != files.end();
+        }
+        if (!affected) {
+            continue;
+        }
+
+        if (shader->reload()) {
+            std::cout << "Reloaded shader " << files[0] << std::endl;
+            reloaded++;
+        }
+        else {
+            std::cerr << "WARNING::SHADER_WATCHER::RELOAD_FAILED: " << files[0] << " keeps its last program" << std::endl;
+        }
+    }
+    return reloaded;
+}
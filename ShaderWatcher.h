@@ -0,0 +1,56 @@
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FileStamp.h"
+#include "Shader.h"
+
+// Hot reload of the GLSL files behind every live Shader. A background thread
+// polls the files' FileStamps and hashes a file whose stamp moved, or every
+// poll where the stamp cannot tell saves within a second apart; update(), on
+// the thread that owns the GL context, rebuilds the programs that read a file
+// whose contents changed. A
+// rebuilt program replaces the old one only once it links, so a shader saved
+// with an error keeps drawing with its last good version.
+class ShaderWatcher {
+public:
+    explicit ShaderWatcher(int pollMilliseconds = 250);
+    ~ShaderWatcher();
+
+    ShaderWatcher(const ShaderWatcher&) = delete;
+    ShaderWatcher& operator=(const ShaderWatcher&) = delete;
+
+    // Once per frame: pick up shaders created since the last call and reload
+    // those whose files changed. Returns the number of programs swapped in.
+    int update();
+
+private:
+    struct WatchedFile {
+        FileStamp stamp;
+        uint64_t hash;          // FNV-1a of the contents
+    };
+
+    // Watcher thread: stat every watched file each poll interval
+    void watchLoop();
+
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_running;
+    int m_pollMilliseconds;
+
+    // Guarded by m_mutex
+    std::vector<std::string> m_paths;            // Stage files of the watched shaders
+    std::vector<std::string> m_changedPaths;     // Changed since the last update()
+
+    std::map<std::string, WatchedFile> m_files;  // Watcher thread only
+    std::vector<Shader*> m_shaders;              // Render thread only; the paths are taken from these
+};
+
+#endif
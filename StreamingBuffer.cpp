@@ -0,0 +1,178 @@
+#include "StreamingBuffer.h"
+#include "FrameProfiler.h"
+
+#include <cstring>
+#include <iostream>
+
+StreamingBuffer::StreamingBuffer()
+    : m_buffer(0), m_regionSize(0), m_region(0),
+      m_persistentData(nullptr), m_mappedRegion(nullptr),
+      m_dirtyBegin(0), m_dirtyEnd(0) {
+    for (int i = 0; i < kRegionCount; i++) {
+        m_fences[i] = 0;
+    }
+}
+
+bool StreamingBuffer::bufferStorageSupported() {
+#if defined(GL_VERSION_4_4)
+    if (GLAD_GL_VERSION_4_4) {
+        return true;
+    }
+#endif
+#if defined(GL_ARB_buffer_storage)
+    if (GLAD_GL_ARB_buffer_storage) {
+        return true;
+    }
+#endif
+    return false;
+}
+
+void StreamingBuffer::create(GLsizeiptr regionSize) {
+    m_regionSize = regionSize;
+    m_region = kRegionCount - 1;   // First beginWrite() moves to region 0
+
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+
+    GLsizeiptr totalSize = m_regionSize * kRegionCount;
+
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+    if (bufferStorageSupported()) {
+        // Immutable storage mapped once for the lifetime of the buffer
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, totalSize, nullptr, flags);
+        m_persistentData = static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, totalSize, flags));
+        if (!m_persistentData) {
+            std::cerr << "WARNING::STREAMING_BUFFER::PERSISTENT_MAP_FAILED" << std::endl;
+        }
+    }
+#endif
+
+    if (!m_persistentData) {
+        glBufferData(GL_ARRAY_BUFFER, totalSize, nullptr, GL_DYNAMIC_DRAW);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void StreamingBuffer::destroy() {
+    for (int i = 0; i < kRegionCount; i++) {
+        if (m_fences[i]) {
+            glDeleteSync(m_fences[i]);
+            m_fences[i] = 0;
+        }
+    }
+
+    if (m_persistentData) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        m_persistentData = nullptr;
+    }
+
+    glDeleteBuffers(1, &m_buffer);
+    m_buffer = 0;
+}
+
+void StreamingBuffer::waitForRegion(int region) {
+    GLsync sync = m_fences[region];
+    if (!sync) {
+        return;
+    }
+
+    // Flush on the first wait so the fence is guaranteed to be submitted
+    GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (true) {
+        GLenum result = glClientWaitSync(sync, waitFlags, 1000000);  // 1 ms
+        if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED) {
+            break;
+        }
+        waitFlags = 0;
+    }
+
+    glDeleteSync(sync);
+    m_fences[region] = 0;
+}
+
+void StreamingBuffer::beginWrite() {
+    m_region = (m_region + 1) % kRegionCount;
+    waitForRegion(m_region);
+
+    m_dirtyBegin = 0;
+    m_dirtyEnd = 0;
+
+    if (!m_persistentData) {
+        // The fence already guarantees the GPU is done with this region, so skip the
+        // driver's own synchronization. The region is not invalidated because only
+        // the changed bytes are written and the rest must stay intact.
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        m_mappedRegion = static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER,
+            m_region * m_regionSize, m_regionSize,
+            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_FLUSH_EXPLICIT_BIT));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+void StreamingBuffer::write(GLintptr offset, const void* data, GLsizeiptr size) {
+    unsigned char* regionData = m_persistentData
+        ? m_persistentData + m_region * m_regionSize
+        : m_mappedRegion;
+    if (!regionData || size <= 0) {
+        return;
+    }
+
+    std::memcpy(regionData + offset, data, size);
+    FrameProfiler::instance().addUploadedBytes(static_cast<size_t>(size));
+
+    if (m_persistentData) {
+        return;
+    }
+
+    // Merge nearby writes into one flush; flush the pending span once a write lands far away
+    GLintptr end = offset + size;
+    bool hasSpan = m_dirtyEnd > m_dirtyBegin;
+    if (hasSpan && (offset > m_dirtyEnd + kFlushMergeGap || end + kFlushMergeGap < m_dirtyBegin)) {
+        flushDirtySpan();
+        hasSpan = false;
+    }
+
+    if (!hasSpan) {
+        m_dirtyBegin = offset;
+        m_dirtyEnd = end;
+    }
+    else {
+        if (offset < m_dirtyBegin) m_dirtyBegin = offset;
+        if (end > m_dirtyEnd) m_dirtyEnd = end;
+    }
+}
+
+void StreamingBuffer::flushDirtySpan() {
+    if (m_dirtyEnd > m_dirtyBegin) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+        glFlushMappedBufferRange(GL_ARRAY_BUFFER, m_dirtyBegin, m_dirtyEnd - m_dirtyBegin);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    m_dirtyBegin = 0;
+    m_dirtyEnd = 0;
+}
+
+void StreamingBuffer::endWrite() {
+    if (m_persistentData || !m_mappedRegion) {
+        // Coherent persistent mapping needs no explicit flush
+        return;
+    }
+
+    flushDirtySpan();
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_mappedRegion = nullptr;
+}
+
+void StreamingBuffer::fence() {
+    if (m_fences[m_region]) {
+        glDeleteSync(m_fences[m_region]);
+    }
+    m_fences[m_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
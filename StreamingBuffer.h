@@ -0,0 +1,58 @@
+#ifndef STREAMING_BUFFER_H
+#define STREAMING_BUFFER_H
+
+#include <glad/glad.h>
+
+// Vertex buffer split into several equally sized regions that the CPU
+// writes in turn while the GPU reads the others. Each region is protected
+// by a fence, so writes never stall on a draw that is still in flight.
+// Uses a persistently mapped buffer when glBufferStorage is available and
+// falls back to unsynchronized glMapBufferRange on plain GL 3.3.
+class StreamingBuffer {
+public:
+    static const int kRegionCount = 3;
+    static const GLintptr kFlushMergeGap = 256;    // Writes closer than this share one flush (fallback path)
+
+    StreamingBuffer();
+
+    // Allocate kRegionCount regions of regionSize bytes each
+    void create(GLsizeiptr regionSize);
+
+    // Release the buffer, mapping and fences
+    void destroy();
+
+    // Move to the next region, waiting for the GPU to finish with it
+    void beginWrite();
+
+    // Copy data into the current region at the given byte offset
+    void write(GLintptr offset, const void* data, GLsizeiptr size);
+
+    // Make the writes of the current region visible to the GPU
+    void endWrite();
+
+    // Mark the current region as in use by the draws issued so far
+    void fence();
+
+    GLuint id() const { return m_buffer; }
+    int region() const { return m_region; }
+    bool isPersistent() const { return m_persistentData != nullptr; }
+
+private:
+    GLuint m_buffer;
+    GLsizeiptr m_regionSize;
+    int m_region;
+    GLsync m_fences[kRegionCount];
+
+    unsigned char* m_persistentData;   // Whole buffer, mapped once (persistent path)
+    unsigned char* m_mappedRegion;     // Current region, mapped per frame (fallback path)
+
+    // Pending dirty byte span of the current region (fallback path)
+    GLintptr m_dirtyBegin;
+    GLintptr m_dirtyEnd;
+
+    void waitForRegion(int region);
+    void flushDirtySpan();
+    static bool bufferStorageSupported();
+};
+
+#endif
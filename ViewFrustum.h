@@ -0,0 +1,69 @@
+#ifndef VIEW_FRUSTUM_H
+#define VIEW_FRUSTUM_H
+
+#include <glm/glm.hpp>
+#include <cfloat>
+
+// Axis-aligned box in model space
+struct BoundingBox {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// Camera frustum moved into one model's space, so mesh bounds can be tested
+// and sized without transforming them. Sizes are in pixels and assume a
+// perspective projection and a model matrix with uniform scale.
+class ViewFrustum {
+public:
+    ViewFrustum(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, float viewportHeight) {
+        glm::mat4 clip = projection * view * model;
+
+        // Gribb-Hartmann: each plane is the fourth row of clip plus or minus one of the others
+        for (int i = 0; i < 3; i++) {
+            for (int side = 0; side < 2; side++) {
+                float sign = side == 0 ? 1.0f : -1.0f;
+                m_planes[i * 2 + side] = glm::vec4(
+                    clip[0][3] + sign * clip[0][i],
+                    clip[1][3] + sign * clip[1][i],
+                    clip[2][3] + sign * clip[2][i],
+                    clip[3][3] + sign * clip[3][i]);
+            }
+        }
+
+        m_eye = glm::vec3(glm::inverse(view * model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        m_pixelScale = projection[1][1] * viewportHeight * 0.5f;
+    }
+
+    // False only when the box lies entirely outside one of the planes
+    bool isVisible(const BoundingBox& box) const {
+        for (int i = 0; i < 6; i++) {
+            const glm::vec4& plane = m_planes[i];
+            glm::vec3 farthest(
+                plane.x >= 0.0f ? box.max.x : box.min.x,
+                plane.y >= 0.0f ? box.max.y : box.min.y,
+                plane.z >= 0.0f ? box.max.z : box.min.z);
+            if (plane.x * farthest.x + plane.y * farthest.y + plane.z * farthest.z + plane.w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // On-screen diameter of the box's bounding sphere; FLT_MAX when the camera is inside it
+    float projectedSize(const BoundingBox& box) const {
+        glm::vec3 center = (box.min + box.max) * 0.5f;
+        float radius = glm::length(box.max - box.min) * 0.5f;
+        float distance = glm::length(center - m_eye);
+        if (distance <= radius) {
+            return FLT_MAX;
+        }
+        return 2.0f * radius * m_pixelScale / distance;
+    }
+
+private:
+    glm::vec4 m_planes[6];
+    glm::vec3 m_eye;
+    float m_pixelScale;
+};
+
+#endif
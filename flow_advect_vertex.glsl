@@ -0,0 +1,200 @@
+#version 330 core
+// Advances every flow line by one step; all outputs are captured with transform feedback
+layout (location = 0) in vec4 aHeadLife;     // head.xyz (anchor frame), life
+layout (location = 1) in vec4 aDynamics;     // speed, pressure, vortexPhase, pointCount
+layout (location = 2) in vec4 aOffsetLife;   // initialOffset.xyz, initialLife
+layout (location = 3) in vec4 aDirection;    // direction.xyz, velocity
+layout (location = 4) in vec4 aZone;         // zoneType, isVortex, vortexStrength, unused
+
+out vec4 outHeadLife;
+out vec4 outDynamics;
+flat out uvec2 outTrailPosition;   // The head as a FlowPointCode: x | y << 16, z | emission life << 16
+
+uniform float deltaTime;
+uniform float carLength;
+uniform float carWidth;
+uniform float carHeight;
+uniform float carSpeed;
+uniform float carPosition;
+uniform float anchor;
+uniform float positionScale;        // Meters per FlowPointCode unit
+uniform float lifeScale;            // FlowLineShade life units per second
+uniform float vortexIntensity;
+uniform bool simulateDRS;
+uniform int randomSeed;
+uniform int frameIndex;
+uniform int maxPoints;
+
+// Precomputed aerodynamics: velocity.xyz and pressure coefficient per node, in car coordinates
+uniform bool useFlowField;
+uniform sampler3D flowField;
+uniform vec3 fieldScale;             // Car coordinates to texture coordinates
+uniform vec3 fieldOffset;
+uniform float fieldVelocityScale;    // Car speed over the field's reference speed
+
+// Per-line random stream for this frame, keyed like FlowRandom on the CPU
+uint rngKey;
+uint rngDraw;
+
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+float randomFloat(float minValue, float maxValue) {
+    rngDraw++;
+    uint bits = hash(rngKey + rngDraw * 0x632be5abu);
+    return minValue + (maxValue - minValue) * (float(bits >> 8) * (1.0 / 16777216.0));
+}
+
+vec3 applyAerodynamics(vec3 head, float distanceToAdvance, inout float pressure) {
+    vec3 displacement = aDirection.xyz * distanceToAdvance;
+
+    vec3 relativePos = head;
+    relativePos.z += anchor - carPosition;
+
+    float carSpeedFactor = carSpeed / 250.0;
+    displacement *= carSpeedFactor;
+
+    // Wake effect behind the car
+    if (relativePos.z > carLength * 0.3) {
+        float wakeStrength = 0.05 * exp(-(relativePos.z - carLength * 0.3) / 2.0);
+        float speedMultiplier = 0.8 + (carSpeedFactor * 0.4);
+        displacement.x += (relativePos.x > 0.0) ? -wakeStrength * speedMultiplier : wakeStrength * speedMultiplier;
+
+        // Upwash, reduced over the rear wing with DRS open
+        if (simulateDRS && abs(relativePos.x) < carWidth * 0.3 && relativePos.z < carLength * 0.6) {
+            displacement.y += wakeStrength * 0.3 * speedMultiplier;
+        }
+        else {
+            displacement.y += wakeStrength * 0.5 * speedMultiplier;
+        }
+    }
+
+    // Ground effect under the car
+    if (relativePos.y < carHeight * 0.2 &&
+        abs(relativePos.x) < carWidth * 0.4 &&
+        abs(relativePos.z) < carLength * 0.4) {
+        float speedEffect = 1.0 + (carSpeedFactor * 0.5);
+        displacement.z *= 1.2 * speedEffect;
+        displacement.y *= 0.8;
+
+        if (int(aZone.x) == 4) {
+            pressure = clamp(pressure * 0.5, 0.05, 0.2);
+        }
+    }
+
+    // Small turbulence, increasing with car speed
+    float turbulence = 0.01 * (0.5 + carSpeedFactor * 0.5);
+    displacement.x += randomFloat(-turbulence, turbulence);
+    displacement.y += randomFloat(-turbulence, turbulence);
+    displacement.z += randomFloat(-turbulence, turbulence);
+
+    return displacement;
+}
+
+// Same as applyAerodynamics(), with the wake and ground effect looked up in the flow field
+vec3 applyFlowField(vec3 head, float distanceToAdvance, inout float pressure) {
+    vec3 relativePos = head;
+    relativePos.z += anchor - carPosition;
+
+    vec4 node = texture(flowField, relativePos * fieldScale + fieldOffset);
+    float suction = clamp(-node.w, 0.0, 1.0);
+
+    float carSpeedFactor = carSpeed / 250.0;
+    float groundScaleZ = 1.2 * (1.0 + (carSpeedFactor * 0.5));
+    vec3 velocity = node.xyz * (fieldVelocityScale * deltaTime);
+
+    vec3 displacement = aDirection.xyz * (distanceToAdvance * carSpeedFactor);
+    displacement.xy += velocity.xy;
+    displacement.z = displacement.z * (1.0 + (groundScaleZ - 1.0) * suction) + velocity.z;
+    displacement.y *= 1.0 - 0.2 * suction;
+
+    if (int(aZone.x) == 4) {
+        pressure = mix(pressure, clamp(pressure * 0.5, 0.05, 0.2), suction);
+    }
+
+    float turbulence = 0.01 * (0.5 + carSpeedFactor * 0.5);
+    displacement.x += randomFloat(-turbulence, turbulence);
+    displacement.y += randomFloat(-turbulence, turbulence);
+    displacement.z += randomFloat(-turbulence, turbulence);
+
+    return displacement;
+}
+
+vec3 applyVortexMotion(vec3 head, float distanceToAdvance, inout float vortexPhase) {
+    vec3 relativePos = head;
+    relativePos.z += anchor - carPosition;
+
+    float carSpeedFactor = carSpeed / 250.0;
+    vec3 displacement = vec3(0.0, 0.0, distanceToAdvance * carSpeedFactor);
+
+    vortexPhase += 0.1 * carSpeedFactor;
+
+    float rotationRadius = aZone.z * 0.1 * vortexIntensity;
+    float rotationSpeed = 0.5 + (carSpeedFactor * 0.5);
+
+    float distFromOrigin = length(relativePos.xy);
+    rotationRadius *= (1.0 - min(1.0, distFromOrigin / 2.0));
+
+    displacement.x += rotationRadius * cos(vortexPhase * rotationSpeed);
+    displacement.y += rotationRadius * sin(vortexPhase * rotationSpeed);
+
+    float turbulence = 0.005 * (0.5 + carSpeedFactor * 0.5);
+    displacement.x += randomFloat(-turbulence, turbulence);
+    displacement.y += randomFloat(-turbulence, turbulence);
+
+    return displacement;
+}
+
+void main() {
+    int line = gl_VertexID;
+    rngKey = hash(hash(uint(randomSeed) + uint(line) * 0x9e3779b9u + 0x6a09e667u) ^ (uint(frameIndex) * 0x85ebca6bu));
+    rngDraw = 0u;
+
+    vec3 head = aHeadLife.xyz;
+    float life = aHeadLife.w - deltaTime;
+    float speed = aDynamics.x;
+    float pressure = aDynamics.y;
+    float vortexPhase = aDynamics.z;
+    float pointCount = aDynamics.w;
+    bool isVortex = aZone.y > 0.5;
+
+    // Restart the line at its emitter, which follows the car. Transform
+    // feedback writes one trail point per step, so the emitter is this step's
+    // point and the line advances from the next step. The CPU backend pushes
+    // the emitter and advances in the same step, so a respawned GPU line
+    // runs one step behind it; both trails start at the emitter.
+    if (life <= 0.0) {
+        life = aOffsetLife.w;
+        head = aOffsetLife.xyz;
+        head.z += carPosition - anchor;
+        pointCount = 0.0;
+        speed = aDirection.w * (carSpeed / 250.0);
+        if (isVortex) {
+            vortexPhase = randomFloat(0.0, 6.28);
+        }
+    }
+    else {
+        float distanceToAdvance = speed * deltaTime;
+        if (isVortex) {
+            head += applyVortexMotion(head, distanceToAdvance, vortexPhase);
+        }
+        else if (useFlowField) {
+            head += applyFlowField(head, distanceToAdvance, pressure);
+        }
+        else {
+            head += applyAerodynamics(head, distanceToAdvance, pressure);
+        }
+    }
+
+    outHeadLife = vec4(head, life);
+    outDynamics = vec4(speed, pressure, vortexPhase, min(pointCount + 1.0, float(maxPoints)));
+    ivec3 code = ivec3(clamp(round(head / positionScale), -32767.0, 32767.0));
+    uint emissionLife = uint(clamp(life * lifeScale + 0.5, 0.0, 65535.0));
+    outTrailPosition = uvec2((uint(code.x) & 0xffffu) | (uint(code.y) << 16), (uint(code.z) & 0xffffu) | (emissionLife << 16));
+}
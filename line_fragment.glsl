@@ -1,7 +1,18 @@
 #version 330 core
+// Analytic antialiasing of a line ribbon: coverage falls from one to zero
+// over the pixel at the edge of the round-capped segment
 in vec3 Color;
+noperspective in vec2 SegmentCoord;
+flat in float SegmentLength;
+flat in float HalfWidth;
+
 out vec4 FragColor;
 
 void main() {
-    FragColor = vec4(Color, 1.0);
+    vec2 nearest = vec2(clamp(SegmentCoord.x, 0.0, SegmentLength), 0.0);
+    float coverage = clamp(HalfWidth + 0.5 - length(SegmentCoord - nearest), 0.0, 1.0);
+    if (coverage <= 0.0) {
+        discard;
+    }
+    FragColor = vec4(Color, coverage);
 }
\ No newline at end of file
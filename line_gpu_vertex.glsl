@@ -0,0 +1,60 @@
+#version 330 core
+// Flow line trails fetched from the GPU advection buffers, one instance per line
+out vec3 VertexColor;
+out float VertexWidth;
+
+uniform mat4 model;
+
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec4 viewport;      // Unused here, but the ribbon geometry stage declares the whole block
+};
+
+uniform isamplerBuffer trailPositions;  // FlowPointCodes around the anchor, [slot][line]; w is the emission life
+uniform samplerBuffer lineHeads;        // w holds the remaining life
+uniform samplerBuffer lineDynamics;     // y holds the pressure, w the point count
+uniform samplerBuffer lineParams;       // 3 per line: w of the first is the initial life, of the second the velocity, x of the third the zone
+uniform int numLines;
+uniform int maxPoints;
+uniform int newestSlot;
+uniform float positionScale;            // Meters per FlowPointCode unit
+uniform float lifeScale;                // FlowLineShade life units per second
+uniform float lineWidth;                // Ribbon width in pixels
+uniform float vortexLineWidth;          // For lines from firstVortexLine on
+uniform int firstVortexLine;
+uniform sampler2D flowColormap;
+uniform bool visualizePressure;
+
+// Color of a flow line point, from the rows of FlowColormap: the line's
+// pressure or emission zone, the line's brightness, and the life the line
+// had left when the point was emitted
+vec3 flowColor(float pressure, int zone, float brightness, float lifeRatio) {
+    vec2 lookup = visualizePressure ?
+        vec2((pressure * 255.0 + 0.5) / 256.0, 0.25) :
+        vec2((float(zone) + 0.5) / 256.0, 0.75);
+    return texture(flowColormap, lookup).rgb * brightness * clamp(lifeRatio, 0.1, 1.0);
+}
+
+void main() {
+    int line = gl_InstanceID;
+    vec4 dynamics = texelFetch(lineDynamics, line);
+    int pointCount = int(dynamics.w);
+
+    // Vertices past the end of the trail collapse onto its oldest point
+    int point = min(gl_VertexID, max(pointCount - 1, 0));
+    int slot = (newestSlot - point + maxPoints) % maxPoints;
+    int texel = slot * numLines + line;
+
+    ivec4 code = texelFetch(trailPositions, texel);
+    vec3 position = vec3(code.xyz) * positionScale;
+    gl_Position = projection * view * model * vec4(position, 1.0);
+
+    // Each point carries the life its line had when it was emitted
+    float life = float(code.w & 0xffff) / lifeScale;
+    float initialLife = texelFetch(lineParams, line * 3).w;
+    float brightness = clamp(texelFetch(lineParams, line * 3 + 1).w / 10.0, 0.5, 1.5);
+    int zone = int(texelFetch(lineParams, line * 3 + 2).x);
+    VertexColor = flowColor(dynamics.y, zone, brightness, life / max(initialLife, 1e-3));
+    VertexWidth = line >= firstVortexLine ? vortexLineWidth : lineWidth;
+}
\ No newline at end of file
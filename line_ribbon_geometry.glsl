@@ -0,0 +1,70 @@
+#version 330 core
+// Expands every line segment into a screen-space quad, as wide as the line
+// plus a pixel on either side; line_fragment.glsl shades it by the distance
+// of each pixel to the segment. Widths are the same on every driver, unlike
+// glLineWidth, which core profiles may clamp to one pixel.
+layout (lines) in;
+layout (triangle_strip, max_vertices = 4) out;
+
+in vec3 VertexColor[];
+in float VertexWidth[];
+
+out vec3 Color;
+noperspective out vec2 SegmentCoord;    // Pixels from the segment start, along and across it
+flat out float SegmentLength;           // Pixels
+flat out float HalfWidth;               // Pixels
+
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec4 viewport;                      // xy: framebuffer size in pixels
+};
+
+void main() {
+    vec4 p0 = gl_in[0].gl_Position;
+    vec4 p1 = gl_in[1].gl_Position;
+
+    // Clip to the near plane first, so that both ends project in front of the camera
+    float near0 = p0.z + p0.w;
+    float near1 = p1.z + p1.w;
+    if (near0 < 0.0 && near1 < 0.0) {
+        return;
+    }
+    if (near0 < 0.0) {
+        p0 = mix(p0, p1, near0 / (near0 - near1));
+    }
+    else if (near1 < 0.0) {
+        p1 = mix(p1, p0, near1 / (near1 - near0));
+    }
+
+    vec2 halfViewport = 0.5 * viewport.xy;
+    vec2 s0 = p0.xy / p0.w * halfViewport;
+    vec2 s1 = p1.xy / p1.w * halfViewport;
+    float segmentLength = length(s1 - s0);
+    if (segmentLength < 1e-4) {
+        return;     // Collapsed trail points
+    }
+    vec2 along = (s1 - s0) / segmentLength;
+    vec2 across = vec2(-along.y, along.x);
+
+    float halfWidth = 0.5 * VertexWidth[0];
+    float extent = halfWidth + 1.0;
+
+    for (int end = 0; end < 2; end++) {
+        vec4 p = end == 0 ? p0 : p1;
+        vec2 s = end == 0 ? s0 : s1;
+        float reach = end == 0 ? -extent : segmentLength + extent;
+        for (int side = -1; side <= 1; side += 2) {
+            vec2 corner = s + along * (end == 0 ? -extent : extent) + across * (float(side) * extent);
+
+            // Back to clip space at the end's own depth, so depth testing is unchanged
+            gl_Position = vec4(corner / halfViewport * p.w, p.z, p.w);
+            Color = VertexColor[end];
+            SegmentCoord = vec2(reach, float(side) * extent);
+            SegmentLength = segmentLength;
+            HalfWidth = halfWidth;
+            EmitVertex();
+        }
+    }
+    EndPrimitive();
+}
\ No newline at end of file
@@ -1,15 +1,63 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aColor;
+layout (location = 0) in vec4 aPos;    // Flow lines: FlowPointCode, emission life in w
+layout (location = 1) in vec3 aColor;   // Only for geometry that is not a flow line
 
-out vec3 Color;
+out vec3 VertexColor;
+out float VertexWidth;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform float positionScale;    // Meters per unit: FlowPointCode::kStep for flow lines, 1 for float geometry
+
+// Ribbon width in pixels. Flow line vertices are drawn straight from the ring
+// slots, so the slot a vertex sits in tells its line and whether it is a vortex line.
+uniform float lineWidth;
+uniform float vortexLineWidth;
+uniform int firstVortexLine;
+uniform int slotSize;           // Ring slots per line; 0 for geometry that is not a flow line
+uniform int numLines;           // Lines per streaming region
+
+// Flow line colors, from one FlowLineShade per line and streaming region
+uniform usamplerBuffer lineShades;
+uniform int shadeBase;          // Shade of line 0 in the region drawn
+uniform sampler2D flowColormap;
+uniform bool visualizePressure;
+
+// Shared by every program, see CameraUniforms
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec4 viewport;      // Unused here, but the ribbon geometry stage declares the whole block
+};
+
+// Color of a flow line point, from the rows of FlowColormap: the line's
+// pressure or emission zone, the line's brightness, and the life the line
+// had left when the point was emitted
+vec3 flowColor(float pressure, int zone, float brightness, float lifeRatio) {
+    vec2 lookup = visualizePressure ?
+        vec2((pressure * 255.0 + 0.5) / 256.0, 0.25) :
+        vec2((float(zone) + 0.5) / 256.0, 0.75);
+    return texture(flowColormap, lookup).rgb * brightness * clamp(lifeRatio, 0.1, 1.0);
+}
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    Color = aColor;
-    gl_PointSize = 2.0;  // Point size for better visualization
+    gl_Position = projection * view * model * vec4(aPos.xyz * positionScale, 1.0);
+    if (slotSize == 0) {
+        VertexColor = aColor;
+        VertexWidth = lineWidth;
+        return;
+    }
+
+    int line = (gl_VertexID / slotSize) % numLines;
+    uvec4 shade = texelFetch(lineShades, shadeBase + line);
+
+    // Each point carries the life its line had when it was emitted, as the
+    // bits of an unsigned short read back as a signed one
+    float emissionLife = aPos.w < 0.0 ? aPos.w + 65536.0 : aPos.w;
+    float lifeRatio = emissionLife / max(float(shade.z), 1.0);
+    float pressure = float(shade.w & 0xffu) / 255.0;
+    int zone = int((shade.w >> 8) & 7u);
+    float brightness = 0.5 + float(shade.w >> 11) / 31.0;
+
+    VertexColor = flowColor(pressure, zone, brightness, lifeRatio);
+    VertexWidth = line >= firstVortexLine ? vortexLineWidth : lineWidth;
 }
\ No newline at end of file
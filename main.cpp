@@ -7,13 +7,19 @@
 #include "Shader.h"
 #include "Model.h"
 #include "FlowVisualization.h"
+#include "CameraUniforms.h"
+#include "FrameProfiler.h"
+#include "GpuPassTimer.h"
+#include "ProfilerOverlay.h"
+#include "ParticleTracer.h"
+#include "ShaderWatcher.h"
 
 #include <iostream>
 #include <cstdlib>
+#include <fstream>
 #include <direct.h>
 #include <windows.h>
-#include <chrono>
-#include <thread>
+#include <mutex>
 
 // Camera variables - adjusted for side view by default
 glm::vec3 cameraPos = glm::vec3(5.0f, 1.0f, 0.0f);
@@ -40,6 +46,21 @@ bool simulateDRS = false;
 int flowDensity = 350; // Reduced from 400 to avoid congestion
 float streamlineDensity = 0.20f; // Controls spacing between streamlines
 bool enableAdaptiveDensity = true;
+bool useGpuAdvection = false; // Advect flow lines on the GPU instead of the CPU
+bool useParallelUpdate = true; // Split the CPU flow update across worker threads
+bool useSimulationThread = true; // Step the CPU flow simulation on its own thread
+bool recordFlow = false; // Record the flow to flowSessionPath
+bool replayFlow = false; // Play flowSessionPath back instead of simulating
+int replaySeekFrames = 0; // Pending jump through the replay, in recorded frames
+const std::string flowSessionPath = "flow_session.f1flow";
+bool useFlowField = true; // Sample the precomputed flow field instead of the analytic aerodynamics
+FlowIntegrator flowIntegrator = FlowIntegrator::Euler; // How the CPU backend integrates line heads
+const std::string flowFieldPaths[2] = { "flow_field.f1field", "flow_field_drs.f1field" }; // CFD data for DRS closed/open, used if present
+const std::string flowBrickPaths[2] = { "flow_field.f1bricks", "flow_field_drs.f1bricks" }; // Streamed CFD data, preferred over the above
+bool showProfiler = false; // Time the frame and draw the profiler overlay
+bool showParticles = false; // Smoke wand of GPU particles in front of the car
+float wandHeight = 0.4f; // Height of the smoke wand in car coordinates, meters
+const int profileCaptureFrames = 300; // Frames written by a profile capture
 
 // Simulation variables
 float carSpeed = 250.0f; // km/h - affects flow behavior
@@ -83,6 +104,7 @@ void printCurrentDirectory();
 void setCurrentCameraPreset();
 void printSimulationInfo();
 void updateCarMovement(float deltaTime);
+void updateModelLoading(GLFWwindow* window, Model& model);
 void drawBackground() {
     // Set the background color (for example, a light gray)
     glBegin(GL_QUADS);
@@ -193,6 +215,61 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     if (key == GLFW_KEY_I && action == GLFW_PRESS) {
         printSimulationInfo();
     }
+    if (key == GLFW_KEY_G && action == GLFW_PRESS) {
+        useGpuAdvection = !useGpuAdvection;
+        std::cout << "Flow advection: " << (useGpuAdvection ? "GPU" : "CPU") << std::endl;
+    }
+    if (key == GLFW_KEY_U && action == GLFW_PRESS) {
+        useParallelUpdate = !useParallelUpdate;
+        std::cout << "Parallel flow update: " << (useParallelUpdate ? "ON" : "OFF") << std::endl;
+    }
+    if (key == GLFW_KEY_O && action == GLFW_PRESS) {
+        useSimulationThread = !useSimulationThread;
+        std::cout << "Simulation thread: " << (useSimulationThread ? "ON" : "OFF") << std::endl;
+    }
+    if (key == GLFW_KEY_N && action == GLFW_PRESS) {
+        recordFlow = !recordFlow;
+        std::cout << "Flow recording: " << (recordFlow ? "ON" : "OFF") << std::endl;
+    }
+    if (key == GLFW_KEY_B && action == GLFW_PRESS) {
+        replayFlow = !replayFlow;
+        std::cout << "Flow replay: " << (replayFlow ? "ON" : "OFF") << std::endl;
+    }
+    if (key == GLFW_KEY_Z && action == GLFW_PRESS) {
+        useFlowField = !useFlowField;
+        std::cout << "Aerodynamics: " << (useFlowField ? "flow field" : "analytic") << std::endl;
+    }
+    if (key == GLFW_KEY_Y && action == GLFW_PRESS) {
+        flowIntegrator = flowIntegrator == FlowIntegrator::Euler ? FlowIntegrator::RK4 :
+            flowIntegrator == FlowIntegrator::RK4 ? FlowIntegrator::RK45 : FlowIntegrator::Euler;
+        std::cout << "Integrator: " << integratorName(flowIntegrator) << std::endl;
+    }
+    if (key == GLFW_KEY_1 && action == GLFW_PRESS) {
+        showParticles = !showParticles;
+        std::cout << "Smoke particles: " << (showParticles ? "ON" : "OFF") << std::endl;
+    }
+    if ((key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET) && action == GLFW_PRESS) {
+        wandHeight += (key == GLFW_KEY_RIGHT_BRACKET) ? 0.1f : -0.1f;
+        wandHeight = std::min(std::max(wandHeight, 0.05f), 1.5f);
+        std::cout << "Smoke wand height: " << wandHeight << " m" << std::endl;
+    }
+    if (key == GLFW_KEY_H && action == GLFW_PRESS) {
+        showProfiler = !showProfiler;
+        FrameProfiler::instance().setEnabled(showProfiler);
+        std::cout << "Profiler overlay: " << (showProfiler ? "ON" : "OFF") << std::endl;
+    }
+    if (key == GLFW_KEY_X && action == GLFW_PRESS && !FrameProfiler::instance().isCapturing()) {
+        FrameProfiler::instance().startCapture(profileCaptureFrames, "profile_trace.json", "profile_frames.csv");
+        std::cout << "Capturing a profile of the next " << profileCaptureFrames << " frames" << std::endl;
+    }
+
+    // Scrub through the replay about a second at a time
+    if (key == GLFW_KEY_LEFT && (action == GLFW_PRESS || action == GLFW_REPEAT)) {
+        replaySeekFrames -= 60;
+    }
+    if (key == GLFW_KEY_RIGHT && (action == GLFW_PRESS || action == GLFW_REPEAT)) {
+        replaySeekFrames += 60;
+    }
 
     // Car movement controls
     if (key == GLFW_KEY_M && action == GLFW_PRESS) {
@@ -268,11 +345,38 @@ void printSimulationInfo() {
     std::cout << "Adaptive density: " << (enableAdaptiveDensity ? "ON" : "OFF") << std::endl;
     std::cout << "Pressure mapping: " << (usePressureMap ? "ON" : "OFF") << std::endl;
     std::cout << "DRS: " << (simulateDRS ? "OPEN" : "CLOSED") << std::endl;
+    std::cout << "Flow advection: " << (useGpuAdvection ? "GPU" : "CPU") << std::endl;
+    std::cout << "Parallel flow update: " << (useParallelUpdate ? "ON" : "OFF") << std::endl;
+    std::cout << "Simulation thread: " << (useSimulationThread ? "ON" : "OFF") << std::endl;
+    std::cout << "Flow recording: " << (recordFlow ? "ON" : "OFF") << std::endl;
+    std::cout << "Flow replay: " << (replayFlow ? "ON" : "OFF") << std::endl;
+    std::cout << "Aerodynamics: " << (useFlowField ? "flow field" : "analytic") << std::endl;
+    std::cout << "Integrator: " << integratorName(flowIntegrator) << std::endl;
+    std::cout << "Profiler overlay: " << (showProfiler ? "ON" : "OFF") << std::endl;
+    std::cout << "Smoke particles: " << (showParticles ? "ON" : "OFF") << std::endl;
     std::cout << "Camera: " << cameraPresets[currentPreset].name << std::endl;
     std::cout << "Simulation: " << (pauseSimulation ? "PAUSED" : "RUNNING") << std::endl;
     std::cout << "-----------------------------\n" << std::endl;
 }
 
+// Upload the meshes the loader has finished and show its progress in the title bar
+void updateModelLoading(GLFWwindow* window, Model& model) {
+    const int kMeshUploadsPerFrame = 4;
+    if (model.uploadPending(kMeshUploadsPerFrame)) {
+        glfwSetWindowTitle(window, "F1 Car Aero Visualization");
+        std::cout << "Model loaded successfully!" << std::endl;
+        return;
+    }
+
+    static int shownPercent = -1;
+    int percent = static_cast<int>(model.loadProgress() * 100.0f);
+    if (percent != shownPercent) {
+        shownPercent = percent;
+        std::string title = "F1 Car Aero Visualization - loading car " + std::to_string(percent) + "%";
+        glfwSetWindowTitle(window, title.c_str());
+    }
+}
+
 // Update car movement
 void updateCarMovement(float deltaTime) {
     if (carMoving && !pauseSimulation) {
@@ -350,6 +454,7 @@ int main() {
     setCurrentCameraPreset();
 
     glfwMakeContextCurrent(window);
+    glfwSwapInterval(1); // Pace frames with vsync; the flow simulation keeps its own fixed step
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
@@ -388,6 +493,15 @@ int main() {
     std::cout << "  J/K: Decrease/increase movement speed" << std::endl;
     std::cout << "  L: Stop car movement" << std::endl;
     std::cout << "  T: Toggle camera following car" << std::endl;
+    std::cout << "  N: Start/stop recording the flow" << std::endl;
+    std::cout << "  B: Start/stop replaying the recording" << std::endl;
+    std::cout << "  LEFT/RIGHT: Scrub through the replay" << std::endl;
+    std::cout << "  Z: Toggle flow field/analytic aerodynamics" << std::endl;
+    std::cout << "  Y: Cycle Euler/RK4/RK45 integration (CPU advection)" << std::endl;
+    std::cout << "  1: Toggle smoke wand particles" << std::endl;
+    std::cout << "  [/]: Lower/raise the smoke wand" << std::endl;
+    std::cout << "  H: Toggle profiler overlay" << std::endl;
+    std::cout << "  X: Capture a profile (profile_trace.json, profile_frames.csv)" << std::endl;
     std::cout << "  ESC: Exit" << std::endl;
     std::cout << "-------------------------------------\n" << std::endl;
 
@@ -400,15 +514,44 @@ int main() {
         std::cout << "Car shader loaded successfully!" << std::endl;
 
         // Line shader for flow visualization
-        Shader lineShader("line_vertex.glsl", "line_fragment.glsl");
+        Shader lineShader("line_vertex.glsl", "line_ribbon_geometry.glsl", "line_fragment.glsl");
         std::cout << "Line shader loaded successfully!" << std::endl;
 
+        // Camera matrices are uploaded once per frame and shared by both programs
+        CameraUniforms cameraUniforms;
+        cameraUniforms.create();
+        ourShader.bindUniformBlock("Camera", CameraUniforms::kBindingPoint);
+        lineShader.bindUniformBlock("Camera", CameraUniforms::kBindingPoint);
+
+        // Car lighting does not change between frames
+        UniformHandle carModelUniform = ourShader.uniform("model");
+        UniformHandle carViewPosUniform = ourShader.uniform("viewPos");
+        ourShader.use();
+        ourShader.setVec3(ourShader.uniform("lightPos"), glm::vec3(5.0f, 5.0f, 5.0f));
+        ourShader.setVec3(ourShader.uniform("lightColor"), glm::vec3(1.0f, 1.0f, 1.0f));
+        // Use McLaren orange color
+        ourShader.setVec3(ourShader.uniform("objectColor"), glm::vec3(1.0f, 0.35f, 0.0f));
+
+        // Frame profiler: GPU time of the car and flow passes, drawn by the overlay
+        GpuPassTimer carPassTimer("car");
+        GpuPassTimer flowPassTimer("flow");
+        GpuPassTimer particlePassTimer("particles");
+        carPassTimer.create();
+        flowPassTimer.create();
+        particlePassTimer.create();
+        ProfilerOverlay profilerOverlay;
+        profilerOverlay.create();
+
+        // Edited .glsl files are rebuilt and swapped in while the app runs
+        ShaderWatcher shaderWatcher;
+
         // 8. Load model
         std::string modelPath = "C:/Users/hp/Desktop/C assgn/ComputerGraphicsProject/F1_Project_lib/F1_Project_lib/x64/Release/mcl35m_2.obj";
 
+        // Imported in the background; the first frames show a placeholder box instead
         std::cout << "Loading model from: " << modelPath << std::endl;
-        Model ourModel(modelPath);
-        std::cout << "Model loaded successfully!" << std::endl;
+        // Only drawn, so the meshes need no CPU copy; once loaded the car is a single multi-draw
+        Model ourModel(modelPath, false, ModelLoading::Background, ModelGeometry::Merged);
 
         // 9. Create flow lines visualization
         float carLength = 5.7f;
@@ -417,15 +560,28 @@ int main() {
         FlowLinesVisualization flowLinesVis(flowDensity, carLength, carWidth, carHeight);
         flowLinesVis.setDensity(streamlineDensity);
         flowLinesVis.setAdaptiveDensity(enableAdaptiveDensity);
+        for (int state = 0; state < 2; state++) {
+            if (std::ifstream(flowBrickPaths[state].c_str()).good() &&
+                flowLinesVis.loadFlowFieldBricks(flowBrickPaths[state], state == 1)) {
+                std::cout << "Streaming flow field " << flowBrickPaths[state] << std::endl;
+            }
+            else if (std::ifstream(flowFieldPaths[state].c_str()).good() &&
+                flowLinesVis.loadFlowField(flowFieldPaths[state], state == 1)) {
+                std::cout << "Loaded flow field " << flowFieldPaths[state] << std::endl;
+            }
+        }
         std::cout << "Flow lines visualization initialized with " << flowDensity << " lines!" << std::endl;
 
+        // Smoke wand particles, advected and drawn on the GPU alone
+        ParticleTracer particleTracer;
+        particleTracer.create();
+        std::cout << "Particle tracer initialized with " << particleTracer.particleCount() << " particles!" << std::endl;
+
         // 10. OpenGL settings
         glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
         glEnable(GL_DEPTH_TEST);
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glEnable(GL_LINE_SMOOTH);
-        glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
         glEnable(GL_MULTISAMPLE); // Enable MSAA
 
         // Print initial simulation info
@@ -433,33 +589,77 @@ int main() {
 
         // 11. Main loop
         while (!glfwWindowShouldClose(window)) {
+            FrameProfiler::instance().beginFrame();
             float currentFrame = glfwGetTime();
             deltaTime = currentFrame - lastFrame;
             lastFrame = currentFrame;
-            // Limit frame rate to avoid too fast simulation on powerful GPUs
-            if (deltaTime < 0.01f) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(10 - static_cast<int>(deltaTime * 1000)));
-                currentFrame = glfwGetTime();
-                deltaTime = currentFrame - lastFrame;
-                lastFrame = currentFrame;
-            }
             processInput(window);
+            shaderWatcher.update();
+            if (!ourModel.isLoaded()) {
+                updateModelLoading(window, ourModel);
+            }
             // Update car movement
             updateCarMovement(deltaTime);
-            flowLinesVis.setCarPosition(carPosition);
+            if (useSimulationThread != flowLinesVis.isSimulationThreadRunning()) {
+                if (useSimulationThread) {
+                    flowLinesVis.startSimulationThread();
+                }
+                else {
+                    flowLinesVis.stopSimulationThread();
+                }
+            }
+            flowLinesVis.setSimulationPaused(pauseSimulation || !showFlow);
+            {
+                // The simulation thread reads these between its steps
+                std::lock_guard<std::mutex> lock(flowLinesVis.stateMutex());
+                flowLinesVis.setCarPosition(carPosition);
+                flowLinesVis.setCarSpeed(carSpeed);           // Rebakes the field on the next step after a change
+                flowLinesVis.setAdvectionBackend(useGpuAdvection ? AdvectionBackend::GPU : AdvectionBackend::CPU);
+                flowLinesVis.setParallelUpdate(useParallelUpdate);
+                flowLinesVis.setDensity(streamlineDensity);   // Reseeds only when the value changed
+                flowLinesVis.setAdaptiveDensity(enableAdaptiveDensity);
+                flowLinesVis.setDRS(simulateDRS);
+                flowLinesVis.setPressureVisualization(usePressureMap);
+                flowLinesVis.setFlowFieldAdvection(useFlowField);
+                flowLinesVis.setIntegrator(flowIntegrator);
+
+                if (replayFlow != flowLinesVis.isReplaying()) {
+                    if (replayFlow) {
+                        recordFlow = false;
+                        replayFlow = flowLinesVis.startReplay(flowSessionPath);
+                    }
+                    else {
+                        flowLinesVis.stopReplay();
+                    }
+                }
+                if (recordFlow != flowLinesVis.isRecording()) {
+                    if (recordFlow) {
+                        recordFlow = flowLinesVis.startRecording(flowSessionPath);
+                    }
+                    else {
+                        flowLinesVis.stopRecording();
+                    }
+                }
+                if (replaySeekFrames != 0) {
+                    flowLinesVis.seekReplay(flowLinesVis.replayFrame() + replaySeekFrames);
+                    replaySeekFrames = 0;
+                }
+            }
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
             drawBackground(); // Call th
             glm::mat4 projection = glm::perspective(glm::radians(fov), static_cast<float>(windowWidth) / windowHeight, 0.1f, 100.0f);
             glm::mat4 view = glm::lookAt(cameraPos, cameraPos + cameraFront, cameraUp);
+            cameraUniforms.update(projection, view, glm::vec2(windowWidth, windowHeight));
+            {
+                // Stream in the CFD bricks under the seeds in view; the frustum is moved into car coordinates
+                std::lock_guard<std::mutex> lock(flowLinesVis.stateMutex());
+                glm::mat4 carFrame = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, carPosition));
+                flowLinesVis.prefetchFlowField(ViewFrustum(carFrame, view, projection, static_cast<float>(windowHeight)));
+            }
             if (showCar) {
+                carPassTimer.begin();
                 ourShader.use();
-                ourShader.setVec3("lightPos", glm::vec3(5.0f, 5.0f, 5.0f));
-                ourShader.setVec3("viewPos", cameraPos);
-                ourShader.setVec3("lightColor", glm::vec3(1.0f, 1.0f, 1.0f));
-                // Use McLaren orange color
-                ourShader.setVec3("objectColor", glm::vec3(1.0f, 0.35f, 0.0f));
-                ourShader.setMat4("projection", projection);
-                ourShader.setMat4("view", view);
+                ourShader.setVec3(carViewPosUniform, cameraPos);
                 // Center the car properly and apply position offset
                 glm::mat4 model = glm::mat4(1.0f);
                 model = glm::translate(model, glm::vec3(0.0f, 0.5f, carPosition));
@@ -467,27 +667,63 @@ int main() {
                 model = glm::rotate(model, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
                 float scale = 1.0f;
                 model = glm::scale(model, glm::vec3(scale));
-                ourShader.setMat4("model", model);
-                ourModel.Draw(ourShader);
+                ourShader.setMat4(carModelUniform, model);
+                // Off-screen meshes are skipped and distant ones drawn coarser
+                ourModel.Draw(ourShader, ViewFrustum(model, view, projection, static_cast<float>(windowHeight)));
+
+                if (!ourModel.isLoaded()) {
+                    flowLinesVis.drawCarPlaceholder(lineShader);
+                }
+                carPassTimer.end();
             }
+            flowPassTimer.begin();
             if (showFlow && !pauseSimulation) {
                 // Update flow lines, passing car position for relative flow calculation
                 flowLinesVis.update(deltaTime);
-                flowLinesVis.draw(lineShader, view, projection);
+                flowLinesVis.draw(lineShader);
             }
             else if (showFlow && pauseSimulation) {
                 // If paused, just draw without updating
-                flowLinesVis.draw(lineShader, view, projection);
+                flowLinesVis.draw(lineShader);
+            }
+            flowPassTimer.end();
+
+            if (showParticles) {
+                particlePassTimer.begin();
+                particleTracer.setWand(glm::vec3(-0.8f * carWidth, wandHeight, -0.55f * carLength),
+                    glm::vec3(0.8f * carWidth, wandHeight, -0.55f * carLength));
+                if (!pauseSimulation) {
+                    // The field is baked for carSpeed, forwarded with the other setters above
+                    std::lock_guard<std::mutex> lock(flowLinesVis.stateMutex());
+                    particleTracer.step(flowLinesVis.flowField(), std::min(deltaTime, 0.05f), carSpeed);
+                }
+                particleTracer.draw(carPosition, glm::vec3(0.9f, 0.92f, 0.95f), 0.15f);
+                particlePassTimer.end();
             }
 
             // INSERT HERE: Draw reference marker through the flowLinesVis object
-            flowLinesVis.drawReferenceMarker(lineShader, view, projection);
+            flowLinesVis.drawReferenceMarker(lineShader);
+
+            if (showProfiler) {
+                profilerOverlay.draw(windowWidth, windowHeight);
+            }
 
-            glfwSwapBuffers(window);
+            {
+                // Includes the wait for vsync
+                ProfileScope swapScope("swapBuffers");
+                glfwSwapBuffers(window);
+            }
             glfwPollEvents();
+            FrameProfiler::instance().endFrame();
         }
 
+        profilerOverlay.destroy();
+        carPassTimer.destroy();
+        flowPassTimer.destroy();
+        particlePassTimer.destroy();
+        particleTracer.destroy();
         flowLinesVis.cleanup();
+        cameraUniforms.destroy();
     }
     catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
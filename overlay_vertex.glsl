@@ -0,0 +1,12 @@
+#version 330 core
+layout (location = 0) in vec2 aPos;     // Pixels, origin at the top left
+layout (location = 1) in vec4 aColor;
+
+out vec4 Color;
+
+uniform vec2 viewport;                  // Viewport size in pixels
+
+void main() {
+    gl_Position = vec4(aPos.x / viewport.x * 2.0 - 1.0, 1.0 - aPos.y / viewport.y * 2.0, 0.0, 1.0);
+    Color = aColor;
+}
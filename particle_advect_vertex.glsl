@@ -0,0 +1,86 @@
+#version 330 core
+// Advances every smoke particle by one step; the new state is captured with transform feedback
+layout (location = 0) in vec4 aState;    // position.xyz (car coordinates), age
+
+out vec4 outState;
+
+uniform float deltaTime;
+uniform float lifetime;
+uniform float streamSpeed;               // Free stream through the car frame, m/s along +Z
+uniform float groundScaleZ;              // Speed-up along Z at full suction
+uniform float turbulence;                // Largest random offset per axis this step
+uniform int stepIndex;
+uniform vec3 wandStart;
+uniform vec3 wandEnd;
+
+// Precomputed aerodynamics: velocity.xyz and pressure coefficient per node, in car coordinates
+uniform sampler3D flowField;
+uniform vec3 fieldScale;                 // Car coordinates to texture coordinates
+uniform vec3 fieldOffset;
+uniform float fieldVelocityScale;        // Car speed over the field's reference speed
+uniform vec3 boundsMin;                  // Particles leaving the field wait for their next emission
+uniform vec3 boundsMax;
+
+uint rngKey;
+uint rngDraw;
+
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+float randomFloat(float minValue, float maxValue) {
+    rngDraw++;
+    uint bits = hash(rngKey + rngDraw * 0x632be5abu);
+    return minValue + (maxValue - minValue) * (float(bits >> 8) * (1.0 / 16777216.0));
+}
+
+vec3 emissionPoint() {
+    vec3 jitter = vec3(randomFloat(-0.02, 0.02), randomFloat(-0.02, 0.02), randomFloat(-0.02, 0.02));
+    return mix(wandStart, wandEnd, randomFloat(0.0, 1.0)) + jitter;
+}
+
+void main() {
+    rngKey = hash(uint(gl_VertexID) * 0x9e3779b9u ^ hash(uint(stepIndex) + 0x6a09e667u));
+    rngDraw = 0u;
+
+    vec3 position = aState.xyz;
+    float age = aState.w;
+
+    if (age < 0.0) {
+        // Waiting for emission
+        age += deltaTime;
+        if (age >= 0.0) {
+            position = emissionPoint();
+        }
+        outState = vec4(position, age);
+        return;
+    }
+
+    // Same wake, upwash and ground effect as the flow lines see in the field
+    vec4 node = texture(flowField, position * fieldScale + fieldOffset);
+    float suction = clamp(-node.w, 0.0, 1.0);
+    vec3 velocity = node.xyz * fieldVelocityScale;
+    velocity.z += streamSpeed * (1.0 + (groundScaleZ - 1.0) * suction);
+    velocity.y *= 1.0 - 0.2 * suction;
+
+    position += velocity * deltaTime;
+    position += vec3(randomFloat(-turbulence, turbulence), randomFloat(-turbulence, turbulence),
+        randomFloat(-turbulence, turbulence));
+    age += deltaTime;
+
+    if (age >= lifetime) {
+        // Emitted again, keeping its place in the stagger
+        age -= lifetime;
+        position = emissionPoint();
+    }
+    else if (any(lessThan(position, boundsMin)) || any(greaterThan(position, boundsMax))) {
+        age -= lifetime;
+    }
+
+    outState = vec4(position, age);
+}
@@ -1,5 +1,6 @@
 #version 330 core
 in vec3 Color;
+in float Fade;
 out vec4 FragColor;
 
 uniform float particleAlpha;
@@ -16,7 +17,7 @@ void main()
     }
     
     // Smooth the edges
-    float alpha = particleAlpha * (1.0 - smoothstep(0.7, 1.0, dist));
+    float alpha = particleAlpha * Fade * (1.0 - smoothstep(0.7, 1.0, dist));
     
     // Output color with alpha
     FragColor = vec4(Color, alpha);
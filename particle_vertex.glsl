@@ -1,16 +1,34 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aColor;
+// Smoke particles of the ParticleTracer, drawn straight from its state buffer
+layout (location = 0) in vec3 aPos;      // Car coordinates
+layout (location = 1) in float aAge;     // Seconds since emission; negative until emitted
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+};
+
 uniform vec3 particleColor;
+uniform float particleLifetime;
+uniform float particleSize;              // Diameter in pixels at 10 m
 
 out vec3 Color;
+out float Fade;
 
 void main()
 {
+    Color = particleColor;
+
+    // Particles not emitted yet are clipped away
+    if (aAge < 0.0) {
+        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+        gl_PointSize = 1.0;
+        Fade = 0.0;
+        return;
+    }
+
     gl_Position = projection * view * model * vec4(aPos, 1.0);
     
     // Calculate distance from camera (in view space)
@@ -18,9 +36,9 @@ void main()
     float distance = length(viewPos.xyz);
     
     // Size particles based on distance (closer particles are larger)
-    // and consistent with the new car scale
-    gl_PointSize = max(8.0 * (1.0 / (distance * 0.1 + 0.1)), 2.0);
-    
-    // Pass color to fragment shader
-    Color = particleColor;
+    gl_PointSize = max(particleSize * (1.1 / (distance * 0.1 + 0.1)), 1.0);
+
+    // Fade in at the wand and out toward the end of the lifetime
+    float lifeRatio = aAge / particleLifetime;
+    Fade = smoothstep(0.0, 0.05, lifeRatio) * (1.0 - smoothstep(0.6, 1.0, lifeRatio));
 }
\ No newline at end of file
@@ -4,16 +4,24 @@ layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+layout (std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+};
 
 out vec3 FragPos;
 out vec3 Normal;
 
 void main()
 {
-    FragPos = vec3(model * vec4(aPos, 1.0));
+    // Merged geometry stores quantized positions; per-mesh buffers pass offset 0, scale 1
+    vec3 position = positionOffset + positionScale * aPos;
+
+    FragPos = vec3(model * vec4(position, 1.0));
     Normal = mat3(transpose(inverse(model))) * aNormal;
     
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = projection * view * model * vec4(position, 1.0);
 }
\ No newline at end of file